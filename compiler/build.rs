@@ -0,0 +1,48 @@
+use std::env;
+use std::fs;
+use std::path::{Path, PathBuf};
+
+// Sources that decide what cached modules contain and how they're keyed. Modules cached by a build
+// with different versions of any of these are never loaded.
+const CACHED_SOURCES: &[&str] = &["src/codegen", "src/mir", "src/frontend/module_cache.rs"];
+
+fn collect_sources(path: &Path, sources: &mut Vec<PathBuf>) {
+    if path.is_dir() {
+        let mut entries: Vec<_> = fs::read_dir(path)
+            .unwrap()
+            .map(|entry| entry.unwrap().path())
+            .collect();
+        entries.sort();
+        for entry in entries {
+            collect_sources(&entry, sources);
+        }
+    } else if path.extension().map_or(false, |ext| ext == "rs") {
+        sources.push(path.to_path_buf());
+    }
+}
+
+// 64-bit FNV-1a, the same hash the module cache uses for its keys.
+fn hash_bytes(hash: &mut u64, bytes: &[u8]) {
+    for byte in bytes {
+        *hash ^= u64::from(*byte);
+        *hash = hash.wrapping_mul(0x0100_0000_01b3);
+    }
+}
+
+fn main() {
+    let root = PathBuf::from(env::var("CARGO_MANIFEST_DIR").unwrap());
+
+    let mut sources = Vec::new();
+    for source in CACHED_SOURCES {
+        println!("cargo:rerun-if-changed={}", source);
+        collect_sources(&root.join(source), &mut sources);
+    }
+
+    let mut hash = 0xcbf2_9ce4_8422_2325;
+    for source in sources {
+        let relative_path = source.strip_prefix(&root).unwrap();
+        hash_bytes(&mut hash, relative_path.to_string_lossy().as_bytes());
+        hash_bytes(&mut hash, &fs::read(&source).unwrap());
+    }
+    println!("cargo:rustc-env=MAXIM_CACHE_VERSION={:016x}", hash);
+}
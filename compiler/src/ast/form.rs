@@ -29,6 +29,27 @@ impl Form {
     }
 }
 
+impl FormType {
+    /// Converts the value of a form stored in a number back to its type. Returns `None` if the
+    /// value isn't a valid form.
+    pub fn from_u8(value: u8) -> Option<FormType> {
+        match value {
+            0 => Some(FormType::None),
+            1 => Some(FormType::Control),
+            2 => Some(FormType::Oscillator),
+            3 => Some(FormType::Note),
+            4 => Some(FormType::Frequency),
+            5 => Some(FormType::Beats),
+            6 => Some(FormType::Seconds),
+            7 => Some(FormType::Samples),
+            8 => Some(FormType::Db),
+            9 => Some(FormType::Amplitude),
+            10 => Some(FormType::Q),
+            _ => None,
+        }
+    }
+}
+
 impl fmt::Display for FormType {
     fn fmt(&self, f: &mut fmt::Formatter) -> Result<(), fmt::Error> {
         match self {
@@ -2,6 +2,25 @@ use crate::codegen::controls::ControlPointers;
 use crate::codegen::data_analyzer::BlockLayout;
 use crate::codegen::BuilderContext;
 use inkwell::values::PointerValue;
+use std::mem;
+
+/// The pointers and statement results of one instance of a block, when several instances are
+/// being built side by side in the same function.
+pub struct BlockLane {
+    pointers_ptr: PointerValue,
+    constant_ptr: PointerValue,
+    statement_ptrs: Vec<PointerValue>,
+}
+
+impl BlockLane {
+    pub fn new(pointers_ptr: PointerValue, constant_ptr: PointerValue) -> Self {
+        BlockLane {
+            pointers_ptr,
+            constant_ptr,
+            statement_ptrs: Vec::new(),
+        }
+    }
+}
 
 pub struct BlockContext<'a> {
     pub ctx: BuilderContext<'a>,
@@ -27,10 +46,28 @@ impl<'a> BlockContext<'a> {
         }
     }
 
+    /// Swaps the context's pointers and statements with those of the lane. Swapping the same lane
+    /// back in afterwards restores the context to how it was.
+    pub fn swap_lane(&mut self, lane: &mut BlockLane) {
+        mem::swap(&mut self.pointers_ptr, &mut lane.pointers_ptr);
+        mem::swap(&mut self.constant_ptr, &mut lane.constant_ptr);
+        mem::swap(&mut self.statement_ptrs, &mut lane.statement_ptrs);
+    }
+
     pub fn push_statement(&mut self, ptr: PointerValue) {
         self.statement_ptrs.push(ptr)
     }
 
+    /// Swaps the results of the statements built so far with another list of them, for when
+    /// statements need to see different results depending on where they're built.
+    pub fn swap_statements(&mut self, statement_ptrs: &mut Vec<PointerValue>) {
+        mem::swap(&mut self.statement_ptrs, statement_ptrs);
+    }
+
+    pub fn clear_statements(&mut self) {
+        self.statement_ptrs.clear()
+    }
+
     pub fn get_statement(&self, index: usize) -> PointerValue {
         self.statement_ptrs[index]
     }
@@ -110,6 +147,22 @@ impl<'a> BlockContext<'a> {
             .into_pointer_value()
     }
 
+    pub fn get_control_rate_ptr(&self) -> PointerValue {
+        self.ctx
+            .b
+            .build_load(
+                &unsafe {
+                    self.ctx.b.build_struct_gep(
+                        &self.pointers_ptr,
+                        self.layout.control_rate_ptr_index() as u32,
+                        "ctx.controlrate.ptr",
+                    )
+                },
+                "ctx.controlrate",
+            )
+            .into_pointer_value()
+    }
+
     pub fn get_function_ptr(&self, layout_index: usize) -> PointerValue {
         self.ctx
             .b
@@ -0,0 +1,256 @@
+use super::{gen_statement, BlockContext};
+use crate::codegen::control_rate::{StatementRate, CONTROL_RATE_PERIOD};
+use crate::codegen::data_analyzer::ControlRateLayout;
+use crate::codegen::util;
+use crate::codegen::values::NumValue;
+use crate::mir::block::Statement;
+use inkwell::values::{IntValue, PointerValue, VectorValue};
+use inkwell::IntPredicate;
+use std::ops::Range;
+
+/// Splits the statements into runs that are either all control-rate or all evaluated every
+/// sample, in order.
+pub fn get_control_rate_runs(layout: &ControlRateLayout) -> Vec<(bool, Range<usize>)> {
+    let mut runs: Vec<(bool, Range<usize>)> = Vec::new();
+    for (index, rate) in layout.rates.iter().enumerate() {
+        let is_control = *rate == StatementRate::Control;
+        match runs.last_mut() {
+            Some((run_is_control, range)) if *run_is_control == is_control => range.end = index + 1,
+            _ => runs.push((is_control, index..index + 1)),
+        }
+    }
+    runs
+}
+
+/// Builds the statements of one instance of a block with control-rate statements.
+///
+/// Control-rate statements are built in branches that are only taken once every period. Each one
+/// sees the results of the others directly, while statements that run every sample see the
+/// outputs of the control-rate statements interpolated from their previous value to their newest
+/// one over the period. The interpolated values lag a period behind, but never jump.
+pub struct ControlRateSection {
+    state_ptr: PointerValue,
+    is_due: IntValue,
+    is_primed: IntValue,
+    fraction: VectorValue,
+
+    // while statements that run every sample are being built, this has the results that the
+    // control-rate statements see, and while control-rate statements are being built it has the
+    // results the other statements see
+    other_statements: Vec<PointerValue>,
+}
+
+impl ControlRateSection {
+    pub fn new(node: &mut BlockContext) -> Self {
+        let context = node.ctx.context;
+        let state_ptr = node.get_control_rate_ptr();
+        let counter_ptr = unsafe { node.ctx.b.build_struct_gep(&state_ptr, 0, "counter.ptr") };
+        let primed_ptr = unsafe { node.ctx.b.build_struct_gep(&state_ptr, 1, "primed.ptr") };
+
+        let counter = node
+            .ctx
+            .b
+            .build_load(&counter_ptr, "counter")
+            .into_int_value();
+        let is_due = node.ctx.b.build_int_compare(
+            IntPredicate::EQ,
+            counter,
+            context.i32_type().const_int(0, false),
+            "isdue",
+        );
+        let next_counter = node.ctx.b.build_int_add(
+            counter,
+            context.i32_type().const_int(1, false),
+            "counter.next",
+        );
+        node.ctx.b.build_store(
+            &counter_ptr,
+            &node.ctx.b.build_and(
+                next_counter,
+                context
+                    .i32_type()
+                    .const_int(u64::from(CONTROL_RATE_PERIOD - 1), false),
+                "",
+            ),
+        );
+
+        // the first evaluation has nothing to interpolate from, so it starts at its own value
+        let is_primed = node
+            .ctx
+            .b
+            .build_load(&primed_ptr, "isprimed")
+            .into_int_value();
+        node.ctx
+            .b
+            .build_store(&primed_ptr, &context.bool_type().const_int(1, false));
+
+        // the newest value is reached on the last sample of the period
+        let fraction = node.ctx.b.build_float_mul(
+            node.ctx
+                .b
+                .build_unsigned_int_to_float(next_counter, context.f64_type(), ""),
+            context
+                .f64_type()
+                .const_float(1. / f64::from(CONTROL_RATE_PERIOD)),
+            "fraction",
+        );
+
+        ControlRateSection {
+            state_ptr,
+            is_due,
+            is_primed,
+            fraction: util::splat_vector(node.ctx.b, fraction, "fraction"),
+            other_statements: Vec::new(),
+        }
+    }
+
+    pub fn gen_sample_statement(
+        &mut self,
+        index: usize,
+        statement: &Statement,
+        node: &mut BlockContext,
+    ) {
+        let statement_result = gen_statement(index, statement, node);
+        node.push_statement(statement_result);
+        self.other_statements.push(statement_result);
+    }
+
+    pub fn gen_control_run(
+        &mut self,
+        statements: &[Statement],
+        layout: &ControlRateLayout,
+        run: Range<usize>,
+        node: &mut BlockContext,
+    ) {
+        let context = node.ctx.context;
+        let due_block = context.append_basic_block(&node.ctx.func, "controlrate");
+        let end_block = context.append_basic_block(&node.ctx.func, "controlrate.end");
+        node.ctx
+            .b
+            .build_conditional_branch(&self.is_due, &due_block, &end_block);
+
+        node.ctx.b.position_at_end(&due_block);
+        node.swap_statements(&mut self.other_statements);
+        for index in run.clone() {
+            let statement_result = gen_statement(index, &statements[index], node);
+            node.push_statement(statement_result);
+            self.other_statements.push(statement_result);
+
+            if let Some(output_index) = layout.outputs.iter().position(|&output| output == index) {
+                self.gen_store_output(output_index, statement_result, node);
+            }
+        }
+        node.ctx.b.build_unconditional_branch(&end_block);
+
+        node.ctx.b.position_at_end(&end_block);
+        for index in run {
+            if let Some(output_index) = layout.outputs.iter().position(|&output| output == index) {
+                self.other_statements[index] = self.gen_load_output(output_index, node);
+            }
+        }
+        node.swap_statements(&mut self.other_statements);
+    }
+
+    fn get_output_ptrs(
+        &self,
+        output_index: usize,
+        node: &mut BlockContext,
+    ) -> (PointerValue, PointerValue, PointerValue) {
+        let context = node.ctx.context;
+        let output_ptr = unsafe {
+            node.ctx.b.build_in_bounds_gep(
+                &self.state_ptr,
+                &[
+                    context.i32_type().const_int(0, false),
+                    context.i32_type().const_int(2, false),
+                    context.i32_type().const_int(output_index as u64, false),
+                ],
+                "output.ptr",
+            )
+        };
+        unsafe {
+            (
+                node.ctx
+                    .b
+                    .build_struct_gep(&output_ptr, 0, "output.prev.ptr"),
+                node.ctx
+                    .b
+                    .build_struct_gep(&output_ptr, 1, "output.next.ptr"),
+                node.ctx
+                    .b
+                    .build_struct_gep(&output_ptr, 2, "output.form.ptr"),
+            )
+        }
+    }
+
+    fn gen_store_output(&self, output_index: usize, value: PointerValue, node: &mut BlockContext) {
+        let (prev_ptr, next_ptr, form_ptr) = self.get_output_ptrs(output_index, node);
+        let value_num = NumValue::new(value);
+        let new_vec = value_num.get_vec(node.ctx.b);
+        let old_vec = node
+            .ctx
+            .b
+            .build_load(&next_ptr, "output.next")
+            .into_vector_value();
+        let prev_vec = node
+            .ctx
+            .b
+            .build_select(self.is_primed, old_vec, new_vec, "output.prev")
+            .into_vector_value();
+        node.ctx.b.build_store(&prev_ptr, &prev_vec);
+        node.ctx.b.build_store(&next_ptr, &new_vec);
+        node.ctx
+            .b
+            .build_store(&form_ptr, &value_num.get_form(node.ctx.b));
+    }
+
+    fn gen_load_output(&self, output_index: usize, node: &mut BlockContext) -> PointerValue {
+        let (prev_ptr, next_ptr, form_ptr) = self.get_output_ptrs(output_index, node);
+        let prev_vec = node
+            .ctx
+            .b
+            .build_load(&prev_ptr, "output.prev")
+            .into_vector_value();
+        let next_vec = node
+            .ctx
+            .b
+            .build_load(&next_ptr, "output.next")
+            .into_vector_value();
+        let form = node
+            .ctx
+            .b
+            .build_load(&form_ptr, "output.form")
+            .into_int_value();
+
+        let interpolated_vec = node.ctx.b.build_float_add(
+            prev_vec,
+            node.ctx.b.build_float_mul(
+                node.ctx.b.build_float_sub(next_vec, prev_vec, ""),
+                self.fraction,
+                "",
+            ),
+            "output.interpolated",
+        );
+        let output_num = NumValue::new_undef(node.ctx.context, node.ctx.allocb);
+        output_num.set_vec(node.ctx.b, interpolated_vec);
+        output_num.set_form(node.ctx.b, form);
+        output_num.val
+    }
+}
+
+pub fn gen_control_rate_statements(
+    statements: &[Statement],
+    layout: &ControlRateLayout,
+    node: &mut BlockContext,
+) {
+    let mut section = ControlRateSection::new(node);
+    for (is_control, run) in get_control_rate_runs(layout) {
+        if is_control {
+            section.gen_control_run(statements, layout, run, node);
+        } else {
+            for index in run {
+                section.gen_sample_statement(index, &statements[index], node);
+            }
+        }
+    }
+}
@@ -2,6 +2,7 @@ mod block_context;
 mod gen_call_func;
 mod gen_combine;
 mod gen_constant;
+mod gen_control_rate;
 mod gen_extract;
 mod gen_global;
 mod gen_load_control;
@@ -11,21 +12,28 @@ mod gen_num_convert;
 mod gen_store_control;
 mod gen_unary_op;
 
-use self::block_context::BlockContext;
+use self::block_context::{BlockContext, BlockLane};
+use crate::codegen::data_analyzer::ControlRateLayout;
+use crate::codegen::values::NumValue;
 use crate::codegen::{
     build_context_function, controls, functions, util, BuilderContext, LifecycleFunc, ObjectCache,
 };
 use crate::mir::block::Statement;
-use crate::mir::{Block, BlockRef};
+use crate::mir::{Block, BlockRef, ConstantNum};
+use crate::pass;
 use inkwell::attribute::AttrKind;
 use inkwell::builder::Builder;
 use inkwell::module::{Linkage, Module};
-use inkwell::values::{FunctionValue, PointerValue};
-use inkwell::AddressSpace;
+use inkwell::types::BasicType;
+use inkwell::values::{BasicValue, FunctionValue, PointerValue};
+use inkwell::{AddressSpace, FloatPredicate, IntPredicate};
 
 use self::gen_call_func::gen_call_func_statement;
 use self::gen_combine::gen_combine_statement;
 use self::gen_constant::gen_constant_statement;
+use self::gen_control_rate::{
+    gen_control_rate_statements, get_control_rate_runs, ControlRateSection,
+};
 use self::gen_extract::gen_extract_statement;
 use self::gen_global::gen_global_statement;
 use self::gen_load_control::gen_load_control_statement;
@@ -161,6 +169,36 @@ pub fn build_construct_func(module: &Module, cache: &ObjectCache, block: &Block)
     )
 }
 
+fn build_control_updates(
+    module: &Module,
+    cache: &ObjectCache,
+    block: &Block,
+    block_ctx: &mut BlockContext,
+) {
+    for (control_index, control) in block.controls.iter().enumerate() {
+        let ptrs = block_ctx.get_control_ptrs(control_index);
+        controls::build_lifecycle_call(
+            module,
+            &mut block_ctx.ctx.b,
+            control.control_type,
+            LifecycleFunc::Update,
+            ptrs,
+        );
+
+        if cache.target().include_ui {
+            let ui_ptr = block_ctx.get_ui_ptr(control_index);
+            controls::build_ui_lifecycle_call(
+                module,
+                &mut block_ctx.ctx.b,
+                control.control_type,
+                LifecycleFunc::Update,
+                ptrs,
+                ui_ptr,
+            )
+        }
+    }
+}
+
 pub fn build_update_func(module: &Module, cache: &ObjectCache, block: &Block) {
     build_lifecycle_func(
         module,
@@ -168,37 +206,230 @@ pub fn build_update_func(module: &Module, cache: &ObjectCache, block: &Block) {
         block.id.id,
         LifecycleFunc::Update,
         &|block_ctx: &mut BlockContext| {
-            for (control_index, control) in block.controls.iter().enumerate() {
-                let ptrs = block_ctx.get_control_ptrs(control_index);
-                controls::build_lifecycle_call(
-                    module,
-                    &mut block_ctx.ctx.b,
-                    control.control_type,
-                    LifecycleFunc::Update,
-                    ptrs,
-                );
+            build_control_updates(module, cache, block, block_ctx);
 
-                if cache.target().include_ui {
-                    let ui_ptr = block_ctx.get_ui_ptr(control_index);
-                    controls::build_ui_lifecycle_call(
-                        module,
-                        &mut block_ctx.ctx.b,
-                        control.control_type,
-                        LifecycleFunc::Update,
-                        ptrs,
-                        ui_ptr,
-                    )
+            match cache.block_specialization(block.id.id) {
+                Some(values) if !values.is_empty() => {
+                    build_specialized_statements(block, values, block_ctx)
                 }
-            }
-
-            for (statement_index, statement) in block.statements.iter().enumerate() {
-                let statement_result = gen_statement(statement_index, statement, block_ctx);
-                block_ctx.push_statement(statement_result);
+                _ => gen_statements(&block.statements, block_ctx),
             }
         },
     )
 }
 
+// Updates several instances of a block at once, e.g for the voices of an extracted group. The
+// instances run their statements in lockstep, so the same operation on each instance ends up next
+// to the others, where LLVM's SLP vectorizer can pack them into wider vectors.
+//
+// This is built into the module of the surface that calls it, since a block doesn't know if it's
+// in an extracted group. Blocks in extracted groups are never specialized, so this only has the
+// regular statements.
+fn get_lanes_update_func(
+    module: &Module,
+    cache: &ObjectCache,
+    block: BlockRef,
+    lane_count: usize,
+) -> FunctionValue {
+    let func_name = format!("maxim.block.{}.update.lanes{}", block, lane_count);
+    if let Some(func) = module.get_function(&func_name) {
+        return func;
+    }
+
+    let context = module.get_context();
+    let layout = cache.block_layout(block).unwrap();
+    let pointers_type = layout.pointer_struct.ptr_type(AddressSpace::Generic);
+    let const_type = layout.constant_struct.ptr_type(AddressSpace::Generic);
+    let param_types: Vec<&BasicType> = (0..lane_count)
+        .flat_map(|_| vec![&pointers_type as &BasicType, &const_type as &BasicType])
+        .collect();
+    let func = util::get_or_create_func(module, &func_name, true, &|| {
+        (
+            Linkage::PrivateLinkage,
+            context.void_type().fn_type(&param_types, false),
+        )
+    });
+    for lane_index in 0..lane_count {
+        func.add_param_attribute(
+            lane_index as u32 * 2,
+            context.get_enum_attr(AttrKind::NoAlias, 1),
+        );
+    }
+
+    let block_mir = cache.block_mir(block).unwrap();
+    build_context_function(module, func, cache.target(), &|ctx: BuilderContext| {
+        let mut lanes: Vec<_> = (0..lane_count)
+            .map(|lane_index| {
+                BlockLane::new(
+                    ctx.func
+                        .get_nth_param(lane_index as u32 * 2)
+                        .unwrap()
+                        .into_pointer_value(),
+                    ctx.func
+                        .get_nth_param(lane_index as u32 * 2 + 1)
+                        .unwrap()
+                        .into_pointer_value(),
+                )
+            })
+            .collect();
+
+        // The context's own pointers are never used, since a lane is always swapped in first.
+        let placeholder_pointers = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
+        let placeholder_const = ctx.func.get_nth_param(1).unwrap().into_pointer_value();
+        let mut block_ctx = BlockContext::new(ctx, layout, placeholder_pointers, placeholder_const);
+
+        for lane in &mut lanes {
+            block_ctx.swap_lane(lane);
+            build_control_updates(module, cache, block_mir, &mut block_ctx);
+            block_ctx.swap_lane(lane);
+        }
+
+        match &layout.control_rate {
+            Some(control_rate) => gen_lanes_control_rate_statements(
+                block_mir,
+                control_rate,
+                &mut lanes,
+                &mut block_ctx,
+            ),
+            None => {
+                for (statement_index, statement) in block_mir.statements.iter().enumerate() {
+                    for lane in &mut lanes {
+                        block_ctx.swap_lane(lane);
+                        let statement_result =
+                            gen_statement(statement_index, statement, &mut block_ctx);
+                        block_ctx.push_statement(statement_result);
+                        block_ctx.swap_lane(lane);
+                    }
+                }
+            }
+        }
+
+        block_ctx.ctx.b.build_return(None);
+    });
+    func
+}
+
+// Each lane has its own control-rate state, so control-rate runs are built for each lane in turn.
+// Statements that run every sample are still built in lockstep.
+fn gen_lanes_control_rate_statements(
+    block: &Block,
+    layout: &ControlRateLayout,
+    lanes: &mut [BlockLane],
+    block_ctx: &mut BlockContext,
+) {
+    let mut sections: Vec<_> = lanes
+        .iter_mut()
+        .map(|lane| {
+            block_ctx.swap_lane(lane);
+            let section = ControlRateSection::new(block_ctx);
+            block_ctx.swap_lane(lane);
+            section
+        })
+        .collect();
+
+    for (is_control, run) in get_control_rate_runs(layout) {
+        if is_control {
+            for (lane, section) in lanes.iter_mut().zip(&mut sections) {
+                block_ctx.swap_lane(lane);
+                section.gen_control_run(&block.statements, layout, run.clone(), block_ctx);
+                block_ctx.swap_lane(lane);
+            }
+        } else {
+            for index in run {
+                for (lane, section) in lanes.iter_mut().zip(&mut sections) {
+                    block_ctx.swap_lane(lane);
+                    section.gen_sample_statement(index, &block.statements[index], block_ctx);
+                    block_ctx.swap_lane(lane);
+                }
+            }
+        }
+    }
+}
+
+fn gen_statements(statements: &[Statement], block_ctx: &mut BlockContext) {
+    let layout = block_ctx.layout;
+    if let Some(control_rate) = &layout.control_rate {
+        gen_control_rate_statements(statements, control_rate, block_ctx);
+        return;
+    }
+
+    for (statement_index, statement) in statements.iter().enumerate() {
+        let statement_result = gen_statement(statement_index, statement, block_ctx);
+        block_ctx.push_statement(statement_result);
+    }
+}
+
+// Specialized blocks have two copies of their statements: one with the specialized controls
+// replaced by their values, which LLVM can fold, and the regular one. Each sample checks if the
+// controls still have those values, so the regular code takes over as soon as one of them moves.
+fn build_specialized_statements(
+    block: &Block,
+    values: &[(usize, ConstantNum)],
+    block_ctx: &mut BlockContext,
+) {
+    let context = block_ctx.ctx.context;
+    let mut is_specialized = context.bool_type().const_int(1, false);
+    for (control_index, value) in values {
+        let control_value = NumValue::new(block_ctx.get_control_ptrs(*control_index).group);
+        let control_vec = control_value.get_vec(block_ctx.ctx.b);
+        let control_form = control_value.get_form(block_ctx.ctx.b);
+
+        let vec_equal = block_ctx.ctx.b.build_float_compare(
+            FloatPredicate::OEQ,
+            control_vec,
+            util::get_const_vec(context, value.left, value.right),
+            "specialize.vec.equal",
+        );
+        let left_equal = block_ctx
+            .ctx
+            .b
+            .build_extract_element(
+                &vec_equal,
+                &context.i32_type().const_int(0, false),
+                "specialize.left.equal",
+            )
+            .into_int_value();
+        let right_equal = block_ctx
+            .ctx
+            .b
+            .build_extract_element(
+                &vec_equal,
+                &context.i32_type().const_int(1, false),
+                "specialize.right.equal",
+            )
+            .into_int_value();
+        let form_equal = block_ctx.ctx.b.build_int_compare(
+            IntPredicate::EQ,
+            control_form,
+            context.i8_type().const_int(value.form as u64, false),
+            "specialize.form.equal",
+        );
+
+        is_specialized = block_ctx.ctx.b.build_and(is_specialized, left_equal, "");
+        is_specialized = block_ctx.ctx.b.build_and(is_specialized, right_equal, "");
+        is_specialized = block_ctx.ctx.b.build_and(is_specialized, form_equal, "");
+    }
+
+    let specialized_block = context.append_basic_block(&block_ctx.ctx.func, "specialized");
+    let generic_block = context.append_basic_block(&block_ctx.ctx.func, "generic");
+    let end_block = context.append_basic_block(&block_ctx.ctx.func, "end");
+    block_ctx
+        .ctx
+        .b
+        .build_conditional_branch(&is_specialized, &specialized_block, &generic_block);
+
+    block_ctx.ctx.b.position_at_end(&specialized_block);
+    gen_statements(&pass::specialize_controls(block, values), block_ctx);
+    block_ctx.ctx.b.build_unconditional_branch(&end_block);
+
+    block_ctx.clear_statements();
+    block_ctx.ctx.b.position_at_end(&generic_block);
+    gen_statements(&block.statements, block_ctx);
+    block_ctx.ctx.b.build_unconditional_branch(&end_block);
+
+    block_ctx.ctx.b.position_at_end(&end_block);
+}
+
 pub fn build_destruct_func(module: &Module, cache: &ObjectCache, block: &Block) {
     build_lifecycle_func(
         module,
@@ -251,6 +482,25 @@ pub fn build_funcs(module: &Module, cache: &ObjectCache, block: &Block) {
     build_destruct_func(module, cache, block);
 }
 
+/// Updates an instance of the block for each pair of node and constant pointers at once. See
+/// `get_lanes_update_func`.
+pub fn build_lanes_update_call(
+    module: &Module,
+    cache: &ObjectCache,
+    builder: &mut Builder,
+    block: BlockRef,
+    lane_pointers: &[(PointerValue, PointerValue)],
+) {
+    let func = get_lanes_update_func(module, cache, block, lane_pointers.len());
+    let args: Vec<&BasicValue> = lane_pointers
+        .iter()
+        .flat_map(|(pointers_ptr, const_ptr)| {
+            vec![pointers_ptr as &BasicValue, const_ptr as &BasicValue]
+        })
+        .collect();
+    builder.build_call(&func, &args, "", true);
+}
+
 pub fn build_lifecycle_call(
     module: &Module,
     cache: &ObjectCache,
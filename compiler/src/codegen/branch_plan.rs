@@ -0,0 +1,192 @@
+use crate::codegen::ObjectCache;
+use crate::mir::{NodeData, Surface, ValueGroupSource};
+use std::collections::HashMap;
+
+// Value groups that come from sockets can point to the same storage (e.g if two portals of a
+// group are connected to the same wire outside it), so they're all treated as one group.
+const SOCKET_GROUP_KEY: usize = usize::max_value();
+
+/// A split of a surface's nodes into independent branches, which can run at the same time,
+/// followed by a tail that runs once every branch has finished.
+///
+/// Nodes in different branches never share a value group that either of them writes to, and the
+/// order of nodes inside each branch and the tail is the same as in the surface.
+pub struct BranchPlan {
+    pub branches: Vec<Vec<usize>>,
+    pub tail: Vec<usize>,
+}
+
+struct Components {
+    parents: Vec<usize>,
+    weights: Vec<usize>,
+}
+
+impl Components {
+    fn new(weights: Vec<usize>) -> Self {
+        Components {
+            parents: (0..weights.len()).collect(),
+            weights,
+        }
+    }
+
+    fn find(&mut self, node: usize) -> usize {
+        let mut root = node;
+        while self.parents[root] != root {
+            root = self.parents[root];
+        }
+
+        let mut walk = node;
+        while self.parents[walk] != root {
+            let next = self.parents[walk];
+            self.parents[walk] = root;
+            walk = next;
+        }
+
+        root
+    }
+
+    fn union(&mut self, a: usize, b: usize) -> usize {
+        let a_root = self.find(a);
+        let b_root = self.find(b);
+        if a_root != b_root {
+            self.parents[b_root] = a_root;
+            self.weights[a_root] += self.weights[b_root];
+        }
+        a_root
+    }
+}
+
+#[derive(Default)]
+struct GroupUsage {
+    is_written: bool,
+    nodes: Vec<usize>,
+}
+
+fn get_surface_weight(cache: &ObjectCache, surface: &Surface) -> usize {
+    surface
+        .nodes
+        .iter()
+        .map(|node| get_node_weight(cache, &node.data))
+        .sum()
+}
+
+fn get_node_weight(cache: &ObjectCache, data: &NodeData) -> usize {
+    match data {
+        NodeData::Dummy => 0,
+        NodeData::Custom { block, .. } => cache
+            .block_mir(*block)
+            .map(|block| block.statements.len() + 1)
+            .unwrap_or(1),
+        NodeData::Group(surface) => cache
+            .surface_mir(*surface)
+            .map(|surface| get_surface_weight(cache, surface))
+            .unwrap_or(1),
+        NodeData::ExtractGroup { surface, .. } => cache
+            .surface_mir(*surface)
+            .map(|surface| get_surface_weight(cache, surface))
+            .unwrap_or(1),
+    }
+}
+
+fn get_group_key(surface: &Surface, group: usize) -> usize {
+    if let ValueGroupSource::Socket(_) = surface.groups[group].source {
+        SOCKET_GROUP_KEY
+    } else {
+        group
+    }
+}
+
+/// Groups the first `prefix_len` nodes of the surface into components, calling `on_node` after
+/// each node is added with the number of nodes added so far.
+fn build_components(
+    surface: &Surface,
+    weights: &[usize],
+    prefix_len: usize,
+    on_node: &mut FnMut(&mut Components, usize, usize),
+) -> Components {
+    let mut components = Components::new(weights.to_vec());
+    let mut usages: HashMap<usize, GroupUsage> = HashMap::new();
+
+    for node_index in 0..prefix_len {
+        for socket in &surface.nodes[node_index].sockets {
+            let usage = usages
+                .entry(get_group_key(surface, socket.group_id))
+                .or_insert_with(GroupUsage::default);
+
+            // Nodes only need to be in the same branch if one of them writes to the group, so
+            // groups that are just read from don't join branches until someone writes to them.
+            if socket.value_written || usage.is_written {
+                usage.is_written = true;
+                for &other_node in &usage.nodes {
+                    components.union(other_node, node_index);
+                }
+                usage.nodes.clear();
+            }
+            usage.nodes.push(node_index);
+        }
+
+        let node_root = components.find(node_index);
+        on_node(&mut components, node_root, node_index + 1);
+    }
+
+    components
+}
+
+/// Finds the split of the surface with the most work that can be taken off the calling thread,
+/// or `None` if none of it can be. Work is estimated by counting block statements, with extract
+/// groups counted as a single voice.
+pub fn plan_branches(cache: &ObjectCache, surface: &Surface) -> Option<BranchPlan> {
+    let weights: Vec<_> = surface
+        .nodes
+        .iter()
+        .map(|node| get_node_weight(cache, &node.data))
+        .collect();
+
+    // Any prefix of the node order can be split into branches, since nodes after the prefix run
+    // once the branches are done, just as they would without the split. The work saved is all of
+    // the prefix except the biggest branch, which still takes as long as it would have serially.
+    let mut prefix_weight = 0;
+    let mut max_branch_weight = 0;
+    let mut best_saving = 0;
+    let mut best_len = 0;
+    build_components(
+        surface,
+        &weights,
+        surface.nodes.len(),
+        &mut |components, node_root, prefix_len| {
+            prefix_weight += weights[prefix_len - 1];
+            max_branch_weight = max_branch_weight.max(components.weights[node_root]);
+
+            let saving = prefix_weight - max_branch_weight;
+            if saving >= best_saving {
+                best_saving = saving;
+                best_len = prefix_len;
+            }
+        },
+    );
+
+    if best_saving == 0 {
+        return None;
+    }
+
+    let mut components = build_components(surface, &weights, best_len, &mut |_, _, _| {});
+    let mut branch_indices = HashMap::new();
+    let mut branches: Vec<Vec<usize>> = Vec::new();
+    for node_index in 0..best_len {
+        if weights[node_index] == 0 {
+            continue;
+        }
+
+        let root = components.find(node_index);
+        let branch_index = *branch_indices.entry(root).or_insert_with(|| {
+            branches.push(Vec::new());
+            branches.len() - 1
+        });
+        branches[branch_index].push(node_index);
+    }
+
+    Some(BranchPlan {
+        branches,
+        tail: (best_len..surface.nodes.len()).collect(),
+    })
+}
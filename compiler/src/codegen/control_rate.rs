@@ -0,0 +1,181 @@
+use crate::mir::block::{Function, Statement};
+use crate::mir::{Block, VarType};
+use inkwell::context::Context;
+use inkwell::types::StructType;
+
+/// How many samples a block's control-rate statements are held for. Must be a power of two.
+pub const CONTROL_RATE_PERIOD: u32 = 16;
+
+/// How often a statement needs evaluating.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum StatementRate {
+    /// Only depends on constants and globals, so it's cheap enough (or folded by LLVM) to be left
+    /// alone.
+    Constant,
+
+    /// Depends on a `controlRate` call, and is only evaluated every `CONTROL_RATE_PERIOD` samples.
+    Control,
+
+    /// Evaluated every sample.
+    Audio,
+}
+
+// Functions that always give the same result for the same arguments, which can be moved out of
+// the per-sample code without changing what they do.
+fn is_pure_function(function: Function) -> bool {
+    match function {
+        Function::Sin
+        | Function::Cos
+        | Function::Tan
+        | Function::Min
+        | Function::Max
+        | Function::Sqrt
+        | Function::Floor
+        | Function::Ceil
+        | Function::Round
+        | Function::Abs
+        | Function::CopySign
+        | Function::Fract
+        | Function::Exp
+        | Function::Exp2
+        | Function::Exp10
+        | Function::Log
+        | Function::Log2
+        | Function::Log10
+        | Function::Asin
+        | Function::Acos
+        | Function::Atan
+        | Function::Atan2
+        | Function::Sinh
+        | Function::Cosh
+        | Function::Tanh
+        | Function::Hypot
+        | Function::ToRad
+        | Function::ToDeg
+        | Function::Clamp
+        | Function::Pan
+        | Function::Left
+        | Function::Right
+        | Function::Swap
+        | Function::Combine
+        | Function::Mix
+        | Function::Sequence
+        | Function::ControlRate => true,
+        _ => false,
+    }
+}
+
+fn get_statement_refs(statement: &Statement) -> Vec<usize> {
+    match statement {
+        Statement::Constant(_) | Statement::Global(_) | Statement::LoadControl { .. } => vec![],
+        Statement::NumConvert { input, .. }
+        | Statement::NumCast { input, .. }
+        | Statement::NumUnaryOp { input, .. } => vec![*input],
+        Statement::NumMathOp { lhs, rhs, .. } => vec![*lhs, *rhs],
+        Statement::Extract { tuple, .. } => vec![*tuple],
+        Statement::Combine { indexes } => indexes.clone(),
+        Statement::CallFunc { args, varargs, .. } => {
+            args.iter().chain(varargs.iter()).cloned().collect()
+        }
+        Statement::StoreControl { value, .. } => vec![*value],
+    }
+}
+
+fn is_pure_statement(statement: &Statement) -> bool {
+    match statement {
+        Statement::Constant(_)
+        | Statement::Global(_)
+        | Statement::NumConvert { .. }
+        | Statement::NumCast { .. }
+        | Statement::NumUnaryOp { .. }
+        | Statement::NumMathOp { .. }
+        | Statement::Extract { .. }
+        | Statement::Combine { .. } => true,
+        Statement::CallFunc { function, .. } => is_pure_function(*function),
+        Statement::StoreControl { .. } | Statement::LoadControl { .. } => false,
+    }
+}
+
+/// Finds the rate of each statement in the block. The result of a `controlRate` call is
+/// control-rate whatever its argument is, and so is any pure statement that returns a number and
+/// only depends on control-rate and constant statements, as long as it depends on at least one
+/// control-rate one.
+pub fn find_statement_rates(block: &Block) -> Vec<StatementRate> {
+    let mut rates: Vec<StatementRate> = Vec::with_capacity(block.statements.len());
+    for (index, statement) in block.statements.iter().enumerate() {
+        let rate = match statement {
+            Statement::CallFunc {
+                function: Function::ControlRate,
+                ..
+            } => StatementRate::Control,
+            _ if is_pure_statement(statement) => {
+                let refs = get_statement_refs(statement);
+                if refs
+                    .iter()
+                    .any(|&ref_index| rates[ref_index] == StatementRate::Audio)
+                {
+                    StatementRate::Audio
+                } else if refs
+                    .iter()
+                    .all(|&ref_index| rates[ref_index] == StatementRate::Constant)
+                {
+                    StatementRate::Constant
+                } else if VarType::of_statement(block, index) == VarType::Num {
+                    StatementRate::Control
+                } else {
+                    StatementRate::Audio
+                }
+            }
+            _ => StatementRate::Audio,
+        };
+        rates.push(rate);
+    }
+    rates
+}
+
+/// Finds the control-rate statements that are used by audio-rate ones. These are the values the
+/// control-rate statements hand over to the rest of the block, which are interpolated between
+/// each evaluation.
+pub fn find_outputs(block: &Block, rates: &[StatementRate]) -> Vec<usize> {
+    let mut is_output = vec![false; block.statements.len()];
+    for (statement, rate) in block.statements.iter().zip(rates) {
+        if *rate != StatementRate::Audio {
+            continue;
+        }
+
+        for ref_index in get_statement_refs(statement) {
+            if rates[ref_index] == StatementRate::Control {
+                is_output[ref_index] = true;
+            }
+        }
+    }
+
+    is_output
+        .iter()
+        .enumerate()
+        .filter(|(_, &is_output)| is_output)
+        .map(|(index, _)| index)
+        .collect()
+}
+
+/// The state kept by a block with control-rate statements: how many samples into the period it
+/// is, whether the outputs have been evaluated yet, and the previous and current values of each
+/// output along with the form of the current one.
+pub fn get_state_type(context: &Context, output_count: usize) -> StructType {
+    let output_type = context.struct_type(
+        &[
+            &context.f64_type().vec_type(2),
+            &context.f64_type().vec_type(2),
+            &context.i8_type(),
+        ],
+        false,
+    );
+    context.struct_type(
+        &[
+            &context.i32_type(),
+            &context.bool_type(),
+            &output_type.array_type(output_count as u32),
+        ],
+        false,
+    )
+}
@@ -1,7 +1,9 @@
+use crate::ast::ControlType;
+use crate::codegen::control_rate::{self, StatementRate};
 use crate::codegen::TargetProperties;
-use crate::codegen::{controls, functions, values, ObjectCache};
-use crate::mir::block::{Function, Statement};
-use crate::mir::{Block, Node, NodeData, Surface, ValueGroup, ValueGroupSource};
+use crate::codegen::{controls, functions, half_band, values, ObjectCache};
+use crate::mir::block::{Function, Global, Statement};
+use crate::mir::{Block, Node, NodeData, Surface, ValueGroup, ValueGroupSource, VarType};
 use inkwell::context::Context;
 use inkwell::types::{BasicType, BasicTypeEnum, StructType};
 use inkwell::values::{BasicValue, StructValue};
@@ -55,10 +57,20 @@ pub struct BlockLayout {
     pub pointer_sources: Vec<PointerSource>,
     pub constant_struct: StructType,
     pub functions: Vec<Function>,
+    pub control_rate: Option<ControlRateLayout>,
     control_count: usize,
     func_indexes: HashMap<usize, usize>,
 }
 
+/// A block that calls `controlRate` evaluates the statements depending on it once every
+/// `CONTROL_RATE_PERIOD` samples. Its control-rate state is kept at the end of its scratch, and a
+/// pointer to it at the end of its pointers.
+#[derive(Debug, Clone)]
+pub struct ControlRateLayout {
+    pub rates: Vec<StatementRate>,
+    pub outputs: Vec<usize>,
+}
+
 #[derive(Debug, Clone)]
 pub struct SurfaceLayout {
     pub initialized_const: StructValue,
@@ -67,10 +79,52 @@ pub struct SurfaceLayout {
     pub pointer_struct: StructType,
     pub pointer_sources: Vec<PointerSource>,
     pub node_layouts: Vec<NodeLayout>,
+    pub sleep: Option<SleepLayout>,
+    pub oversample: Option<OversampleLayout>,
     node_scratch_offset: usize,
     node_initializer_offset: usize,
 }
 
+/// How long a surface has to be quiet for before it's put to sleep, in seconds. Delays can play
+/// an echo long after their input went quiet, so surfaces with them also wait for as long as
+/// their buffers are.
+pub const SLEEP_TAIL_SECONDS: f64 = 1.;
+
+/// A surface whose value groups are all numbers or MIDI can sleep while they're quiet. This covers
+/// its sockets as well as the controls and connections of its nodes, so moving a knob inside the
+/// surface wakes it up too. Its sleep state is kept at the end of its scratch, and pointers to it,
+/// the groups in `groups` and the data of the delays in `delays` are kept at the end of its
+/// pointers, in that order.
+///
+/// The sleep state is a struct of how many samples the surface has been quiet for, followed by a
+/// reference value for each number group that its value is compared against.
+#[derive(Debug, Clone)]
+pub struct SleepLayout {
+    pub groups: Vec<usize>,
+    /// The node index and function index of each delay in the surface.
+    pub delays: Vec<(usize, usize)>,
+}
+
+/// A surface whose sockets are all numbers can run its nodes several times per sample, with its
+/// inputs upsampled and outputs downsampled around them. Its filter state is kept at the end of
+/// its scratch, and pointers to it and the socket groups are kept at the end of its pointers,
+/// after the sleep pointers, with the inputs first.
+///
+/// The filter state is a struct of the upsampling history of each input, followed by the
+/// downsampling history of each output.
+#[derive(Debug, Clone)]
+pub struct OversampleLayout {
+    pub stage_count: usize,
+    pub inputs: Vec<usize>,
+    pub outputs: Vec<usize>,
+}
+
+impl OversampleLayout {
+    pub fn factor(&self) -> usize {
+        1 << self.stage_count
+    }
+}
+
 /// Builds up the structure types used for initializing/retaining state of a node.
 /// Nodes are made up of several structs:
 ///
@@ -204,12 +258,13 @@ pub fn build_node_layout(
             surface,
             ref source_sockets,
             ref dest_sockets,
+            ..
         } => {
             let surface_layout = cache.surface_layout(surface).unwrap();
 
             // generate new pointer sources that point to each voice
             let voice_pointer_sources: Vec<_> = iter::repeat(&surface_layout.pointer_sources)
-                .take(values::ARRAY_CAPACITY as usize)
+                .take(cache.target().array_capacity as usize)
                 .enumerate()
                 .map(|(voice_index, pointer_sources)| {
                     let sub_sources = pointer_sources
@@ -295,7 +350,7 @@ pub fn build_node_layout(
                 &[
                     &surface_layout
                         .scratch_struct
-                        .array_type(u32::from(values::ARRAY_CAPACITY)),
+                        .array_type(u32::from(cache.target().array_capacity)),
                     &context.i32_type(),
                 ],
                 false,
@@ -305,7 +360,7 @@ pub fn build_node_layout(
                 &[
                     &surface_layout
                         .pointer_struct
-                        .array_type(u32::from(values::ARRAY_CAPACITY))
+                        .array_type(u32::from(cache.target().array_capacity))
                         as &BasicType,
                     &context.struct_type(&source_type_refs, false) as &BasicType,
                     &context.struct_type(&dest_type_refs, false) as &BasicType,
@@ -472,6 +527,15 @@ pub fn build_block_layout(
         }
     }
 
+    let control_rate = build_control_rate_layout(block);
+    if let Some(control_rate) = &control_rate {
+        let state_type = control_rate::get_state_type(context, control_rate.outputs.len());
+        let scratch_index = scratch_types.len();
+        scratch_types.push(state_type.into());
+        pointer_sources.push(PointerSource::Scratch(vec![scratch_index]));
+        pointer_types.push(state_type.ptr_type(AddressSpace::Generic).into());
+    }
+
     let scratch_type_refs: Vec<_> = scratch_types.iter().map(|x| x as &BasicType).collect();
     let shared_type_refs: Vec<_> = shared_types.iter().map(|x| x as &BasicType).collect();
     let pointer_type_refs: Vec<_> = pointer_types.iter().map(|x| x as &BasicType).collect();
@@ -484,11 +548,24 @@ pub fn build_block_layout(
         pointer_sources,
         constant_struct: context.struct_type(&constant_type_refs, false),
         functions,
+        control_rate,
         control_count: block.controls.len(),
         func_indexes,
     }
 }
 
+fn build_control_rate_layout(block: &Block) -> Option<ControlRateLayout> {
+    let rates = control_rate::find_statement_rates(block);
+    let outputs = control_rate::find_outputs(block, &rates);
+
+    // with no outputs the control-rate statements don't affect anything
+    if outputs.is_empty() {
+        None
+    } else {
+        Some(ControlRateLayout { rates, outputs })
+    }
+}
+
 /// Builds up the structure types and default values used for initializing/retaining state of a surface.
 ///
 ///  - `initialized` is a struct containing pre-initialized value group values.
@@ -574,6 +651,93 @@ pub fn build_surface_layout(cache: &ObjectCache, surface: &Surface) -> SurfaceLa
         pointer_sources.push(new_pointer_source);
     }
 
+    let sleep = build_sleep_layout(cache, surface);
+    if let Some(sleep) = &sleep {
+        let sleep_scratch_index = scratch_types.len();
+        let mut state_types: Vec<BasicTypeEnum> = vec![context.i32_type().into()];
+        let mut sleep_pointer_types: Vec<BasicTypeEnum> = Vec::new();
+        let mut sleep_pointer_sources = Vec::new();
+        for &group_index in &sleep.groups {
+            let group_type = values::remap_type(context, &surface.groups[group_index].value_type);
+            if surface.groups[group_index].value_type == VarType::Num {
+                state_types.push(group_type);
+            }
+            sleep_pointer_types.push(group_type.ptr_type(AddressSpace::Generic).into());
+            sleep_pointer_sources.push(group_pointers[group_index].clone());
+        }
+        for &(node_index, function_index) in &sleep.delays {
+            let block_layout = match surface.nodes[node_index].data {
+                NodeData::Custom { block, .. } => cache.block_layout(block).unwrap(),
+                _ => unreachable!(),
+            };
+            let delay_type = functions::get_data_type(context, Function::Delay);
+            let delay_source =
+                block_layout.pointer_sources[block_layout.function_index(function_index)].clone();
+            let node_scratch_index = node_scratch_offset + node_index;
+            sleep_pointer_types.push(delay_type.ptr_type(AddressSpace::Generic).into());
+            sleep_pointer_sources.push(modify_pointer_source(
+                delay_source,
+                &PointerSource::Initialized,
+                &|mut indices| {
+                    indices.insert(0, node_scratch_index);
+                    PointerSource::Scratch(indices)
+                },
+                &PointerSource::Shared,
+                &PointerSource::Socket,
+            ));
+        }
+
+        let state_type_refs: Vec<_> = state_types.iter().map(|x| x as &BasicType).collect();
+        let state_struct = context.struct_type(&state_type_refs, false);
+        scratch_types.push(state_struct.into());
+        sleep_pointer_types.insert(0, state_struct.ptr_type(AddressSpace::Generic).into());
+        sleep_pointer_sources.insert(0, PointerSource::Scratch(vec![sleep_scratch_index]));
+
+        let sleep_pointer_refs: Vec<_> = sleep_pointer_types
+            .iter()
+            .map(|x| x as &BasicType)
+            .collect();
+        pointer_types.push(context.struct_type(&sleep_pointer_refs, false));
+        pointer_sources.push(PointerSource::Aggregate(
+            PointerSourceAggregateType::Struct,
+            sleep_pointer_sources,
+        ));
+    }
+
+    let oversample = build_oversample_layout(surface);
+    if let Some(oversample) = &oversample {
+        let oversample_scratch_index = scratch_types.len();
+        let mut state_types: Vec<BasicTypeEnum> = Vec::new();
+        let mut oversample_pointer_types: Vec<BasicTypeEnum> = Vec::new();
+        let mut oversample_pointer_sources = Vec::new();
+        let up_history_type = half_band::get_up_history_type(context, oversample.stage_count);
+        let down_history_type = half_band::get_down_history_type(context, oversample.stage_count);
+        state_types.extend(oversample.inputs.iter().map(|_| up_history_type.into()));
+        state_types.extend(oversample.outputs.iter().map(|_| down_history_type.into()));
+        for &group_index in oversample.inputs.iter().chain(oversample.outputs.iter()) {
+            let group_type = values::remap_type(context, &surface.groups[group_index].value_type);
+            oversample_pointer_types.push(group_type.ptr_type(AddressSpace::Generic).into());
+            oversample_pointer_sources.push(group_pointers[group_index].clone());
+        }
+
+        let state_type_refs: Vec<_> = state_types.iter().map(|x| x as &BasicType).collect();
+        let state_struct = context.struct_type(&state_type_refs, false);
+        scratch_types.push(state_struct.into());
+        oversample_pointer_types.insert(0, state_struct.ptr_type(AddressSpace::Generic).into());
+        oversample_pointer_sources
+            .insert(0, PointerSource::Scratch(vec![oversample_scratch_index]));
+
+        let oversample_pointer_refs: Vec<_> = oversample_pointer_types
+            .iter()
+            .map(|x| x as &BasicType)
+            .collect();
+        pointer_types.push(context.struct_type(&oversample_pointer_refs, false));
+        pointer_sources.push(PointerSource::Aggregate(
+            PointerSourceAggregateType::Struct,
+            oversample_pointer_sources,
+        ));
+    }
+
     let initialized_val_refs: Vec<_> = initialized_values
         .iter()
         .map(|x| x as &BasicValue)
@@ -589,11 +753,130 @@ pub fn build_surface_layout(cache: &ObjectCache, surface: &Surface) -> SurfaceLa
         pointer_struct: context.struct_type(&pointer_type_refs, false),
         node_layouts,
         pointer_sources,
+        sleep,
+        oversample,
         node_scratch_offset,
         node_initializer_offset,
     }
 }
 
+// Surfaces are only put to sleep if every value in them can be compared cheaply, so anything that
+// changes wakes them up again. Surfaces with nested groups are left awake, since the controls in
+// the groups aren't visible from here, but the groups can still sleep on their own.
+fn build_sleep_layout(cache: &ObjectCache, surface: &Surface) -> Option<SleepLayout> {
+    let can_compare = surface.groups.iter().all(|group| match group.value_type {
+        VarType::Num | VarType::Midi => true,
+        _ => false,
+    });
+    if surface.groups.is_empty() || !can_compare {
+        return None;
+    }
+
+    let mut delays = Vec::new();
+    for (node_index, node) in surface.nodes.iter().enumerate() {
+        match node.data {
+            NodeData::Dummy => {}
+            NodeData::Custom { block, .. } => {
+                if is_autonomous(cache.block_mir(block).unwrap()) {
+                    return None;
+                }
+
+                let functions = &cache.block_layout(block).unwrap().functions;
+                delays.extend(
+                    functions
+                        .iter()
+                        .enumerate()
+                        .filter(|(_, &function)| function == Function::Delay)
+                        .map(|(function_index, _)| (node_index, function_index)),
+                );
+            }
+            NodeData::Group(_) | NodeData::ExtractGroup { .. } => return None,
+        }
+    }
+
+    Some(SleepLayout {
+        groups: (0..surface.groups.len()).collect(),
+        delays,
+    })
+}
+
+// Whether a block can change its output while none of its inputs or controls change, because it
+// runs over time, follows the tempo, or uses impulses that are loaded from outside the graph.
+fn is_autonomous(block: &Block) -> bool {
+    let has_timed_control = block
+        .controls
+        .iter()
+        .any(|control| match control.control_type {
+            ControlType::Graph | ControlType::Roll => true,
+            _ => false,
+        });
+
+    has_timed_control
+        || block.statements.iter().any(|statement| match statement {
+            Statement::Global(Global::BPM) => true,
+            Statement::CallFunc { function, .. } => match function {
+                Function::Noise
+                | Function::SinOsc
+                | Function::SqrOsc
+                | Function::SawOsc
+                | Function::TriOsc
+                | Function::RmpOsc
+                | Function::BlSqrOsc
+                | Function::BlSawOsc
+                | Function::BlTriOsc
+                | Function::Adsr
+                | Function::Accum
+                | Function::Convolve => true,
+                _ => false,
+            },
+            _ => false,
+        })
+}
+
+// Inputs are sockets the surface only reads, and outputs are sockets it writes. Surfaces with other
+// sockets aren't oversampled, since MIDI events and arrays can't be resampled.
+fn build_oversample_layout(surface: &Surface) -> Option<OversampleLayout> {
+    let stage_count = match surface.oversampling {
+        2 => 1,
+        4 => 2,
+        8 => 3,
+        _ => return None,
+    };
+
+    let groups: Vec<_> = surface
+        .groups
+        .iter()
+        .enumerate()
+        .filter(|(_, group)| match group.source {
+            ValueGroupSource::Socket(_) => true,
+            _ => false,
+        })
+        .map(|(group_index, _)| group_index)
+        .collect();
+    if !groups
+        .iter()
+        .all(|&group_index| surface.groups[group_index].value_type == VarType::Num)
+    {
+        return None;
+    }
+
+    let is_written = |group_index: usize| {
+        surface.nodes.iter().any(|node| {
+            node.sockets
+                .iter()
+                .any(|socket| socket.value_written && socket.group_id == group_index)
+        })
+    };
+    let (outputs, inputs) = groups
+        .into_iter()
+        .partition(|&group_index| is_written(group_index));
+    Some(OversampleLayout {
+        stage_count,
+        inputs,
+        outputs,
+    })
+}
+
 fn modify_pointer_source(
     source: PointerSource,
     initialized_modifier: &Fn(Vec<usize>) -> PointerSource,
@@ -677,6 +960,10 @@ impl NodeLayout {
 }
 
 impl BlockLayout {
+    pub fn control_count(&self) -> usize {
+        self.control_count
+    }
+
     pub fn control_index(&self, control: usize) -> usize {
         // controls are always ordered first
         control
@@ -689,6 +976,11 @@ impl BlockLayout {
     pub fn statement_index(&self, statement: usize) -> Option<usize> {
         self.func_indexes.get(&statement).cloned()
     }
+
+    pub fn control_rate_ptr_index(&self) -> usize {
+        // the control-rate pointer is always after the functions
+        self.control_count + self.functions.len()
+    }
 }
 
 impl SurfaceLayout {
@@ -704,4 +996,14 @@ impl SurfaceLayout {
     pub fn node_ptr_index(&self, node: usize) -> usize {
         node
     }
+
+    pub fn sleep_ptr_index(&self) -> usize {
+        // the sleep pointers are always after the nodes
+        self.node_layouts.len()
+    }
+
+    pub fn oversample_ptr_index(&self) -> usize {
+        // the oversample pointers are after the sleep pointers, if there are any
+        self.node_layouts.len() + if self.sleep.is_some() { 1 } else { 0 }
+    }
 }
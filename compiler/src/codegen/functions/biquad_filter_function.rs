@@ -126,6 +126,7 @@ fn biquad_data_type(context: &Context, has_gain: bool) -> StructType {
         &vec_type, // z2 (previous output 2)
         &vec_type, // cached frequency
         &vec_type, // cached Q
+        &vec_type, // cached sample rate
     ];
     if has_gain {
         field_types.push(&vec_type);
@@ -177,11 +178,16 @@ fn gen_biquad_call(
             .b
             .build_struct_gep(&func.data_ptr, 10, "cachedq.ptr")
     };
+    let cached_sample_rate_ptr = unsafe {
+        func.ctx
+            .b
+            .build_struct_gep(&func.data_ptr, 11, "cachedsamplerate.ptr")
+    };
     let cached_gain_ptr = if has_gain {
         Some(unsafe {
             func.ctx
                 .b
-                .build_struct_gep(&func.data_ptr, 11, "cachedgain.ptr")
+                .build_struct_gep(&func.data_ptr, 12, "cachedgain.ptr")
         })
     } else {
         None
@@ -220,6 +226,30 @@ fn gen_biquad_call(
             .b
             .build_float_compare(FloatPredicate::ONE, q_vec, cached_q, "qchanged");
     let needs_regen_vec = func.ctx.b.build_or(freq_changed, q_changed, "needsregen");
+
+    // The sample rate can change while the filter runs (e.g in an oversampled group), and is zero
+    // before the first call, so the coefficients are always generated at least once.
+    let fs = func
+        .ctx
+        .b
+        .build_load(
+            &globals::get_sample_rate(func.ctx.module).as_pointer_value(),
+            "samplerate",
+        )
+        .into_vector_value();
+    let cached_fs = func
+        .ctx
+        .b
+        .build_load(&cached_sample_rate_ptr, "cachedsamplerate")
+        .into_vector_value();
+    let fs_changed =
+        func.ctx
+            .b
+            .build_float_compare(FloatPredicate::ONE, fs, cached_fs, "sampleratechanged");
+    let needs_regen_vec = func
+        .ctx
+        .b
+        .build_or(needs_regen_vec, fs_changed, "needsregen");
     let needs_regen_vec = if let Some(cached_gain_ptr) = cached_gain_ptr {
         let cached_gain = func
             .ctx
@@ -270,6 +300,7 @@ fn gen_biquad_call(
     func.ctx.b.position_at_end(&needs_regen_true_block);
     func.ctx.b.build_store(&cached_freq_ptr, &freq_vec);
     func.ctx.b.build_store(&cached_q_ptr, &q_vec);
+    func.ctx.b.build_store(&cached_sample_rate_ptr, &fs);
     if let Some(cached_gain_ptr) = cached_gain_ptr {
         func.ctx.b.build_store(&cached_gain_ptr, &gain_vec.unwrap());
     }
@@ -303,14 +334,6 @@ fn gen_biquad_call(
         .into_vector_value();
 
     // w0 = 2 * PI * f0 / fs
-    let fs = func
-        .ctx
-        .b
-        .build_load(
-            &globals::get_sample_rate(func.ctx.module).as_pointer_value(),
-            "samplerate",
-        )
-        .into_vector_value();
     let w0 = func.ctx.b.build_float_mul(
         util::get_vec_spread(func.ctx.context, 2. * consts::PI),
         func.ctx.b.build_float_div(f0, fs, ""),
@@ -342,42 +365,23 @@ fn gen_biquad_call(
 
     let coefficients = generate_coefficients(func, cos_w0, alpha, gain_vec);
 
-    // divide each value by a0 and store
-    func.ctx.b.build_store(
-        &a1_ptr,
-        &func
-            .ctx
-            .b
-            .build_float_div(coefficients.a1, coefficients.a0, ""),
-    );
-    func.ctx.b.build_store(
-        &a2_ptr,
-        &func
-            .ctx
-            .b
-            .build_float_div(coefficients.a2, coefficients.a0, ""),
-    );
-    func.ctx.b.build_store(
-        &b0_ptr,
-        &func
-            .ctx
-            .b
-            .build_float_div(coefficients.b0, coefficients.a0, ""),
-    );
-    func.ctx.b.build_store(
-        &b1_ptr,
-        &func
-            .ctx
-            .b
-            .build_float_div(coefficients.b1, coefficients.a0, ""),
+    // normalize each value by a0 and store, with one division shared between them
+    let a0_recip = func.ctx.b.build_float_div(
+        util::get_vec_spread(func.ctx.context, 1.),
+        coefficients.a0,
+        "a0recip",
     );
-    func.ctx.b.build_store(
-        &b2_ptr,
-        &func
-            .ctx
+    for (ptr, value) in &[
+        (a1_ptr, coefficients.a1),
+        (a2_ptr, coefficients.a2),
+        (b0_ptr, coefficients.b0),
+        (b1_ptr, coefficients.b1),
+        (b2_ptr, coefficients.b2),
+    ] {
+        func.ctx
             .b
-            .build_float_div(coefficients.b2, coefficients.a0, ""),
-    );
+            .build_store(ptr, &func.ctx.b.build_float_mul(*value, a0_recip, ""));
+    }
 
     func.ctx
         .b
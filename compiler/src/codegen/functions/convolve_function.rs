@@ -0,0 +1,180 @@
+use super::{Function, FunctionContext, VarArgs};
+use crate::codegen::globals;
+use crate::codegen::values::NumValue;
+use crate::mir::block;
+use inkwell::context::Context;
+use inkwell::types::StructType;
+use inkwell::values::PointerValue;
+use inkwell::{AddressSpace, FloatPredicate};
+
+/// Convolves the input with an impulse loaded into the runtime. The work is done by the runtime's
+/// convolver, which keeps its state in a buffer from the buffer pool that's pointed to from this
+/// function's data, along with its size so it can be freed.
+pub struct ConvolveFunction {}
+impl Function for ConvolveFunction {
+    fn function_type() -> block::Function {
+        block::Function::Convolve
+    }
+
+    fn data_type(context: &Context) -> StructType {
+        context.struct_type(
+            &[
+                &context.i8_type().ptr_type(AddressSpace::Generic), // state buffer
+                &context.i64_type(),                                // state buffer size
+            ],
+            false,
+        )
+    }
+
+    fn gen_call(
+        func: &mut FunctionContext,
+        args: &[PointerValue],
+        _varargs: Option<VarArgs>,
+        result: PointerValue,
+    ) {
+        let convolve_func = globals::get_convolve_func(func.ctx.module);
+        let input_num = NumValue::new(args[0]);
+        let impulse_num = NumValue::new(args[1]);
+        let result_num = NumValue::new(result);
+
+        // The impulse is picked by the left channel of the argument. Converting NaN or a value
+        // outside the range of an i32 gives poison, so those pick -1 instead, which the runtime
+        // treats as an empty slot.
+        let impulse_vec = impulse_num.get_vec(func.ctx.b);
+        let impulse_float = func
+            .ctx
+            .b
+            .build_extract_element(
+                &impulse_vec,
+                &func.ctx.context.i32_type().const_int(0, false),
+                "impulse",
+            )
+            .into_float_value();
+        let is_above_min = func.ctx.b.build_float_compare(
+            FloatPredicate::OGE,
+            impulse_float,
+            func.ctx.context.f64_type().const_float(0.),
+            "impulse.abovemin",
+        );
+        let is_below_max = func.ctx.b.build_float_compare(
+            FloatPredicate::OLT,
+            impulse_float,
+            func.ctx
+                .context
+                .f64_type()
+                .const_float(f64::from(i32::max_value()) + 1.),
+            "impulse.belowmax",
+        );
+        let is_in_range = func
+            .ctx
+            .b
+            .build_and(is_above_min, is_below_max, "impulse.inrange");
+        let impulse_float = func
+            .ctx
+            .b
+            .build_select(
+                is_in_range,
+                impulse_float,
+                func.ctx.context.f64_type().const_float(-1.),
+                "impulse.clamped",
+            )
+            .into_float_value();
+        let impulse_index = func.ctx.b.build_float_to_signed_int(
+            impulse_float,
+            func.ctx.context.i32_type(),
+            "impulseindex",
+        );
+
+        let samples_ptr = func
+            .ctx
+            .allocb
+            .build_alloca(&func.ctx.context.f64_type().vec_type(2), "samples");
+        let input_vec = input_num.get_vec(func.ctx.b);
+        func.ctx.b.build_store(&samples_ptr, &input_vec);
+
+        let impulse_library = func
+            .ctx
+            .b
+            .build_load(
+                &globals::get_impulse_library(func.ctx.module).as_pointer_value(),
+                "impulselibrary",
+            )
+            .into_pointer_value();
+        let buffer_pool = func
+            .ctx
+            .b
+            .build_load(
+                &globals::get_buffer_pool(func.ctx.module).as_pointer_value(),
+                "bufferpool",
+            )
+            .into_pointer_value();
+        func.ctx.b.build_call(
+            &convolve_func,
+            &[
+                &impulse_library,
+                &buffer_pool,
+                &func.ctx.b.build_pointer_cast(
+                    func.data_ptr,
+                    func.ctx.context.i8_type().ptr_type(AddressSpace::Generic),
+                    "",
+                ),
+                &impulse_index,
+                &func.ctx.b.build_pointer_cast(
+                    samples_ptr,
+                    func.ctx.context.f64_type().ptr_type(AddressSpace::Generic),
+                    "",
+                ),
+            ],
+            "",
+            false,
+        );
+
+        let result_vec = func
+            .ctx
+            .b
+            .build_load(&samples_ptr, "result")
+            .into_vector_value();
+        result_num.set_vec(func.ctx.b, result_vec);
+
+        let input_form = input_num.get_form(func.ctx.b);
+        result_num.set_form(func.ctx.b, input_form);
+    }
+
+    fn gen_destruct(func: &mut FunctionContext) {
+        let free_buffer_func = globals::get_free_buffer_func(func.ctx.module);
+        let buffer_pool = func
+            .ctx
+            .b
+            .build_load(
+                &globals::get_buffer_pool(func.ctx.module).as_pointer_value(),
+                "bufferpool",
+            )
+            .into_pointer_value();
+        let state_buffer = func
+            .ctx
+            .b
+            .build_load(
+                &unsafe { func.ctx.b.build_struct_gep(&func.data_ptr, 0, "state.ptr") },
+                "state",
+            )
+            .into_pointer_value();
+        let state_size = func
+            .ctx
+            .b
+            .build_load(
+                &unsafe {
+                    func.ctx
+                        .b
+                        .build_struct_gep(&func.data_ptr, 1, "statesize.ptr")
+                },
+                "statesize",
+            )
+            .into_int_value();
+        func.ctx.b.build_call(
+            &free_buffer_func,
+            &[&buffer_pool, &state_buffer, &state_size],
+            "",
+            false,
+        );
+    }
+}
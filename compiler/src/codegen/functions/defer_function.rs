@@ -273,3 +273,23 @@ impl Function for AccumFunction {
         result_num.set_vec(func.ctx.b, new_accum);
     }
 }
+
+// The value is passed straight through. What makes it control-rate is how the block builds the
+// statements that depend on it, see `codegen::control_rate`.
+pub struct ControlRateFunction {}
+impl Function for ControlRateFunction {
+    fn function_type() -> block::Function {
+        block::Function::ControlRate
+    }
+
+    fn gen_call(
+        func: &mut FunctionContext,
+        args: &[PointerValue],
+        _varargs: Option<VarArgs>,
+        result: PointerValue,
+    ) {
+        let x_num = NumValue::new(args[0]);
+        let result_num = NumValue::new(result);
+        x_num.copy_to(func.ctx.b, func.ctx.module, &result_num);
+    }
+}
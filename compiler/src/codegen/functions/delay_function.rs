@@ -1,18 +1,35 @@
 use super::{Function, FunctionContext, VarArgs};
 use crate::codegen::values::NumValue;
 use crate::codegen::{
-    build_context_function, globals, intrinsics, math, util, BuilderContext, TargetProperties,
+    build_context_function, globals, intrinsics, math, util, BuilderContext, Precision,
+    TargetProperties,
 };
 use crate::mir::block;
 use inkwell::attribute::AttrKind;
 use inkwell::context::Context;
 use inkwell::module::{Linkage, Module};
-use inkwell::types::StructType;
-use inkwell::values::{FunctionValue, PointerValue};
+use inkwell::types::{FloatType, StructType};
+use inkwell::values::{FunctionValue, InstructionOpcode, PointerValue};
 use inkwell::{AddressSpace, IntPredicate};
 
 pub struct DelayFunction {}
 impl DelayFunction {
+    // Single precision targets store delayed samples as floats, which halves the memory delay
+    // lines take up. Samples are still passed in and out as doubles.
+    fn get_sample_type(context: &Context, target: &TargetProperties) -> FloatType {
+        match target.precision {
+            Precision::Double => context.f64_type(),
+            Precision::Single => context.f32_type(),
+        }
+    }
+
+    fn get_sample_bytes(target: &TargetProperties) -> u64 {
+        match target.precision {
+            Precision::Double => 8,
+            Precision::Single => 4,
+        }
+    }
+
     fn get_channel_update_func(module: &Module) -> FunctionValue {
         let func =
             util::get_or_create_func(module, "maxim.util.delay.channelUpdate", true, &|| {
@@ -60,32 +77,40 @@ impl DelayFunction {
     ///
     ///         (*buffer)[loadedCurrentPos] = input;
     ///     } else {
-    ///         resultVal = input;
+    ///         // an empty delay line until there's a buffer to delay with
+    ///         resultVal = delaySamples != 0 ? 0 : input;
     ///     }
     ///
     ///     auto bufferSize = calculateNextPowerOfTwo(reserveSamples);
     ///     if (bufferSize != *currentSize) {
-    ///         *buffer = realloc(*buffer, bufferSize * sizeof(float));
-    ///         if (bufferSize == 0) {
-    ///             *buffer = nullptr;
-    ///         } else if (bufferSize > *currentSize) {
-    ///             memset(*buffer + *currentSize, 0, (bufferSize - *currentSize) * sizeof(float));
-    ///         } else {
-    ///             *currentPos = *currentPos % bufferSize;
+    ///         float *newBuffer = nullptr;
+    ///         if (bufferSize != 0) {
+    ///             // gives back null if the pool doesn't have a buffer ready, in which case the
+    ///             // old buffer is kept and we try again on the next sample
+    ///             newBuffer = maxim_buffer_alloc(bufferPool, bufferSize * sizeof(float));
+    ///             if (!newBuffer) goto done;
+    ///             memcpy(newBuffer, *buffer, min(bufferSize, *currentSize) * sizeof(float));
     ///         }
+    ///         maxim_buffer_free(bufferPool, *buffer, *currentSize * sizeof(float));
+    ///         *buffer = newBuffer;
+    ///         *currentPos = *currentPos % max(bufferSize, 1);
     ///         *currentSize = bufferSize;
     ///     }
     ///
+    /// done:
     ///     return resultVal;
     /// }
     /// ```
+    ///
+    /// The samples in the buffer are doubles unless the target is single precision, see
+    /// `get_sample_type`.
     fn build_channel_update_func(module: &Module, target: &TargetProperties) {
         let func = DelayFunction::get_channel_update_func(module);
         build_context_function(module, func, target, &|ctx: BuilderContext| {
-            let target_data = target.machine.get_data();
             let next_power_intrinsic = intrinsics::next_power_i32(ctx.module);
-            let realloc_intrinsic = intrinsics::realloc(ctx.module, &target_data);
-            let memset_intrinsic = intrinsics::memset(ctx.module, &target_data);
+            let memcpy_intrinsic = intrinsics::memcpy(ctx.module);
+            let alloc_buffer_func = globals::get_alloc_buffer_func(ctx.module);
+            let free_buffer_func = globals::get_free_buffer_func(ctx.module);
 
             let current_pos_ptr = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
             let current_size_ptr = ctx.func.get_nth_param(1).unwrap().into_pointer_value();
@@ -108,40 +133,42 @@ impl DelayFunction {
             let has_buffer_continue_block = ctx
                 .context
                 .append_basic_block(&ctx.func, "hasbuffer.continue");
-            let needs_realloc_true_block = ctx
-                .context
-                .append_basic_block(&ctx.func, "needsrealloc.true");
-            let size_zero_true_block = ctx.context.append_basic_block(&ctx.func, "sizezero.true");
-            let size_zero_false_block = ctx.context.append_basic_block(&ctx.func, "sizezero.false");
-            let size_increase_true_block = ctx
-                .context
-                .append_basic_block(&ctx.func, "sizeincrease.true");
-            let size_decrease_true_block = ctx
+            let needs_resize_true_block = ctx
                 .context
-                .append_basic_block(&ctx.func, "sizedecrease.true");
-            let size_increase_continue_block = ctx
+                .append_basic_block(&ctx.func, "needsresize.true");
+            let size_nonzero_true_block = ctx
                 .context
-                .append_basic_block(&ctx.func, "sizeincrease.continue");
-            let size_zero_continue_block = ctx
+                .append_basic_block(&ctx.func, "sizenonzero.true");
+            let got_buffer_true_block = ctx.context.append_basic_block(&ctx.func, "gotbuffer.true");
+            let swap_buffer_block = ctx.context.append_basic_block(&ctx.func, "swapbuffer");
+            let needs_resize_continue_block = ctx
                 .context
-                .append_basic_block(&ctx.func, "sizezero.continue");
-            let needs_realloc_continue_block = ctx
-                .context
-                .append_basic_block(&ctx.func, "needsrealloc.continue");
+                .append_basic_block(&ctx.func, "needsresize.continue");
 
             let result_ptr = ctx
                 .allocb
                 .build_alloca(&ctx.context.f64_type(), "resultval");
-            let buffer_ptr = ctx
-                .b
-                .build_load(&buffer_ptr_ptr, "bufferptr")
-                .into_pointer_value();
+            let is_single = target.precision == Precision::Single;
+            let sample_type = DelayFunction::get_sample_type(ctx.context, target);
+            let buffer_ptr = ctx.b.build_pointer_cast(
+                ctx.b
+                    .build_load(&buffer_ptr_ptr, "bufferptr")
+                    .into_pointer_value(),
+                sample_type.ptr_type(AddressSpace::Generic),
+                "samplesptr",
+            );
 
             // if (*currentSize) {
             let current_size = ctx
                 .b
                 .build_load(&current_size_ptr, "currentsize")
                 .into_int_value();
+            let has_samples = ctx.b.build_int_compare(
+                IntPredicate::NE,
+                delay_samples,
+                ctx.context.i32_type().const_int(0, false),
+                "hassamples",
+            );
             let has_buffer = ctx.b.build_int_compare(
                 IntPredicate::UGT,
                 current_size,
@@ -175,12 +202,6 @@ impl DelayFunction {
             ctx.b.build_store(&current_pos_ptr, &new_pos);
 
             // if (delaySamples != 0) {
-            let has_samples = ctx.b.build_int_compare(
-                IntPredicate::NE,
-                delay_samples,
-                ctx.context.i32_type().const_int(0, false),
-                "hassamples",
-            );
             ctx.b.build_conditional_branch(
                 &has_samples,
                 &has_samples_true_block,
@@ -201,16 +222,23 @@ impl DelayFunction {
             );
 
             // resultVal = (*buffer)[readPosition];
-            let result_val = ctx
-                .b
-                .build_load(
-                    &unsafe {
-                        ctx.b
-                            .build_in_bounds_gep(&buffer_ptr, &[read_position], "result.ptr")
-                    },
+            let result_sample = ctx.b.build_load(
+                &unsafe {
+                    ctx.b
+                        .build_in_bounds_gep(&buffer_ptr, &[read_position], "result.ptr")
+                },
+                "result.sample",
+            );
+            let result_val = if is_single {
+                ctx.b.build_cast(
+                    InstructionOpcode::FPExt,
+                    &result_sample,
+                    &ctx.context.f64_type(),
                     "result",
                 )
-                .into_float_value();
+            } else {
+                result_sample
+            };
             ctx.b.build_store(&result_ptr, &result_val);
             ctx.b
                 .build_unconditional_branch(&has_samples_continue_block);
@@ -232,14 +260,32 @@ impl DelayFunction {
                     ctx.b
                         .build_in_bounds_gep(&buffer_ptr, &[current_pos], "write.ptr")
                 },
-                &input_num,
+                &if is_single {
+                    ctx.b.build_cast(
+                        InstructionOpcode::FPTrunc,
+                        &input_num,
+                        &sample_type,
+                        "input.sample",
+                    )
+                } else {
+                    input_num.into()
+                },
             );
             ctx.b.build_unconditional_branch(&has_buffer_continue_block);
 
             ctx.b.position_at_end(&has_buffer_false_block);
 
-            // resultVal = input;
-            ctx.b.build_store(&result_ptr, &input_num);
+            // resultVal = delaySamples != 0 ? 0 : input;
+            let empty_val = ctx
+                .b
+                .build_select(
+                    has_samples,
+                    ctx.context.f64_type().const_float(0.),
+                    input_num,
+                    "emptyval",
+                )
+                .into_float_value();
+            ctx.b.build_store(&result_ptr, &empty_val);
             ctx.b.build_unconditional_branch(&has_buffer_continue_block);
 
             ctx.b.position_at_end(&has_buffer_continue_block);
@@ -258,140 +304,165 @@ impl DelayFunction {
                 .into_int_value();
 
             // if (bufferSize != *currentSize) {
-            let needs_realloc = ctx.b.build_int_compare(
+            let needs_resize = ctx.b.build_int_compare(
                 IntPredicate::NE,
                 new_buffer_size,
                 current_size,
-                "needsrealloc",
+                "needsresize",
             );
             ctx.b.build_conditional_branch(
-                &needs_realloc,
-                &needs_realloc_true_block,
-                &needs_realloc_continue_block,
+                &needs_resize,
+                &needs_resize_true_block,
+                &needs_resize_continue_block,
             );
 
-            ctx.b.position_at_end(&needs_realloc_true_block);
-
-            // *buffer = realloc(*buffer, bufferSize * sizeof(float));
-            let size_type = target_data.int_ptr_type_in_context(ctx.context);
+            ctx.b.position_at_end(&needs_resize_true_block);
+            let buffer_pool = ctx
+                .b
+                .build_load(
+                    &globals::get_buffer_pool(ctx.module).as_pointer_value(),
+                    "bufferpool",
+                )
+                .into_pointer_value();
             let float_size = ctx
                 .context
-                .f64_type()
-                .size_of()
-                .const_cast(&size_type, false);
-            let realloc_size = ctx.b.build_int_mul(
-                ctx.b.build_int_cast(new_buffer_size, size_type, ""),
+                .i64_type()
+                .const_int(DelayFunction::get_sample_bytes(target), false);
+            let new_size_bytes = ctx.b.build_int_mul(
+                ctx.b
+                    .build_int_z_extend(new_buffer_size, ctx.context.i64_type(), ""),
                 float_size,
-                "",
+                "newsizebytes",
+            );
+            let current_size_bytes = ctx.b.build_int_mul(
+                ctx.b
+                    .build_int_z_extend(current_size, ctx.context.i64_type(), ""),
+                float_size,
+                "currentsizebytes",
+            );
+            let byte_ptr_type = ctx.context.i8_type().ptr_type(AddressSpace::Generic);
+            let old_buffer = ctx
+                .b
+                .build_pointer_cast(buffer_ptr, byte_ptr_type, "oldbuffer");
+
+            // float *newBuffer = nullptr;
+            let new_buffer_ptr = ctx.allocb.build_alloca(&byte_ptr_type, "newbuffer.ptr");
+            ctx.b
+                .build_store(&new_buffer_ptr, &byte_ptr_type.const_null());
+
+            // if (bufferSize != 0) {
+            let size_nonzero = ctx.b.build_int_compare(
+                IntPredicate::NE,
+                new_buffer_size,
+                ctx.context.i32_type().const_int(0, false),
+                "sizenonzero",
             );
-            let realloc_ptr = ctx
+            ctx.b.build_conditional_branch(
+                &size_nonzero,
+                &size_nonzero_true_block,
+                &swap_buffer_block,
+            );
+
+            ctx.b.position_at_end(&size_nonzero_true_block);
+
+            // newBuffer = maxim_buffer_alloc(bufferPool, bufferSize * sizeof(float));
+            let new_buffer = ctx
                 .b
                 .build_call(
-                    &realloc_intrinsic,
-                    &[
-                        &ctx.b.build_pointer_cast(
-                            buffer_ptr,
-                            ctx.context.i8_type().ptr_type(AddressSpace::Generic),
-                            "",
-                        ),
-                        &realloc_size,
-                    ],
-                    "",
+                    &alloc_buffer_func,
+                    &[&buffer_pool, &new_size_bytes],
+                    "newbuffer",
                     false,
                 )
                 .left()
                 .unwrap()
                 .into_pointer_value();
+            ctx.b.build_store(&new_buffer_ptr, &new_buffer);
 
-            // if (bufferSize == 0) *buffer = nullptr;
-            let size_is_zero = ctx.b.build_int_compare(
-                IntPredicate::EQ,
-                realloc_size,
-                size_type.const_int(0, false),
-                "sizezero",
-            );
+            // if (!newBuffer) goto done;
+            let got_buffer = ctx.b.build_is_not_null(new_buffer, "gotbuffer");
             ctx.b.build_conditional_branch(
-                &size_is_zero,
-                &size_zero_true_block,
-                &size_zero_false_block,
+                &got_buffer,
+                &got_buffer_true_block,
+                &needs_resize_continue_block,
             );
 
-            let buffer_ptr_type = ctx.context.f64_type().ptr_type(AddressSpace::Generic);
+            ctx.b.position_at_end(&got_buffer_true_block);
 
-            ctx.b.position_at_end(&size_zero_true_block);
-            ctx.b
-                .build_store(&buffer_ptr_ptr, &buffer_ptr_type.const_null());
-            ctx.b.build_unconditional_branch(&size_zero_continue_block);
-
-            // else if (bufferSize > *currentSize) memset(*buffer + *currentSize, 0, (bufferSize - *currentSize) * sizeof(float));
-            ctx.b.position_at_end(&size_zero_false_block);
-            let size_increase = ctx.b.build_int_compare(
+            // memcpy(newBuffer, *buffer, min(bufferSize, *currentSize) * sizeof(float));
+            let is_growing = ctx.b.build_int_compare(
                 IntPredicate::UGT,
-                new_buffer_size,
-                current_size,
-                "sizeincrease",
-            );
-            ctx.b.build_conditional_branch(
-                &size_increase,
-                &size_increase_true_block,
-                &size_decrease_true_block,
-            );
-
-            ctx.b.position_at_end(&size_increase_true_block);
-            let current_size_bytes = ctx.b.build_int_mul(
-                ctx.b.build_int_cast(current_size, size_type, ""),
-                float_size,
-                "currentsizebytes",
+                new_size_bytes,
+                current_size_bytes,
+                "isgrowing",
             );
+            let copy_bytes = ctx
+                .b
+                .build_select(is_growing, current_size_bytes, new_size_bytes, "copybytes")
+                .into_int_value();
             ctx.b.build_call(
-                &memset_intrinsic,
+                &memcpy_intrinsic,
                 &[
-                    &unsafe {
-                        ctx.b
-                            .build_in_bounds_gep(&realloc_ptr, &[current_size_bytes], "offsetptr")
-                    },
-                    &ctx.context.i8_type().const_int(0, false),
-                    &ctx.b.build_int_sub(realloc_size, current_size_bytes, ""),
-                    &ctx.context.i32_type().const_int(0, false),
+                    &new_buffer,
+                    &old_buffer,
+                    &copy_bytes,
+                    &ctx.context.i32_type().const_int(8, false),
                     &ctx.context.bool_type().const_int(0, false),
                 ],
                 "",
                 false,
             );
-            ctx.b
-                .build_unconditional_branch(&size_increase_continue_block);
+            ctx.b.build_unconditional_branch(&swap_buffer_block);
+
+            ctx.b.position_at_end(&swap_buffer_block);
+
+            // maxim_buffer_free(bufferPool, *buffer, *currentSize * sizeof(float));
+            ctx.b.build_call(
+                &free_buffer_func,
+                &[&buffer_pool, &old_buffer, &current_size_bytes],
+                "",
+                false,
+            );
+
+            // *buffer = newBuffer;
+            let swapped_buffer = ctx
+                .b
+                .build_load(&new_buffer_ptr, "swappedbuffer")
+                .into_pointer_value();
+            ctx.b.build_store(
+                &buffer_ptr_ptr,
+                &ctx.b.build_pointer_cast(
+                    swapped_buffer,
+                    ctx.context.f64_type().ptr_type(AddressSpace::Generic),
+                    "newbufferptr",
+                ),
+            );
 
-            // else {
-            ctx.b.position_at_end(&size_decrease_true_block);
-            // *currentPos = *currentPos % *currentSize;
+            // *currentPos = *currentPos % max(bufferSize, 1);
+            let pos_divisor = ctx
+                .b
+                .build_select(
+                    size_nonzero,
+                    new_buffer_size,
+                    ctx.context.i32_type().const_int(1, false),
+                    "posdivisor",
+                )
+                .into_int_value();
             ctx.b.build_store(
                 &current_pos_ptr,
                 &ctx.b.build_int_unsigned_rem(
                     ctx.b.build_load(&current_pos_ptr, "").into_int_value(),
-                    new_buffer_size,
+                    pos_divisor,
                     "",
                 ),
             );
-            // }
-            ctx.b
-                .build_unconditional_branch(&size_increase_continue_block);
-
-            ctx.b.position_at_end(&size_increase_continue_block);
-            ctx.b.build_store(
-                &buffer_ptr_ptr,
-                &ctx.b
-                    .build_pointer_cast(realloc_ptr, buffer_ptr_type, "newbufferptr"),
-            );
-            ctx.b.build_unconditional_branch(&size_zero_continue_block);
-
-            ctx.b.position_at_end(&size_zero_continue_block);
 
             // *currentSize = bufferSize;
             ctx.b.build_store(&current_size_ptr, &new_buffer_size);
             ctx.b
-                .build_unconditional_branch(&needs_realloc_continue_block);
+                .build_unconditional_branch(&needs_resize_continue_block);
 
-            ctx.b.position_at_end(&needs_realloc_continue_block);
+            ctx.b.position_at_end(&needs_resize_continue_block);
             ctx.b.build_return(Some(&ctx.b.build_load(&result_ptr, "")));
         });
     }
@@ -639,31 +710,67 @@ impl Function for DelayFunction {
     }
 
     fn gen_destruct(func: &mut FunctionContext) {
-        let left_buffer_ptr = func
-            .ctx
-            .b
-            .build_load(
-                &unsafe {
-                    func.ctx
-                        .b
-                        .build_struct_gep(&func.data_ptr, 4, "leftbuffer.ptr")
-                },
-                "leftbuffer",
-            )
-            .into_pointer_value();
-        let right_buffer_ptr = func
+        let free_buffer_func = globals::get_free_buffer_func(func.ctx.module);
+        let buffer_pool = func
             .ctx
             .b
             .build_load(
-                &unsafe {
-                    func.ctx
-                        .b
-                        .build_struct_gep(&func.data_ptr, 5, "rightbuffer.ptr")
-                },
-                "rightbuffer",
+                &globals::get_buffer_pool(func.ctx.module).as_pointer_value(),
+                "bufferpool",
             )
             .into_pointer_value();
-        func.ctx.b.build_free(&left_buffer_ptr);
-        func.ctx.b.build_free(&right_buffer_ptr);
+
+        // buffers go back to the pool along with their size, which picks the queue they end up in
+        for &(length_index, buffer_index) in &[(2, 4), (3, 5)] {
+            let buffer_length = func
+                .ctx
+                .b
+                .build_load(
+                    &unsafe {
+                        func.ctx
+                            .b
+                            .build_struct_gep(&func.data_ptr, length_index, "buflength.ptr")
+                    },
+                    "buflength",
+                )
+                .into_int_value();
+            let buffer_ptr = func
+                .ctx
+                .b
+                .build_load(
+                    &unsafe {
+                        func.ctx
+                            .b
+                            .build_struct_gep(&func.data_ptr, buffer_index, "buffer.ptr")
+                    },
+                    "buffer",
+                )
+                .into_pointer_value();
+            func.ctx.b.build_call(
+                &free_buffer_func,
+                &[
+                    &buffer_pool,
+                    &func.ctx.b.build_pointer_cast(
+                        buffer_ptr,
+                        func.ctx.context.i8_type().ptr_type(AddressSpace::Generic),
+                        "",
+                    ),
+                    &func.ctx.b.build_int_mul(
+                        func.ctx.b.build_int_z_extend(
+                            buffer_length,
+                            func.ctx.context.i64_type(),
+                            "",
+                        ),
+                        func.ctx
+                            .context
+                            .i64_type()
+                            .const_int(DelayFunction::get_sample_bytes(func.ctx.target), false),
+                        "buflength.bytes",
+                    ),
+                ],
+                "",
+                false,
+            );
+        }
     }
 }
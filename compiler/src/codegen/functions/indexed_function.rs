@@ -1,7 +1,7 @@
 use super::{Function, FunctionContext, VarArgs};
 use crate::ast::FormType;
-use crate::codegen::values::{ArrayValue, NumValue, ARRAY_CAPACITY};
-use crate::codegen::{math, util};
+use crate::codegen::values::{ArrayValue, NumValue, MAX_ARRAY_CAPACITY};
+use crate::codegen::{globals, math, util};
 use crate::mir::block;
 use inkwell::values::PointerValue;
 use inkwell::IntPredicate;
@@ -34,6 +34,21 @@ impl Function for IndexedFunction {
                 "input.left",
             )
             .into_float_value();
+
+        // the array only gets as many items as the project's capacity allows
+        let capacity = func
+            .ctx
+            .b
+            .build_load(
+                &globals::get_array_capacity(func.ctx.module).as_pointer_value(),
+                "capacity",
+            )
+            .into_int_value();
+        let capacity_float = func.ctx.b.build_unsigned_int_to_float(
+            capacity,
+            func.ctx.context.f64_type(),
+            "capacity.float",
+        );
         let input_count_clamped = func
             .ctx
             .b
@@ -55,11 +70,7 @@ impl Function for IndexedFunction {
                         .left()
                         .unwrap()
                         .into_float_value(),
-                    &func
-                        .ctx
-                        .context
-                        .f64_type()
-                        .const_float(f64::from(ARRAY_CAPACITY)),
+                    &capacity_float,
                 ],
                 "",
                 true,
@@ -79,7 +90,7 @@ impl Function for IndexedFunction {
             func.ctx
                 .context
                 .i8_type()
-                .const_int(u64::from(ARRAY_CAPACITY), false),
+                .const_int(u64::from(MAX_ARRAY_CAPACITY), false),
             input_count_int,
             "shiftamount",
         );
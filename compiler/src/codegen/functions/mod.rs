@@ -1,10 +1,12 @@
 mod adsr_function;
 mod biquad_filter_function;
 mod channel_function;
+mod convolve_function;
 mod defer_function;
 mod delay_function;
 mod function_context;
 mod indexed_function;
+mod noise_function;
 mod note_function;
 mod num_function;
 mod oscillator_function;
@@ -32,9 +34,11 @@ use self::function_context::FunctionContext;
 pub use self::adsr_function::*;
 pub use self::biquad_filter_function::*;
 pub use self::channel_function::*;
+pub use self::convolve_function::*;
 pub use self::defer_function::*;
 pub use self::delay_function::*;
 pub use self::indexed_function::*;
+pub use self::noise_function::*;
 pub use self::note_function::*;
 pub use self::num_function::*;
 pub use self::oscillator_function::*;
@@ -156,9 +160,11 @@ map_functions! {
     Sequence => SequenceFunction,
     Last => LastFunction,
     Delay => DelayFunction,
+    Convolve => ConvolveFunction,
     Amplitude => AmplitudeFunction,
     Hold => HoldFunction,
     Accum => AccumFunction,
+    ControlRate => ControlRateFunction,
     Mixdown => MixdownFunction,
     SvFilter => SvFilterFunction,
     LowBqFilter => LowBqFilterFunction,
@@ -173,6 +179,9 @@ map_functions! {
     SawOsc => SawOscFunction,
     TriOsc => TriOscFunction,
     RmpOsc => RmpOscFunction,
+    BlSqrOsc => BlSqrOscFunction,
+    BlSawOsc => BlSawOscFunction,
+    BlTriOsc => BlTriOscFunction,
     Note => NoteFunction,
     Voices => VoicesFunction,
     Channel => ChannelFunction,
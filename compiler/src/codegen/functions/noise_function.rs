@@ -0,0 +1,62 @@
+use super::{Function, FunctionContext, VarArgs};
+use crate::ast::FormType;
+use crate::codegen::values::NumValue;
+use crate::codegen::{globals, math};
+use crate::mir::block;
+use inkwell::context::Context;
+use inkwell::types::StructType;
+use inkwell::values::PointerValue;
+
+/// Generates white noise. Each instance keeps its own random seed, so voices that run in parallel
+/// don't race on a shared one.
+pub struct NoiseFunction {}
+impl Function for NoiseFunction {
+    fn function_type() -> block::Function {
+        block::Function::Noise
+    }
+
+    fn data_type(context: &Context) -> StructType {
+        context.struct_type(&[&context.i64_type().vec_type(2)], false)
+    }
+
+    fn gen_construct(func: &mut FunctionContext) {
+        // Instances are seeded from the module's seed, which is advanced each time so they all
+        // produce different noise. Constructors only run on one thread, so this doesn't race.
+        let rand_intrinsic = math::rand_v2f64(func.ctx.module);
+        let module_seed_ptr = globals::get_rand_seed(func.ctx.module).as_pointer_value();
+        func.ctx
+            .b
+            .build_call(&rand_intrinsic, &[&module_seed_ptr], "", true);
+
+        let seed = func.ctx.b.build_load(&module_seed_ptr, "seed");
+        let seed_ptr = unsafe { func.ctx.b.build_struct_gep(&func.data_ptr, 0, "seed.ptr") };
+        func.ctx.b.build_store(&seed_ptr, &seed);
+    }
+
+    fn gen_call(
+        func: &mut FunctionContext,
+        _args: &[PointerValue],
+        _varargs: Option<VarArgs>,
+        result: PointerValue,
+    ) {
+        let rand_intrinsic = math::rand_v2f64(func.ctx.module);
+        let seed_ptr = unsafe { func.ctx.b.build_struct_gep(&func.data_ptr, 0, "seed.ptr") };
+        let result_vec = func
+            .ctx
+            .b
+            .build_call(&rand_intrinsic, &[&seed_ptr], "result", true)
+            .left()
+            .unwrap()
+            .into_vector_value();
+
+        let result_num = NumValue::new(result);
+        result_num.set_vec(func.ctx.b, result_vec);
+        result_num.set_form(
+            func.ctx.b,
+            func.ctx
+                .context
+                .i8_type()
+                .const_int(FormType::Oscillator as u64, false),
+        );
+    }
+}
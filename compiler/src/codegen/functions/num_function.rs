@@ -1,5 +1,5 @@
 use super::{Function, FunctionContext, VarArgs};
-use crate::codegen::values::{ArrayValue, NumValue, ARRAY_CAPACITY};
+use crate::codegen::values::{ArrayValue, NumValue};
 use crate::codegen::{intrinsics, math, util};
 use crate::mir::block;
 use inkwell::types::VectorType;
@@ -433,10 +433,6 @@ impl Function for MixdownFunction {
             .ctx
             .context
             .append_basic_block(&func.ctx.func, "looprun");
-        let item_active_true_block = func
-            .ctx
-            .context
-            .append_basic_block(&func.ctx.func, "itemactive.true");
         let loop_continue_block = func
             .ctx
             .context
@@ -450,45 +446,35 @@ impl Function for MixdownFunction {
             .b
             .build_store(&result_vec, &util::get_vec_spread(func.ctx.context, 0.));
 
-        let index_ptr = func
+        // only visit the active items, by taking the lowest set bit until the bitmap is empty
+        let remaining_ptr = func
             .ctx
             .allocb
-            .build_alloca(&func.ctx.context.i32_type(), "index.ptr");
-        func.ctx
-            .b
-            .build_store(&index_ptr, &func.ctx.context.i32_type().const_int(0, false));
+            .build_alloca(&func.ctx.context.i32_type(), "remaining.ptr");
+        func.ctx.b.build_store(&remaining_ptr, &in_bitmap);
         func.ctx.b.build_unconditional_branch(&loop_check_block);
 
         func.ctx.b.position_at_end(&loop_check_block);
-        let current_index = func.ctx.b.build_load(&index_ptr, "index").into_int_value();
-        let index_cond = func.ctx.b.build_int_compare(
-            IntPredicate::ULT,
-            current_index,
-            func.ctx
-                .context
-                .i32_type()
-                .const_int(u64::from(ARRAY_CAPACITY), false),
-            "indexcond",
+        let remaining = func
+            .ctx
+            .b
+            .build_load(&remaining_ptr, "remaining")
+            .into_int_value();
+        let remaining_cond = func.ctx.b.build_int_compare(
+            IntPredicate::NE,
+            remaining,
+            func.ctx.context.i32_type().const_int(0, false),
+            "remainingcond",
         );
         func.ctx
             .b
-            .build_conditional_branch(&index_cond, &loop_run_block, &loop_continue_block);
+            .build_conditional_branch(&remaining_cond, &loop_run_block, &loop_continue_block);
 
         func.ctx.b.position_at_end(&loop_run_block);
-        let next_index = func.ctx.b.build_int_nuw_add(
-            current_index,
-            func.ctx.context.i32_type().const_int(1, false),
-            "nextindex",
-        );
-        func.ctx.b.build_store(&index_ptr, &next_index);
-        let item_active = util::get_bit(func.ctx.b, in_bitmap, current_index);
-        func.ctx.b.build_conditional_branch(
-            &item_active,
-            &item_active_true_block,
-            &loop_check_block,
-        );
+        let current_index = util::get_lowest_bit(func.ctx.b, func.ctx.module, remaining);
+        let next_remaining = util::clear_lowest_bit(func.ctx.b, remaining);
+        func.ctx.b.build_store(&remaining_ptr, &next_remaining);
 
-        func.ctx.b.position_at_end(&item_active_true_block);
         let item_num = NumValue::new(in_array.get_item_ptr(func.ctx.b, current_index));
         let item_vec = item_num.get_vec(func.ctx.b);
         func.ctx.b.build_store(
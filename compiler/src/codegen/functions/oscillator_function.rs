@@ -4,11 +4,18 @@ use crate::codegen::values::NumValue;
 use crate::codegen::{globals, math, util, BuilderContext};
 use crate::mir::block;
 use inkwell::context::Context;
+use inkwell::module::Module;
 use inkwell::types::StructType;
-use inkwell::values::{PointerValue, VectorValue};
+use inkwell::values::{GlobalValue, PointerValue, VectorValue};
 use inkwell::FloatPredicate;
 use std::f64::consts;
 
+// Band-limited oscillators correct the naive waveform around each discontinuity with a residual
+// looked up from a table. The tables cover one sample either side of the discontinuity, with this
+// many entries per sample.
+const BLEP_RESOLUTION: usize = 64;
+const BLEP_INTEGRATION_STEPS: usize = 16;
+
 fn gen_periodic_real_args(
     ctx: &mut BuilderContext,
     mut args: Vec<PointerValue>,
@@ -35,7 +42,7 @@ fn gen_periodic_call(
     func: &mut FunctionContext,
     args: &[PointerValue],
     result: PointerValue,
-    next_val: &Fn(&mut FunctionContext, VectorValue, &[PointerValue]) -> VectorValue,
+    next_val: &Fn(&mut FunctionContext, VectorValue, VectorValue, &[PointerValue]) -> VectorValue,
 ) {
     let fract_intrinsic = math::fract_v2f64(func.ctx.module);
 
@@ -93,7 +100,7 @@ fn gen_periodic_call(
         .unwrap()
         .into_vector_value();
 
-    let result_vec = next_val(func, input_phase, &args[2..]);
+    let result_vec = next_val(func, input_phase, phase_offset, &args[2..]);
 
     result_num.set_vec(func.ctx.b, result_vec);
     result_num.set_form(
@@ -126,6 +133,7 @@ macro_rules! define_periodic_func (
 fn sin_next_value(
     func: &mut FunctionContext,
     phase: VectorValue,
+    _phase_step: VectorValue,
     _extra_args: &[PointerValue],
 ) -> VectorValue {
     let sin_intrinsic = math::sin_v2f64(func.ctx.module);
@@ -146,6 +154,7 @@ define_periodic_func!(SinOscFunction: block::Function::SinOsc, false => sin_next
 fn sqr_next_value(
     func: &mut FunctionContext,
     phase: VectorValue,
+    _phase_step: VectorValue,
     extra_args: &[PointerValue],
 ) -> VectorValue {
     let pulse_width = NumValue::new(extra_args[0]);
@@ -171,6 +180,7 @@ define_periodic_func!(SqrOscFunction: block::Function::SqrOsc, true => sqr_next_
 fn saw_next_value(
     func: &mut FunctionContext,
     phase: VectorValue,
+    _phase_step: VectorValue,
     _extra_args: &[PointerValue],
 ) -> VectorValue {
     func.ctx.b.build_float_sub(
@@ -188,6 +198,7 @@ define_periodic_func!(SawOscFunction: block::Function::SawOsc, false => saw_next
 fn tri_next_value(
     func: &mut FunctionContext,
     phase: VectorValue,
+    _phase_step: VectorValue,
     _extra_args: &[PointerValue],
 ) -> VectorValue {
     let abs_intrinsic = math::abs_v2f64(func.ctx.module);
@@ -221,6 +232,7 @@ define_periodic_func!(TriOscFunction: block::Function::TriOsc, false => tri_next
 fn rmp_next_value(
     func: &mut FunctionContext,
     phase: VectorValue,
+    _phase_step: VectorValue,
     _extra_args: &[PointerValue],
 ) -> VectorValue {
     func.ctx.b.build_float_sub(
@@ -234,3 +246,397 @@ fn rmp_next_value(
     )
 }
 define_periodic_func!(RmpOscFunction: block::Function::RmpOsc, false => rmp_next_value);
+
+// The band-limited step is the integral of a Blackman-windowed sinc one sample either side of the
+// step, and the band-limited ramp is the integral of that. Both are sampled from -1 to 1 samples
+// around the discontinuity, with an extra entry at the end so lookups never need to clamp.
+fn build_blep_tables() -> (Vec<f64>, Vec<f64>) {
+    let table_len = BLEP_RESOLUTION * 2 + 2;
+    let dx = 1. / (BLEP_RESOLUTION * BLEP_INTEGRATION_STEPS) as f64;
+    let kernel = |x: f64| {
+        let sinc = if x == 0. {
+            1.
+        } else {
+            (consts::PI * x).sin() / (consts::PI * x)
+        };
+        let window = 0.42 + 0.5 * (consts::PI * x).cos() + 0.08 * (consts::PI * 2. * x).cos();
+        sinc * window
+    };
+
+    let mut step_table = vec![0.; table_len];
+    let mut ramp_table = vec![0.; table_len];
+    let (mut step, mut ramp) = (0., 0.);
+    for index in 1..table_len - 1 {
+        for sub_index in 0..BLEP_INTEGRATION_STEPS {
+            let x = -1. + ((index - 1) * BLEP_INTEGRATION_STEPS + sub_index) as f64 * dx;
+            let next_step = step + (kernel(x) + kernel(x + dx)) * 0.5 * dx;
+            ramp += (step + next_step) * 0.5 * dx;
+            step = next_step;
+        }
+        step_table[index] = step;
+        ramp_table[index] = ramp;
+    }
+
+    // normalize so the step ends at exactly 1, and the ramp at exactly 1 sample
+    let step_total = step_table[table_len - 2];
+    for index in 0..table_len - 1 {
+        step_table[index] /= step_total;
+        ramp_table[index] /= step_total;
+    }
+    step_table[table_len - 1] = step_table[table_len - 2];
+    ramp_table[table_len - 1] = ramp_table[table_len - 2] + 1. / BLEP_RESOLUTION as f64;
+
+    (step_table, ramp_table)
+}
+
+// The tables are only used by update functions, so they're built into the library module once.
+fn get_blep_tables(module: &Module) -> (GlobalValue, GlobalValue) {
+    if let (Some(step_global), Some(ramp_global)) = (
+        module.get_global("maxim.blep.step"),
+        module.get_global("maxim.blep.ramp"),
+    ) {
+        return (step_global, ramp_global);
+    }
+
+    let context = module.get_context();
+    let (step_table, ramp_table) = build_blep_tables();
+    let build_global = |name: &str, table: &[f64]| {
+        let values: Vec<_> = table
+            .iter()
+            .map(|&val| context.f64_type().const_float(val))
+            .collect();
+        let value_refs: Vec<_> = values.iter().collect();
+        let global = util::get_or_create_global(
+            module,
+            name,
+            &context.f64_type().array_type(table.len() as u32),
+        );
+        global.set_constant(true);
+        global.set_initializer(&context.f64_type().const_array(&value_refs));
+        global
+    };
+    (
+        build_global("maxim.blep.step", &step_table),
+        build_global("maxim.blep.ramp", &ramp_table),
+    )
+}
+
+// Finds how many samples ago a discontinuity at phase 0 happened, or will happen if negative. Both
+// directions are clamped to one sample, which also catches a phase step of zero.
+fn get_blep_position(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+) -> VectorValue {
+    let is_before = func.ctx.b.build_float_compare(
+        FloatPredicate::OGE,
+        phase,
+        util::get_vec_spread(func.ctx.context, 0.5),
+        "isbefore",
+    );
+    let distance = func
+        .ctx
+        .b
+        .build_select(
+            is_before,
+            func.ctx
+                .b
+                .build_float_sub(phase, util::get_vec_spread(func.ctx.context, 1.), ""),
+            phase,
+            "distance",
+        )
+        .into_vector_value();
+    let position = func.ctx.b.build_float_div(distance, phase_step, "position");
+
+    // written so NaN ends up at 1, where the residual is 0
+    let position = func
+        .ctx
+        .b
+        .build_select(
+            func.ctx.b.build_float_compare(
+                FloatPredicate::OLT,
+                position,
+                util::get_vec_spread(func.ctx.context, 1.),
+                "",
+            ),
+            position,
+            util::get_vec_spread(func.ctx.context, 1.),
+            "",
+        )
+        .into_vector_value();
+    func.ctx
+        .b
+        .build_select(
+            func.ctx.b.build_float_compare(
+                FloatPredicate::OGT,
+                position,
+                util::get_vec_spread(func.ctx.context, -1.),
+                "",
+            ),
+            position,
+            util::get_vec_spread(func.ctx.context, -1.),
+            "position.clamped",
+        )
+        .into_vector_value()
+}
+
+fn build_blep_lookup(
+    func: &mut FunctionContext,
+    table: GlobalValue,
+    position: VectorValue,
+) -> VectorValue {
+    let context = func.ctx.context;
+    let table_pos = func.ctx.b.build_float_mul(
+        func.ctx
+            .b
+            .build_float_add(position, util::get_vec_spread(context, 1.), ""),
+        util::get_vec_spread(context, BLEP_RESOLUTION as f64),
+        "tablepos",
+    );
+    let table_index = func.ctx.b.build_float_to_signed_int(
+        table_pos,
+        context.i32_type().vec_type(2),
+        "tableindex",
+    );
+    let table_frac = func.ctx.b.build_float_sub(
+        table_pos,
+        func.ctx
+            .b
+            .build_signed_int_to_float(table_index, context.f64_type().vec_type(2), ""),
+        "tablefrac",
+    );
+
+    let mut low_vec = context.f64_type().vec_type(2).get_undef();
+    let mut high_vec = context.f64_type().vec_type(2).get_undef();
+    for lane in 0..2 {
+        let lane_index = context.i32_type().const_int(lane, false);
+        let index = func
+            .ctx
+            .b
+            .build_extract_element(&table_index, &lane_index, "")
+            .into_int_value();
+        let low_ptr = unsafe {
+            func.ctx.b.build_in_bounds_gep(
+                &table.as_pointer_value(),
+                &[context.i32_type().const_int(0, false), index],
+                "",
+            )
+        };
+        let high_ptr = unsafe {
+            func.ctx
+                .b
+                .build_in_bounds_gep(&low_ptr, &[context.i32_type().const_int(1, false)], "")
+        };
+        low_vec = func
+            .ctx
+            .b
+            .build_insert_element(
+                &low_vec,
+                &func.ctx.b.build_load(&low_ptr, ""),
+                &lane_index,
+                "",
+            )
+            .into_vector_value();
+        high_vec = func
+            .ctx
+            .b
+            .build_insert_element(
+                &high_vec,
+                &func.ctx.b.build_load(&high_ptr, ""),
+                &lane_index,
+                "",
+            )
+            .into_vector_value();
+    }
+
+    func.ctx.b.build_float_add(
+        low_vec,
+        func.ctx.b.build_float_mul(
+            func.ctx.b.build_float_sub(high_vec, low_vec, ""),
+            table_frac,
+            "",
+        ),
+        "residual",
+    )
+}
+
+// The difference between a band-limited step and a naive one, for a step from 0 to 1.
+fn get_step_residual(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+) -> VectorValue {
+    let (step_table, _) = get_blep_tables(func.ctx.module);
+    let position = get_blep_position(func, phase, phase_step);
+    let band_limited = build_blep_lookup(func, step_table, position);
+    let naive = func
+        .ctx
+        .b
+        .build_select(
+            func.ctx.b.build_float_compare(
+                FloatPredicate::OGE,
+                position,
+                util::get_vec_spread(func.ctx.context, 0.),
+                "",
+            ),
+            util::get_vec_spread(func.ctx.context, 1.),
+            util::get_vec_spread(func.ctx.context, 0.),
+            "",
+        )
+        .into_vector_value();
+    func.ctx
+        .b
+        .build_float_sub(band_limited, naive, "stepresidual")
+}
+
+// The difference between a band-limited ramp and a naive one, for a slope change from 0 to 1 per
+// sample.
+fn get_ramp_residual(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+) -> VectorValue {
+    let max_intrinsic = math::max_v2f64(func.ctx.module);
+    let (_, ramp_table) = get_blep_tables(func.ctx.module);
+    let position = get_blep_position(func, phase, phase_step);
+    let band_limited = build_blep_lookup(func, ramp_table, position);
+    let naive = func
+        .ctx
+        .b
+        .build_call(
+            &max_intrinsic,
+            &[&position, &util::get_vec_spread(func.ctx.context, 0.)],
+            "",
+            true,
+        )
+        .left()
+        .unwrap()
+        .into_vector_value();
+    func.ctx
+        .b
+        .build_float_sub(band_limited, naive, "rampresidual")
+}
+
+// Steps in a waveform that runs backwards go the other way, so heights are scaled by the sign of
+// the phase step.
+fn get_signed_height(
+    func: &mut FunctionContext,
+    height: f64,
+    phase_step: VectorValue,
+) -> VectorValue {
+    let copysign_intrinsic = math::copysign_v2f64(func.ctx.module);
+    func.ctx
+        .b
+        .build_call(
+            &copysign_intrinsic,
+            &[&util::get_vec_spread(func.ctx.context, height), &phase_step],
+            "height",
+            true,
+        )
+        .left()
+        .unwrap()
+        .into_vector_value()
+}
+
+// Moves the phase so a discontinuity at `offset` ends up at 0.
+fn get_offset_phase(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    offset: VectorValue,
+) -> VectorValue {
+    let fract_intrinsic = math::fract_v2f64(func.ctx.module);
+    func.ctx
+        .b
+        .build_call(
+            &fract_intrinsic,
+            &[&func.ctx.b.build_float_sub(phase, offset, "")],
+            "offsetphase",
+            true,
+        )
+        .left()
+        .unwrap()
+        .into_vector_value()
+}
+
+fn bl_sqr_next_value(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+    extra_args: &[PointerValue],
+) -> VectorValue {
+    let naive = sqr_next_value(func, phase, phase_step, extra_args);
+    let pulse_width_vec = NumValue::new(extra_args[0]).get_vec(func.ctx.b);
+
+    // the wave steps up by 2 at the start of each period and down by 2 at the pulse width
+    let rise_residual = get_step_residual(func, phase, phase_step);
+    let fall_phase = get_offset_phase(func, phase, pulse_width_vec);
+    let fall_residual = get_step_residual(func, fall_phase, phase_step);
+    let height = get_signed_height(func, 2., phase_step);
+    func.ctx.b.build_float_add(
+        naive,
+        func.ctx.b.build_float_mul(
+            height,
+            func.ctx.b.build_float_sub(rise_residual, fall_residual, ""),
+            "",
+        ),
+        "result",
+    )
+}
+define_periodic_func!(BlSqrOscFunction: block::Function::BlSqrOsc, true => bl_sqr_next_value);
+
+fn bl_saw_next_value(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+    extra_args: &[PointerValue],
+) -> VectorValue {
+    let naive = saw_next_value(func, phase, phase_step, extra_args);
+
+    // the wave steps down by 2 at the start of each period
+    let residual = get_step_residual(func, phase, phase_step);
+    let height = get_signed_height(func, 2., phase_step);
+    func.ctx.b.build_float_sub(
+        naive,
+        func.ctx.b.build_float_mul(height, residual, ""),
+        "result",
+    )
+}
+define_periodic_func!(BlSawOscFunction: block::Function::BlSawOsc, false => bl_saw_next_value);
+
+fn bl_tri_next_value(
+    func: &mut FunctionContext,
+    phase: VectorValue,
+    phase_step: VectorValue,
+    extra_args: &[PointerValue],
+) -> VectorValue {
+    let abs_intrinsic = math::abs_v2f64(func.ctx.module);
+    let naive = tri_next_value(func, phase, phase_step, extra_args);
+
+    // the slope changes by 8 per period at the start of each period and -8 halfway, and the
+    // residuals are per sample
+    let bottom_residual = get_ramp_residual(func, phase, phase_step);
+    let top_phase = get_offset_phase(func, phase, util::get_vec_spread(func.ctx.context, 0.5));
+    let top_residual = get_ramp_residual(func, top_phase, phase_step);
+    let slope_change = func.ctx.b.build_float_mul(
+        util::get_vec_spread(func.ctx.context, 8.),
+        func.ctx
+            .b
+            .build_call(&abs_intrinsic, &[&phase_step], "", true)
+            .left()
+            .unwrap()
+            .into_vector_value(),
+        "slopechange",
+    );
+    func.ctx.b.build_float_add(
+        naive,
+        func.ctx.b.build_float_mul(
+            slope_change,
+            func.ctx
+                .b
+                .build_float_sub(bottom_residual, top_residual, ""),
+            "",
+        ),
+        "result",
+    )
+}
+define_periodic_func!(BlTriOscFunction: block::Function::BlTriOsc, false => bl_tri_next_value);
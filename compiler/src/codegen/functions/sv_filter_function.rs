@@ -5,7 +5,7 @@ use crate::mir::block;
 use inkwell::context::Context;
 use inkwell::types::StructType;
 use inkwell::values::PointerValue;
-use inkwell::IntPredicate;
+use inkwell::{FloatPredicate, IntPredicate};
 use std::f64::consts;
 
 const LOOP_COUNT: u64 = 2;
@@ -22,6 +22,9 @@ impl Function for SvFilterFunction {
             &[
                 &float_vec, // low
                 &float_vec, // band
+                &float_vec, // cached frequency
+                &float_vec, // cached sample rate
+                &float_vec, // cached f
             ],
             false,
         )
@@ -37,6 +40,21 @@ impl Function for SvFilterFunction {
 
         let low_ptr = unsafe { func.ctx.b.build_struct_gep(&func.data_ptr, 0, "low.ptr") };
         let band_ptr = unsafe { func.ctx.b.build_struct_gep(&func.data_ptr, 1, "band.ptr") };
+        let cached_freq_ptr = unsafe {
+            func.ctx
+                .b
+                .build_struct_gep(&func.data_ptr, 2, "cachedfreq.ptr")
+        };
+        let cached_sample_rate_ptr = unsafe {
+            func.ctx
+                .b
+                .build_struct_gep(&func.data_ptr, 3, "cachedsamplerate.ptr")
+        };
+        let cached_f_ptr = unsafe {
+            func.ctx
+                .b
+                .build_struct_gep(&func.data_ptr, 4, "cachedf.ptr")
+        };
 
         let input_num = NumValue::new(args[0]);
         let freq_num = NumValue::new(args[1]);
@@ -47,40 +65,110 @@ impl Function for SvFilterFunction {
         let freq_vec = freq_num.get_vec(func.ctx.b);
         let q_vec = q_num.get_vec(func.ctx.b);
 
-        let f_val = func.ctx.b.build_float_mul(
-            util::get_vec_spread(func.ctx.context, 1.),
+        // f only depends on the frequency and sample rate, so it's only worked out again when
+        // one of them changes. The sample rate is zero before the first call, so it's always
+        // worked out at least once.
+        let sample_rate_vec = func
+            .ctx
+            .b
+            .build_load(
+                &globals::get_sample_rate(func.ctx.module).as_pointer_value(),
+                "samplerate",
+            )
+            .into_vector_value();
+        let freq_changed = func.ctx.b.build_float_compare(
+            FloatPredicate::ONE,
+            freq_vec,
             func.ctx
                 .b
-                .build_call(
-                    &sin_intrinsic,
-                    &[&func.ctx.b.build_float_div(
-                        func.ctx.b.build_float_div(
-                            func.ctx.b.build_float_mul(
-                                util::get_vec_spread(func.ctx.context, consts::PI),
-                                freq_vec,
-                                "",
-                            ),
-                            util::get_vec_spread(func.ctx.context, LOOP_COUNT as f64),
-                            "",
-                        ),
-                        func.ctx
-                            .b
-                            .build_load(
-                                &globals::get_sample_rate(func.ctx.module).as_pointer_value(),
-                                "samplerate",
-                            )
-                            .into_vector_value(),
-                        "",
-                    )],
+                .build_load(&cached_freq_ptr, "cachedfreq")
+                .into_vector_value(),
+            "freqchanged",
+        );
+        let sample_rate_changed = func.ctx.b.build_float_compare(
+            FloatPredicate::ONE,
+            sample_rate_vec,
+            func.ctx
+                .b
+                .build_load(&cached_sample_rate_ptr, "cachedsamplerate")
+                .into_vector_value(),
+            "sampleratechanged",
+        );
+        let needs_regen_vec = func
+            .ctx
+            .b
+            .build_or(freq_changed, sample_rate_changed, "needsregen");
+        let needs_regen = func.ctx.b.build_or(
+            func.ctx
+                .b
+                .build_extract_element(
+                    &needs_regen_vec,
+                    &func.ctx.context.i32_type().const_int(0, false),
                     "",
-                    true,
                 )
-                .left()
-                .unwrap()
-                .into_vector_value(),
-            "f",
+                .into_int_value(),
+            func.ctx
+                .b
+                .build_extract_element(
+                    &needs_regen_vec,
+                    &func.ctx.context.i32_type().const_int(1, false),
+                    "",
+                )
+                .into_int_value(),
+            "",
         );
 
+        let needs_regen_true_block = func
+            .ctx
+            .context
+            .append_basic_block(&func.ctx.func, "needsregen.true");
+        let needs_regen_continue_block = func
+            .ctx
+            .context
+            .append_basic_block(&func.ctx.func, "needsregen.continue");
+        func.ctx.b.build_conditional_branch(
+            &needs_regen,
+            &needs_regen_true_block,
+            &needs_regen_continue_block,
+        );
+
+        func.ctx.b.position_at_end(&needs_regen_true_block);
+        func.ctx.b.build_store(&cached_freq_ptr, &freq_vec);
+        func.ctx
+            .b
+            .build_store(&cached_sample_rate_ptr, &sample_rate_vec);
+        let new_f_val = func
+            .ctx
+            .b
+            .build_call(
+                &sin_intrinsic,
+                &[&func.ctx.b.build_float_div(
+                    func.ctx.b.build_float_mul(
+                        util::get_vec_spread(func.ctx.context, consts::PI / LOOP_COUNT as f64),
+                        freq_vec,
+                        "",
+                    ),
+                    sample_rate_vec,
+                    "",
+                )],
+                "",
+                true,
+            )
+            .left()
+            .unwrap()
+            .into_vector_value();
+        func.ctx.b.build_store(&cached_f_ptr, &new_f_val);
+        func.ctx
+            .b
+            .build_unconditional_branch(&needs_regen_continue_block);
+
+        func.ctx.b.position_at_end(&needs_regen_continue_block);
+        let f_val = func
+            .ctx
+            .b
+            .build_load(&cached_f_ptr, "f")
+            .into_vector_value();
+
         let high_ptr = func
             .ctx
             .allocb
@@ -57,7 +57,6 @@ macro_rules! define_vector_intrinsic (
     )
 );
 
-define_vector_intrinsic!(NoiseFunction: block::Function::Noise => math::rand_v2f64 => Oscillator);
 define_vector_intrinsic!(SinFunction: block::Function::Sin => math::sin_v2f64);
 define_vector_intrinsic!(CosFunction: block::Function::Cos => math::cos_v2f64);
 define_vector_intrinsic!(TanFunction: block::Function::Tan => math::tan_v2f64);
@@ -1,6 +1,6 @@
 use super::{Function, FunctionContext, VarArgs};
 use crate::codegen::util;
-use crate::codegen::values::{ArrayValue, MidiValue, NumValue, ARRAY_CAPACITY};
+use crate::codegen::values::{ArrayValue, MidiValue, NumValue, MAX_ARRAY_CAPACITY};
 use crate::mir::block;
 use inkwell::context::Context;
 use inkwell::types::StructType;
@@ -16,7 +16,7 @@ impl Function for VoicesFunction {
     fn data_type(context: &Context) -> StructType {
         context.struct_type(
             &[
-                &context.i8_type().array_type(u32::from(ARRAY_CAPACITY)), // assigned notes
+                &context.i8_type().array_type(u32::from(MAX_ARRAY_CAPACITY)), // assigned notes
             ],
             false,
         )
@@ -39,23 +39,19 @@ impl Function for VoicesFunction {
         let result_array = ArrayValue::new(result);
         result_array.set_bitmap(func.ctx.b, func.ctx.context.i32_type().const_int(0, false));
 
-        let init_index_ptr = func
+        // Voices are found by taking the lowest set bit from a bitmap of the voices left to look
+        // at, so only active voices (or free ones, for note on events) are visited.
+        let remaining_ptr = func
             .ctx
             .allocb
-            .build_alloca(&func.ctx.context.i8_type(), "initindex.ptr");
+            .build_alloca(&func.ctx.context.i32_type(), "voicesleft.ptr");
         let event_index_ptr = func
             .ctx
             .allocb
             .build_alloca(&func.ctx.context.i8_type(), "eventindex.ptr");
-        let inner_index_ptr = func
-            .ctx
-            .allocb
-            .build_alloca(&func.ctx.context.i8_type(), "innerindex.ptr");
 
-        func.ctx.b.build_store(
-            &init_index_ptr,
-            &func.ctx.context.i8_type().const_int(0, false),
-        );
+        let last_active_bitmap = last_active_array.get_bitmap(func.ctx.b);
+        func.ctx.b.build_store(&remaining_ptr, &last_active_bitmap);
         func.ctx.b.build_store(
             &event_index_ptr,
             &func.ctx.context.i8_type().const_int(0, false),
@@ -89,19 +85,19 @@ impl Function for VoicesFunction {
             .context
             .append_basic_block(&func.ctx.func, "eventloop.finish");
 
-        let note_on_loop_check_block = func
+        let note_on_block = func
             .ctx
             .context
-            .append_basic_block(&func.ctx.func, "noteonloop.check");
-        let note_on_loop_run_block = func
+            .append_basic_block(&func.ctx.func, "noteon");
+        let note_on_assign_block = func
             .ctx
             .context
-            .append_basic_block(&func.ctx.func, "noteonloop.run");
-        let note_on_loop_assign_block = func
+            .append_basic_block(&func.ctx.func, "noteon.assign");
+
+        let note_else_block = func
             .ctx
             .context
-            .append_basic_block(&func.ctx.func, "noteonloop.assign");
-
+            .append_basic_block(&func.ctx.func, "noteelse");
         let note_else_loop_check_block = func
             .ctx
             .context
@@ -110,10 +106,6 @@ impl Function for VoicesFunction {
             .ctx
             .context
             .append_basic_block(&func.ctx.func, "noteelseloop.run");
-        let note_else_loop_active_block = func
-            .ctx
-            .context
-            .append_basic_block(&func.ctx.func, "noteelseloop.active");
         let note_else_loop_assign_block = func
             .ctx
             .context
@@ -123,18 +115,20 @@ impl Function for VoicesFunction {
             .b
             .build_unconditional_branch(&init_loop_check_block);
 
-        // Build the init loop, which iterates over each voice, clearing MIDI counts in the result
-        // and making outputs active if the inputs are.
+        // Build the init loop, which iterates over each voice that was active, clearing MIDI
+        // counts in the result and making outputs active if the inputs are. Voices that weren't
+        // active are left alone, since they aren't in the result bitmap.
         {
             func.ctx.b.position_at_end(&init_loop_check_block);
-            let current_init_index = func.ctx.b.build_load(&init_index_ptr, "").into_int_value();
+            let remaining_voices = func
+                .ctx
+                .b
+                .build_load(&remaining_ptr, "voicesleft")
+                .into_int_value();
             let init_cond = func.ctx.b.build_int_compare(
-                IntPredicate::ULT,
-                current_init_index,
-                func.ctx
-                    .context
-                    .i8_type()
-                    .const_int(u64::from(ARRAY_CAPACITY), false),
+                IntPredicate::NE,
+                remaining_voices,
+                func.ctx.context.i32_type().const_int(0, false),
                 "",
             );
             func.ctx.b.build_conditional_branch(
@@ -144,21 +138,15 @@ impl Function for VoicesFunction {
             );
 
             func.ctx.b.position_at_end(&init_loop_run_block);
-            let incremented_init_index = func.ctx.b.build_int_add(
-                current_init_index,
-                func.ctx.context.i8_type().const_int(1, false),
-                "nextinitindex",
-            );
+            let current_init_index =
+                util::get_lowest_bit(func.ctx.b, func.ctx.module, remaining_voices);
+            let next_remaining_voices = util::clear_lowest_bit(func.ctx.b, remaining_voices);
             func.ctx
                 .b
-                .build_store(&init_index_ptr, &incremented_init_index);
+                .build_store(&remaining_ptr, &next_remaining_voices);
 
             let init_last_active =
                 NumValue::new(last_active_array.get_item_ptr(func.ctx.b, current_init_index));
-            let init_midi =
-                MidiValue::new(result_array.get_item_ptr(func.ctx.b, current_init_index));
-            init_midi.set_count(func.ctx.b, func.ctx.context.i8_type().const_int(0, false));
-
             let init_last_active_vec = init_last_active.get_vec(func.ctx.b);
             let active_cond = func.ctx.b.build_float_compare(
                 FloatPredicate::ONE,
@@ -182,6 +170,9 @@ impl Function for VoicesFunction {
             func.ctx.b.position_at_end(&init_active_block);
 
             // set the bitmap in the result bitmap if the voice is active
+            let init_midi =
+                MidiValue::new(result_array.get_item_ptr(func.ctx.b, current_init_index));
+            init_midi.set_count(func.ctx.b, func.ctx.context.i8_type().const_int(0, false));
             let current_result_bitmap = result_array.get_bitmap(func.ctx.b);
             let new_bitmap = util::set_bit(func.ctx.b, current_result_bitmap, current_init_index);
             result_array.set_bitmap(func.ctx.b, new_bitmap);
@@ -191,7 +182,7 @@ impl Function for VoicesFunction {
         }
 
         // Loop over each event in the input and distribute to the output voices:
-        //  - If the input event is a note on event, find an available voice slot (i.e one that isn't active) and claim it
+        //  - If the input event is a note on event, claim the lowest voice slot that isn't active
         //  - If the input event is a note-specific event, find the voice set to that note and pass through the event
         //  - If the input event is a global event, pass it into all voices
         {
@@ -227,64 +218,38 @@ impl Function for VoicesFunction {
                 func.ctx.context.i8_type().const_int(0, false),
                 "oncond",
             );
-            func.ctx.b.build_store(
-                &inner_index_ptr,
-                &func.ctx.context.i8_type().const_int(0, false),
-            );
-            func.ctx.b.build_conditional_branch(
-                &is_on_cond,
-                &note_on_loop_check_block,
-                &note_else_loop_check_block,
-            );
+            func.ctx
+                .b
+                .build_conditional_branch(&is_on_cond, &note_on_block, &note_else_block);
 
             {
-                func.ctx.b.position_at_end(&note_on_loop_check_block);
-                let current_active_index =
-                    func.ctx.b.build_load(&inner_index_ptr, "").into_int_value();
-                let active_cond = func.ctx.b.build_int_compare(
-                    IntPredicate::ULT,
-                    current_active_index,
-                    func.ctx
-                        .context
-                        .i8_type()
-                        .const_int(u64::from(ARRAY_CAPACITY), false),
-                    "activecond",
-                );
-                func.ctx.b.build_conditional_branch(
-                    &active_cond,
-                    &note_on_loop_run_block,
-                    &event_loop_check_block,
+                func.ctx.b.position_at_end(&note_on_block);
+                let current_result_bitmap = result_array.get_bitmap(func.ctx.b);
+                let free_bitmap = func.ctx.b.build_and(
+                    func.ctx.b.build_not(&current_result_bitmap, ""),
+                    ArrayValue::build_full_bitmap(func.ctx.b, func.ctx.module),
+                    "freebitmap",
                 );
-
-                func.ctx.b.position_at_end(&note_on_loop_run_block);
-                let incremented_active_index = func.ctx.b.build_int_nuw_add(
-                    current_active_index,
-                    func.ctx.context.i8_type().const_int(1, false),
-                    "nextactiveindex",
+                let has_free_cond = func.ctx.b.build_int_compare(
+                    IntPredicate::NE,
+                    free_bitmap,
+                    func.ctx.context.i32_type().const_int(0, false),
+                    "hasfreecond",
                 );
-                func.ctx
-                    .b
-                    .build_store(&inner_index_ptr, &incremented_active_index);
-
-                let current_result_bitmap = result_array.get_bitmap(func.ctx.b);
-                let is_output_active =
-                    util::get_bit(func.ctx.b, current_result_bitmap, current_active_index);
                 func.ctx.b.build_conditional_branch(
-                    &is_output_active,
-                    &note_on_loop_check_block,
-                    &note_on_loop_assign_block,
+                    &has_free_cond,
+                    &note_on_assign_block,
+                    &event_loop_check_block,
                 );
 
-                func.ctx.b.position_at_end(&note_on_loop_assign_block);
+                func.ctx.b.position_at_end(&note_on_assign_block);
                 // claim the note - set the voice in the array, set the bitmap on the output,
                 // and push the event to the output voice
+                let free_index = util::get_lowest_bit(func.ctx.b, func.ctx.module, free_bitmap);
                 let assign_note_ptr = unsafe {
                     func.ctx.b.build_in_bounds_gep(
                         &current_notes_ptr,
-                        &[
-                            func.ctx.context.i64_type().const_int(0, false),
-                            current_active_index,
-                        ],
+                        &[func.ctx.context.i64_type().const_int(0, false), free_index],
                         "noteassign.ptr",
                     )
                 };
@@ -292,12 +257,12 @@ impl Function for VoicesFunction {
                 func.ctx
                     .b
                     .build_store(&assign_note_ptr, &current_event_note);
-                let new_bitmap =
-                    util::set_bit(func.ctx.b, current_result_bitmap, current_active_index);
+                let new_bitmap = util::set_bit(func.ctx.b, current_result_bitmap, free_index);
                 result_array.set_bitmap(func.ctx.b, new_bitmap);
 
-                let output_midi =
-                    MidiValue::new(result_array.get_item_ptr(func.ctx.b, current_active_index));
+                // the voice wasn't active, so its MIDI hasn't been cleared yet
+                let output_midi = MidiValue::new(result_array.get_item_ptr(func.ctx.b, free_index));
+                output_midi.set_count(func.ctx.b, func.ctx.context.i8_type().const_int(0, false));
                 output_midi.push_event(func.ctx.b, func.ctx.module, &current_event);
                 func.ctx
                     .b
@@ -305,16 +270,25 @@ impl Function for VoicesFunction {
             }
 
             {
+                func.ctx.b.position_at_end(&note_else_block);
+                let current_result_bitmap = result_array.get_bitmap(func.ctx.b);
+                func.ctx
+                    .b
+                    .build_store(&remaining_ptr, &current_result_bitmap);
+                func.ctx
+                    .b
+                    .build_unconditional_branch(&note_else_loop_check_block);
+
                 func.ctx.b.position_at_end(&note_else_loop_check_block);
-                let current_note_index =
-                    func.ctx.b.build_load(&inner_index_ptr, "").into_int_value();
+                let remaining_voices = func
+                    .ctx
+                    .b
+                    .build_load(&remaining_ptr, "voicesleft")
+                    .into_int_value();
                 let note_cond = func.ctx.b.build_int_compare(
-                    IntPredicate::ULT,
-                    current_note_index,
-                    func.ctx
-                        .context
-                        .i8_type()
-                        .const_int(u64::from(ARRAY_CAPACITY), false),
+                    IntPredicate::NE,
+                    remaining_voices,
+                    func.ctx.context.i32_type().const_int(0, false),
                     "notecond",
                 );
                 func.ctx.b.build_conditional_branch(
@@ -324,26 +298,14 @@ impl Function for VoicesFunction {
                 );
 
                 func.ctx.b.position_at_end(&note_else_loop_run_block);
-                let incremented_note_index = func.ctx.b.build_int_nuw_add(
-                    current_note_index,
-                    func.ctx.context.i8_type().const_int(1, false),
-                    "noteindex",
-                );
+                let current_note_index =
+                    util::get_lowest_bit(func.ctx.b, func.ctx.module, remaining_voices);
+                let next_remaining_voices = util::clear_lowest_bit(func.ctx.b, remaining_voices);
                 func.ctx
                     .b
-                    .build_store(&inner_index_ptr, &incremented_note_index);
-
-                // determine if the voice is active and matches the note in the event, or the event doesn't have an event
-                let current_result_bitmap = result_array.get_bitmap(func.ctx.b);
-                let is_output_active =
-                    util::get_bit(func.ctx.b, current_result_bitmap, current_note_index);
-                func.ctx.b.build_conditional_branch(
-                    &is_output_active,
-                    &note_else_loop_active_block,
-                    &note_else_loop_check_block,
-                );
+                    .build_store(&remaining_ptr, &next_remaining_voices);
 
-                func.ctx.b.position_at_end(&note_else_loop_active_block);
+                // determine if the voice matches the note in the event, or the event doesn't have a note
                 let current_note_ptr = unsafe {
                     func.ctx.b.build_in_bounds_gep(
                         &current_notes_ptr,
@@ -1,13 +1,47 @@
-use crate::codegen::util;
-use crate::mir::block::FUNCTION_TABLE;
-use inkwell::module::Module;
-use inkwell::types::{ArrayType, VectorType};
-use inkwell::values::GlobalValue;
+use crate::codegen::{
+    build_context_function, intrinsics, util, values, BuilderContext, TargetProperties,
+};
+use crate::mir::SurfaceRef;
+use inkwell::context::Context;
+use inkwell::module::{Linkage, Module};
+use inkwell::types::{ArrayType, FunctionType, VectorType};
+use inkwell::values::{FunctionValue, GlobalValue};
+use inkwell::AddressSpace;
 
 pub const SAMPLERATE_GLOBAL_NAME: &str = "maxim.samplerate";
 pub const BPM_GLOBAL_NAME: &str = "maxim.bpm";
 pub const RAND_SEED_GLOBAL_NAME: &str = "maxim.randseed";
 pub const PROFILE_TIME_GLOBAL_NAME: &str = "maxim.profiletimes";
+pub const TASK_POOL_GLOBAL_NAME: &str = "maxim.taskpool";
+pub const ARRAY_CAPACITY_GLOBAL_NAME: &str = "maxim.arraycapacity";
+pub const BUFFER_POOL_GLOBAL_NAME: &str = "maxim.bufferpool";
+pub const IMPULSE_LIBRARY_GLOBAL_NAME: &str = "maxim.impulselibrary";
+
+/// Fields of the profile times global, which is shared with the editor. Setting the request field
+/// asks for the next tick to be profiled, and once that tick is finished the root clears it and
+/// increments the sample count.
+pub const PROFILE_REQUEST_INDEX: u64 = 0;
+pub const PROFILE_SAMPLE_COUNT_INDEX: u64 = 1;
+const PROFILE_FIELD_COUNT: u32 = 2;
+
+/// Provided by the runtime as a JIT builtin: `void(i8* pool, task_func* func, i8* data, i32 count)`.
+pub const RUN_TASKS_FUNC_NAME: &str = "maxim.runtasks";
+
+/// Provided by the runtime as JIT builtins: `i8*(i8* pool, i64 size)`, which returns a zeroed
+/// buffer or null if one isn't ready yet, and `void(i8* pool, i8* buffer, i64 size)`. Neither
+/// touches the system allocator, so they're safe to call from the audio thread.
+pub const ALLOC_BUFFER_FUNC_NAME: &str = "maxim.buffer.alloc";
+pub const FREE_BUFFER_FUNC_NAME: &str = "maxim.buffer.free";
+
+/// Provided by the runtime as a JIT builtin:
+/// `void(i8* library, i8* pool, i8* data, i32 impulse, double* samples)`, which convolves the
+/// left and right samples with an impulse from the library, replacing them with the result.
+pub const CONVOLVE_FUNC_NAME: &str = "maxim.convolve";
+
+/// Provided by the runtime as a JIT builtin: `void(i64* total, i64 time)`, which atomically adds
+/// a profiled time to a node's total, since voices running on the task pool can time the same
+/// node at once.
+pub const PROFILE_ADD_FUNC_NAME: &str = "maxim.profile.add";
 
 pub fn get_sample_rate(module: &Module) -> GlobalValue {
     util::get_or_create_global(
@@ -33,11 +67,21 @@ pub fn get_rand_seed(module: &Module) -> GlobalValue {
     )
 }
 
+/// The array capacity of the project being run, as an i32. Surfaces are built for a fixed
+/// capacity, but the library reads it from here.
+pub fn get_array_capacity(module: &Module) -> GlobalValue {
+    util::get_or_create_global(
+        module,
+        ARRAY_CAPACITY_GLOBAL_NAME,
+        &module.get_context().i32_type(),
+    )
+}
+
 fn get_profile_time_type(module: &Module) -> ArrayType {
     module
         .get_context()
         .i64_type()
-        .array_type(FUNCTION_TABLE.len() as u32)
+        .array_type(PROFILE_FIELD_COUNT)
 }
 
 pub fn get_profile_time(module: &Module) -> GlobalValue {
@@ -48,6 +92,222 @@ pub fn get_profile_time(module: &Module) -> GlobalValue {
     )
 }
 
+pub fn get_surface_profile_name(surface: SurfaceRef) -> String {
+    format!("maxim.surface.{}.profile", surface)
+}
+
+/// The cycle counts of each node in a surface, accumulated over every profiled tick. This is
+/// defined in the surface's module, so it's reset whenever the surface is rebuilt.
+pub fn get_surface_profile(module: &Module, surface: SurfaceRef, node_count: usize) -> GlobalValue {
+    let profile_type = module
+        .get_context()
+        .i64_type()
+        .array_type(node_count as u32);
+    let name = get_surface_profile_name(surface);
+    if let Some(global) = module.get_global(&name) {
+        return global;
+    }
+
+    let global = module.add_global(&profile_type, None, &name);
+    global.set_initializer(&profile_type.const_null());
+    global
+}
+
+/// Refers to the profile global of a surface from outside of the surface's module, e.g to profile
+/// a copy of the surface's update that's built into another module.
+pub fn get_external_surface_profile(
+    module: &Module,
+    surface: SurfaceRef,
+    node_count: usize,
+) -> GlobalValue {
+    let profile_type = module
+        .get_context()
+        .i64_type()
+        .array_type(node_count as u32);
+    util::get_or_create_global(module, &get_surface_profile_name(surface), &profile_type)
+}
+
+/// The type of a function that can be run on the task pool: `void(i8* data, i32 index)`.
+pub fn get_task_func_type(context: &Context) -> FunctionType {
+    context.void_type().fn_type(
+        &[
+            &context.i8_type().ptr_type(AddressSpace::Generic),
+            &context.i32_type(),
+        ],
+        false,
+    )
+}
+
+pub fn get_task_pool(module: &Module) -> GlobalValue {
+    util::get_or_create_global(
+        module,
+        TASK_POOL_GLOBAL_NAME,
+        &module
+            .get_context()
+            .i8_type()
+            .ptr_type(AddressSpace::Generic),
+    )
+}
+
+pub fn get_run_tasks_func(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, RUN_TASKS_FUNC_NAME, false, &|| {
+        let context = module.get_context();
+        (
+            Linkage::ExternalLinkage,
+            context.void_type().fn_type(
+                &[
+                    &context.i8_type().ptr_type(AddressSpace::Generic),
+                    &get_task_func_type(&context).ptr_type(AddressSpace::Generic),
+                    &context.i8_type().ptr_type(AddressSpace::Generic),
+                    &context.i32_type(),
+                ],
+                false,
+            ),
+        )
+    })
+}
+
+pub fn get_buffer_pool(module: &Module) -> GlobalValue {
+    util::get_or_create_global(
+        module,
+        BUFFER_POOL_GLOBAL_NAME,
+        &module
+            .get_context()
+            .i8_type()
+            .ptr_type(AddressSpace::Generic),
+    )
+}
+
+pub fn get_alloc_buffer_func(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, ALLOC_BUFFER_FUNC_NAME, false, &|| {
+        let context = module.get_context();
+        let ptr_type = context.i8_type().ptr_type(AddressSpace::Generic);
+        (
+            Linkage::ExternalLinkage,
+            ptr_type.fn_type(&[&ptr_type, &context.i64_type()], false),
+        )
+    })
+}
+
+pub fn get_free_buffer_func(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, FREE_BUFFER_FUNC_NAME, false, &|| {
+        let context = module.get_context();
+        let ptr_type = context.i8_type().ptr_type(AddressSpace::Generic);
+        (
+            Linkage::ExternalLinkage,
+            context
+                .void_type()
+                .fn_type(&[&ptr_type, &ptr_type, &context.i64_type()], false),
+        )
+    })
+}
+
+pub fn get_impulse_library(module: &Module) -> GlobalValue {
+    util::get_or_create_global(
+        module,
+        IMPULSE_LIBRARY_GLOBAL_NAME,
+        &module
+            .get_context()
+            .i8_type()
+            .ptr_type(AddressSpace::Generic),
+    )
+}
+
+pub fn get_convolve_func(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, CONVOLVE_FUNC_NAME, false, &|| {
+        let context = module.get_context();
+        let ptr_type = context.i8_type().ptr_type(AddressSpace::Generic);
+        (
+            Linkage::ExternalLinkage,
+            context.void_type().fn_type(
+                &[
+                    &ptr_type,
+                    &ptr_type,
+                    &ptr_type,
+                    &context.i32_type(),
+                    &context.f64_type().ptr_type(AddressSpace::Generic),
+                ],
+                false,
+            ),
+        )
+    })
+}
+
+pub fn get_profile_add_func(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, PROFILE_ADD_FUNC_NAME, false, &|| {
+        let context = module.get_context();
+        (
+            Linkage::ExternalLinkage,
+            context.void_type().fn_type(
+                &[
+                    &context.i64_type().ptr_type(AddressSpace::Generic),
+                    &context.i64_type(),
+                ],
+                false,
+            ),
+        )
+    })
+}
+
+/// Builds bodies for the buffer functions that go straight to the system allocator, for exported
+/// modules that don't have a buffer pool to take buffers from.
+pub fn build_system_buffer_funcs(module: &Module, target: &TargetProperties) {
+    build_context_function(
+        module,
+        get_alloc_buffer_func(module),
+        target,
+        &|ctx: BuilderContext| {
+            let target_data = target.machine.get_data();
+            let size_type = target_data.int_ptr_type_in_context(ctx.context);
+            let size = ctx.b.build_int_cast(
+                ctx.func.get_nth_param(1).unwrap().into_int_value(),
+                size_type,
+                "size",
+            );
+            let buffer = ctx
+                .b
+                .build_call(
+                    &intrinsics::realloc(ctx.module, &target_data),
+                    &[
+                        &ctx.context
+                            .i8_type()
+                            .ptr_type(AddressSpace::Generic)
+                            .const_null(),
+                        &size,
+                    ],
+                    "buffer",
+                    false,
+                )
+                .left()
+                .unwrap()
+                .into_pointer_value();
+            ctx.b.build_call(
+                &intrinsics::memset(ctx.module, &target_data),
+                &[
+                    &buffer,
+                    &ctx.context.i8_type().const_int(0, false),
+                    &size,
+                    &ctx.context.i32_type().const_int(0, false),
+                    &ctx.context.bool_type().const_int(0, false),
+                ],
+                "",
+                false,
+            );
+            ctx.b.build_return(Some(&buffer));
+        },
+    );
+    build_context_function(
+        module,
+        get_free_buffer_func(module),
+        target,
+        &|ctx: BuilderContext| {
+            ctx.b
+                .build_free(&ctx.func.get_nth_param(1).unwrap().into_pointer_value());
+            ctx.b.build_return(None);
+        },
+    );
+}
+
 pub fn build_globals(module: &Module) {
     let context = module.get_context();
 
@@ -57,5 +317,28 @@ pub fn build_globals(module: &Module) {
         &context.i64_type().const_int(1, false),
         &context.i64_type().const_int(31337, false),
     ]));
+    get_array_capacity(module).set_initializer(
+        &context
+            .i32_type()
+            .const_int(u64::from(values::DEFAULT_ARRAY_CAPACITY), false),
+    );
     get_profile_time(module).set_initializer(&get_profile_time_type(module).const_null());
+    get_task_pool(module).set_initializer(
+        &context
+            .i8_type()
+            .ptr_type(AddressSpace::Generic)
+            .const_null(),
+    );
+    get_buffer_pool(module).set_initializer(
+        &context
+            .i8_type()
+            .ptr_type(AddressSpace::Generic)
+            .const_null(),
+    );
+    get_impulse_library(module).set_initializer(
+        &context
+            .i8_type()
+            .ptr_type(AddressSpace::Generic)
+            .const_null(),
+    );
 }
@@ -0,0 +1,218 @@
+use crate::codegen::util;
+use inkwell::builder::Builder;
+use inkwell::context::Context;
+use inkwell::types::ArrayType;
+use inkwell::values::{PointerValue, VectorValue};
+use std::f64::consts;
+
+// Oversampled surfaces resample their sockets in stages of 2x, each with the same half-band FIR
+// filter. Every other tap of a half-band filter is zero apart from the middle one, which is 0.5,
+// so the filter has `4 * SIDE_TAPS - 1` taps but only `2 * SIDE_TAPS` of them need multiplying.
+// With a Kaiser window this gives around 52dB of rejection above 0.3 of the oversampled rate,
+// with less than 0.03dB of ripple below 0.2.
+const SIDE_TAPS: usize = 8;
+const KAISER_BETA: f64 = 5.;
+
+/// How many past inputs each upsampling stage keeps.
+const UP_HISTORY_LEN: usize = SIDE_TAPS * 2 - 1;
+
+/// How many past inputs each downsampling stage keeps: the even ones the filter taps, followed by
+/// the odd ones waiting to reach the middle tap.
+const DOWN_HISTORY_LEN: usize = SIDE_TAPS * 2 - 1 + SIDE_TAPS;
+
+pub fn get_up_history_type(context: &Context, stage_count: usize) -> ArrayType {
+    context
+        .f64_type()
+        .vec_type(2)
+        .array_type(UP_HISTORY_LEN as u32)
+        .array_type(stage_count as u32)
+}
+
+pub fn get_down_history_type(context: &Context, stage_count: usize) -> ArrayType {
+    context
+        .f64_type()
+        .vec_type(2)
+        .array_type(DOWN_HISTORY_LEN as u32)
+        .array_type(stage_count as u32)
+}
+
+fn bessel_i0(x: f64) -> f64 {
+    let mut sum = 1.;
+    let mut term = 1.;
+    for k in 1..32 {
+        term *= (x / (2. * k as f64)).powi(2);
+        sum += term;
+    }
+    sum
+}
+
+// The taps that aren't zero, from the outside in. They're symmetric, so only one side is
+// returned, and they add up to 0.25 so the whole filter has unity gain.
+fn get_side_coefficients() -> Vec<f64> {
+    let coefficients: Vec<_> = (0..SIDE_TAPS)
+        .map(|tap| {
+            let distance = (SIDE_TAPS * 2 - 1 - tap * 2) as f64;
+            let sinc = (consts::PI * distance / 2.).sin() / (consts::PI * distance / 2.);
+            let window_pos = distance / (SIDE_TAPS * 2) as f64;
+            let window = bessel_i0(KAISER_BETA * (1. - window_pos * window_pos).sqrt())
+                / bessel_i0(KAISER_BETA);
+            0.5 * sinc * window
+        })
+        .collect();
+    let total: f64 = coefficients.iter().sum();
+    coefficients.iter().map(|val| val * 0.25 / total).collect()
+}
+
+fn get_history_ptr(
+    builder: &Builder,
+    context: &Context,
+    history_ptr: PointerValue,
+    stage: usize,
+    index: usize,
+) -> PointerValue {
+    unsafe {
+        builder.build_in_bounds_gep(
+            &history_ptr,
+            &[
+                context.i32_type().const_int(0, false),
+                context.i32_type().const_int(stage as u64, false),
+                context.i32_type().const_int(index as u64, false),
+            ],
+            "",
+        )
+    }
+}
+
+fn load_history(
+    builder: &Builder,
+    context: &Context,
+    history_ptr: PointerValue,
+    stage: usize,
+    len: usize,
+) -> Vec<VectorValue> {
+    (0..len)
+        .map(|index| {
+            builder
+                .build_load(
+                    &get_history_ptr(builder, context, history_ptr, stage, index),
+                    "history",
+                )
+                .into_vector_value()
+        })
+        .collect()
+}
+
+fn store_history(
+    builder: &Builder,
+    context: &Context,
+    history_ptr: PointerValue,
+    stage: usize,
+    history: &[VectorValue],
+) {
+    for (index, value) in history.iter().enumerate() {
+        builder.build_store(
+            &get_history_ptr(builder, context, history_ptr, stage, index),
+            value,
+        );
+    }
+}
+
+// Applies the side taps to a window of values, newest first, adding the taps at the same distance
+// on each side before multiplying.
+fn build_side_taps(
+    builder: &Builder,
+    context: &Context,
+    coefficients: &[f64],
+    window: &[VectorValue],
+    gain: f64,
+) -> VectorValue {
+    coefficients
+        .iter()
+        .enumerate()
+        .map(|(tap, &coefficient)| {
+            builder.build_float_mul(
+                builder.build_float_add(window[tap], window[window.len() - 1 - tap], ""),
+                util::get_vec_spread(context, coefficient * gain),
+                "",
+            )
+        })
+        .fold(None, |acc, val| match acc {
+            Some(acc) => Some(builder.build_float_add(acc, val, "")),
+            None => Some(val),
+        })
+        .unwrap()
+}
+
+/// Upsamples the inputs by 2 for each stage, returning `inputs.len() << stage_count` values.
+/// `history_ptr` must point to a value of `get_up_history_type`.
+pub fn build_upsample(
+    builder: &Builder,
+    context: &Context,
+    history_ptr: PointerValue,
+    stage_count: usize,
+    inputs: Vec<VectorValue>,
+) -> Vec<VectorValue> {
+    let coefficients = get_side_coefficients();
+    (0..stage_count).fold(inputs, |inputs, stage| {
+        let mut history = load_history(builder, context, history_ptr, stage, UP_HISTORY_LEN);
+        let mut outputs = Vec::with_capacity(inputs.len() * 2);
+        for input in inputs {
+            history.insert(0, input);
+
+            // Zeroes are stuffed between the inputs, so the even outputs only see the side taps
+            // and the odd outputs only see the middle one. Both are doubled to make up for the
+            // zeroes.
+            outputs.push(build_side_taps(
+                builder,
+                context,
+                &coefficients,
+                &history,
+                2.,
+            ));
+            outputs.push(history[SIDE_TAPS - 1]);
+
+            history.pop();
+        }
+        store_history(builder, context, history_ptr, stage, &history);
+        outputs
+    })
+}
+
+/// Downsamples the inputs by 2 for each stage, returning `inputs.len() >> stage_count` values.
+/// `history_ptr` must point to a value of `get_down_history_type`.
+pub fn build_downsample(
+    builder: &Builder,
+    context: &Context,
+    history_ptr: PointerValue,
+    stage_count: usize,
+    inputs: Vec<VectorValue>,
+) -> Vec<VectorValue> {
+    let coefficients = get_side_coefficients();
+    (0..stage_count).rev().fold(inputs, |inputs, stage| {
+        let history = load_history(builder, context, history_ptr, stage, DOWN_HISTORY_LEN);
+        let (mut even_history, mut odd_history) = (
+            history[..SIDE_TAPS * 2 - 1].to_vec(),
+            history[SIDE_TAPS * 2 - 1..].to_vec(),
+        );
+        let mut outputs = Vec::with_capacity(inputs.len() / 2);
+        for pair in inputs.chunks(2) {
+            even_history.insert(0, pair[0]);
+            outputs.push(builder.build_float_add(
+                build_side_taps(builder, context, &coefficients, &even_history, 1.),
+                builder.build_float_mul(
+                    odd_history[SIDE_TAPS - 1],
+                    util::get_vec_spread(context, 0.5),
+                    "",
+                ),
+                "",
+            ));
+            even_history.pop();
+
+            odd_history.insert(0, pair[1]);
+            odd_history.pop();
+        }
+        even_history.extend(odd_history);
+        store_history(builder, context, history_ptr, stage, &even_history);
+        outputs
+    })
+}
@@ -77,6 +77,26 @@ pub fn ctlz_i32(module: &Module) -> FunctionValue {
     })
 }
 
+pub fn cttz_i32(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, "llvm.cttz.i32", true, &|| {
+        let i32_type = module.get_context().i32_type();
+        (
+            Linkage::ExternalLinkage,
+            i32_type.fn_type(&[&i32_type, &module.get_context().bool_type()], false),
+        )
+    })
+}
+
+pub fn ctpop_i32(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, "llvm.ctpop.i32", true, &|| {
+        let i32_type = module.get_context().i32_type();
+        (
+            Linkage::ExternalLinkage,
+            i32_type.fn_type(&[&i32_type], false),
+        )
+    })
+}
+
 pub fn eucrem_v2i32(module: &Module) -> FunctionValue {
     util::get_or_create_func(module, "maxim.eucrem.v2i32", true, &|| {
         let v2i32_type = module.get_context().i32_type().vec_type(2);
@@ -98,7 +118,7 @@ pub fn next_power_i32(module: &Module) -> FunctionValue {
 }
 
 pub fn profile_timestamp_i64(module: &Module) -> FunctionValue {
-    util::get_or_create_func(module, "profile_timestamp", false, &|| {
+    util::get_or_create_func(module, "llvm.readcyclecounter", false, &|| {
         let i64_type = module.get_context().i64_type();
         (Linkage::ExternalLinkage, i64_type.fn_type(&[], false))
     })
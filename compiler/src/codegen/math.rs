@@ -1,10 +1,10 @@
-use crate::codegen::{build_context_function, globals, util, BuilderContext, TargetProperties};
+use crate::codegen::{build_context_function, util, BuilderContext, Precision, TargetProperties};
 use inkwell::context::Context;
 use inkwell::module::{Linkage, Module};
 use inkwell::types::{BasicType, VectorType};
 use inkwell::values::InstructionOpcode;
 use inkwell::values::{FunctionValue, VectorValue};
-use inkwell::FloatPredicate;
+use inkwell::{AddressSpace, FloatPredicate};
 use std::f64::consts;
 
 // utils
@@ -30,6 +30,56 @@ fn get_i32_spread(context: &Context, val: u64) -> VectorValue {
     ])
 }
 
+fn get_f32_spread(context: &Context, val: f64) -> VectorValue {
+    let val = context.f32_type().const_float(val);
+    VectorType::const_vector(&[&val, &val, &val, &val])
+}
+
+// Single precision functions work on four lanes, since that's what the SSE conversions take. Only
+// the first two are used, and the others just mirror them.
+fn narrow_to_v4f32(ctx: &BuilderContext, x_vec: VectorValue) -> VectorValue {
+    let x_narrow = ctx
+        .b
+        .build_cast(
+            InstructionOpcode::FPTrunc,
+            &x_vec,
+            &ctx.context.f32_type().vec_type(2),
+            "",
+        )
+        .into_vector_value();
+    ctx.b.build_shuffle_vector(
+        &x_narrow,
+        &ctx.context.f32_type().vec_type(2).get_undef(),
+        &VectorType::const_vector(&[
+            &ctx.context.i32_type().const_int(0, false),
+            &ctx.context.i32_type().const_int(1, false),
+            &ctx.context.i32_type().const_int(0, false),
+            &ctx.context.i32_type().const_int(1, false),
+        ]),
+        "x.narrow",
+    )
+}
+
+fn widen_to_v2f64(ctx: &BuilderContext, x_vec: VectorValue) -> VectorValue {
+    let x_pair = ctx.b.build_shuffle_vector(
+        &x_vec,
+        &ctx.context.f32_type().vec_type(4).get_undef(),
+        &VectorType::const_vector(&[
+            &ctx.context.i32_type().const_int(0, false),
+            &ctx.context.i32_type().const_int(1, false),
+        ]),
+        "",
+    );
+    ctx.b
+        .build_cast(
+            InstructionOpcode::FPExt,
+            &x_pair,
+            &ctx.context.f64_type().vec_type(2),
+            "x.wide",
+        )
+        .into_vector_value()
+}
+
 pub fn build_math_functions(module: &Module, target: &TargetProperties) {
     build_rand_v2f64(module, target);
     build_sin_v2f64(module, target);
@@ -59,10 +109,20 @@ pub fn build_math_functions(module: &Module, target: &TargetProperties) {
 }
 
 // rand
+// Takes a pointer to the seed to advance, so callers running on different threads can each have
+// their own.
 pub fn rand_v2f64(module: &Module) -> FunctionValue {
     util::get_or_create_func(module, "maxim.rand.v2f64", true, &|| {
-        let v2f64_type = module.get_context().f64_type().vec_type(2);
-        (Linkage::PrivateLinkage, v2f64_type.fn_type(&[], false))
+        let context = module.get_context();
+        let v2f64_type = context.f64_type().vec_type(2);
+        let seed_ptr_type = context
+            .i64_type()
+            .vec_type(2)
+            .ptr_type(AddressSpace::Generic);
+        (
+            Linkage::PrivateLinkage,
+            v2f64_type.fn_type(&[&seed_ptr_type], false),
+        )
     })
 }
 
@@ -85,7 +145,7 @@ fn build_rand_v2f64(module: &Module, target: &TargetProperties) {
                         ),
                     )
                 });
-            let seed_ptr = globals::get_rand_seed(ctx.module).as_pointer_value();
+            let seed_ptr = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
 
             let current_seed = ctx.b.build_load(&seed_ptr, "seed").into_vector_value();
             let new_seed = ctx
@@ -194,18 +254,28 @@ fn build_sin_v2f64(module: &Module, target: &TargetProperties) {
             )
             .into_vector_value();
 
+        // the approximation isn't precise enough to need doubles, so it can use singles if the
+        // target allows it
+        let is_single = ctx.target.precision == Precision::Single;
+        let (wrapped_x, abs_intrinsic) = if is_single {
+            (narrow_to_v4f32(&ctx, wrapped_x), abs_v4f32(module))
+        } else {
+            (wrapped_x, abs_intrinsic)
+        };
+        let spread = |val: f64| {
+            if is_single {
+                get_f32_spread(ctx.context, val)
+            } else {
+                util::get_vec_spread(ctx.context, val)
+            }
+        };
+
         let y_val = ctx.b.build_float_add(
+            ctx.b
+                .build_float_mul(spread(1.273_239_544_723_765), wrapped_x, ""),
             ctx.b.build_float_mul(
-                util::get_vec_spread(ctx.context, 1.273_239_544_723_765),
-                wrapped_x,
-                "",
-            ),
-            ctx.b.build_float_mul(
-                ctx.b.build_float_mul(
-                    util::get_vec_spread(ctx.context, -0.405_284_734_566_521_37),
-                    wrapped_x,
-                    "",
-                ),
+                ctx.b
+                    .build_float_mul(spread(-0.405_284_734_566_521_37), wrapped_x, ""),
                 ctx.b
                     .build_call(&abs_intrinsic, &[&wrapped_x], "", true)
                     .left()
@@ -218,7 +288,7 @@ fn build_sin_v2f64(module: &Module, target: &TargetProperties) {
 
         let result = ctx.b.build_float_add(
             ctx.b.build_float_mul(
-                util::get_vec_spread(ctx.context, 0.224_999_904_632_568_36),
+                spread(0.224_999_904_632_568_36),
                 ctx.b.build_float_sub(
                     ctx.b.build_float_mul(
                         y_val,
@@ -237,6 +307,11 @@ fn build_sin_v2f64(module: &Module, target: &TargetProperties) {
             y_val,
             "res",
         );
+        let result = if is_single {
+            widen_to_v2f64(&ctx, result)
+        } else {
+            result
+        };
 
         ctx.b.build_return(Some(&result));
     })
@@ -516,6 +591,16 @@ pub fn abs_v2f64(module: &Module) -> FunctionValue {
     })
 }
 
+pub fn abs_v4f32(module: &Module) -> FunctionValue {
+    util::get_or_create_func(module, "llvm.fabs.v4f32", true, &|| {
+        let v4f32_type = module.get_context().f32_type().vec_type(4);
+        (
+            Linkage::ExternalLinkage,
+            v4f32_type.fn_type(&[&v4f32_type], false),
+        )
+    })
+}
+
 // copysign
 pub fn copysign_v2f64(module: &Module) -> FunctionValue {
     util::get_or_create_func(module, "llvm.copysign.v2f64", true, &|| {
@@ -764,6 +849,13 @@ fn build_exp2_v2f64(module: &Module, target: &TargetProperties) {
         exp2_v2f64(module),
         target,
         &|ctx: BuilderContext| {
+            if ctx.target.precision == Precision::Single {
+                let x_vec = ctx.func.get_nth_param(0).unwrap().into_vector_value();
+                let res = build_exp2_single(&ctx, x_vec);
+                ctx.b.build_return(Some(&res));
+                return;
+            }
+
             let cvtpd_intrinsic =
                 util::get_or_create_func(module, "llvm.x86.sse2.cvtpd2dq", true, &|| {
                     (
@@ -853,6 +945,94 @@ fn build_exp2_v2f64(module: &Module, target: &TargetProperties) {
     )
 }
 
+fn build_exp2_single(ctx: &BuilderContext, x_vec: VectorValue) -> VectorValue {
+    let v4f32_type = ctx.context.f32_type().vec_type(4);
+    let v4i32_type = ctx.context.i32_type().vec_type(4);
+    let cvtps_intrinsic =
+        util::get_or_create_func(ctx.module, "llvm.x86.sse2.cvtps2dq", true, &|| {
+            (
+                Linkage::ExternalLinkage,
+                v4i32_type.fn_type(&[&v4f32_type], false),
+            )
+        });
+
+    // keep the exponent in the range of a single, so building it below can't overflow
+    let x_vec = narrow_to_v4f32(ctx, x_vec);
+    let x_vec = ctx
+        .b
+        .build_select(
+            ctx.b.build_float_compare(
+                FloatPredicate::OGT,
+                x_vec,
+                get_f32_spread(ctx.context, 127.),
+                "",
+            ),
+            get_f32_spread(ctx.context, 127.),
+            x_vec,
+            "",
+        )
+        .into_vector_value();
+    let x_vec = ctx
+        .b
+        .build_select(
+            ctx.b.build_float_compare(
+                FloatPredicate::OLT,
+                x_vec,
+                get_f32_spread(ctx.context, -126.),
+                "",
+            ),
+            get_f32_spread(ctx.context, -126.),
+            x_vec,
+            "x.clamped",
+        )
+        .into_vector_value();
+
+    let x_int_vec = ctx
+        .b
+        .build_call(&cvtps_intrinsic, &[&x_vec], "", true)
+        .left()
+        .unwrap()
+        .into_vector_value();
+    let x_frac = ctx.b.build_float_sub(
+        x_vec,
+        ctx.b.build_signed_int_to_float(x_int_vec, v4f32_type, ""),
+        "x.frac",
+    );
+
+    let mad = |r: VectorValue, exp: f64| {
+        ctx.b.build_float_add(
+            ctx.b.build_float_mul(r, x_frac, ""),
+            get_f32_spread(ctx.context, exp),
+            "",
+        )
+    };
+
+    // coefficients for singles with x.frac in -0.5..0.5
+    let r = get_f32_spread(ctx.context, 1.535_336_188_319_5e-4); // const 0
+    let r = mad(r, 1.339_887_440_266_574e-3); // const 1
+    let r = mad(r, 9.618_437_357_674_64e-3); // const 2
+    let r = mad(r, 5.550_332_471_162_809e-2); // const 3
+    let r = mad(r, 2.402_264_791_363_012e-1); // const 4
+    let r = mad(r, 6.931_472_028_550_421e-1); // const 5
+    let r = mad(r, 1.); // const 6
+
+    let k = ctx
+        .b
+        .build_int_add(x_int_vec, get_i32_spread(ctx.context, 127), "");
+    let k = ctx
+        .b
+        .build_left_shift(k, get_i32_spread(ctx.context, 23), "");
+    let res = ctx.b.build_float_mul(
+        r,
+        ctx.b
+            .build_cast(InstructionOpcode::BitCast, &k, &v4f32_type, "k.float")
+            .into_vector_value(),
+        "",
+    );
+
+    widen_to_v2f64(ctx, res)
+}
+
 // exp10
 pub fn exp10_v2f64(module: &Module) -> FunctionValue {
     util::get_or_create_func(module, "maxim.exp10.v2f64", true, &|| {
@@ -944,6 +1124,12 @@ fn build_log2_v2f64(module: &Module, target: &TargetProperties) {
         target,
         &|ctx: BuilderContext| {
             let x_vec = ctx.func.get_nth_param(0).unwrap().into_vector_value();
+            if ctx.target.precision == Precision::Single {
+                let res = build_log2_single(&ctx, x_vec);
+                ctx.b.build_return(Some(&res));
+                return;
+            }
+
             let x_int_vec = ctx
                 .b
                 .build_cast(
@@ -1036,6 +1222,70 @@ fn build_log2_v2f64(module: &Module, target: &TargetProperties) {
     );
 }
 
+fn build_log2_single(ctx: &BuilderContext, x_vec: VectorValue) -> VectorValue {
+    let v4f32_type = ctx.context.f32_type().vec_type(4);
+    let x_vec = narrow_to_v4f32(ctx, x_vec);
+    let x_int_vec = ctx
+        .b
+        .build_cast(
+            InstructionOpcode::BitCast,
+            &x_vec,
+            &ctx.context.i32_type().vec_type(4),
+            "x.int",
+        )
+        .into_vector_value();
+
+    let min_exp = 127;
+    let exp_o = min_exp << 23;
+    let exp_a = u64::from(u32::max_value() >> 9);
+
+    let ilogb_x = ctx.b.build_int_sub(
+        ctx.b
+            .build_right_shift(x_int_vec, get_i32_spread(ctx.context, 23), false, ""),
+        get_i32_spread(ctx.context, min_exp),
+        "x.ilogb",
+    );
+
+    let p_int = ctx.b.build_or(
+        ctx.b
+            .build_and(x_int_vec, get_i32_spread(ctx.context, exp_a), ""),
+        get_i32_spread(ctx.context, exp_o),
+        "p.int",
+    );
+    let p_float = ctx
+        .b
+        .build_cast(InstructionOpcode::BitCast, &p_int, &v4f32_type, "p.float")
+        .into_vector_value();
+    let y = ctx.b.build_float_div(
+        ctx.b
+            .build_float_sub(p_float, get_f32_spread(ctx.context, 1.), ""),
+        ctx.b
+            .build_float_add(p_float, get_f32_spread(ctx.context, 1.), ""),
+        "y",
+    );
+    let y2 = ctx.b.build_float_mul(y, y, "y2");
+
+    let mad = |r: VectorValue, exp: f64| {
+        ctx.b.build_float_add(
+            ctx.b.build_float_mul(r, y2, ""),
+            get_f32_spread(ctx.context, exp),
+            "",
+        )
+    };
+
+    let r = get_f32_spread(ctx.context, 0.410_981_538_279_884_26); // const 0
+    let r = mad(r, 0.402_155_483_170_645_3); // const 1
+    let r = mad(r, 0.577_550_146_270_368_7); // const 2
+    let r = mad(r, 0.961_787_806_001_666_5); // const 3
+    let r = mad(r, 2.885_390_127_834_398_3); // const 4
+
+    let r = ctx.b.build_float_mul(r, y, "");
+    let ilogb_float = ctx.b.build_signed_int_to_float(ilogb_x, v4f32_type, "");
+    let r = ctx.b.build_float_add(r, ilogb_float, "");
+
+    widen_to_v2f64(ctx, r)
+}
+
 // log10
 pub fn log10_v2f64(module: &Module) -> FunctionValue {
     util::get_or_create_func(module, "maxim.log10.v2f64", true, &|| {
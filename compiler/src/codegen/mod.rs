@@ -1,11 +1,14 @@
 pub mod block;
+mod branch_plan;
 mod builder_context;
+pub mod control_rate;
 pub mod controls;
 pub mod converters;
 pub mod data_analyzer;
 pub mod editor;
 pub mod functions;
 pub mod globals;
+mod half_band;
 pub mod intrinsics;
 pub mod math;
 mod module_iterator;
@@ -22,7 +25,7 @@ pub use self::builder_context::{build_context_function, BuilderContext};
 pub use self::module_iterator::{ModuleFunctionIterator, ModuleGlobalIterator};
 pub use self::object_cache::ObjectCache;
 pub use self::optimizer::Optimizer;
-pub use self::target_properties::{OptimizationLevel, TargetProperties};
+pub use self::target_properties::{OptimizationLevel, Precision, TargetProperties};
 
 use std::fmt;
 
@@ -1,5 +1,5 @@
 use crate::codegen::{data_analyzer, TargetProperties};
-use crate::mir::{Block, BlockRef, Surface, SurfaceRef};
+use crate::mir::{Block, BlockRef, ConstantNum, Surface, SurfaceRef};
 use inkwell::context::Context;
 
 pub trait ObjectCache {
@@ -14,4 +14,10 @@ pub trait ObjectCache {
     fn block_mir(&self, id: BlockRef) -> Option<&Block>;
 
     fn block_layout(&self, id: BlockRef) -> Option<&data_analyzer::BlockLayout>;
+
+    /// Values of audio controls that the block's update function is specialized on, as pairs of
+    /// control index and value.
+    fn block_specialization(&self, _id: BlockRef) -> Option<&[(usize, ConstantNum)]> {
+        None
+    }
 }
@@ -1,4 +1,4 @@
-use crate::codegen::{ModuleFunctionIterator, TargetProperties};
+use crate::codegen::{ModuleFunctionIterator, OptimizationLevel, TargetProperties};
 use inkwell::module::Module;
 use inkwell::passes::{PassManager, PassManagerBuilder};
 
@@ -10,8 +10,13 @@ pub struct Optimizer {
 
 impl Optimizer {
     pub fn new(target: &TargetProperties) -> Self {
+        Optimizer::new_with_level(target, target.optimization_level)
+    }
+
+    /// Creates an optimizer that runs a different pipeline to the one the target asks for.
+    pub fn new_with_level(target: &TargetProperties, level: OptimizationLevel) -> Self {
         let builder = PassManagerBuilder::create();
-        let opt_specification = target.optimization_level.into_specification();
+        let opt_specification = level.into_specification();
         builder.set_optimization_level(opt_specification.llvm_level);
         builder.set_size_level(opt_specification.size_level);
         builder.set_inliner_with_threshold(opt_specification.inliner_threshold);
@@ -1,14 +1,15 @@
+use crate::ast::FormType;
 use crate::codegen::data_analyzer::{PointerSource, PointerSourceAggregateType};
-use crate::codegen::values::remap_type;
+use crate::codegen::values::{remap_type, NumValue};
 use crate::codegen::{
-    build_context_function, surface, util, BuilderContext, LifecycleFunc, ObjectCache,
+    build_context_function, globals, surface, util, BuilderContext, LifecycleFunc, ObjectCache,
 };
-use crate::mir::{Root, SurfaceRef};
+use crate::mir::{Root, SurfaceRef, VarType};
 use inkwell::context::Context;
 use inkwell::module::{Linkage, Module};
 use inkwell::types::BasicType;
 use inkwell::values::{BasicValue, BasicValueEnum, GlobalValue, IntValue, PointerValue};
-use inkwell::AddressSpace;
+use inkwell::{AddressSpace, IntPredicate};
 use std::iter;
 
 fn get_gep_indices(context: &Context, path: impl IntoIterator<Item = u64>) -> Vec<IntValue> {
@@ -192,12 +193,59 @@ pub fn build_lifecycle_func(
             module.get_context().void_type().fn_type(&[], false),
         )
     });
-    build_context_function(module, func, cache.target(), &|ctx: BuilderContext| {
+    build_context_function(module, func, cache.target(), &|mut ctx: BuilderContext| {
         surface::build_lifecycle_call(module, cache, ctx.b, surface, lifecycle, pointers);
+        if lifecycle == LifecycleFunc::Update && cache.target().include_ui {
+            build_finish_profile_sample(&mut ctx);
+        }
         ctx.b.build_return(None);
     });
 }
 
+/// Marks the tick as profiled if the editor asked for it, and clears the request so only the one
+/// tick is timed.
+fn build_finish_profile_sample(ctx: &mut BuilderContext) {
+    let profile_ptr = globals::get_profile_time(ctx.module).as_pointer_value();
+    let request_ptr = unsafe {
+        ctx.b.build_in_bounds_gep(
+            &profile_ptr,
+            &get_gep_indices(ctx.context, iter::once(globals::PROFILE_REQUEST_INDEX)),
+            "profile.request.ptr",
+        )
+    };
+    let sample_count_ptr = unsafe {
+        ctx.b.build_in_bounds_gep(
+            &profile_ptr,
+            &get_gep_indices(ctx.context, iter::once(globals::PROFILE_SAMPLE_COUNT_INDEX)),
+            "profile.samplecount.ptr",
+        )
+    };
+
+    let request = ctx
+        .b
+        .build_load(&request_ptr, "profile.request")
+        .into_int_value();
+    let is_sampled = ctx.b.build_int_compare(
+        IntPredicate::NE,
+        request,
+        ctx.context.i64_type().const_int(0, false),
+        "profile.sampled",
+    );
+    let sample_increment =
+        ctx.b
+            .build_int_z_extend(is_sampled, ctx.context.i64_type(), "profile.increment");
+    let sample_count = ctx
+        .b
+        .build_load(&sample_count_ptr, "profile.samplecount")
+        .into_int_value();
+    let new_sample_count =
+        ctx.b
+            .build_int_add(sample_count, sample_increment, "profile.newsamplecount");
+    ctx.b.build_store(&sample_count_ptr, &new_sample_count);
+    ctx.b
+        .build_store(&request_ptr, &ctx.context.i64_type().const_int(0, false));
+}
+
 pub fn build_funcs(
     module: &Module,
     cache: &ObjectCache,
@@ -264,3 +312,219 @@ pub fn build_socket_accessor_func(
         ctx.b.build_return(Some(&socket_ptr));
     });
 }
+
+struct BlockSocket {
+    value: NumValue,
+    inputs: [PointerValue; 2],
+    outputs: [PointerValue; 2],
+}
+
+fn load_buffer_ptr(ctx: &mut BuilderContext, buffers: PointerValue, index: u64) -> PointerValue {
+    let buffer_ptr_ptr = unsafe {
+        ctx.b.build_in_bounds_gep(
+            &buffers,
+            &[ctx.context.i64_type().const_int(index, false)],
+            "buffer.ptr",
+        )
+    };
+    ctx.b
+        .build_load(&buffer_ptr_ptr, "buffer")
+        .into_pointer_value()
+}
+
+fn build_read_sample(
+    ctx: &mut BuilderContext,
+    value: &NumValue,
+    channel: u64,
+    buffer: PointerValue,
+    offset: IntValue,
+) {
+    let read_block = ctx.context.append_basic_block(&ctx.func, "sample.read");
+    let continue_block = ctx
+        .context
+        .append_basic_block(&ctx.func, "sample.readcontinue");
+
+    let is_unbound = ctx.b.build_is_null(buffer, "unbound");
+    ctx.b
+        .build_conditional_branch(&is_unbound, &continue_block, &read_block);
+    ctx.b.position_at_end(&read_block);
+
+    let sample_ptr = unsafe { ctx.b.build_in_bounds_gep(&buffer, &[offset], "sample.ptr") };
+    let sample = ctx.b.build_load(&sample_ptr, "sample").into_float_value();
+    let sample = ctx.b.build_float_ext(sample, ctx.context.f64_type(), "");
+    let vec = value.get_vec(ctx.b);
+    let vec = ctx.b.build_insert_element(
+        &vec,
+        &sample,
+        &ctx.context.i32_type().const_int(channel, false),
+        "",
+    );
+    value.set_vec(ctx.b, vec);
+    value.set_form(
+        ctx.b,
+        ctx.context
+            .i8_type()
+            .const_int(FormType::Oscillator as u64, false),
+    );
+    ctx.b.build_unconditional_branch(&continue_block);
+    ctx.b.position_at_end(&continue_block);
+}
+
+fn build_write_sample(
+    ctx: &mut BuilderContext,
+    value: &NumValue,
+    channel: u64,
+    buffer: PointerValue,
+    offset: IntValue,
+) {
+    let write_block = ctx.context.append_basic_block(&ctx.func, "sample.write");
+    let continue_block = ctx
+        .context
+        .append_basic_block(&ctx.func, "sample.writecontinue");
+
+    let is_unbound = ctx.b.build_is_null(buffer, "unbound");
+    ctx.b
+        .build_conditional_branch(&is_unbound, &continue_block, &write_block);
+    ctx.b.position_at_end(&write_block);
+
+    let vec = value.get_vec(ctx.b);
+    let sample = ctx
+        .b
+        .build_extract_element(&vec, &ctx.context.i32_type().const_int(channel, false), "")
+        .into_float_value();
+    let sample = ctx
+        .b
+        .build_float_trunc(sample, ctx.context.f32_type(), "sample");
+    let sample_ptr = unsafe { ctx.b.build_in_bounds_gep(&buffer, &[offset], "sample.ptr") };
+    ctx.b.build_store(&sample_ptr, &sample);
+    ctx.b.build_unconditional_branch(&continue_block);
+    ctx.b.position_at_end(&continue_block);
+}
+
+/// Builds a function that runs the update lifecycle `frames` times, streaming number sockets in
+/// from and out to planar float buffers. The function takes the frame count, the stride between
+/// consecutive samples in a buffer, and arrays of input and output buffer pointers. Both arrays
+/// have two entries (left and right) per socket, and null entries are left unbound.
+pub fn build_update_block_func(
+    module: &Module,
+    cache: &ObjectCache,
+    root: &Root,
+    func_name: &str,
+    sockets: PointerValue,
+    pointers: PointerValue,
+) {
+    let func = util::get_or_create_func(module, func_name, false, &|| {
+        let context = module.get_context();
+        let buffers_type = context
+            .f32_type()
+            .ptr_type(AddressSpace::Generic)
+            .ptr_type(AddressSpace::Generic);
+        (
+            Linkage::ExternalLinkage,
+            context.void_type().fn_type(
+                &[
+                    &context.i64_type(),
+                    &context.i64_type(),
+                    &buffers_type,
+                    &buffers_type,
+                ],
+                false,
+            ),
+        )
+    });
+    build_context_function(module, func, cache.target(), &|mut ctx: BuilderContext| {
+        let frames = ctx.func.get_nth_param(0).unwrap().into_int_value();
+        let stride = ctx.func.get_nth_param(1).unwrap().into_int_value();
+        let inputs = ctx.func.get_nth_param(2).unwrap().into_pointer_value();
+        let outputs = ctx.func.get_nth_param(3).unwrap().into_pointer_value();
+
+        // the buffer pointers don't change during the block, so only load them once
+        let mut block_sockets = Vec::new();
+        for (socket_index, socket_type) in root.sockets.iter().enumerate() {
+            if *socket_type != VarType::Num {
+                continue;
+            }
+
+            let buffer_index = socket_index as u64 * 2;
+            let value = NumValue::new(unsafe {
+                ctx.b
+                    .build_struct_gep(&sockets, socket_index as u32, "socket")
+            });
+            let socket_inputs = [
+                load_buffer_ptr(&mut ctx, inputs, buffer_index),
+                load_buffer_ptr(&mut ctx, inputs, buffer_index + 1),
+            ];
+            let socket_outputs = [
+                load_buffer_ptr(&mut ctx, outputs, buffer_index),
+                load_buffer_ptr(&mut ctx, outputs, buffer_index + 1),
+            ];
+            block_sockets.push(BlockSocket {
+                value,
+                inputs: socket_inputs,
+                outputs: socket_outputs,
+            });
+        }
+
+        let index_ptr = ctx
+            .allocb
+            .build_alloca(&ctx.context.i64_type(), "frameindex.ptr");
+        ctx.b
+            .build_store(&index_ptr, &ctx.context.i64_type().const_int(0, false));
+
+        let check_block = ctx.context.append_basic_block(&ctx.func, "frame.check");
+        let run_block = ctx.context.append_basic_block(&ctx.func, "frame.run");
+        let end_block = ctx.context.append_basic_block(&ctx.func, "frame.end");
+
+        ctx.b.build_unconditional_branch(&check_block);
+        ctx.b.position_at_end(&check_block);
+
+        let current_index = ctx.b.build_load(&index_ptr, "frameindex").into_int_value();
+        let can_continue_loop =
+            ctx.b
+                .build_int_compare(IntPredicate::ULT, current_index, frames, "cancontinue");
+        ctx.b
+            .build_conditional_branch(&can_continue_loop, &run_block, &end_block);
+        ctx.b.position_at_end(&run_block);
+
+        let next_index = ctx.b.build_int_nuw_add(
+            current_index,
+            ctx.context.i64_type().const_int(1, false),
+            "nextindex",
+        );
+        ctx.b.build_store(&index_ptr, &next_index);
+        let offset = ctx.b.build_int_nuw_mul(current_index, stride, "offset");
+
+        for socket in &block_sockets {
+            for channel in 0..2 {
+                build_read_sample(
+                    &mut ctx,
+                    &socket.value,
+                    channel as u64,
+                    socket.inputs[channel],
+                    offset,
+                );
+            }
+        }
+
+        surface::build_lifecycle_call(module, cache, ctx.b, 0, LifecycleFunc::Update, pointers);
+        if cache.target().include_ui {
+            build_finish_profile_sample(&mut ctx);
+        }
+
+        for socket in &block_sockets {
+            for channel in 0..2 {
+                build_write_sample(
+                    &mut ctx,
+                    &socket.value,
+                    channel as u64,
+                    socket.outputs[channel],
+                    offset,
+                );
+            }
+        }
+
+        ctx.b.build_unconditional_branch(&check_block);
+        ctx.b.position_at_end(&end_block);
+        ctx.b.build_return(None);
+    });
+}
@@ -1,12 +1,21 @@
+use crate::codegen::branch_plan::{plan_branches, BranchPlan};
 use crate::codegen::{
-    block, build_context_function, util, values, BuilderContext, LifecycleFunc, ObjectCache,
+    block, build_context_function, data_analyzer, globals, half_band, intrinsics, util, values,
+    BuilderContext, LifecycleFunc, ObjectCache,
 };
-use crate::mir::{Node, NodeData, Surface, SurfaceRef};
+use crate::mir::{Node, NodeData, Surface, SurfaceRef, VarType};
 use inkwell::attribute::AttrKind;
+use inkwell::basic_block::BasicBlock;
 use inkwell::builder::Builder;
+use inkwell::context::Context;
 use inkwell::module::{Linkage, Module};
-use inkwell::values::{FunctionValue, PointerValue};
-use inkwell::{AddressSpace, IntPredicate};
+use inkwell::types::{BasicType, PointerType, StructType};
+use inkwell::values::{BasicValue, FunctionValue, IntValue, PointerValue, VectorValue};
+use inkwell::{AddressSpace, FloatPredicate, IntPredicate};
+
+// How far a socket's value can move from where it was when the surface went quiet, while still
+// counting as quiet. This is around -90dB, below the noise floor of most audio.
+const QUIET_THRESHOLD: f64 = 3e-5;
 
 fn get_lifecycle_func(
     module: &Module,
@@ -30,6 +39,92 @@ fn get_lifecycle_func(
     func
 }
 
+/// The data passed to voice tasks: a pointer to the voice pointers of the group, and a list of
+/// the active voice indices. Task `n` runs the voice at index `n` in the list.
+fn get_voice_task_type(context: &Context, voices_type: PointerType, capacity: u8) -> StructType {
+    context.struct_type(
+        &[
+            &voices_type,
+            &context.i8_type().array_type(u32::from(capacity)),
+        ],
+        false,
+    )
+}
+
+fn get_voice_task_func(
+    module: &Module,
+    cache: &ObjectCache,
+    surface: SurfaceRef,
+    voices_type: PointerType,
+) -> FunctionValue {
+    let func_name = format!("maxim.surface.{}.voicetask", surface);
+    if let Some(func) = module.get_function(&func_name) {
+        return func;
+    }
+
+    let context = module.get_context();
+    let func = module.add_function(
+        &func_name,
+        &globals::get_task_func_type(&context),
+        Some(&Linkage::PrivateLinkage),
+    );
+    build_context_function(module, func, cache.target(), &|ctx: BuilderContext| {
+        let data_ptr = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
+        let task_index = ctx.func.get_nth_param(1).unwrap().into_int_value();
+
+        let task_ptr = ctx.b.build_pointer_cast(
+            data_ptr,
+            get_voice_task_type(ctx.context, voices_type, cache.target().array_capacity)
+                .ptr_type(AddressSpace::Generic),
+            "task",
+        );
+        let voices = ctx
+            .b
+            .build_load(
+                &unsafe { ctx.b.build_struct_gep(&task_ptr, 0, "voices.ptr") },
+                "voices",
+            )
+            .into_pointer_value();
+
+        let const_zero = ctx.context.i32_type().const_int(0, false);
+        let voice_index = ctx
+            .b
+            .build_load(
+                &unsafe {
+                    ctx.b.build_in_bounds_gep(
+                        &task_ptr,
+                        &[
+                            const_zero,
+                            ctx.context.i32_type().const_int(1, false),
+                            task_index,
+                        ],
+                        "voiceindex.ptr",
+                    )
+                },
+                "voiceindex",
+            )
+            .into_int_value();
+        let voice_index_32 = ctx
+            .b
+            .build_int_z_extend(voice_index, ctx.context.i32_type(), "");
+        let voice_pointers_ptr = unsafe {
+            ctx.b
+                .build_in_bounds_gep(&voices, &[const_zero, voice_index_32], "pointersptr")
+        };
+
+        build_lifecycle_call(
+            ctx.module,
+            cache,
+            ctx.b,
+            surface,
+            LifecycleFunc::Update,
+            voice_pointers_ptr,
+        );
+        ctx.b.build_return(None);
+    });
+    func
+}
+
 fn build_node_call(
     ctx: &mut BuilderContext,
     cache: &ObjectCache,
@@ -61,7 +156,9 @@ fn build_node_call(
             surface: surface_id,
             source_sockets,
             dest_sockets,
+            parallel,
         } => {
+            let parallel = *parallel && !node_contains_oversampling(cache, node);
             let voice_pointers = unsafe { ctx.b.build_struct_gep(&pointers_ptr, 0, "voices.ptr") };
             let source_socket_pointers =
                 unsafe { ctx.b.build_struct_gep(&pointers_ptr, 1, "sources.ptr") };
@@ -70,6 +167,10 @@ fn build_node_call(
             let bitmap_pointer =
                 unsafe { ctx.b.build_struct_gep(&pointers_ptr, 3, "bitmap.ptr.ptr") };
 
+            // the group only has scratch for as many voices as the project's capacity
+            let full_bitmap =
+                values::ArrayValue::get_full_bitmap(ctx.context, cache.target().array_capacity);
+
             // if this is the update lifecycle function and there are source groups, generate a
             // bitmap of which indices are valid
             let valid_bitmap = if lifecycle == LifecycleFunc::Update && !source_sockets.is_empty() {
@@ -102,6 +203,10 @@ fn build_node_call(
                         let nth_bitmap = nth_array.get_bitmap(ctx.b);
                         ctx.b.build_and(acc, nth_bitmap, "")
                     });
+
+                // Arrays are limited to the capacity where they're built, but array values have
+                // room for more items, so anything past the last voice is masked off to be safe.
+                let active_bitmap = ctx.b.build_and(active_bitmap, full_bitmap, "activebitmap");
                 ctx.b.build_store(
                     &ctx.b
                         .build_load(&bitmap_pointer, "bitmap.ptr")
@@ -114,87 +219,201 @@ fn build_node_call(
                 None
             };
 
-            // build a for loop to iterate over each instance
-            let index_ptr = ctx
+            // Voices of parallel groups aren't run inside the loop. Instead their indices are
+            // collected into a list, which is handed to the task pool after the loop.
+            let voice_task = if parallel && lifecycle == LifecycleFunc::Update {
+                let task_type = get_voice_task_type(
+                    ctx.context,
+                    voice_pointers.get_type(),
+                    cache.target().array_capacity,
+                );
+                let task_ptr = ctx.allocb.build_alloca(&task_type, "voicetask.ptr");
+                let count_ptr = ctx
+                    .allocb
+                    .build_alloca(&ctx.context.i32_type(), "voicecount.ptr");
+                ctx.b.build_store(
+                    &unsafe { ctx.b.build_struct_gep(&task_ptr, 0, "voices.ptr") },
+                    &voice_pointers,
+                );
+                ctx.b
+                    .build_store(&count_ptr, &ctx.context.i32_type().const_int(0, false));
+                Some((task_ptr, count_ptr))
+            } else {
+                None
+            };
+
+            // Iterate over the active voices by taking the lowest set bit from a bitmap of the
+            // voices left to run, so voices that aren't active don't cost anything.
+            let remaining_ptr = ctx
                 .allocb
-                .build_alloca(&ctx.context.i8_type(), "voiceindex.ptr");
+                .build_alloca(&ctx.context.i32_type(), "voicesleft.ptr");
             ctx.b
-                .build_store(&index_ptr, &ctx.context.i8_type().const_int(0, false));
+                .build_store(&remaining_ptr, &valid_bitmap.unwrap_or(full_bitmap));
 
             let check_block = ctx.context.append_basic_block(&ctx.func, "voice.check");
-            let check_active_block = ctx
-                .context
-                .append_basic_block(&ctx.func, "voice.checkactive");
             let run_block = ctx.context.append_basic_block(&ctx.func, "voice.run");
             let end_block = ctx.context.append_basic_block(&ctx.func, "voice.end");
 
-            ctx.b.build_unconditional_branch(&check_block);
-            ctx.b.position_at_end(&check_block);
+            // Voices of groups that aren't parallel are updated a register's worth at a time while
+            // there are enough of them left, and whatever is left over runs one voice at a time.
+            let lane_count = cache.target().voice_lanes as usize;
+            if voice_task.is_none()
+                && lifecycle == LifecycleFunc::Update
+                && lane_count > 1
+                && can_update_lanes(cache, *surface_id)
+            {
+                let lanes_check_block = ctx
+                    .context
+                    .append_basic_block(&ctx.func, "voice.lanes.check");
+                let lanes_run_block = ctx.context.append_basic_block(&ctx.func, "voice.lanes.run");
 
-            let current_index = ctx.b.build_load(&index_ptr, "voiceindex").into_int_value();
-            let iter_limit = ctx
-                .context
-                .i8_type()
-                .const_int(u64::from(values::ARRAY_CAPACITY), false);
-            let can_continue_loop = ctx.b.build_int_compare(
-                IntPredicate::ULT,
-                current_index,
-                iter_limit,
-                "cancontinue",
-            );
-
-            ctx.b
-                .build_conditional_branch(&can_continue_loop, &check_active_block, &end_block);
-            ctx.b.position_at_end(&check_active_block);
-
-            // increment the stored value
-            let next_index = ctx.b.build_int_nuw_add(
-                current_index,
-                ctx.context.i8_type().const_int(1, false),
-                "nextindex",
-            );
-            ctx.b.build_store(&index_ptr, &next_index);
+                ctx.b.build_unconditional_branch(&lanes_check_block);
+                ctx.b.position_at_end(&lanes_check_block);
 
-            let index_32 = ctx
-                .b
-                .build_int_z_extend(current_index, ctx.context.i32_type(), "");
-            if let Some(active_bitmap) = valid_bitmap {
-                // check if this iteration is active according to the bitmap
-                let active_bit = util::get_bit(ctx.b, active_bitmap, index_32);
+                let remaining_voices = ctx
+                    .b
+                    .build_load(&remaining_ptr, "voicesleft")
+                    .into_int_value();
+                let remaining_count = ctx
+                    .b
+                    .build_call(
+                        &intrinsics::ctpop_i32(ctx.module),
+                        &[&remaining_voices],
+                        "voicesleft.count",
+                        false,
+                    )
+                    .left()
+                    .unwrap()
+                    .into_int_value();
+                let has_lanes = ctx.b.build_int_compare(
+                    IntPredicate::UGE,
+                    remaining_count,
+                    ctx.context.i32_type().const_int(lane_count as u64, false),
+                    "haslanes",
+                );
                 ctx.b
-                    .build_conditional_branch(&active_bit, &run_block, &check_block);
+                    .build_conditional_branch(&has_lanes, &lanes_run_block, &check_block);
+                ctx.b.position_at_end(&lanes_run_block);
+
+                let const_zero = ctx.context.i32_type().const_int(0, false);
+                let mut next_remaining_voices = remaining_voices;
+                let mut lane_pointers = Vec::new();
+                for _ in 0..lane_count {
+                    let index_32 = util::get_lowest_bit(ctx.b, ctx.module, next_remaining_voices);
+                    next_remaining_voices = util::clear_lowest_bit(ctx.b, next_remaining_voices);
+                    lane_pointers.push(unsafe {
+                        ctx.b.build_in_bounds_gep(
+                            &voice_pointers,
+                            &[const_zero, index_32],
+                            "pointersptr",
+                        )
+                    });
+                }
+                ctx.b.build_store(&remaining_ptr, &next_remaining_voices);
+
+                build_lanes_update_call(ctx.module, cache, ctx.b, *surface_id, &lane_pointers);
+                ctx.b.build_unconditional_branch(&lanes_check_block);
             } else {
-                ctx.b.build_unconditional_branch(&run_block);
+                ctx.b.build_unconditional_branch(&check_block);
             }
+            ctx.b.position_at_end(&check_block);
 
+            let remaining_voices = ctx
+                .b
+                .build_load(&remaining_ptr, "voicesleft")
+                .into_int_value();
+            let can_continue_loop = ctx.b.build_int_compare(
+                IntPredicate::NE,
+                remaining_voices,
+                ctx.context.i32_type().const_int(0, false),
+                "cancontinue",
+            );
+            ctx.b
+                .build_conditional_branch(&can_continue_loop, &run_block, &end_block);
             ctx.b.position_at_end(&run_block);
 
+            let index_32 = util::get_lowest_bit(ctx.b, ctx.module, remaining_voices);
+            let next_remaining_voices = util::clear_lowest_bit(ctx.b, remaining_voices);
+            ctx.b.build_store(&remaining_ptr, &next_remaining_voices);
+
             let const_zero = ctx.context.i32_type().const_int(0, false);
-            let voice_pointers_ptr = unsafe {
-                ctx.b
-                    .build_in_bounds_gep(&voice_pointers, &[const_zero, index_32], "pointersptr")
-            };
+            if let Some((task_ptr, count_ptr)) = voice_task {
+                let voice_count = ctx.b.build_load(&count_ptr, "voicecount").into_int_value();
+                let task_index_ptr = unsafe {
+                    ctx.b.build_in_bounds_gep(
+                        &task_ptr,
+                        &[
+                            const_zero,
+                            ctx.context.i32_type().const_int(1, false),
+                            voice_count,
+                        ],
+                        "taskindex.ptr",
+                    )
+                };
+                let voice_index =
+                    ctx.b
+                        .build_int_truncate(index_32, ctx.context.i8_type(), "voiceindex");
+                ctx.b.build_store(&task_index_ptr, &voice_index);
 
-            build_lifecycle_call(
-                ctx.module,
-                cache,
-                ctx.b,
-                *surface_id,
-                lifecycle,
-                voice_pointers_ptr,
-            );
+                let next_count = ctx.b.build_int_nuw_add(
+                    voice_count,
+                    ctx.context.i32_type().const_int(1, false),
+                    "nextcount",
+                );
+                ctx.b.build_store(&count_ptr, &next_count);
+            } else {
+                let voice_pointers_ptr = unsafe {
+                    ctx.b.build_in_bounds_gep(
+                        &voice_pointers,
+                        &[const_zero, index_32],
+                        "pointersptr",
+                    )
+                };
+
+                build_lifecycle_call(
+                    ctx.module,
+                    cache,
+                    ctx.b,
+                    *surface_id,
+                    lifecycle,
+                    voice_pointers_ptr,
+                );
+            }
 
             ctx.b.build_unconditional_branch(&check_block);
             ctx.b.position_at_end(&end_block);
 
+            // Run the collected voices. This doesn't return until every voice has finished, so
+            // the output arrays below are complete.
+            if let Some((task_ptr, count_ptr)) = voice_task {
+                let task_func =
+                    get_voice_task_func(ctx.module, cache, *surface_id, voice_pointers.get_type());
+                let task_pool = ctx.b.build_load(
+                    &globals::get_task_pool(ctx.module).as_pointer_value(),
+                    "taskpool",
+                );
+                let task_data = ctx.b.build_pointer_cast(
+                    task_ptr,
+                    ctx.context.i8_type().ptr_type(AddressSpace::Generic),
+                    "taskdata",
+                );
+                let voice_count = ctx.b.build_load(&count_ptr, "voicecount");
+                ctx.b.build_call(
+                    &globals::get_run_tasks_func(ctx.module),
+                    &[
+                        &task_pool,
+                        &task_func.as_global_value().as_pointer_value(),
+                        &task_data,
+                        &voice_count,
+                    ],
+                    "",
+                    false,
+                );
+            }
+
             // set the bitmaps of all output arrays to be this input
             if lifecycle == LifecycleFunc::Update {
-                let active_bitmap = if let Some(active_bitmap) = valid_bitmap {
-                    active_bitmap
-                } else {
-                    ctx.b
-                        .build_not(&ctx.context.i32_type().const_int(0, false), "")
-                };
+                let active_bitmap = valid_bitmap.unwrap_or(full_bitmap);
 
                 for dest_socket_index in 0..dest_sockets.len() {
                     let dest_array = values::ArrayValue::new(
@@ -218,25 +437,935 @@ fn build_node_call(
     }
 }
 
+/// Times node updates into the surface's profile global on ticks the editor asked to be profiled.
+/// Other ticks only pay for a branch on a value that's loaded once per call.
+struct NodeProfiler {
+    is_sampling: IntValue,
+    start_ptr: PointerValue,
+    times_ptr: PointerValue,
+}
+
+impl NodeProfiler {
+    fn new(ctx: &mut BuilderContext, times_ptr: PointerValue) -> Self {
+        let request_ptr = unsafe {
+            ctx.b.build_in_bounds_gep(
+                &globals::get_profile_time(ctx.module).as_pointer_value(),
+                &[
+                    ctx.context.i32_type().const_int(0, false),
+                    ctx.context
+                        .i32_type()
+                        .const_int(globals::PROFILE_REQUEST_INDEX, false),
+                ],
+                "profile.request.ptr",
+            )
+        };
+        let request = ctx
+            .b
+            .build_load(&request_ptr, "profile.request")
+            .into_int_value();
+        let is_sampling = ctx.b.build_int_compare(
+            IntPredicate::NE,
+            request,
+            ctx.context.i64_type().const_int(0, false),
+            "profile.sampling",
+        );
+
+        NodeProfiler {
+            is_sampling,
+            start_ptr: ctx
+                .allocb
+                .build_alloca(&ctx.context.i64_type(), "profile.start.ptr"),
+            times_ptr,
+        }
+    }
+
+    fn build_timestamp(ctx: &mut BuilderContext) -> IntValue {
+        ctx.b
+            .build_call(
+                &intrinsics::profile_timestamp_i64(ctx.module),
+                &[],
+                "profile.time",
+                false,
+            )
+            .left()
+            .unwrap()
+            .into_int_value()
+    }
+
+    fn build_start(&self, ctx: &mut BuilderContext) {
+        let start_block = ctx.context.append_basic_block(&ctx.func, "profile.start");
+        let call_block = ctx.context.append_basic_block(&ctx.func, "profile.call");
+        ctx.b
+            .build_conditional_branch(&self.is_sampling, &start_block, &call_block);
+
+        ctx.b.position_at_end(&start_block);
+        let start_time = NodeProfiler::build_timestamp(ctx);
+        ctx.b.build_store(&self.start_ptr, &start_time);
+        ctx.b.build_unconditional_branch(&call_block);
+
+        ctx.b.position_at_end(&call_block);
+    }
+
+    fn build_end(&self, ctx: &mut BuilderContext, node_index: usize) {
+        let end_block = ctx.context.append_basic_block(&ctx.func, "profile.end");
+        let next_block = ctx.context.append_basic_block(&ctx.func, "profile.next");
+        ctx.b
+            .build_conditional_branch(&self.is_sampling, &end_block, &next_block);
+
+        ctx.b.position_at_end(&end_block);
+        let end_time = NodeProfiler::build_timestamp(ctx);
+        let start_time = ctx
+            .b
+            .build_load(&self.start_ptr, "profile.starttime")
+            .into_int_value();
+        let elapsed = ctx.b.build_int_sub(end_time, start_time, "profile.elapsed");
+
+        // Voices and branches running on the task pool can time the same node at once, so the
+        // runtime adds to the total atomically.
+        let total_ptr = unsafe {
+            ctx.b.build_in_bounds_gep(
+                &self.times_ptr,
+                &[
+                    ctx.context.i32_type().const_int(0, false),
+                    ctx.context.i32_type().const_int(node_index as u64, false),
+                ],
+                "profile.total.ptr",
+            )
+        };
+        ctx.b.build_call(
+            &globals::get_profile_add_func(ctx.module),
+            &[&total_ptr, &elapsed],
+            "",
+            false,
+        );
+        ctx.b.build_unconditional_branch(&next_block);
+
+        ctx.b.position_at_end(&next_block);
+    }
+}
+
+fn build_node_calls(
+    ctx: &mut BuilderContext,
+    cache: &ObjectCache,
+    surface: &Surface,
+    node_indices: impl IntoIterator<Item = usize>,
+    lifecycle: LifecycleFunc,
+    pointers_ptr: PointerValue,
+) {
+    let layout = cache.surface_layout(surface.id.id).unwrap();
+
+    // Node updates are only profiled in the editor.
+    let profiler = if lifecycle == LifecycleFunc::Update && cache.target().include_ui {
+        let times_ptr =
+            globals::get_surface_profile(ctx.module, surface.id.id, surface.nodes.len())
+                .as_pointer_value();
+        Some(NodeProfiler::new(ctx, times_ptr))
+    } else {
+        None
+    };
+
+    for node_index in node_indices {
+        let node = &surface.nodes[node_index];
+        let node_profiler = match node.data {
+            NodeData::Dummy => None,
+            _ => profiler.as_ref(),
+        };
+
+        let layout_ptr_index = layout.node_ptr_index(node_index);
+        let node_pointers_ptr = unsafe {
+            ctx.b
+                .build_struct_gep(&pointers_ptr, layout_ptr_index as u32, "")
+        };
+
+        if let Some(node_profiler) = node_profiler {
+            node_profiler.build_start(ctx);
+        }
+        build_node_call(ctx, cache, node, lifecycle, node_pointers_ptr);
+        if let Some(node_profiler) = node_profiler {
+            node_profiler.build_end(ctx, node_index);
+        }
+    }
+}
+
+/// Whether a node is or contains an oversampled surface. Oversampled surfaces change the sample
+/// rate global while they run, so they can't run alongside anything else on the task pool.
+fn node_contains_oversampling(cache: &ObjectCache, node: &Node) -> bool {
+    match node.data {
+        NodeData::Dummy | NodeData::Custom { .. } => false,
+        NodeData::Group(child_surface)
+        | NodeData::ExtractGroup {
+            surface: child_surface,
+            ..
+        } => {
+            cache
+                .surface_layout(child_surface)
+                .unwrap()
+                .oversample
+                .is_some()
+                || cache
+                    .surface_mir(child_surface)
+                    .unwrap()
+                    .nodes
+                    .iter()
+                    .any(|child_node| node_contains_oversampling(cache, child_node))
+        }
+    }
+}
+
+/// Whether the update of a surface can be run for several voices at once. Surfaces that can sleep
+/// decide whether to sleep for each voice on its own, and oversampled surfaces wrap their update
+/// in the oversampler, so their voices are always run one by one.
+fn can_update_lanes(cache: &ObjectCache, surface: SurfaceRef) -> bool {
+    let layout = cache.surface_layout(surface).unwrap();
+    layout.sleep.is_none() && layout.oversample.is_none()
+}
+
+/// Builds a copy of the surface's update function that updates several voices at once, with the
+/// pointers of each voice as a separate parameter. The voices go through the surface node by node,
+/// and blocks are updated with `block::build_lanes_update_call` so the same code for each voice
+/// ends up side by side. Other nodes are updated for each voice in turn.
+///
+/// Like the block copies it calls, this is built into the module of the surface with the
+/// extracted group, which is rebuilt whenever anything inside the group changes.
+fn get_lanes_update_func(
+    module: &Module,
+    cache: &ObjectCache,
+    surface: SurfaceRef,
+    lane_count: usize,
+) -> FunctionValue {
+    let func_name = format!("maxim.surface.{}.update.lanes{}", surface, lane_count);
+    if let Some(func) = module.get_function(&func_name) {
+        return func;
+    }
+
+    let context = module.get_context();
+    let layout = cache.surface_layout(surface).unwrap();
+    let pointers_type = layout.pointer_struct.ptr_type(AddressSpace::Generic);
+    let param_types = vec![&pointers_type as &BasicType; lane_count];
+    let func = util::get_or_create_func(module, &func_name, true, &|| {
+        (
+            Linkage::PrivateLinkage,
+            context.void_type().fn_type(&param_types, false),
+        )
+    });
+    for lane_index in 0..lane_count {
+        func.add_param_attribute(
+            lane_index as u32,
+            context.get_enum_attr(AttrKind::NoAlias, 1),
+        );
+    }
+
+    let surface_mir = cache.surface_mir(surface).unwrap();
+    build_context_function(module, func, cache.target(), &|mut ctx: BuilderContext| {
+        let lane_pointers: Vec<_> = (0..lane_count)
+            .map(|lane_index| {
+                ctx.func
+                    .get_nth_param(lane_index as u32)
+                    .unwrap()
+                    .into_pointer_value()
+            })
+            .collect();
+
+        // the profile global is defined in the surface's own module
+        let profiler = if cache.target().include_ui {
+            let times_ptr =
+                globals::get_external_surface_profile(ctx.module, surface, surface_mir.nodes.len())
+                    .as_pointer_value();
+            Some(NodeProfiler::new(&mut ctx, times_ptr))
+        } else {
+            None
+        };
+
+        for (node_index, node) in surface_mir.nodes.iter().enumerate() {
+            let node_profiler = match node.data {
+                NodeData::Dummy => None,
+                _ => profiler.as_ref(),
+            };
+
+            let layout_ptr_index = layout.node_ptr_index(node_index) as u32;
+            let node_pointers: Vec<_> = lane_pointers
+                .iter()
+                .map(|pointers_ptr| unsafe {
+                    ctx.b.build_struct_gep(pointers_ptr, layout_ptr_index, "")
+                })
+                .collect();
+
+            if let Some(node_profiler) = node_profiler {
+                node_profiler.build_start(&mut ctx);
+            }
+            match &node.data {
+                NodeData::Custom { block, .. } => {
+                    let block_pointers: Vec<_> = node_pointers
+                        .iter()
+                        .map(|node_pointers_ptr| unsafe {
+                            (
+                                ctx.b.build_struct_gep(node_pointers_ptr, 1, "node.ptrs"),
+                                ctx.b.build_struct_gep(node_pointers_ptr, 0, "const.ptr"),
+                            )
+                        })
+                        .collect();
+                    block::build_lanes_update_call(
+                        ctx.module,
+                        cache,
+                        ctx.b,
+                        *block,
+                        &block_pointers,
+                    );
+                }
+                NodeData::Group(child_surface) if can_update_lanes(cache, *child_surface) => {
+                    build_lanes_update_call(
+                        ctx.module,
+                        cache,
+                        ctx.b,
+                        *child_surface,
+                        &node_pointers,
+                    );
+                }
+                _ => {
+                    for &node_pointers_ptr in &node_pointers {
+                        build_node_call(
+                            &mut ctx,
+                            cache,
+                            node,
+                            LifecycleFunc::Update,
+                            node_pointers_ptr,
+                        );
+                    }
+                }
+            }
+            if let Some(node_profiler) = node_profiler {
+                node_profiler.build_end(&mut ctx, node_index);
+            }
+        }
+
+        ctx.b.build_return(None);
+    });
+    func
+}
+
+fn build_lanes_update_call(
+    module: &Module,
+    cache: &ObjectCache,
+    builder: &mut Builder,
+    surface: SurfaceRef,
+    lane_pointers: &[PointerValue],
+) {
+    let func = get_lanes_update_func(module, cache, surface, lane_pointers.len());
+    let args: Vec<_> = lane_pointers
+        .iter()
+        .map(|pointers_ptr| pointers_ptr as &BasicValue)
+        .collect();
+    builder.build_call(&func, &args, "", true);
+}
+
+/// Builds a task function that runs the update of branch `n` of the plan when called with index
+/// `n`. The task data is the surface's pointer struct.
+fn build_branch_task_func(
+    module: &Module,
+    cache: &ObjectCache,
+    surface: &Surface,
+    plan: &BranchPlan,
+) -> FunctionValue {
+    let func_name = format!("maxim.surface.{}.branchtask", surface.id.id);
+    let context = module.get_context();
+    let func = module.add_function(
+        &func_name,
+        &globals::get_task_func_type(&context),
+        Some(&Linkage::PrivateLinkage),
+    );
+    build_context_function(module, func, cache.target(), &|mut ctx: BuilderContext| {
+        let layout = cache.surface_layout(surface.id.id).unwrap();
+        let data_ptr = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
+        let task_index = ctx.func.get_nth_param(1).unwrap().into_int_value();
+        let pointers_ptr = ctx.b.build_pointer_cast(
+            data_ptr,
+            layout.pointer_struct.ptr_type(AddressSpace::Generic),
+            "pointers",
+        );
+
+        for (branch_index, branch) in plan.branches.iter().enumerate() {
+            let run_block = ctx.context.append_basic_block(&ctx.func, "branch.run");
+            let next_block = ctx.context.append_basic_block(&ctx.func, "branch.next");
+
+            let is_branch = ctx.b.build_int_compare(
+                IntPredicate::EQ,
+                task_index,
+                ctx.context.i32_type().const_int(branch_index as u64, false),
+                "isbranch",
+            );
+            ctx.b
+                .build_conditional_branch(&is_branch, &run_block, &next_block);
+
+            ctx.b.position_at_end(&run_block);
+            build_node_calls(
+                &mut ctx,
+                cache,
+                surface,
+                branch.iter().cloned(),
+                LifecycleFunc::Update,
+                pointers_ptr,
+            );
+            ctx.b.build_return(None);
+
+            ctx.b.position_at_end(&next_block);
+        }
+
+        ctx.b.build_return(None);
+    });
+    func
+}
+
+/// Checks whether the surface's values have been quiet for long enough that it can sleep, and
+/// returns from the update function without running any nodes if so. A value is quiet if its
+/// number has stayed within `QUIET_THRESHOLD` of the same value, or if its MIDI has no events.
+/// Since every value is checked before the nodes run, any input or control waking up runs the
+/// surface on the same sample, and values written by nodes are checked on the sample after.
+///
+/// Sleeping surfaces keep their outputs, which is only right if they keep producing the same
+/// output without new input, so surfaces with oscillators, envelopes or anything else that moves
+/// on its own don't get a sleep layout. The tail is `SLEEP_TAIL_SECONDS`, or the length of the
+/// longest delay buffer in the surface if that's longer, so echoes play out before it sleeps.
+fn build_sleep_check(
+    ctx: &mut BuilderContext,
+    cache: &ObjectCache,
+    surface: &Surface,
+    pointers_ptr: PointerValue,
+) {
+    let layout = cache.surface_layout(surface.id.id).unwrap();
+    let sleep = match &layout.sleep {
+        Some(sleep) => sleep,
+        None => return,
+    };
+
+    let sleep_ptrs = unsafe {
+        ctx.b
+            .build_struct_gep(&pointers_ptr, layout.sleep_ptr_index() as u32, "sleep.ptrs")
+    };
+    let state_ptr = ctx
+        .b
+        .build_load(
+            &unsafe {
+                ctx.b
+                    .build_struct_gep(&sleep_ptrs, 0, "sleep.state.ptr.ptr")
+            },
+            "sleep.state.ptr",
+        )
+        .into_pointer_value();
+    let quiet_time_ptr = unsafe { ctx.b.build_struct_gep(&state_ptr, 0, "sleep.quiettime.ptr") };
+
+    let threshold = util::get_vec_spread(ctx.context, QUIET_THRESHOLD);
+    let negative_threshold = util::get_vec_spread(ctx.context, -QUIET_THRESHOLD);
+    let mut is_quiet = ctx.context.bool_type().const_int(1, false);
+    let mut references = Vec::new();
+    for (sleep_index, &group_index) in sleep.groups.iter().enumerate() {
+        let group_ptr = ctx
+            .b
+            .build_load(
+                &unsafe {
+                    ctx.b.build_struct_gep(
+                        &sleep_ptrs,
+                        sleep_index as u32 + 1,
+                        "sleep.group.ptr.ptr",
+                    )
+                },
+                "sleep.group.ptr",
+            )
+            .into_pointer_value();
+
+        match surface.groups[group_index].value_type {
+            VarType::Num => {
+                let value = values::NumValue::new(group_ptr);
+                let reference = values::NumValue::new(unsafe {
+                    ctx.b.build_struct_gep(
+                        &state_ptr,
+                        references.len() as u32 + 1,
+                        "sleep.reference.ptr",
+                    )
+                });
+
+                let value_vec = value.get_vec(ctx.b);
+                let reference_vec = reference.get_vec(ctx.b);
+                let difference =
+                    ctx.b
+                        .build_float_sub(value_vec, reference_vec, "sleep.difference");
+                let is_below = ctx.b.build_float_compare(
+                    FloatPredicate::OLE,
+                    difference,
+                    threshold,
+                    "sleep.below",
+                );
+                let is_above = ctx.b.build_float_compare(
+                    FloatPredicate::OGE,
+                    difference,
+                    negative_threshold,
+                    "sleep.above",
+                );
+                let is_within = ctx.b.build_and(is_below, is_above, "sleep.within");
+                for lane in 0..2 {
+                    let lane_within = ctx
+                        .b
+                        .build_extract_element(
+                            &is_within,
+                            &ctx.context.i32_type().const_int(lane, false),
+                            "sleep.lane.within",
+                        )
+                        .into_int_value();
+                    is_quiet = ctx.b.build_and(is_quiet, lane_within, "");
+                }
+
+                let is_same_form = ctx.b.build_int_compare(
+                    IntPredicate::EQ,
+                    value.get_form(ctx.b),
+                    reference.get_form(ctx.b),
+                    "sleep.sameform",
+                );
+                is_quiet = ctx.b.build_and(is_quiet, is_same_form, "");
+                references.push((value, reference));
+            }
+            VarType::Midi => {
+                let event_count = values::MidiValue::new(group_ptr).get_count(ctx.b);
+                let has_no_events = ctx.b.build_int_compare(
+                    IntPredicate::EQ,
+                    event_count,
+                    event_count.get_type().const_int(0, false),
+                    "sleep.noevents",
+                );
+                is_quiet = ctx.b.build_and(is_quiet, has_no_events, "");
+            }
+            _ => unreachable!(),
+        }
+    }
+
+    let quiet_block = ctx.context.append_basic_block(&ctx.func, "sleep.quiet");
+    let reset_block = ctx.context.append_basic_block(&ctx.func, "sleep.reset");
+    let count_block = ctx.context.append_basic_block(&ctx.func, "sleep.count");
+    let asleep_block = ctx.context.append_basic_block(&ctx.func, "sleep.asleep");
+    let run_block = ctx.context.append_basic_block(&ctx.func, "sleep.run");
+    ctx.b
+        .build_conditional_branch(&is_quiet, &quiet_block, &reset_block);
+
+    // Something moved, so start waiting for the surface to go quiet again from the new values.
+    ctx.b.position_at_end(&reset_block);
+    for (value, reference) in &references {
+        value.copy_to(ctx.b, ctx.module, reference);
+    }
+    ctx.b
+        .build_store(&quiet_time_ptr, &ctx.context.i32_type().const_int(0, false));
+    ctx.b.build_unconditional_branch(&run_block);
+
+    ctx.b.position_at_end(&quiet_block);
+    let sample_rate = ctx
+        .b
+        .build_extract_element(
+            &ctx.b
+                .build_load(
+                    &globals::get_sample_rate(ctx.module).as_pointer_value(),
+                    "samplerate",
+                )
+                .into_vector_value(),
+            &ctx.context.i32_type().const_int(0, false),
+            "samplerate.left",
+        )
+        .into_float_value();
+    let mut tail_time = ctx.b.build_float_to_unsigned_int(
+        ctx.b.build_float_mul(
+            sample_rate,
+            ctx.context
+                .f64_type()
+                .const_float(data_analyzer::SLEEP_TAIL_SECONDS),
+            "sleep.tailtime.float",
+        ),
+        ctx.context.i32_type(),
+        "sleep.tailtime",
+    );
+    for delay_index in 0..sleep.delays.len() {
+        let delay_ptr = ctx
+            .b
+            .build_load(
+                &unsafe {
+                    ctx.b.build_struct_gep(
+                        &sleep_ptrs,
+                        (1 + sleep.groups.len() + delay_index) as u32,
+                        "sleep.delay.ptr.ptr",
+                    )
+                },
+                "sleep.delay.ptr",
+            )
+            .into_pointer_value();
+
+        // the left and right buffer lengths come after the positions
+        for length_index in 2..4 {
+            let buffer_length = ctx
+                .b
+                .build_load(
+                    &unsafe {
+                        ctx.b
+                            .build_struct_gep(&delay_ptr, length_index, "sleep.delaylength.ptr")
+                    },
+                    "sleep.delaylength",
+                )
+                .into_int_value();
+            let is_longer = ctx.b.build_int_compare(
+                IntPredicate::UGT,
+                buffer_length,
+                tail_time,
+                "sleep.delaylonger",
+            );
+            tail_time = ctx
+                .b
+                .build_select(is_longer, buffer_length, tail_time, "sleep.tailtime")
+                .into_int_value();
+        }
+    }
+    let quiet_time = ctx
+        .b
+        .build_load(&quiet_time_ptr, "sleep.quiettime")
+        .into_int_value();
+    let is_asleep =
+        ctx.b
+            .build_int_compare(IntPredicate::UGE, quiet_time, tail_time, "sleep.isasleep");
+    ctx.b
+        .build_conditional_branch(&is_asleep, &asleep_block, &count_block);
+
+    // The count stops at the tail time, so it can't overflow while the surface sleeps.
+    ctx.b.position_at_end(&count_block);
+    let next_quiet_time = ctx.b.build_int_nuw_add(
+        quiet_time,
+        ctx.context.i32_type().const_int(1, false),
+        "sleep.nextquiettime",
+    );
+    ctx.b.build_store(&quiet_time_ptr, &next_quiet_time);
+    ctx.b.build_unconditional_branch(&run_block);
+
+    ctx.b.position_at_end(&asleep_block);
+    ctx.b.build_return(None);
+
+    ctx.b.position_at_end(&run_block);
+}
+
+/// Runs the nodes of an oversampled surface several times per sample. `build_start` upsamples the
+/// inputs and starts a loop over the oversampled samples, which the nodes are built into, and
+/// `build_end` ends the loop and downsamples the outputs into the sockets.
+///
+/// Functions like oscillators and filters read the sample rate global, so it's raised by the
+/// oversampling factor while the loop runs. Inputs are put back as they were after the loop, since
+/// nodes outside the surface could still read them.
+struct Oversampler {
+    factor: usize,
+    stage_count: usize,
+    sample_rate: VectorValue,
+    state_ptr: PointerValue,
+    index_ptr: PointerValue,
+    loop_block: BasicBlock,
+    inputs: Vec<(values::NumValue, VectorValue, PointerValue)>,
+    outputs: Vec<(values::NumValue, PointerValue)>,
+}
+
+impl Oversampler {
+    fn build_start(
+        ctx: &mut BuilderContext,
+        cache: &ObjectCache,
+        surface: &Surface,
+        pointers_ptr: PointerValue,
+    ) -> Option<Self> {
+        let layout = cache.surface_layout(surface.id.id).unwrap();
+        let oversample = layout.oversample.as_ref()?;
+        let factor = oversample.factor();
+
+        let oversample_ptrs = unsafe {
+            ctx.b.build_struct_gep(
+                &pointers_ptr,
+                layout.oversample_ptr_index() as u32,
+                "oversample.ptrs",
+            )
+        };
+        let state_ptr = ctx
+            .b
+            .build_load(
+                &unsafe {
+                    ctx.b
+                        .build_struct_gep(&oversample_ptrs, 0, "oversample.state.ptr.ptr")
+                },
+                "oversample.state.ptr",
+            )
+            .into_pointer_value();
+        let get_group = |ctx: &mut BuilderContext, socket_index: usize| {
+            values::NumValue::new(
+                ctx.b
+                    .build_load(
+                        &unsafe {
+                            ctx.b.build_struct_gep(
+                                &oversample_ptrs,
+                                socket_index as u32 + 1,
+                                "oversample.group.ptr.ptr",
+                            )
+                        },
+                        "oversample.group.ptr",
+                    )
+                    .into_pointer_value(),
+            )
+        };
+
+        let sample_rate_ptr = globals::get_sample_rate(ctx.module).as_pointer_value();
+        let sample_rate = ctx
+            .b
+            .build_load(&sample_rate_ptr, "samplerate")
+            .into_vector_value();
+        ctx.b.build_store(
+            &sample_rate_ptr,
+            &ctx.b.build_float_mul(
+                sample_rate,
+                util::get_vec_spread(ctx.context, factor as f64),
+                "oversample.samplerate",
+            ),
+        );
+
+        let samples_type = ctx.context.f64_type().vec_type(2).array_type(factor as u32);
+        let mut inputs = Vec::new();
+        for input_index in 0..oversample.inputs.len() {
+            let group = get_group(ctx, input_index);
+            let value_vec = group.get_vec(ctx.b);
+            let history_ptr = unsafe {
+                ctx.b
+                    .build_struct_gep(&state_ptr, input_index as u32, "oversample.history.ptr")
+            };
+            let samples = half_band::build_upsample(
+                ctx.b,
+                ctx.context,
+                history_ptr,
+                oversample.stage_count,
+                vec![value_vec],
+            );
+
+            let samples_ptr = ctx
+                .allocb
+                .build_alloca(&samples_type, "oversample.inputs.ptr");
+            for (sample_index, sample) in samples.iter().enumerate() {
+                ctx.b.build_store(
+                    &get_sample_ptr(
+                        ctx,
+                        samples_ptr,
+                        ctx.context.i32_type().const_int(sample_index as u64, false),
+                    ),
+                    sample,
+                );
+            }
+            inputs.push((group, value_vec, samples_ptr));
+        }
+
+        let outputs = (0..oversample.outputs.len())
+            .map(|output_index| {
+                let group = get_group(ctx, inputs.len() + output_index);
+                let samples_ptr = ctx
+                    .allocb
+                    .build_alloca(&samples_type, "oversample.outputs.ptr");
+                (group, samples_ptr)
+            })
+            .collect();
+
+        let index_ptr = ctx
+            .allocb
+            .build_alloca(&ctx.context.i32_type(), "oversample.index.ptr");
+        ctx.b
+            .build_store(&index_ptr, &ctx.context.i32_type().const_int(0, false));
+        let loop_block = ctx.context.append_basic_block(&ctx.func, "oversample.loop");
+        ctx.b.build_unconditional_branch(&loop_block);
+        ctx.b.position_at_end(&loop_block);
+
+        let index = ctx
+            .b
+            .build_load(&index_ptr, "oversample.index")
+            .into_int_value();
+        for (group, _, samples_ptr) in &inputs {
+            let sample = ctx
+                .b
+                .build_load(
+                    &get_sample_ptr(ctx, *samples_ptr, index),
+                    "oversample.input",
+                )
+                .into_vector_value();
+            group.set_vec(ctx.b, sample);
+        }
+
+        Some(Oversampler {
+            factor,
+            stage_count: oversample.stage_count,
+            sample_rate,
+            state_ptr,
+            index_ptr,
+            loop_block,
+            inputs,
+            outputs,
+        })
+    }
+
+    fn build_end(&self, ctx: &mut BuilderContext) {
+        let index = ctx
+            .b
+            .build_load(&self.index_ptr, "oversample.index")
+            .into_int_value();
+        for (group, samples_ptr) in &self.outputs {
+            let sample = group.get_vec(ctx.b);
+            ctx.b
+                .build_store(&get_sample_ptr(ctx, *samples_ptr, index), &sample);
+        }
+
+        let next_index = ctx.b.build_int_nuw_add(
+            index,
+            ctx.context.i32_type().const_int(1, false),
+            "oversample.nextindex",
+        );
+        ctx.b.build_store(&self.index_ptr, &next_index);
+        let is_done = ctx.b.build_int_compare(
+            IntPredicate::EQ,
+            next_index,
+            ctx.context.i32_type().const_int(self.factor as u64, false),
+            "oversample.isdone",
+        );
+        let end_block = ctx.context.append_basic_block(&ctx.func, "oversample.end");
+        ctx.b
+            .build_conditional_branch(&is_done, &end_block, &self.loop_block);
+        ctx.b.position_at_end(&end_block);
+
+        // Inputs and outputs can share a value if they're connected to the same wire outside, in
+        // which case the output wins.
+        for (group, value_vec, _) in &self.inputs {
+            group.set_vec(ctx.b, *value_vec);
+        }
+        for (output_index, (group, samples_ptr)) in self.outputs.iter().enumerate() {
+            let samples = (0..self.factor)
+                .map(|sample_index| {
+                    ctx.b
+                        .build_load(
+                            &get_sample_ptr(
+                                ctx,
+                                *samples_ptr,
+                                ctx.context.i32_type().const_int(sample_index as u64, false),
+                            ),
+                            "oversample.output",
+                        )
+                        .into_vector_value()
+                })
+                .collect();
+            let history_ptr = unsafe {
+                ctx.b.build_struct_gep(
+                    &self.state_ptr,
+                    (self.inputs.len() + output_index) as u32,
+                    "oversample.history.ptr",
+                )
+            };
+            let output = half_band::build_downsample(
+                ctx.b,
+                ctx.context,
+                history_ptr,
+                self.stage_count,
+                samples,
+            );
+            group.set_vec(ctx.b, output[0]);
+        }
+
+        ctx.b.build_store(
+            &globals::get_sample_rate(ctx.module).as_pointer_value(),
+            &self.sample_rate,
+        );
+    }
+}
+
+fn get_sample_ptr(
+    ctx: &BuilderContext,
+    samples_ptr: PointerValue,
+    index: IntValue,
+) -> PointerValue {
+    unsafe {
+        ctx.b.build_in_bounds_gep(
+            &samples_ptr,
+            &[ctx.context.i32_type().const_int(0, false), index],
+            "oversample.sample.ptr",
+        )
+    }
+}
+
 pub fn build_lifecycle_func(
     module: &Module,
     cache: &ObjectCache,
     surface: &Surface,
     lifecycle: LifecycleFunc,
 ) {
+    // Independent branches of the surface can be run on the task pool during updates, if the
+    // surface asks for it and there's more than one of them. Branches with oversampled surfaces
+    // inside them can't run alongside other branches.
+    let branch_plan = if surface.parallel_branches && lifecycle == LifecycleFunc::Update {
+        plan_branches(cache, surface).filter(|plan| {
+            plan.branches.len() > 1
+                && !plan.branches.iter().flatten().any(|&node_index| {
+                    node_contains_oversampling(cache, &surface.nodes[node_index])
+                })
+        })
+    } else {
+        None
+    };
+    let branch_task_func = branch_plan
+        .as_ref()
+        .map(|plan| build_branch_task_func(module, cache, surface, plan));
+
     let func = get_lifecycle_func(module, cache, surface.id.id, lifecycle);
     build_context_function(module, func, cache.target(), &|mut ctx: BuilderContext| {
-        let layout = cache.surface_layout(surface.id.id).unwrap();
         let pointers_ptr = ctx.func.get_nth_param(0).unwrap().into_pointer_value();
 
-        for (node_index, node) in surface.nodes.iter().enumerate() {
-            let layout_ptr_index = layout.node_ptr_index(node_index);
-            let node_pointers_ptr = unsafe {
-                ctx.b
-                    .build_struct_gep(&pointers_ptr, layout_ptr_index as u32, "")
-            };
+        let oversampler = if lifecycle == LifecycleFunc::Update {
+            build_sleep_check(&mut ctx, cache, surface, pointers_ptr);
+            Oversampler::build_start(&mut ctx, cache, surface, pointers_ptr)
+        } else {
+            None
+        };
+
+        if let (Some(plan), Some(task_func)) = (&branch_plan, &branch_task_func) {
+            let task_pool = ctx.b.build_load(
+                &globals::get_task_pool(ctx.module).as_pointer_value(),
+                "taskpool",
+            );
+            let task_data = ctx.b.build_pointer_cast(
+                pointers_ptr,
+                ctx.context.i8_type().ptr_type(AddressSpace::Generic),
+                "taskdata",
+            );
+            let branch_count = ctx
+                .context
+                .i32_type()
+                .const_int(plan.branches.len() as u64, false);
+            ctx.b.build_call(
+                &globals::get_run_tasks_func(ctx.module),
+                &[
+                    &task_pool,
+                    &task_func.as_global_value().as_pointer_value(),
+                    &task_data,
+                    &branch_count,
+                ],
+                "",
+                false,
+            );
+
+            build_node_calls(
+                &mut ctx,
+                cache,
+                surface,
+                plan.tail.iter().cloned(),
+                lifecycle,
+                pointers_ptr,
+            );
+        } else {
+            build_node_calls(
+                &mut ctx,
+                cache,
+                surface,
+                0..surface.nodes.len(),
+                lifecycle,
+                pointers_ptr,
+            );
+        }
 
-            build_node_call(&mut ctx, cache, node, lifecycle, node_pointers_ptr);
+        if let Some(oversampler) = &oversampler {
+            oversampler.build_end(&mut ctx);
         }
 
         ctx.b.build_return(None);
@@ -1,3 +1,4 @@
+use super::values;
 use inkwell::context::Context;
 use inkwell::module::Module;
 use inkwell::targets::TargetMachine;
@@ -15,6 +16,17 @@ pub enum OptimizationLevel {
     AggressiveSize,
 }
 
+/// The precision the library's approximations of transcendental functions are evaluated in, and
+/// that delay lines store their samples in. Numbers are otherwise always stored as doubles, but
+/// the approximations used by single precision need fewer terms, single precision division is
+/// cheaper, and float delay lines take half the memory.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[repr(u8)]
+pub enum Precision {
+    Double,
+    Single,
+}
+
 pub struct OptimizationSpecification {
     pub llvm_level: inkwell::OptimizationLevel,
     pub size_level: u32,
@@ -68,6 +80,18 @@ pub struct TargetProperties {
     pub include_ui: bool,
     pub optimization_level: OptimizationLevel,
     pub machine: TargetMachine,
+
+    /// How many voices extracted groups have. This is set from the root of the project being
+    /// built, and can't be more than `values::MAX_ARRAY_CAPACITY`.
+    pub array_capacity: u8,
+
+    /// How many voices of an extracted group are updated together, so LLVM can pack them into
+    /// the same vector registers. This is 1 if the target's registers only fit one voice.
+    pub voice_lanes: u32,
+
+    /// The precision of the library's math approximations and of delay lines. The library is
+    /// built once per runtime, so this is fixed once a runtime is created.
+    pub precision: Precision,
 }
 
 impl TargetProperties {
@@ -80,6 +104,9 @@ impl TargetProperties {
             include_ui,
             optimization_level,
             machine,
+            array_capacity: values::DEFAULT_ARRAY_CAPACITY,
+            voice_lanes: 1,
+            precision: Precision::Double,
         }
     }
 
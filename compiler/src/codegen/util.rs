@@ -194,3 +194,25 @@ pub fn clear_bit(builder: &mut Builder, bitmap: IntValue, bit: IntValue) -> IntV
     );
     builder.build_and(bitmap, bitmask, "clearbit")
 }
+
+/// Finds the index of the lowest set bit in the bitmap. The result is undefined if no bits are set.
+pub fn get_lowest_bit(builder: &mut Builder, module: &Module, bitmap: IntValue) -> IntValue {
+    builder
+        .build_call(
+            &intrinsics::cttz_i32(module),
+            &[
+                &bitmap,
+                &module.get_context().bool_type().const_int(1, false),
+            ],
+            "lowestbit",
+            false,
+        )
+        .left()
+        .unwrap()
+        .into_int_value()
+}
+
+pub fn clear_lowest_bit(builder: &mut Builder, bitmap: IntValue) -> IntValue {
+    let bitmap_less_one = builder.build_int_sub(bitmap, bitmap.get_type().const_int(1, false), "");
+    builder.build_and(bitmap, bitmap_less_one, "clearlowestbit")
+}
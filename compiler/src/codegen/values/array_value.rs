@@ -1,9 +1,19 @@
+use crate::codegen::globals;
 use inkwell::builder::Builder;
 use inkwell::context::Context;
+use inkwell::module::Module;
 use inkwell::types::StructType;
 use inkwell::values::{IntValue, PointerValue};
 
-pub const ARRAY_CAPACITY: u8 = 32;
+/// The number of items array values have room for. Bitmaps are 32 bits, so this is as high as
+/// the capacity of a project can go.
+pub const MAX_ARRAY_CAPACITY: u8 = 32;
+
+/// The capacity of projects that don't set their own. The capacity limits how many voices
+/// extracted groups have and how many items library functions put in arrays, but array values
+/// always have room for `MAX_ARRAY_CAPACITY` items, so modules built for different capacities
+/// can pass arrays to each other.
+pub const DEFAULT_ARRAY_CAPACITY: u8 = MAX_ARRAY_CAPACITY;
 
 #[derive(Debug, Clone)]
 pub struct ArrayValue {
@@ -15,7 +25,7 @@ impl ArrayValue {
         context.struct_type(
             &[
                 &context.i32_type(),
-                &inner_type.array_type(u32::from(ARRAY_CAPACITY)),
+                &inner_type.array_type(u32::from(MAX_ARRAY_CAPACITY)),
             ],
             false,
         )
@@ -25,6 +35,40 @@ impl ArrayValue {
         ArrayValue { val }
     }
 
+    /// A bitmap with a bit set for each of the first `capacity` items in the array.
+    pub fn get_full_bitmap(context: &Context, capacity: u8) -> IntValue {
+        context
+            .i32_type()
+            .const_int(u64::from(u32::max_value() >> (32 - capacity)), false)
+    }
+
+    /// Builds the full bitmap for the capacity in the `maxim.arraycapacity` global. The library
+    /// is shared by every project the runtime loads, so it can't use a constant capacity.
+    pub fn build_full_bitmap(builder: &mut Builder, module: &Module) -> IntValue {
+        let context = module.get_context();
+        let capacity = builder
+            .build_load(
+                &globals::get_array_capacity(module).as_pointer_value(),
+                "capacity",
+            )
+            .into_int_value();
+        let shift_amount = builder.build_int_nuw_sub(
+            context
+                .i32_type()
+                .const_int(u64::from(MAX_ARRAY_CAPACITY), false),
+            capacity,
+            "capacity.shift",
+        );
+        builder.build_right_shift(
+            context
+                .i32_type()
+                .const_int(u64::from(u32::max_value()), false),
+            shift_amount,
+            false,
+            "fullbitmap",
+        )
+    }
+
     pub fn get_bitmap_ptr(&self, builder: &mut Builder) -> PointerValue {
         unsafe { builder.build_struct_gep(&self.val, 0, "array.bitmap.ptr") }
     }
@@ -0,0 +1,557 @@
+use std::alloc::{self, Layout};
+use std::cell::UnsafeCell;
+use std::os::raw::c_void;
+use std::ptr;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, OnceLock};
+use std::thread::{self, Thread};
+use std::time::{Duration, Instant};
+
+// Buffers come in power-of-two sizes, from 64 bytes (class 0) up to 4GB. Buffers are aligned to
+// their smallest size, which leaves the low bits of their address free to hold the class.
+const MIN_SIZE_LOG2: u32 = 6;
+const CLASS_COUNT: usize = 27;
+const BUFFER_ALIGN: usize = 1 << MIN_SIZE_LOG2;
+
+// How many buffers of each size are kept ready once that size has been asked for.
+const READY_CAPACITY: usize = 2;
+
+// How long ready buffers of a size are kept after that size was last asked for or freed. Delays
+// only change size while they're being edited, so spares are given back once editing stops.
+const SPARE_LIFETIME: Duration = Duration::from_secs(10);
+
+// How many freed buffers can wait for the helper thread. Audio threads only free buffers when a
+// delay shrinks or grows, so this is far more than can build up between two helper passes.
+const RETIRED_CAPACITY: usize = 4096;
+
+struct QueueSlot {
+    sequence: AtomicUsize,
+    value: UnsafeCell<usize>,
+}
+
+/// A bounded multi-producer multi-consumer queue, which never allocates or blocks after it's
+/// created. Pushing to a full queue or popping from an empty one just fails.
+struct BoundedQueue {
+    slots: Box<[QueueSlot]>,
+    mask: usize,
+    push_pos: AtomicUsize,
+    pop_pos: AtomicUsize,
+}
+
+unsafe impl Sync for BoundedQueue {}
+
+impl BoundedQueue {
+    fn new(capacity: usize) -> Self {
+        let capacity = capacity.next_power_of_two();
+        BoundedQueue {
+            slots: (0..capacity)
+                .map(|index| QueueSlot {
+                    sequence: AtomicUsize::new(index),
+                    value: UnsafeCell::new(0),
+                })
+                .collect::<Vec<_>>()
+                .into_boxed_slice(),
+            mask: capacity - 1,
+            push_pos: AtomicUsize::new(0),
+            pop_pos: AtomicUsize::new(0),
+        }
+    }
+
+    // Each slot's sequence says whose turn it is: it equals the position when the slot is free to
+    // push to, and the position + 1 once a value is waiting in it.
+    fn push(&self, value: usize) -> bool {
+        let mut pos = self.push_pos.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let sequence = slot.sequence.load(Ordering::Acquire);
+            if sequence == pos {
+                match self.push_pos.compare_exchange_weak(
+                    pos,
+                    pos.wrapping_add(1),
+                    Ordering::Relaxed,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => {
+                        unsafe {
+                            *slot.value.get() = value;
+                        }
+                        slot.sequence.store(pos.wrapping_add(1), Ordering::Release);
+                        return true;
+                    }
+                    Err(actual_pos) => pos = actual_pos,
+                }
+            } else if (sequence.wrapping_sub(pos) as isize) < 0 {
+                return false;
+            } else {
+                pos = self.push_pos.load(Ordering::Relaxed);
+            }
+        }
+    }
+
+    // Only a guess while other threads are pushing or popping.
+    fn is_full(&self) -> bool {
+        let pushed = self.push_pos.load(Ordering::Relaxed);
+        let popped = self.pop_pos.load(Ordering::Relaxed);
+        pushed.wrapping_sub(popped) > self.mask
+    }
+
+    fn pop(&self) -> Option<usize> {
+        let mut pos = self.pop_pos.load(Ordering::Relaxed);
+        loop {
+            let slot = &self.slots[pos & self.mask];
+            let sequence = slot.sequence.load(Ordering::Acquire);
+            let next_pos = pos.wrapping_add(1);
+            if sequence == next_pos {
+                match self.pop_pos.compare_exchange_weak(
+                    pos,
+                    next_pos,
+                    Ordering::Relaxed,
+                    Ordering::Relaxed,
+                ) {
+                    Ok(_) => {
+                        let value = unsafe { *slot.value.get() };
+                        slot.sequence
+                            .store(pos.wrapping_add(self.mask + 1), Ordering::Release);
+                        return Some(value);
+                    }
+                    Err(actual_pos) => pos = actual_pos,
+                }
+            } else if (sequence.wrapping_sub(next_pos) as isize) < 0 {
+                return None;
+            } else {
+                pos = self.pop_pos.load(Ordering::Relaxed);
+            }
+        }
+    }
+}
+
+fn get_class(size: u64) -> Option<usize> {
+    let size_log2 = 64 - size.saturating_sub(1).leading_zeros();
+    let class = size_log2.saturating_sub(MIN_SIZE_LOG2) as usize;
+    if class < CLASS_COUNT {
+        Some(class)
+    } else {
+        None
+    }
+}
+
+fn get_class_layout(class: usize) -> Layout {
+    Layout::from_size_align(1usize << (class as u32 + MIN_SIZE_LOG2), BUFFER_ALIGN).unwrap()
+}
+
+struct Shared {
+    ready: Vec<BoundedQueue>,
+    wanted: Vec<AtomicBool>,
+    retired: BoundedQueue,
+    is_realtime: AtomicBool,
+    is_shutdown: AtomicBool,
+
+    // Set once the helper has started. Unparking never blocks, and a wakeup sent before the
+    // helper parks isn't lost, so the audio thread can wake it whenever it leaves work.
+    helper_thread: OnceLock<Thread>,
+}
+
+impl Shared {
+    fn new() -> Self {
+        Shared {
+            ready: (0..CLASS_COUNT)
+                .map(|_| BoundedQueue::new(READY_CAPACITY))
+                .collect(),
+            wanted: (0..CLASS_COUNT).map(|_| AtomicBool::new(false)).collect(),
+            retired: BoundedQueue::new(RETIRED_CAPACITY),
+            is_realtime: AtomicBool::new(true),
+            is_shutdown: AtomicBool::new(false),
+            helper_thread: OnceLock::new(),
+        }
+    }
+
+    fn wake_helper(&self) {
+        if let Some(helper_thread) = self.helper_thread.get() {
+            helper_thread.unpark();
+        }
+    }
+
+    fn alloc(&self, size: u64) -> *mut u8 {
+        let class = match get_class(size) {
+            Some(class) => class,
+            None => return ptr::null_mut(),
+        };
+
+        // Either way the helper should top the class back up. If nothing was ready the caller is
+        // probably growing a buffer by doubling it, so the next size up gets readied too. It's
+        // released again with the other spares if it's never asked for. A caller waiting for a
+        // buffer asks every sample, so the helper is only woken when a class is newly wanted
+        // rather than on every call.
+        let mut is_newly_wanted = !self.wanted[class].swap(true, Ordering::Relaxed);
+        let buffer = match self.ready[class].pop() {
+            Some(buffer) => buffer as *mut u8,
+            None if !self.is_realtime.load(Ordering::Relaxed) => unsafe {
+                alloc::alloc_zeroed(get_class_layout(class))
+            },
+            None => {
+                if class + 1 < CLASS_COUNT {
+                    is_newly_wanted |= !self.wanted[class + 1].swap(true, Ordering::Relaxed);
+                }
+                ptr::null_mut()
+            }
+        };
+        if is_newly_wanted {
+            self.wake_helper();
+        }
+        buffer
+    }
+
+    fn free(&self, buffer: *mut u8, size: u64) {
+        if buffer.is_null() {
+            return;
+        }
+
+        // If the helper has fallen so far behind that the queue is full, a real-time caller can't
+        // release the buffer itself without risking a glitch, so it's leaked instead.
+        let class = get_class(size).unwrap();
+        if self.retired.push(buffer as usize | class) {
+            self.wake_helper();
+        } else if !self.is_realtime.load(Ordering::Relaxed) {
+            unsafe {
+                alloc::dealloc(buffer, get_class_layout(class));
+            }
+        }
+    }
+
+    // Returns freed buffers to the ready queues (or the system, if there are enough ready),
+    // allocates new buffers for any classes that have been asked for, and releases the spares of
+    // classes that haven't been used for a while. `last_used` is when each class that has spares
+    // was last asked for or freed. Returns when the next spares are due to be released, if any.
+    fn run_helper_pass(&self, now: Instant, last_used: &mut [Option<Instant>]) -> Option<Instant> {
+        while let Some(retired) = self.retired.pop() {
+            let class = retired & (BUFFER_ALIGN - 1);
+            let buffer = (retired & !(BUFFER_ALIGN - 1)) as *mut u8;
+            let layout = get_class_layout(class);
+            last_used[class] = Some(now);
+            unsafe {
+                ptr::write_bytes(buffer, 0, layout.size());
+                if !self.ready[class].push(buffer as usize) {
+                    alloc::dealloc(buffer, layout);
+                }
+            }
+        }
+
+        for (class, wanted) in self.wanted.iter().enumerate() {
+            if !wanted.swap(false, Ordering::Relaxed) {
+                continue;
+            }
+            last_used[class] = Some(now);
+
+            let layout = get_class_layout(class);
+            while !self.ready[class].is_full() {
+                let buffer = unsafe { alloc::alloc_zeroed(layout) };
+                if buffer.is_null() {
+                    break;
+                }
+                if !self.ready[class].push(buffer as usize) {
+                    unsafe {
+                        alloc::dealloc(buffer, layout);
+                    }
+                    break;
+                }
+            }
+        }
+
+        let mut next_release = None;
+        for (class, class_last_used) in last_used.iter_mut().enumerate() {
+            let release_time = match *class_last_used {
+                Some(time) => time + SPARE_LIFETIME,
+                None => continue,
+            };
+            if release_time <= now {
+                self.release_ready(class);
+                *class_last_used = None;
+            } else {
+                next_release =
+                    Some(next_release.map_or(release_time, |next: Instant| next.min(release_time)));
+            }
+        }
+        next_release
+    }
+
+    fn release_ready(&self, class: usize) {
+        while let Some(buffer) = self.ready[class].pop() {
+            unsafe {
+                alloc::dealloc(buffer as *mut u8, get_class_layout(class));
+            }
+        }
+    }
+
+    fn release_all(&self) {
+        let mut last_used = [None; CLASS_COUNT];
+        self.run_helper_pass(Instant::now(), &mut last_used);
+        for class in 0..CLASS_COUNT {
+            self.release_ready(class);
+        }
+    }
+}
+
+// Runs whenever the pool is woken with work to do. Between passes the helper parks until it's
+// woken again, or until the next spares are due to be released, so an idle pool doesn't use any
+// CPU.
+fn helper_main(shared: Arc<Shared>) {
+    let mut last_used = [None; CLASS_COUNT];
+    while !shared.is_shutdown.load(Ordering::SeqCst) {
+        let now = Instant::now();
+        match shared.run_helper_pass(now, &mut last_used) {
+            Some(next_release) => thread::park_timeout(next_release - now),
+            None => thread::park(),
+        }
+    }
+}
+
+/// Hands out zeroed, power-of-two sized buffers to generated code without touching the system
+/// allocator on the calling thread, so stateful functions like delays can resize their memory
+/// from the audio thread.
+///
+/// Buffers are allocated ahead of time by a helper thread. Asking for a size that isn't ready
+/// returns null and wakes the helper, which makes some ready, so callers keep what they have and
+/// ask again later. Freed buffers are handed back to the helper, which zeroes them for reuse.
+/// Spare buffers of a size that hasn't been used for a while are given back to the system.
+///
+/// When the pool isn't real-time, like in offline renders, a size that isn't ready is allocated
+/// on the calling thread instead, so the output doesn't depend on how quickly the helper runs.
+pub struct BufferPool {
+    shared: Arc<Shared>,
+    helper: Option<thread::JoinHandle<()>>,
+}
+
+impl BufferPool {
+    pub fn new() -> Self {
+        let shared = Arc::new(Shared::new());
+
+        let helper_shared = shared.clone();
+        let helper = thread::Builder::new()
+            .name("maxim.buffers".to_string())
+            .spawn(move || helper_main(helper_shared))
+            .unwrap();
+        shared.helper_thread.set(helper.thread().clone()).unwrap();
+
+        BufferPool {
+            shared,
+            helper: Some(helper),
+        }
+    }
+
+    /// Sets whether buffers are taken from the calling thread without ever allocating. This is on by
+    /// default.
+    pub fn set_realtime(&self, realtime: bool) {
+        self.shared.is_realtime.store(realtime, Ordering::Relaxed);
+    }
+
+    /// The pointer that generated code passes back to `alloc_buffer` and `free_buffer`.
+    pub fn as_ptr(&self) -> *const c_void {
+        &*self.shared as *const Shared as *const c_void
+    }
+}
+
+impl Drop for BufferPool {
+    fn drop(&mut self) {
+        self.shared.is_shutdown.store(true, Ordering::SeqCst);
+        self.shared.wake_helper();
+        if let Some(helper) = self.helper.take() {
+            helper.join().unwrap();
+        }
+        self.shared.release_all();
+    }
+}
+
+/// Takes a zeroed buffer of at least `size` bytes from the pool, or returns null if there isn't
+/// one ready and the pool is real-time. This is registered with the JIT as the `maxim.buffer.alloc` builtin.
+pub unsafe extern "C" fn alloc_buffer(pool: *const c_void, size: u64) -> *mut c_void {
+    (*(pool as *const Shared)).alloc(size) as *mut c_void
+}
+
+/// Gives a buffer from `alloc_buffer` back to the pool. `size` must be the size it was asked for
+/// with. This is registered with the JIT as the `maxim.buffer.free` builtin.
+pub unsafe extern "C" fn free_buffer(pool: *const c_void, buffer: *mut c_void, size: u64) {
+    (*(pool as *const Shared)).free(buffer as *mut u8, size)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::collections::HashSet;
+
+    #[test]
+    fn queue_is_first_in_first_out() {
+        let queue = BoundedQueue::new(4);
+        assert_eq!(queue.pop(), None);
+        for value in 1..5 {
+            assert!(queue.push(value));
+        }
+        assert!(queue.is_full());
+        assert!(!queue.push(5));
+        for value in 1..5 {
+            assert_eq!(queue.pop(), Some(value));
+        }
+        assert_eq!(queue.pop(), None);
+    }
+
+    #[test]
+    fn queue_rounds_capacity_up() {
+        let queue = BoundedQueue::new(3);
+        for value in 0..4 {
+            assert!(queue.push(value));
+        }
+        assert!(!queue.push(4));
+    }
+
+    #[test]
+    fn queue_wraps_around() {
+        let queue = BoundedQueue::new(4);
+        let mut next_push = 0;
+        let mut next_pop = 0;
+
+        // keep the queue partly full, so pushes and pops wrap past the end at different times
+        for round in 0..1000 {
+            for _ in 0..(round % 3 + 1) {
+                if queue.push(next_push) {
+                    next_push += 1;
+                }
+            }
+            for _ in 0..(round % 2 + 1) {
+                if let Some(value) = queue.pop() {
+                    assert_eq!(value, next_pop);
+                    next_pop += 1;
+                }
+            }
+        }
+        while let Some(value) = queue.pop() {
+            assert_eq!(value, next_pop);
+            next_pop += 1;
+        }
+        assert_eq!(next_pop, next_push);
+        assert!(next_push > 1000);
+    }
+
+    #[test]
+    fn queue_hands_out_each_value_once_across_threads() {
+        const THREAD_COUNT: usize = 4;
+        const VALUES_PER_THREAD: usize = 20000;
+
+        let queue = Arc::new(BoundedQueue::new(16));
+        let popped_count = Arc::new(AtomicUsize::new(0));
+        let producers: Vec<_> = (0..THREAD_COUNT)
+            .map(|thread_index| {
+                let queue = queue.clone();
+                thread::spawn(move || {
+                    for index in 0..VALUES_PER_THREAD {
+                        let value = thread_index * VALUES_PER_THREAD + index;
+                        while !queue.push(value) {
+                            thread::yield_now();
+                        }
+                    }
+                })
+            })
+            .collect();
+        let consumers: Vec<_> = (0..THREAD_COUNT)
+            .map(|_| {
+                let queue = queue.clone();
+                let popped_count = popped_count.clone();
+                thread::spawn(move || {
+                    let mut values = Vec::new();
+                    while popped_count.load(Ordering::SeqCst) < THREAD_COUNT * VALUES_PER_THREAD {
+                        match queue.pop() {
+                            Some(value) => {
+                                values.push(value);
+                                popped_count.fetch_add(1, Ordering::SeqCst);
+                            }
+                            None => thread::yield_now(),
+                        }
+                    }
+                    values
+                })
+            })
+            .collect();
+
+        for producer in producers {
+            producer.join().unwrap();
+        }
+        let mut seen = HashSet::new();
+        for consumer in consumers {
+            let values = consumer.join().unwrap();
+
+            // values from one producer come out in the order they went in
+            let mut last_values = vec![None; THREAD_COUNT];
+            for value in values {
+                let producer = value / VALUES_PER_THREAD;
+                assert!(last_values[producer].map_or(true, |last| last < value));
+                last_values[producer] = Some(value);
+                assert!(seen.insert(value));
+            }
+        }
+        assert_eq!(seen.len(), THREAD_COUNT * VALUES_PER_THREAD);
+        assert_eq!(queue.pop(), None);
+    }
+
+    #[test]
+    fn classes_cover_sizes() {
+        assert_eq!(get_class(0), Some(0));
+        assert_eq!(get_class(64), Some(0));
+        assert_eq!(get_class(65), Some(1));
+        assert_eq!(get_class(1 << 20), Some(14));
+        assert_eq!(get_class(1 << 32), Some(26));
+        assert_eq!(get_class((1 << 32) + 1), None);
+    }
+
+    #[test]
+    fn offline_pool_allocates_straight_away() {
+        let pool = BufferPool::new();
+        pool.set_realtime(false);
+        unsafe {
+            let buffer = alloc_buffer(pool.as_ptr(), 1000) as *mut u8;
+            assert!(!buffer.is_null());
+            assert!((0..1000).all(|index| *buffer.add(index) == 0));
+            free_buffer(pool.as_ptr(), buffer as *mut c_void, 1000);
+        }
+    }
+
+    #[test]
+    fn unused_spares_are_released() {
+        let shared = Shared::new();
+        let mut last_used = [None; CLASS_COUNT];
+        let start = Instant::now();
+        shared.alloc(1000);
+        shared.alloc(1 << 16);
+
+        let next_release = shared.run_helper_pass(start, &mut last_used);
+        assert_eq!(next_release, Some(start + SPARE_LIFETIME));
+        assert!(shared.ready[get_class(1000).unwrap()].is_full());
+
+        // asking for a class again keeps its spares around
+        let later = start + SPARE_LIFETIME / 2;
+        shared.wanted[get_class(1000).unwrap()].store(true, Ordering::Relaxed);
+        let next_release = shared.run_helper_pass(later, &mut last_used);
+        assert_eq!(next_release, Some(start + SPARE_LIFETIME));
+
+        let next_release = shared.run_helper_pass(start + SPARE_LIFETIME, &mut last_used);
+        assert_eq!(next_release, Some(later + SPARE_LIFETIME));
+        assert_eq!(shared.ready[get_class(1 << 16).unwrap()].pop(), None);
+        assert!(shared.ready[get_class(1000).unwrap()].is_full());
+
+        let next_release = shared.run_helper_pass(later + SPARE_LIFETIME, &mut last_used);
+        assert_eq!(next_release, None);
+        assert_eq!(shared.ready[get_class(1000).unwrap()].pop(), None);
+        shared.release_all();
+    }
+
+    #[test]
+    fn realtime_pool_readies_buffers_in_the_background() {
+        let pool = BufferPool::new();
+        unsafe {
+            let mut buffer = alloc_buffer(pool.as_ptr(), 1 << 16) as *mut u8;
+            while buffer.is_null() {
+                thread::sleep(Duration::from_millis(1));
+                buffer = alloc_buffer(pool.as_ptr(), 1 << 16) as *mut u8;
+            }
+            ptr::write_bytes(buffer, 0xFF, 1 << 16);
+            free_buffer(pool.as_ptr(), buffer as *mut c_void, 1 << 16);
+        }
+    }
+}
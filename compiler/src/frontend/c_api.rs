@@ -1,10 +1,12 @@
-use super::{exporter, value_reader, Runtime, Transaction};
+use super::convolver::IMPULSE_SLOT_COUNT;
+use super::{exporter, value_reader, ControlSnapshot, Runtime, RuntimeShared, Transaction};
 use crate::frontend::exporter::export_config;
-use crate::util::feature_level::{get_target_feature_string, FEATURE_LEVEL};
+use crate::util::feature_level::{get_target_feature_string, get_voice_lanes, FEATURE_LEVEL};
 use crate::{ast, codegen, mir, parser, pass, util, CompileError};
 use inkwell::{orc, targets};
 use std::os::raw::c_void;
 use std::slice;
+use std::sync::Arc;
 
 #[no_mangle]
 pub extern "C" fn maxim_initialize() {
@@ -40,8 +42,9 @@ pub unsafe extern "C" fn maxim_create_runtime(include_ui: bool) -> *mut Runtime
         )
         .unwrap();
 
-    let target =
+    let mut target =
         codegen::TargetProperties::new(include_ui, codegen::OptimizationLevel::Editor, machine);
+    target.voice_lanes = get_voice_lanes(*FEATURE_LEVEL);
     Box::into_raw(Box::new(Runtime::new(target)))
 }
 
@@ -52,9 +55,22 @@ pub unsafe extern "C" fn maxim_destroy_runtime(runtime: *mut Runtime) {
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_allocate_id(runtime: *mut Runtime) -> u64 {
-    use crate::mir::IdAllocator;
-    (*runtime).alloc_id()
+pub unsafe extern "C" fn maxim_set_cache_directory(
+    runtime: *mut Runtime,
+    c_directory: *const std::os::raw::c_char,
+) {
+    let directory = std::ffi::CStr::from_ptr(c_directory).to_str().unwrap();
+    (*runtime).set_cache_directory(std::path::PathBuf::from(directory));
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_runtime_shared(runtime: *const Runtime) -> *const RuntimeShared {
+    Arc::as_ptr((*runtime).shared())
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_allocate_id(shared: *const RuntimeShared) -> u64 {
+    (*shared).next_id()
 }
 
 #[no_mangle]
@@ -67,33 +83,85 @@ pub unsafe extern "C" fn maxim_export_transaction(
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_run_update(runtime: *const Runtime) {
-    (*runtime).run_update();
+pub unsafe extern "C" fn maxim_begin_update(shared: *const RuntimeShared) -> u64 {
+    (*shared).begin_update()
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_set_bpm(runtime: *mut Runtime, bpm: f64) {
-    (*runtime).set_bpm(bpm);
+pub unsafe extern "C" fn maxim_end_update(shared: *const RuntimeShared) {
+    (*shared).end_update();
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_get_bpm(runtime: *const Runtime) -> f64 {
-    (*runtime).get_bpm()
+pub unsafe extern "C" fn maxim_pause_updates(shared: *const RuntimeShared) {
+    (*shared).pause_updates();
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_set_sample_rate(runtime: *mut Runtime, sample_rate: f64) {
-    (*runtime).set_sample_rate(sample_rate);
+pub unsafe extern "C" fn maxim_resume_updates(shared: *const RuntimeShared) {
+    (*shared).resume_updates();
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_get_sample_rate(runtime: *const Runtime) -> f64 {
-    (*runtime).get_sample_rate()
+pub unsafe extern "C" fn maxim_run_update(shared: *const RuntimeShared) {
+    (*shared).run_update();
 }
 
 #[no_mangle]
-pub unsafe extern "C" fn maxim_get_profile_times_ptr(runtime: *const Runtime) -> *mut u64 {
-    (*runtime).get_profile_times_ptr()
+pub unsafe extern "C" fn maxim_run_update_block(
+    shared: *const RuntimeShared,
+    frames: u64,
+    stride: u64,
+    inputs: *const *const f32,
+    outputs: *const *mut f32,
+) {
+    (*shared).run_update_block(frames, stride, inputs, outputs);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_bpm(shared: *const RuntimeShared, bpm: f64) {
+    (*shared).set_bpm(bpm);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_bpm(shared: *const RuntimeShared) -> f64 {
+    (*shared).get_bpm()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_sample_rate(shared: *const RuntimeShared, sample_rate: f64) {
+    (*shared).set_sample_rate(sample_rate);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_sample_rate(shared: *const RuntimeShared) -> f64 {
+    (*shared).get_sample_rate()
+}
+
+#[no_mangle]
+pub extern "C" fn maxim_get_impulse_slot_count() -> usize {
+    IMPULSE_SLOT_COUNT
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_impulse(
+    shared: *const RuntimeShared,
+    index: usize,
+    samples: *const f32,
+    sample_count: usize,
+    channel_count: usize,
+) -> bool {
+    let samples = if sample_count == 0 {
+        &[]
+    } else {
+        slice::from_raw_parts(samples, sample_count)
+    };
+    (*shared).set_impulse(index, samples, channel_count)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_profile_times_ptr(shared: *const RuntimeShared) -> *mut u64 {
+    (*shared).get_profile_times_ptr()
 }
 
 #[no_mangle]
@@ -102,6 +170,79 @@ pub unsafe extern "C" fn maxim_commit(runtime: *mut Runtime, transaction: *mut T
     (*runtime).commit(*owned_transaction)
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn maxim_prepare_commit(
+    runtime: *mut Runtime,
+    transaction: *mut Transaction,
+) -> bool {
+    let owned_transaction = Box::from_raw(transaction);
+    (*runtime).prepare_commit(*owned_transaction)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_deploy_commit(runtime: *mut Runtime) {
+    (*runtime).deploy_commit();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_publish(runtime: *mut Runtime) {
+    (*runtime).publish();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_tiered(runtime: *mut Runtime, tiered: bool) {
+    (*runtime).set_tiered(tiered);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_specializing(runtime: *mut Runtime, specializing: bool) {
+    (*runtime).set_specializing(specializing);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_realtime(shared: *const RuntimeShared, realtime: bool) {
+    (*shared).set_realtime(realtime);
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_voice_lanes(runtime: *mut Runtime, voice_lanes: bool) {
+    (*runtime).set_voice_lanes(if voice_lanes {
+        get_voice_lanes(*FEATURE_LEVEL)
+    } else {
+        1
+    });
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_needs_optimize(runtime: *const Runtime) -> bool {
+    (*runtime).needs_optimize()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_snapshot_controls(runtime: *const Runtime) -> *mut ControlSnapshot {
+    Box::into_raw(Box::new((*runtime).snapshot_controls()))
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_destroy_control_snapshot(snapshot: *mut ControlSnapshot) {
+    Box::from_raw(snapshot);
+    // box will be dropped here
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_prepare_optimize(
+    runtime: *mut Runtime,
+    snapshot: *mut ControlSnapshot,
+) -> bool {
+    let owned_snapshot = Box::from_raw(snapshot);
+    (*runtime).prepare_optimize(*owned_snapshot)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_deploy_optimized(runtime: *mut Runtime) {
+    (*runtime).deploy_optimized();
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn maxim_is_node_extracted(
     runtime: *const Runtime,
@@ -113,20 +254,20 @@ pub unsafe extern "C" fn maxim_is_node_extracted(
 
 #[no_mangle]
 pub unsafe extern "C" fn maxim_convert_num(
-    runtime: *const Runtime,
+    shared: *const RuntimeShared,
     result: *mut c_void,
     target_form: i8,
     num: *const c_void,
 ) {
-    (*runtime).convert_num(result, target_form, num)
+    (*shared).convert_num(result, target_form, num)
 }
 
 #[no_mangle]
 pub unsafe extern "C" fn maxim_get_portal_ptr(
-    runtime: *const Runtime,
+    shared: *const RuntimeShared,
     portal: usize,
 ) -> *mut c_void {
-    (*runtime).get_portal_ptr(portal)
+    (*shared).get_portal_ptr(portal)
 }
 
 #[no_mangle]
@@ -144,6 +285,30 @@ pub unsafe extern "C" fn maxim_get_node_ptr(
     value_reader::get_node_ptr(&*runtime, surface, surface_ptr, node)
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn maxim_request_profile_sample(shared: *const RuntimeShared) {
+    (*shared).request_profile_sample()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_profile_sample_count(shared: *const RuntimeShared) -> u64 {
+    (*shared).get_profile_sample_count()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_profile_cycles_per_second(shared: *const RuntimeShared) -> f64 {
+    (*shared).get_profile_cycles_per_second()
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_get_node_profile_ptr(
+    runtime: *const Runtime,
+    surface: u64,
+    node: usize,
+) -> *const u64 {
+    (*runtime).get_node_profile_ptr(surface, node)
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn maxim_get_extracted_bitmask_ptr(
     runtime: *const Runtime,
@@ -185,6 +350,11 @@ pub unsafe extern "C" fn maxim_destroy_transaction(val: *mut Transaction) {
     // box will be dropped here
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn maxim_transaction_uses_impulses(val: *const Transaction) -> bool {
+    (*val).uses_impulses()
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn maxim_print_transaction_to_stdout(val: *const Transaction) {
     println!("{:#?}", *val);
@@ -326,6 +496,11 @@ pub unsafe extern "C" fn maxim_build_root_socket(root: *mut mir::Root, vartype:
     (*root).sockets.push(*owned_vartype);
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_root_array_capacity(root: *mut mir::Root, capacity: u8) {
+    (*root).array_capacity = capacity.max(1).min(codegen::values::MAX_ARRAY_CAPACITY);
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn maxim_build_surface(
     transaction: *mut Transaction,
@@ -345,6 +520,30 @@ pub unsafe extern "C" fn maxim_build_surface(
     (*transaction).surfaces.get_mut(&id).unwrap()
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_surface_parallel_voices(
+    surface: *mut mir::Surface,
+    parallel_voices: bool,
+) {
+    (*surface).parallel_voices = parallel_voices;
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_surface_parallel_branches(
+    surface: *mut mir::Surface,
+    parallel_branches: bool,
+) {
+    (*surface).parallel_branches = parallel_branches;
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn maxim_set_surface_oversampling(
+    surface: *mut mir::Surface,
+    oversampling: u8,
+) {
+    (*surface).oversampling = oversampling;
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn maxim_build_value_group(
     surface: *mut mir::Surface,
@@ -591,6 +790,7 @@ pub unsafe extern "C" fn maxim_create_code_config(
     c_instrument_prefix: *const std::os::raw::c_char,
     include_instrument: bool,
     include_library: bool,
+    precision: codegen::Precision,
 ) -> *mut export_config::CodeConfig {
     let instrument_prefix = std::ffi::CStr::from_ptr(c_instrument_prefix)
         .to_str()
@@ -601,6 +801,7 @@ pub unsafe extern "C" fn maxim_create_code_config(
         instrument_prefix,
         include_instrument,
         include_library,
+        precision,
     }))
 }
 
@@ -0,0 +1,176 @@
+use super::value_reader;
+use crate::ast::{ControlType, FormType};
+use crate::codegen::ObjectCache;
+use crate::mir::{BlockRef, ConstantNum, NodeData, SurfaceRef};
+use std::collections::hash_map::Entry;
+use std::collections::HashMap;
+use std::os::raw::c_void;
+use std::sync::atomic::{AtomicU64, AtomicU8, Ordering};
+use std::time::{Duration, Instant};
+
+// How long a control has to keep the same value before blocks are specialized on it.
+const STABLE_MILLIS: u64 = 2000;
+
+// Matches the layout of `NumValue`. The audio thread can be writing to a control while it's read,
+// so each field is loaded atomically. A value torn by a write is gone by the next snapshot, so it
+// never stays the same for long enough to be specialized on.
+#[repr(C)]
+struct RawNum {
+    left: AtomicU64,
+    right: AtomicU64,
+    form: AtomicU8,
+}
+
+struct ControlHistory {
+    value: ConstantNum,
+    stable_since: Instant,
+}
+
+/// The values of the watched controls in the deployed code at one point in time.
+///
+/// Only controls that a block reads and doesn't write are watched, and controls inside extracted
+/// groups are skipped since they're different for each voice.
+pub struct ControlSnapshot {
+    values: HashMap<(BlockRef, usize), ConstantNum>,
+    taken_at: Instant,
+}
+
+impl ControlSnapshot {
+    pub fn empty() -> Self {
+        ControlSnapshot {
+            values: HashMap::new(),
+            taken_at: Instant::now(),
+        }
+    }
+
+    /// Reads the current value of every watched control. `root_ptr` must point to the pointers of
+    /// the deployed root surface. Controls can be written to while they're read.
+    pub fn read(cache: &ObjectCache, root_surface: SurfaceRef, root_ptr: *mut c_void) -> Self {
+        let mut snapshot = ControlSnapshot::empty();
+        if !root_ptr.is_null() && cache.surface_layout(root_surface).is_some() {
+            snapshot.read_surface(cache, root_surface, root_ptr);
+        }
+        snapshot
+    }
+
+    fn read_surface(&mut self, cache: &ObjectCache, surface: SurfaceRef, surface_ptr: *mut c_void) {
+        let surface_mir = cache.surface_mir(surface).unwrap();
+        let layout = cache.surface_layout(surface).unwrap();
+        for (node_index, node) in surface_mir.nodes.iter().enumerate() {
+            let node_ptr = value_reader::get_internal_node_ptr(
+                cache.target(),
+                layout,
+                surface_ptr,
+                node_index,
+            );
+            match node.data {
+                NodeData::Custom { block, .. } => self.read_block(cache, block, node_ptr),
+                NodeData::Group(child_surface) => self.read_surface(
+                    cache,
+                    child_surface,
+                    value_reader::get_surface_ptr(node_ptr),
+                ),
+                NodeData::Dummy | NodeData::ExtractGroup { .. } => {}
+            }
+        }
+    }
+
+    fn read_block(&mut self, cache: &ObjectCache, block: BlockRef, node_ptr: *mut c_void) {
+        let block_mir = cache.block_mir(block).unwrap();
+        for (control_index, control) in block_mir.controls.iter().enumerate() {
+            if control.control_type != ControlType::Audio
+                || control.value_written
+                || !control.value_read
+            {
+                continue;
+            }
+
+            let control_ptrs =
+                value_reader::get_control_ptrs(cache, block, node_ptr, control_index);
+            let raw_value = unsafe { &*(control_ptrs.value as *const RawNum) };
+
+            // Controls that haven't been given a value yet can have any form, and are left out.
+            if let Some(form) = FormType::from_u8(raw_value.form.load(Ordering::Relaxed)) {
+                self.values.insert(
+                    (block, control_index),
+                    ConstantNum::new(
+                        f64::from_bits(raw_value.left.load(Ordering::Relaxed)),
+                        f64::from_bits(raw_value.right.load(Ordering::Relaxed)),
+                        form,
+                    ),
+                );
+            }
+        }
+    }
+}
+
+/// Keeps track of how long each watched control has had the same value, to find controls that
+/// haven't changed for a while and can be specialized on.
+pub struct ControlSpecializer {
+    history: HashMap<(BlockRef, usize), ControlHistory>,
+}
+
+impl ControlSpecializer {
+    pub fn new() -> Self {
+        ControlSpecializer {
+            history: HashMap::new(),
+        }
+    }
+
+    /// Forgets the values seen for a block's controls, e.g because the block has been rebuilt and
+    /// its controls might have changed.
+    pub fn forget_block(&mut self, block: BlockRef) {
+        self.history
+            .retain(|&(history_block, _), _| history_block != block);
+    }
+
+    /// Compares the values in a snapshot with the ones seen before, and returns the controls of
+    /// each block that have been stable for long enough, sorted by control index.
+    pub fn sample(
+        &mut self,
+        snapshot: &ControlSnapshot,
+    ) -> HashMap<BlockRef, Vec<(usize, ConstantNum)>> {
+        let now = snapshot.taken_at;
+        self.history
+            .retain(|key, _| snapshot.values.contains_key(key));
+        for (&key, value) in &snapshot.values {
+            match self.history.entry(key) {
+                Entry::Occupied(mut entry) => {
+                    let history = entry.get_mut();
+                    if !is_same_value(&history.value, value) {
+                        history.value = value.clone();
+                        history.stable_since = now;
+                    }
+                }
+                Entry::Vacant(entry) => {
+                    entry.insert(ControlHistory {
+                        value: value.clone(),
+                        stable_since: now,
+                    });
+                }
+            }
+        }
+
+        let stable_duration = Duration::from_millis(STABLE_MILLIS);
+        let mut stable_values = HashMap::new();
+        for (&(block, control), history) in &self.history {
+            if now.duration_since(history.stable_since) >= stable_duration {
+                stable_values
+                    .entry(block)
+                    .or_insert_with(Vec::new)
+                    .push((control, history.value.clone()));
+            }
+        }
+        for values in stable_values.values_mut() {
+            values.sort_by_key(|(control, _)| *control);
+        }
+        stable_values
+    }
+}
+
+// Values are compared by their bits, so a NaN that hasn't changed still counts as stable.
+pub fn is_same_value(a: &ConstantNum, b: &ConstantNum) -> bool {
+    a.left.to_bits() == b.left.to_bits()
+        && a.right.to_bits() == b.right.to_bits()
+        && a.form == b.form
+}
@@ -0,0 +1,706 @@
+use super::buffer_pool;
+use std::f64::consts;
+use std::os::raw::c_void;
+use std::ptr;
+use std::slice;
+use std::sync::atomic::{AtomicPtr, Ordering};
+use std::sync::Mutex;
+
+/// How many impulses can be loaded at once. `convolve` picks one with its `ir` argument.
+pub const IMPULSE_SLOT_COUNT: usize = 64;
+
+/// The longest impulse that can be loaded, in samples, which is about three seconds at 44.1kHz.
+/// Longer impulses are cut short. Each instance keeps the spectra of as many past partitions of
+/// input as the impulse has, so this also caps an instance's state at about 4MB.
+pub const MAX_IMPULSE_LEN: usize = 1 << 17;
+
+// Impulses are split into partitions of this many samples. The first partition is applied
+// directly to each sample, so there's no added latency, and the rest are applied in the frequency
+// domain with an FFT of twice the size. The FFTs run once every partition, but multiplying the
+// spectra of older inputs with the impulse is spread over the samples in between.
+const PARTITION_LEN: usize = 64;
+const FFT_LEN: usize = PARTITION_LEN * 2;
+const BIN_COUNT: usize = PARTITION_LEN + 1;
+
+// The start of each instance's state holds a `StateHeader`, followed by its sample buffers.
+const STATE_HEADER_SIZE: usize = 64;
+
+/// A radix-2 FFT of `FFT_LEN` complex values, with real and imaginary parts kept in separate
+/// arrays.
+struct FftPlan {
+    twiddle_re: [f64; FFT_LEN / 2],
+    twiddle_im: [f64; FFT_LEN / 2],
+    bit_reverse: [usize; FFT_LEN],
+}
+
+impl FftPlan {
+    fn new() -> Self {
+        let mut twiddle_re = [0.; FFT_LEN / 2];
+        let mut twiddle_im = [0.; FFT_LEN / 2];
+        for index in 0..FFT_LEN / 2 {
+            let angle = -2. * consts::PI * index as f64 / FFT_LEN as f64;
+            twiddle_re[index] = angle.cos();
+            twiddle_im[index] = angle.sin();
+        }
+
+        let bit_count = FFT_LEN.trailing_zeros();
+        let mut bit_reverse = [0; FFT_LEN];
+        for (index, reversed) in bit_reverse.iter_mut().enumerate() {
+            *reversed = (0..bit_count).fold(0, |acc, bit| (acc << 1) | ((index >> bit) & 1));
+        }
+
+        FftPlan {
+            twiddle_re,
+            twiddle_im,
+            bit_reverse,
+        }
+    }
+
+    fn forward(&self, re: &mut [f64; FFT_LEN], im: &mut [f64; FFT_LEN]) {
+        for index in 0..FFT_LEN {
+            let reversed = self.bit_reverse[index];
+            if reversed > index {
+                re.swap(index, reversed);
+                im.swap(index, reversed);
+            }
+        }
+
+        let mut size = 2;
+        while size <= FFT_LEN {
+            let half = size / 2;
+            let step = FFT_LEN / size;
+            for start in (0..FFT_LEN).step_by(size) {
+                for offset in 0..half {
+                    let w_re = self.twiddle_re[offset * step];
+                    let w_im = self.twiddle_im[offset * step];
+                    let a = start + offset;
+                    let b = a + half;
+                    let t_re = re[b] * w_re - im[b] * w_im;
+                    let t_im = re[b] * w_im + im[b] * w_re;
+                    re[b] = re[a] - t_re;
+                    im[b] = im[a] - t_im;
+                    re[a] += t_re;
+                    im[a] += t_im;
+                }
+            }
+            size *= 2;
+        }
+    }
+
+    // Unscaled, the scale is folded into the impulse's partitions instead.
+    fn inverse(&self, re: &mut [f64; FFT_LEN], im: &mut [f64; FFT_LEN]) {
+        for val in im.iter_mut() {
+            *val = -*val;
+        }
+        self.forward(re, im);
+        for val in im.iter_mut() {
+            *val = -*val;
+        }
+    }
+}
+
+/// An impulse prepared for convolution: the first partition of each channel, reversed so it can
+/// be applied as a dot product with the newest inputs, and the spectrum of each of the other
+/// partitions. Mono impulses are applied to both channels.
+struct Impulse {
+    head: [Vec<f64>; 2],
+    partitions_re: [Vec<f64>; 2],
+    partitions_im: [Vec<f64>; 2],
+
+    // how many partitions are applied in the frequency domain, not including the head
+    tail_count: usize,
+}
+
+impl Impulse {
+    fn new(plan: &FftPlan, samples: &[f32], channel_count: usize) -> Self {
+        let frame_count = (samples.len() / channel_count).min(MAX_IMPULSE_LEN);
+        let tail_count = (frame_count.max(1) - 1) / PARTITION_LEN;
+        let get_sample = |channel: usize, frame: usize| {
+            if frame < frame_count {
+                f64::from(samples[frame * channel_count + channel.min(channel_count - 1)])
+            } else {
+                0.
+            }
+        };
+
+        let mut impulse = Impulse {
+            head: [vec![0.; PARTITION_LEN], vec![0.; PARTITION_LEN]],
+            partitions_re: [
+                vec![0.; tail_count * BIN_COUNT],
+                vec![0.; tail_count * BIN_COUNT],
+            ],
+            partitions_im: [
+                vec![0.; tail_count * BIN_COUNT],
+                vec![0.; tail_count * BIN_COUNT],
+            ],
+            tail_count,
+        };
+
+        for channel in 0..2 {
+            for tap in 0..PARTITION_LEN {
+                impulse.head[channel][PARTITION_LEN - 1 - tap] = get_sample(channel, tap);
+            }
+
+            for partition in 0..tail_count {
+                let mut re = [0.; FFT_LEN];
+                let mut im = [0.; FFT_LEN];
+                let start = (partition + 1) * PARTITION_LEN;
+                for tap in 0..PARTITION_LEN {
+                    re[tap] = get_sample(channel, start + tap) / FFT_LEN as f64;
+                }
+                plan.forward(&mut re, &mut im);
+
+                let bins = partition * BIN_COUNT..(partition + 1) * BIN_COUNT;
+                impulse.partitions_re[channel][bins.clone()].copy_from_slice(&re[..BIN_COUNT]);
+                impulse.partitions_im[channel][bins].copy_from_slice(&im[..BIN_COUNT]);
+            }
+        }
+
+        impulse
+    }
+
+    // Instances keep the last two partitions of input, the tail's output for the current
+    // partition, the spectrum of the next partition's output so far, and the spectra of past
+    // inputs for each tail partition, for both channels.
+    fn state_size(&self) -> u64 {
+        let sample_count =
+            2 * (FFT_LEN + PARTITION_LEN + 2 * BIN_COUNT + 2 * self.tail_count * BIN_COUNT);
+        (STATE_HEADER_SIZE + sample_count * 8) as u64
+    }
+}
+
+#[repr(C)]
+struct StateHeader {
+    // which impulse the state was set up for, so a new state can be made when it changes
+    impulse: *const Impulse,
+    position: usize,
+    newest_spectrum: usize,
+}
+
+// The per-channel buffers of an instance's state, after its header.
+struct StateBuffers<'a> {
+    history: [&'a mut [f64]; 2],
+    tail_output: [&'a mut [f64]; 2],
+    next_re: [&'a mut [f64]; 2],
+    next_im: [&'a mut [f64]; 2],
+    spectra_re: [&'a mut [f64]; 2],
+    spectra_im: [&'a mut [f64]; 2],
+}
+
+impl<'a> StateBuffers<'a> {
+    unsafe fn new(state: *mut u8, impulse: &Impulse) -> Self {
+        let spectra_len = impulse.tail_count * BIN_COUNT;
+        let mut next_ptr = state.add(STATE_HEADER_SIZE) as *mut f64;
+        let mut take = |len: usize| {
+            let buffer = slice::from_raw_parts_mut(next_ptr, len);
+            next_ptr = next_ptr.add(len);
+            buffer
+        };
+        StateBuffers {
+            history: [take(FFT_LEN), take(FFT_LEN)],
+            tail_output: [take(PARTITION_LEN), take(PARTITION_LEN)],
+            next_re: [take(BIN_COUNT), take(BIN_COUNT)],
+            next_im: [take(BIN_COUNT), take(BIN_COUNT)],
+            spectra_re: [take(spectra_len), take(spectra_len)],
+            spectra_im: [take(spectra_len), take(spectra_len)],
+        }
+    }
+}
+
+// Kept as four separate sums so they can be worked out in parallel.
+fn dot(a: &[f64], b: &[f64]) -> f64 {
+    let mut sums = [0.; 4];
+    for (a_chunk, b_chunk) in a.chunks_exact(4).zip(b.chunks_exact(4)) {
+        for lane in 0..4 {
+            sums[lane] += a_chunk[lane] * b_chunk[lane];
+        }
+    }
+    (sums[0] + sums[1]) + (sums[2] + sums[3])
+}
+
+// Adds the product of one tail partition of the impulse and the spectrum of the input it applies
+// to onto the spectrum of the next partition's output.
+fn multiply_partition(
+    impulse: &Impulse,
+    buffers: &mut StateBuffers,
+    partition: usize,
+    spectrum: usize,
+) {
+    let spectrum_bins = spectrum * BIN_COUNT..(spectrum + 1) * BIN_COUNT;
+    let partition_bins = partition * BIN_COUNT..(partition + 1) * BIN_COUNT;
+    for channel in 0..2 {
+        let x_re = &buffers.spectra_re[channel][spectrum_bins.clone()];
+        let x_im = &buffers.spectra_im[channel][spectrum_bins.clone()];
+        let h_re = &impulse.partitions_re[channel][partition_bins.clone()];
+        let h_im = &impulse.partitions_im[channel][partition_bins.clone()];
+        let next_re = &mut buffers.next_re[channel];
+        let next_im = &mut buffers.next_im[channel];
+        for bin in 0..BIN_COUNT {
+            next_re[bin] += x_re[bin] * h_re[bin] - x_im[bin] * h_im[bin];
+            next_im[bin] += x_re[bin] * h_im[bin] + x_im[bin] * h_re[bin];
+        }
+    }
+}
+
+// Runs after the sample at `position` in the partition, and multiplies its share of the tail
+// partitions that use inputs from before the current partition. By the time the partition is
+// full, only the first tail partition is left, which needs the input that's just come in.
+fn process_tail_slice(impulse: &Impulse, header: &StateHeader, buffers: &mut StateBuffers) {
+    let later_count = impulse.tail_count - 1;
+    let slice_len = (later_count + PARTITION_LEN - 1) / PARTITION_LEN;
+    let start = 1 + header.position * slice_len;
+    let end = (start + slice_len).min(impulse.tail_count);
+
+    // The spectrum of the current partition will be stored one after the newest, so partition
+    // `n` applies to the spectrum `n - 1` before the newest.
+    for partition in start..end {
+        let spectrum =
+            (header.newest_spectrum + 1 + impulse.tail_count - partition) % impulse.tail_count;
+        multiply_partition(impulse, buffers, partition, spectrum);
+    }
+}
+
+// Runs once the current partition of input is full. Both channels share one FFT, with left in
+// the real part and right in the imaginary part, and are pulled apart by their symmetry. The new
+// spectrum is multiplied with the first tail partition of the impulse and added to the products
+// from the rest of the tail, to give the tail's output for the next partition of samples.
+fn process_partition(
+    plan: &FftPlan,
+    impulse: &Impulse,
+    header: &mut StateHeader,
+    buffers: &mut StateBuffers,
+) {
+    let mut re = [0.; FFT_LEN];
+    let mut im = [0.; FFT_LEN];
+    re.copy_from_slice(buffers.history[0]);
+    im.copy_from_slice(buffers.history[1]);
+    plan.forward(&mut re, &mut im);
+
+    let newest = (header.newest_spectrum + 1) % impulse.tail_count;
+    header.newest_spectrum = newest;
+    for bin in 0..BIN_COUNT {
+        let mirror = (FFT_LEN - bin) % FFT_LEN;
+        let index = newest * BIN_COUNT + bin;
+        buffers.spectra_re[0][index] = (re[bin] + re[mirror]) * 0.5;
+        buffers.spectra_im[0][index] = (im[bin] - im[mirror]) * 0.5;
+        buffers.spectra_re[1][index] = (im[bin] + im[mirror]) * 0.5;
+        buffers.spectra_im[1][index] = (re[mirror] - re[bin]) * 0.5;
+    }
+    multiply_partition(impulse, buffers, 0, newest);
+
+    // put the channels back together, filling in the upper bins from the lower ones
+    let (left_re, right_re) = (&buffers.next_re[0], &buffers.next_re[1]);
+    let (left_im, right_im) = (&buffers.next_im[0], &buffers.next_im[1]);
+    for bin in 0..FFT_LEN {
+        if bin < BIN_COUNT {
+            re[bin] = left_re[bin] - right_im[bin];
+            im[bin] = left_im[bin] + right_re[bin];
+        } else {
+            let mirror = FFT_LEN - bin;
+            re[bin] = left_re[mirror] + right_im[mirror];
+            im[bin] = right_re[mirror] - left_im[mirror];
+        }
+    }
+    plan.inverse(&mut re, &mut im);
+
+    // the first half of the output wraps around, so only the second half is kept
+    buffers.tail_output[0].copy_from_slice(&re[PARTITION_LEN..]);
+    buffers.tail_output[1].copy_from_slice(&im[PARTITION_LEN..]);
+
+    for next in buffers.next_re.iter_mut().chain(buffers.next_im.iter_mut()) {
+        for val in next.iter_mut() {
+            *val = 0.;
+        }
+    }
+}
+
+fn process_sample(
+    plan: &FftPlan,
+    impulse: &Impulse,
+    header: &mut StateHeader,
+    buffers: &mut StateBuffers,
+    samples: &mut [f64; 2],
+) {
+    let position = header.position;
+    for channel in 0..2 {
+        let history = &mut buffers.history[channel];
+        history[PARTITION_LEN + position] = samples[channel];
+        samples[channel] = dot(
+            &impulse.head[channel],
+            &history[position + 1..position + 1 + PARTITION_LEN],
+        ) + buffers.tail_output[channel][position];
+    }
+
+    if impulse.tail_count > 0 {
+        process_tail_slice(impulse, header, buffers);
+    }
+
+    header.position = position + 1;
+    if header.position == PARTITION_LEN {
+        if impulse.tail_count > 0 {
+            process_partition(plan, impulse, header, buffers);
+        }
+        for history in buffers.history.iter_mut() {
+            for index in 0..PARTITION_LEN {
+                history[index] = history[PARTITION_LEN + index];
+            }
+        }
+        header.position = 0;
+    }
+}
+
+struct Shared {
+    plan: FftPlan,
+    slots: Vec<AtomicPtr<Impulse>>,
+
+    // Replaced impulses could still be in use on the audio thread, so they're only dropped along
+    // with the library.
+    retired: Mutex<Vec<Box<Impulse>>>,
+}
+
+/// Holds the impulses that `convolve` calls use, which are set from outside the audio thread.
+///
+/// Each `convolve` call keeps its state in a buffer from the buffer pool, sized for its impulse.
+/// The runtime doesn't have a separate arena for node state, and the pool already hands out
+/// buffers of sizes only known while running without allocating on the audio thread, the same as
+/// it does for delays. When the impulse changes, the call keeps going with the old one until a
+/// buffer for the new one is ready. Impulses are used at the runtime's sample rate as they are.
+pub struct ImpulseLibrary {
+    shared: Box<Shared>,
+}
+
+impl ImpulseLibrary {
+    pub fn new() -> Self {
+        ImpulseLibrary {
+            shared: Box::new(Shared {
+                plan: FftPlan::new(),
+                slots: (0..IMPULSE_SLOT_COUNT)
+                    .map(|_| AtomicPtr::new(ptr::null_mut()))
+                    .collect(),
+                retired: Mutex::new(Vec::new()),
+            }),
+        }
+    }
+
+    /// Loads an impulse into a slot from its interleaved samples, or clears the slot if there
+    /// aren't any. Returns false if the slot doesn't exist.
+    pub fn set_impulse(&self, index: usize, samples: &[f32], channel_count: usize) -> bool {
+        if index >= IMPULSE_SLOT_COUNT {
+            return false;
+        }
+
+        let new_impulse = if samples.is_empty() || channel_count == 0 {
+            ptr::null_mut()
+        } else {
+            Box::into_raw(Box::new(Impulse::new(
+                &self.shared.plan,
+                samples,
+                channel_count,
+            )))
+        };
+        let old_impulse = self.shared.slots[index].swap(new_impulse, Ordering::AcqRel);
+        if !old_impulse.is_null() {
+            let old_impulse = unsafe { Box::from_raw(old_impulse) };
+            self.shared.retired.lock().unwrap().push(old_impulse);
+        }
+        true
+    }
+
+    /// The pointer that generated code passes back to `convolve`.
+    pub fn as_ptr(&self) -> *const c_void {
+        &*self.shared as *const Shared as *const c_void
+    }
+}
+
+impl Drop for ImpulseLibrary {
+    fn drop(&mut self) {
+        for slot in &self.shared.slots {
+            let impulse = slot.swap(ptr::null_mut(), Ordering::AcqRel);
+            if !impulse.is_null() {
+                unsafe {
+                    drop(Box::from_raw(impulse));
+                }
+            }
+        }
+    }
+}
+
+/// The data generated code keeps for each `convolve` call.
+#[repr(C)]
+struct ConvolveData {
+    state: *mut u8,
+    state_size: u64,
+}
+
+/// Convolves a pair of samples with the impulse in slot `index`, replacing them with the result.
+/// Outputs silence if the slot is empty or doesn't exist (including negative indexes), or the
+/// call's state isn't ready yet. This is registered
+/// with the JIT as the `maxim.convolve` builtin.
+pub unsafe extern "C" fn convolve(
+    library: *const c_void,
+    pool: *const c_void,
+    data: *mut c_void,
+    index: i32,
+    samples: *mut f64,
+) {
+    let shared = &*(library as *const Shared);
+    let data = &mut *(data as *mut ConvolveData);
+    let samples = &mut *(samples as *mut [f64; 2]);
+
+    let impulse = if index >= 0 && (index as usize) < IMPULSE_SLOT_COUNT {
+        shared.slots[index as usize].load(Ordering::Acquire) as *const Impulse
+    } else {
+        ptr::null()
+    };
+    let state_impulse = if data.state.is_null() {
+        ptr::null()
+    } else {
+        (*(data.state as *const StateHeader)).impulse
+    };
+
+    if impulse != state_impulse {
+        let new_size = if impulse.is_null() {
+            0
+        } else {
+            (*impulse).state_size()
+        };
+        let new_state = if impulse.is_null() {
+            ptr::null_mut()
+        } else {
+            buffer_pool::alloc_buffer(pool, new_size) as *mut u8
+        };
+
+        if impulse.is_null() || !new_state.is_null() {
+            buffer_pool::free_buffer(pool, data.state as *mut c_void, data.state_size);
+            data.state = new_state;
+            data.state_size = new_size;
+            if !new_state.is_null() {
+                (*(new_state as *mut StateHeader)).impulse = impulse;
+            }
+        }
+    }
+
+    if data.state.is_null() {
+        *samples = [0., 0.];
+        return;
+    }
+
+    let header = &mut *(data.state as *mut StateHeader);
+    let impulse = &*header.impulse;
+    let mut buffers = StateBuffers::new(data.state, impulse);
+    process_sample(&shared.plan, impulse, header, &mut buffers, samples);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // A fixed sequence of values between -1 and 1, so failures can be reproduced.
+    fn noise(count: usize, seed: u32) -> Vec<f32> {
+        let mut state = seed;
+        (0..count)
+            .map(|_| {
+                state = state.wrapping_mul(1_664_525).wrapping_add(1_013_904_223);
+                (state >> 8) as f32 / (1 << 23) as f32 - 1.
+            })
+            .collect()
+    }
+
+    fn convolve_direct(impulse: &[f32], channel_count: usize, input: &[[f64; 2]]) -> Vec<[f64; 2]> {
+        let frame_count = impulse.len() / channel_count;
+        (0..input.len())
+            .map(|output_index| {
+                let mut output = [0.; 2];
+                for (channel, output) in output.iter_mut().enumerate() {
+                    let impulse_channel = channel.min(channel_count - 1);
+                    for tap in 0..frame_count.min(output_index + 1) {
+                        *output += f64::from(impulse[tap * channel_count + impulse_channel])
+                            * input[output_index - tap][channel];
+                    }
+                }
+                output
+            })
+            .collect()
+    }
+
+    // Runs the input through an instance the same way `convolve` does, with its state in a zeroed
+    // buffer like the ones from the buffer pool.
+    fn convolve_partitioned(
+        plan: &FftPlan,
+        impulse: &Impulse,
+        input: &[[f64; 2]],
+    ) -> Vec<[f64; 2]> {
+        let mut state = vec![0u64; (impulse.state_size() as usize + 7) / 8];
+        let state_ptr = state.as_mut_ptr() as *mut u8;
+        unsafe {
+            (*(state_ptr as *mut StateHeader)).impulse = impulse;
+        }
+        input
+            .iter()
+            .map(|&samples| {
+                let mut samples = samples;
+                unsafe {
+                    let header = &mut *(state_ptr as *mut StateHeader);
+                    let mut buffers = StateBuffers::new(state_ptr, impulse);
+                    process_sample(plan, impulse, header, &mut buffers, &mut samples);
+                }
+                samples
+            })
+            .collect()
+    }
+
+    fn assert_matches_direct(impulse_samples: &[f32], channel_count: usize, input_len: usize) {
+        let plan = FftPlan::new();
+        let impulse = Impulse::new(&plan, impulse_samples, channel_count);
+        let left = noise(input_len, 1);
+        let right = noise(input_len, 2);
+        let input: Vec<_> = (0..input_len)
+            .map(|index| [f64::from(left[index]), f64::from(right[index])])
+            .collect();
+
+        let expected = convolve_direct(impulse_samples, channel_count, &input);
+        let actual = convolve_partitioned(&plan, &impulse, &input);
+        for (index, (expected, actual)) in expected.iter().zip(actual.iter()).enumerate() {
+            for channel in 0..2 {
+                assert!(
+                    (expected[channel] - actual[channel]).abs() < 1e-9,
+                    "sample {} channel {}: expected {}, got {}",
+                    index,
+                    channel,
+                    expected[channel],
+                    actual[channel]
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn fft_matches_dft() {
+        let plan = FftPlan::new();
+        let input_re = noise(FFT_LEN, 3);
+        let input_im = noise(FFT_LEN, 4);
+        let mut re = [0.; FFT_LEN];
+        let mut im = [0.; FFT_LEN];
+        for index in 0..FFT_LEN {
+            re[index] = f64::from(input_re[index]);
+            im[index] = f64::from(input_im[index]);
+        }
+        plan.forward(&mut re, &mut im);
+
+        for bin in 0..FFT_LEN {
+            let (mut expected_re, mut expected_im) = (0., 0.);
+            for index in 0..FFT_LEN {
+                let angle = -2. * consts::PI * (bin * index) as f64 / FFT_LEN as f64;
+                let (x_re, x_im) = (f64::from(input_re[index]), f64::from(input_im[index]));
+                expected_re += x_re * angle.cos() - x_im * angle.sin();
+                expected_im += x_re * angle.sin() + x_im * angle.cos();
+            }
+            assert!((re[bin] - expected_re).abs() < 1e-9);
+            assert!((im[bin] - expected_im).abs() < 1e-9);
+        }
+    }
+
+    #[test]
+    fn inverse_fft_round_trips_with_scale() {
+        let plan = FftPlan::new();
+        let input = noise(FFT_LEN, 5);
+        let mut re = [0.; FFT_LEN];
+        let mut im = [0.; FFT_LEN];
+        for index in 0..FFT_LEN {
+            re[index] = f64::from(input[index]);
+        }
+        plan.forward(&mut re, &mut im);
+        plan.inverse(&mut re, &mut im);
+
+        for index in 0..FFT_LEN {
+            assert!((re[index] / FFT_LEN as f64 - f64::from(input[index])).abs() < 1e-12);
+            assert!(im[index].abs() < 1e-9);
+        }
+    }
+
+    #[test]
+    fn impulse_splits_into_head_and_tail() {
+        let plan = FftPlan::new();
+        let samples = noise(PARTITION_LEN * 3 + 1, 6);
+        let impulse = Impulse::new(&plan, &samples, 1);
+
+        assert_eq!(impulse.tail_count, 3);
+        for channel in 0..2 {
+            for tap in 0..PARTITION_LEN {
+                assert_eq!(
+                    impulse.head[channel][PARTITION_LEN - 1 - tap],
+                    f64::from(samples[tap])
+                );
+            }
+            assert_eq!(impulse.partitions_re[channel].len(), 3 * BIN_COUNT);
+        }
+
+        assert_eq!(Impulse::new(&plan, &samples[..1], 1).tail_count, 0);
+        assert_eq!(
+            Impulse::new(&plan, &samples[..PARTITION_LEN], 1).tail_count,
+            0
+        );
+        assert_eq!(
+            Impulse::new(&plan, &samples[..PARTITION_LEN + 1], 1).tail_count,
+            1
+        );
+    }
+
+    #[test]
+    fn impulse_is_cut_to_max_length() {
+        let plan = FftPlan::new();
+        let impulse = Impulse::new(&plan, &vec![0.5; MAX_IMPULSE_LEN + 1000], 1);
+        assert_eq!(impulse.tail_count, MAX_IMPULSE_LEN / PARTITION_LEN - 1);
+    }
+
+    #[test]
+    fn missing_impulse_outputs_silence() {
+        let library = ImpulseLibrary::new();
+        assert!(library.set_impulse(1, &noise(PARTITION_LEN, 11), 1));
+        assert!(library.set_impulse(1, &[], 1));
+        assert!(!library.set_impulse(IMPULSE_SLOT_COUNT, &noise(PARTITION_LEN, 11), 1));
+
+        // the calls never get a state buffer, so the pool isn't used
+        let mut data = ConvolveData {
+            state: ptr::null_mut(),
+            state_size: 0,
+        };
+        for &index in &[0, 1, -1, IMPULSE_SLOT_COUNT as i32, i32::max_value()] {
+            let mut samples = [0.5, -0.25];
+            unsafe {
+                convolve(
+                    library.as_ptr(),
+                    ptr::null(),
+                    &mut data as *mut ConvolveData as *mut c_void,
+                    index,
+                    samples.as_mut_ptr(),
+                );
+            }
+            assert_eq!(samples, [0., 0.], "slot {}", index);
+            assert!(data.state.is_null());
+        }
+    }
+
+    #[test]
+    fn short_impulse_matches_direct_convolution() {
+        assert_matches_direct(&noise(2 * 17, 7), 2, 300);
+    }
+
+    #[test]
+    fn mono_impulse_is_applied_to_both_channels() {
+        assert_matches_direct(&noise(PARTITION_LEN * 4 + 9, 8), 1, 700);
+    }
+
+    #[test]
+    fn stereo_tail_matches_direct_convolution() {
+        // the left and right channels share an FFT, so they need different impulses to make sure
+        // they're pulled apart correctly
+        assert_matches_direct(&noise(2 * (PARTITION_LEN * 5 + 30), 9), 2, 1000);
+    }
+
+    #[test]
+    fn long_tail_spread_over_partition_matches_direct_convolution() {
+        // more tail partitions than samples in a partition, so each sample takes on several
+        assert_matches_direct(&noise(2 * (PARTITION_LEN * 150 + 3), 10), 2, 10_500);
+    }
+}
@@ -62,8 +62,14 @@ pub fn build_instrument_module(
         id_allocator.reserve(used_id);
     }
 
+    // Exported instruments don't have a task pool to run voices or branches on, so they always
+    // run serially.
     let mut prepared_surfaces = prepare_surfaces(
-        transaction.surfaces.into_iter().map(|(_, surface)| surface),
+        transaction.surfaces.into_iter().map(|(_, mut surface)| {
+            surface.parallel_voices = false;
+            surface.parallel_branches = false;
+            surface
+        }),
         &mut id_allocator,
         target,
     );
@@ -1,4 +1,4 @@
-use crate::codegen::OptimizationLevel;
+use crate::codegen::{OptimizationLevel, Precision};
 use crate::util::feature_level::FeatureLevel;
 use std::path::PathBuf;
 
@@ -37,6 +37,7 @@ pub struct CodeConfig {
     pub instrument_prefix: String,
     pub include_instrument: bool,
     pub include_library: bool,
+    pub precision: Precision,
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -13,11 +13,12 @@ use crate::codegen::{
     globals, runtime_lib, util, ModuleFunctionIterator, ModuleGlobalIterator, Optimizer,
     TargetProperties,
 };
-use crate::util::feature_level::get_target_feature_string;
+use crate::util::feature_level::{get_target_feature_string, get_voice_lanes};
 use inkwell::context::Context;
 use inkwell::module::{Linkage, Module};
 use inkwell::targets::{CodeModel, FileType, RelocMode, Target};
 use inkwell::types::VectorType;
+use inkwell::AddressSpace;
 use std::{fs, io};
 
 fn export_meta(
@@ -62,6 +63,11 @@ fn export_object(
     module_meta: &ModuleMetadata,
     transaction: Transaction,
 ) -> Result<(), ()> {
+    // Impulses are loaded from files by the runtime, and aren't available to exported code
+    if code_conf.include_instrument && transaction.uses_impulses() {
+        return Err(());
+    }
+
     let target_triple = get_target_triple(target_conf);
     let target_cpu = get_target_cpu(target_conf.instruction_set);
     let target_features = get_target_feature_string(target_conf.feature_level);
@@ -78,7 +84,12 @@ fn export_object(
             CodeModel::Default,
         )
         .unwrap();
-    let target_properties = TargetProperties::new(false, code_conf.optimization_level, machine);
+    let mut target_properties = TargetProperties::new(false, code_conf.optimization_level, machine);
+    target_properties.voice_lanes = get_voice_lanes(target_conf.feature_level);
+    target_properties.precision = code_conf.precision;
+    if let Some(ref root) = transaction.root {
+        target_properties.array_capacity = root.array_capacity;
+    }
 
     let context = Context::create();
     let file_name = match config.location.file_name() {
@@ -96,11 +107,28 @@ fn export_object(
         let bpm_global = globals::get_bpm(&output_module);
         bpm_global.set_constant(true);
         bpm_global.set_initializer(&util::get_vec_spread(&context, audio_conf.bpm));
+
+        let array_capacity_global = globals::get_array_capacity(&output_module);
+        array_capacity_global.set_constant(true);
+        array_capacity_global.set_initializer(
+            &context
+                .i32_type()
+                .const_int(u64::from(target_properties.array_capacity), false),
+        );
         globals::get_rand_seed(&output_module).set_initializer(&VectorType::const_vector(&[
             &context.i64_type().const_int(1, false),
             &context.i64_type().const_int(31337, false),
         ]));
 
+        // exports don't have a buffer pool, so delays allocate from the system instead
+        globals::get_buffer_pool(&output_module).set_initializer(
+            &context
+                .i8_type()
+                .ptr_type(AddressSpace::Generic)
+                .const_null(),
+        );
+        globals::build_system_buffer_funcs(&output_module, &target_properties);
+
         // build the library
         runtime_lib::codegen_lib(&output_module, &target_properties);
     }
@@ -17,6 +17,10 @@ impl Jit {
         Jit { orc }
     }
 
+    pub fn add_builtin(&self, symbol: &str, address: u64) {
+        self.orc.add_builtin(symbol, address);
+    }
+
     pub fn deploy(&self, module: &Module) -> JitKey {
         self.orc.add_module(&module.clone())
     }
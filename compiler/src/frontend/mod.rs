@@ -1,15 +1,24 @@
+mod buffer_pool;
 pub mod c_api;
+mod control_specializer;
+mod convolver;
 mod dependency_graph;
 pub mod exporter;
 mod jit;
 mod mir_optimizer;
+mod module_cache;
+mod parallel_codegen;
 mod runtime;
+mod state_migration;
+mod task_pool;
 pub mod value_reader;
 
+pub use self::control_specializer::ControlSnapshot;
 pub use self::dependency_graph::DependencyGraph;
 pub use self::jit::Jit;
-pub use self::runtime::Runtime;
+pub use self::runtime::{Runtime, RuntimeShared};
 
+use crate::mir::block::{Function, Statement};
 use crate::mir::{Block, BlockRef, Root, Surface, SurfaceRef};
 use std::collections::HashMap;
 use std::iter::FromIterator;
@@ -39,4 +48,17 @@ impl Transaction {
     pub fn add_block(&mut self, block: Block) {
         self.blocks.insert(block.id.id, block);
     }
+
+    /// Whether any block calls `convolve`, which needs impulses loaded into a runtime.
+    pub fn uses_impulses(&self) -> bool {
+        self.blocks.values().any(|block| {
+            block.statements.iter().any(|statement| match statement {
+                Statement::CallFunc {
+                    function: Function::Convolve,
+                    ..
+                } => true,
+                _ => false,
+            })
+        })
+    }
 }
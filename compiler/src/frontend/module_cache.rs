@@ -0,0 +1,342 @@
+use crate::codegen::{ObjectCache, TargetProperties};
+use crate::mir::{Block, NodeData, Surface};
+use crate::util::feature_level::FEATURE_LEVEL;
+use inkwell::context::Context;
+use inkwell::memory_buffer::MemoryBuffer;
+use inkwell::module::Module;
+use lazy_static::lazy_static;
+use regex::{Captures, Regex};
+use std::borrow::Cow;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::mem;
+use std::path::{Path, PathBuf};
+use std::process;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::SystemTime;
+
+// A hash of the codegen and MIR sources, worked out by the build script, so modules built by any
+// other version of them aren't loaded.
+const CACHE_VERSION: &str = env!("MAXIM_CACHE_VERSION");
+
+// The most space cached modules can take up. When it's exceeded, the least recently used modules
+// are removed until the cache is back down to `PRUNED_CACHE_SIZE`, so it isn't pruned again on
+// the next store.
+const MAX_CACHE_SIZE: u64 = 256 << 20;
+const PRUNED_CACHE_SIZE: u64 = 192 << 20;
+
+// How much can be written to the cache before checking whether it needs pruning.
+const PRUNE_INTERVAL: u64 = 16 << 20;
+
+/// 64-bit FNV-1a. Unlike `DefaultHasher`, the algorithm is fixed, so a module gets the same key
+/// every time the editor runs.
+struct FnvHasher(u64);
+
+impl FnvHasher {
+    fn new() -> Self {
+        FnvHasher(0xcbf2_9ce4_8422_2325)
+    }
+}
+
+impl Hasher for FnvHasher {
+    fn finish(&self) -> u64 {
+        self.0
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for byte in bytes {
+            self.0 ^= u64::from(*byte);
+            self.0 = self.0.wrapping_mul(0x0100_0000_01b3);
+        }
+    }
+}
+
+lazy_static! {
+    static ref STORED_ID_REGEX: Regex =
+        Regex::new(r"([@%]maxim\.(?:block|surface)\.)([0-9]+)\.").unwrap();
+    static ref LOADED_ID_REGEX: Regex =
+        Regex::new(r"([@%]maxim\.(?:block|surface)\.)\$([0-9]+)\.").unwrap();
+}
+
+/// Stores optimized modules on disk, keyed by a hash of the MIR they were built from and the
+/// target they were built for. Loading a module from the cache skips building and optimizing it,
+/// which is most of the time spent compiling a project.
+///
+/// Symbol names include the IDs of blocks and surfaces, but keys don't, so identical blocks and
+/// surfaces share modules wherever they are. Modules are stored as IR with each ID replaced by its
+/// index in the list the caller gives, which is the module's own ID followed by the IDs of the
+/// nodes inside a surface, and the IDs are filled back in from the current list when loading.
+///
+/// Keys are hashed from the MIR's fields directly rather than its debug output, which isn't meant
+/// to be stable. The cache is kept under `MAX_CACHE_SIZE` by removing the modules that were least
+/// recently loaded or stored.
+pub struct ModuleCache {
+    directory: PathBuf,
+    target_key: String,
+    unpruned_size: AtomicU64,
+}
+
+impl ModuleCache {
+    pub fn new(directory: PathBuf, target: &TargetProperties) -> Self {
+        let target_key = format!(
+            "{} {} {} {} {} {:?} {} {} {} {:?}",
+            env!("CARGO_PKG_VERSION"),
+            CACHE_VERSION,
+            target.machine.get_triple().to_string_lossy(),
+            target.machine.get_cpu().to_string_lossy(),
+            *FEATURE_LEVEL as u8,
+            target.optimization_level,
+            target.include_ui,
+            target.array_capacity,
+            target.voice_lanes,
+            target.precision
+        );
+
+        let cache = ModuleCache {
+            directory,
+            target_key,
+            unpruned_size: AtomicU64::new(0),
+        };
+        cache.prune();
+        cache
+    }
+
+    pub fn directory(&self) -> &Path {
+        &self.directory
+    }
+
+    /// The IDs a block module's symbols can contain, in the order `load` and `store` expect.
+    pub fn block_ids(block: &Block) -> Vec<u64> {
+        vec![block.id.id]
+    }
+
+    /// The IDs a surface module's symbols can contain, in the order `load` and `store` expect.
+    /// Updates of extracted voices refer to the blocks and surfaces nested anywhere inside the
+    /// surface, so those are included too.
+    pub fn surface_ids(cache: &ObjectCache, surface: &Surface) -> Vec<u64> {
+        let mut ids = vec![surface.id.id];
+        ModuleCache::push_nested_ids(cache, surface, &mut ids);
+        ids
+    }
+
+    fn push_nested_ids(cache: &ObjectCache, surface: &Surface, ids: &mut Vec<u64>) {
+        for node in &surface.nodes {
+            match node.data {
+                NodeData::Dummy => {}
+                NodeData::Custom { block, .. } => ids.push(block),
+                NodeData::Group(child_surface)
+                | NodeData::ExtractGroup {
+                    surface: child_surface,
+                    ..
+                } => {
+                    ids.push(child_surface);
+                    let child_mir = cache.surface_mir(child_surface).unwrap();
+                    ModuleCache::push_nested_ids(cache, child_mir, ids);
+                }
+            }
+        }
+    }
+
+    pub fn block_key(&self, block: &Block) -> u64 {
+        let mut hasher = FnvHasher::new();
+        self.target_key.hash(&mut hasher);
+        block.controls.len().hash(&mut hasher);
+        for control in &block.controls {
+            control.name.hash(&mut hasher);
+            control.control_type.hash(&mut hasher);
+            control.value_written.hash(&mut hasher);
+            control.value_read.hash(&mut hasher);
+        }
+        block.statements.hash(&mut hasher);
+        hasher.finish()
+    }
+
+    /// Surface modules depend on the layouts of the blocks and surfaces inside them, so the keys
+    /// of those modules are included too, in the order of the surface's nodes.
+    pub fn surface_key(&self, cache: &ObjectCache, surface: &Surface, child_keys: &[u64]) -> u64 {
+        let mut hasher = FnvHasher::new();
+        self.target_key.hash(&mut hasher);
+
+        // The source map only matters to the editor, and isn't stored in a stable order. Nodes
+        // are hashed without the IDs of what they contain, since `child_keys` covers that, but
+        // which nodes share an ID changes which symbols they use.
+        surface.groups.hash(&mut hasher);
+        surface.nodes.len().hash(&mut hasher);
+        for node in &surface.nodes {
+            node.sockets.hash(&mut hasher);
+            mem::discriminant(&node.data).hash(&mut hasher);
+            match &node.data {
+                NodeData::Dummy | NodeData::Group(_) => {}
+                NodeData::Custom {
+                    control_initializers,
+                    ..
+                } => control_initializers.hash(&mut hasher),
+                NodeData::ExtractGroup {
+                    source_sockets,
+                    dest_sockets,
+                    parallel,
+                    ..
+                } => {
+                    source_sockets.hash(&mut hasher);
+                    dest_sockets.hash(&mut hasher);
+                    parallel.hash(&mut hasher);
+                }
+            }
+        }
+        let ids = ModuleCache::surface_ids(cache, surface);
+        for id in &ids {
+            ids.iter()
+                .position(|other_id| other_id == id)
+                .hash(&mut hasher);
+        }
+        surface.parallel_voices.hash(&mut hasher);
+        surface.parallel_branches.hash(&mut hasher);
+        surface.oversampling.hash(&mut hasher);
+        child_keys.hash(&mut hasher);
+        hasher.finish()
+    }
+
+    /// Loads the module stored under `key`, with its symbols renamed to use `ids`.
+    pub fn load(&self, context: &Context, key: u64, ids: &[u64]) -> Option<Module> {
+        let path = self.module_path(key);
+        let stored_ir = fs::read_to_string(&path).ok()?;
+
+        let module = ModuleCache::fill_ids(&stored_ir, ids).and_then(|ir| {
+            let buffer = MemoryBuffer::create_from_memory_range(ir.as_bytes(), "module");
+            context.create_module_from_ir(buffer).ok()
+        });
+        match module {
+            Some(module) => {
+                // mark the module as recently used, so it's the last to be pruned
+                if let Ok(file) = fs::OpenOptions::new().write(true).open(&path) {
+                    file.set_modified(SystemTime::now()).ok();
+                }
+                Some(module)
+            }
+            None => {
+                fs::remove_file(&path).ok();
+                None
+            }
+        }
+    }
+
+    /// Stores a module under `key`. `ids` must contain every ID in the module's symbols, or it
+    /// isn't stored.
+    pub fn store(&self, module: &Module, key: u64, ids: &[u64]) {
+        let ir = module.print_to_string();
+        let stored_ir = match ModuleCache::replace_ids(ir.to_str().unwrap(), ids) {
+            Some(stored_ir) => stored_ir,
+            None => return,
+        };
+        if fs::create_dir_all(&self.directory).is_err() {
+            return;
+        }
+
+        // Other instances could be reading or writing the same module, so it's written to a
+        // temporary file first and then moved into place.
+        let path = self.module_path(key);
+        let temp_path = self
+            .directory
+            .join(format!("{:016x}.{}.tmp", key, process::id()));
+        if fs::write(&temp_path, stored_ir.as_bytes()).is_ok() {
+            let size = stored_ir.len() as u64;
+            if fs::rename(&temp_path, &path).is_err() {
+                fs::remove_file(&temp_path).ok();
+            } else if self.unpruned_size.fetch_add(size, Ordering::Relaxed) + size >= PRUNE_INTERVAL
+            {
+                self.prune();
+            }
+        } else {
+            fs::remove_file(&temp_path).ok();
+        }
+    }
+
+    // Replaces each ID in a module's symbols with `$` and its index in `ids`.
+    fn replace_ids<'ir>(ir: &'ir str, ids: &[u64]) -> Option<Cow<'ir, str>> {
+        let mut is_missing_id = false;
+        let stored_ir = STORED_ID_REGEX.replace_all(ir, |captures: &Captures| {
+            let id: u64 = captures[2].parse().unwrap_or(0);
+            match ids.iter().position(|&other_id| other_id == id) {
+                Some(index) => format!("{}${}.", &captures[1], index),
+                None => {
+                    is_missing_id = true;
+                    String::new()
+                }
+            }
+        });
+        if is_missing_id {
+            None
+        } else {
+            Some(stored_ir)
+        }
+    }
+
+    // Fills the IDs from `ids` back into a module stored by `replace_ids`.
+    fn fill_ids<'ir>(stored_ir: &'ir str, ids: &[u64]) -> Option<Cow<'ir, str>> {
+        let mut is_missing_id = false;
+        let ir = LOADED_ID_REGEX.replace_all(stored_ir, |captures: &Captures| {
+            let id = captures[2]
+                .parse::<usize>()
+                .ok()
+                .and_then(|index| ids.get(index));
+            match id {
+                Some(id) => format!("{}{}.", &captures[1], id),
+                None => {
+                    is_missing_id = true;
+                    String::new()
+                }
+            }
+        });
+        if is_missing_id {
+            None
+        } else {
+            Some(ir)
+        }
+    }
+
+    /// Removes the least recently used modules if the cache has grown past `MAX_CACHE_SIZE`.
+    /// Other instances might be using the same directory, so anything that can't be read or
+    /// removed is skipped.
+    pub fn prune(&self) {
+        self.unpruned_size.store(0, Ordering::Relaxed);
+
+        let entries = match fs::read_dir(&self.directory) {
+            Ok(entries) => entries,
+            Err(_) => return,
+        };
+        let mut modules: Vec<_> = entries
+            .filter_map(|entry| entry.ok())
+            .filter(|entry| {
+                // older versions stored bitcode, which is pruned the same way until it's gone
+                entry
+                    .path()
+                    .extension()
+                    .map_or(false, |ext| ext == "ll" || ext == "bc")
+            })
+            .filter_map(|entry| {
+                let meta = entry.metadata().ok()?;
+                let modified = meta.modified().unwrap_or(SystemTime::UNIX_EPOCH);
+                Some((modified, meta.len(), entry.path()))
+            })
+            .collect();
+
+        let mut total_size: u64 = modules.iter().map(|(_, size, _)| size).sum();
+        if total_size <= MAX_CACHE_SIZE {
+            return;
+        }
+
+        modules.sort_by_key(|(modified, _, _)| *modified);
+        for (_, size, path) in modules {
+            if total_size <= PRUNED_CACHE_SIZE {
+                break;
+            }
+            if fs::remove_file(&path).is_ok() {
+                total_size -= size;
+            }
+        }
+    }
+
+    fn module_path(&self, key: u64) -> PathBuf {
+        self.directory.join(format!("{:016x}.ll", key))
+    }
+}
@@ -0,0 +1,259 @@
+use crate::codegen::{
+    block, data_analyzer, surface, ObjectCache, OptimizationLevel, Optimizer, TargetProperties,
+};
+use crate::mir::{Block, BlockRef, ConstantNum, NodeData, Surface, SurfaceRef};
+use crate::util::feature_level::{get_target_feature_string, FEATURE_LEVEL};
+use inkwell::context::Context;
+use inkwell::memory_buffer::MemoryBuffer;
+use inkwell::module::Module;
+use inkwell::targets::{CodeModel, RelocMode, Target};
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{mpsc, Arc};
+use std::thread;
+
+/// A block or surface module that needs to be built.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum CodegenJob {
+    Block(BlockRef),
+    Surface(SurfaceRef),
+}
+
+/// Builds and optimizes the module for a job. The cache must have layouts for the object and
+/// everything inside it.
+pub fn build_module(cache: &ObjectCache, optimizer: &Optimizer, job: CodegenJob) -> Module {
+    let module = match job {
+        CodegenJob::Block(block_id) => {
+            let block = cache.block_mir(block_id).unwrap();
+            let module = cache.target().create_module(
+                cache.context(),
+                &format!("block.{}.{}", block.id.id, block.id.debug_name),
+            );
+            block::build_funcs(&module, cache, block);
+            module
+        }
+        CodegenJob::Surface(surface_id) => {
+            let surface = cache.surface_mir(surface_id).unwrap();
+            let module = cache.target().create_module(
+                cache.context(),
+                &format!("surface.{}.{}", surface.id.id, surface.id.debug_name),
+            );
+            surface::build_funcs(&module, cache, surface);
+            module
+        }
+    };
+    optimizer.optimize_module(&module);
+    module
+}
+
+fn get_codegen_thread_count() -> usize {
+    thread::available_parallelism()
+        .map(|count| count.get())
+        .unwrap_or(1)
+}
+
+/// Builds modules for each job on a set of worker threads, one for each core. LLVM contexts can't
+/// be shared between threads, so each worker builds into its own context, and the optimized
+/// modules are passed back as bitcode to be loaded into the runtime's context.
+///
+/// The MIR maps are shared with the workers rather than copied. The workers are finished with them
+/// by the time this returns, so the runtime can keep changing them in place afterwards.
+pub fn build_modules_parallel(
+    context: &Context,
+    target: &TargetProperties,
+    blocks: &Arc<HashMap<BlockRef, Block>>,
+    surfaces: &Arc<HashMap<SurfaceRef, Surface>>,
+    specializations: &Arc<HashMap<BlockRef, Vec<(usize, ConstantNum)>>>,
+    jobs: Vec<CodegenJob>,
+    optimization_level: OptimizationLevel,
+) -> Vec<(CodegenJob, Module)> {
+    let description = Arc::new(TargetDescription::new(target));
+    let thread_count = get_codegen_thread_count().min(jobs.len());
+    let jobs = Arc::new(jobs);
+    let next_job = Arc::new(AtomicUsize::new(0));
+    let (sender, receiver) = mpsc::channel();
+
+    let workers: Vec<_> = (0..thread_count)
+        .map(|worker_index| {
+            let description = description.clone();
+            let blocks = blocks.clone();
+            let surfaces = surfaces.clone();
+            let specializations = specializations.clone();
+            let jobs = jobs.clone();
+            let next_job = next_job.clone();
+            let sender = sender.clone();
+            thread::Builder::new()
+                .name(format!("maxim.codegen{}", worker_index))
+                .spawn(move || {
+                    let target = description.create_target();
+                    let optimizer = Optimizer::new_with_level(&target, optimization_level);
+                    let mut cache = WorkerCache {
+                        context: Context::create(),
+                        target,
+                        blocks,
+                        surfaces,
+                        specializations,
+                        block_layouts: HashMap::new(),
+                        surface_layouts: HashMap::new(),
+                    };
+
+                    loop {
+                        let job = match jobs.get(next_job.fetch_add(1, Ordering::Relaxed)) {
+                            Some(&job) => job,
+                            None => break,
+                        };
+
+                        cache.build_layouts(job);
+                        let module = build_module(&cache, &optimizer, job);
+                        let bitcode = module.write_bitcode_to_memory().as_slice().to_vec();
+                        sender.send((job, bitcode)).unwrap();
+                    }
+                })
+                .unwrap()
+        })
+        .collect();
+
+    // The receiver finishes once every worker has dropped its sender, including if one panics.
+    drop(sender);
+    let modules = receiver
+        .iter()
+        .map(|(job, bitcode)| {
+            let buffer = MemoryBuffer::create_from_memory_range(&bitcode, "module");
+            let module = Module::parse_bitcode_from_buffer_in_context(&buffer, context).unwrap();
+            (job, module)
+        })
+        .collect();
+
+    for worker in workers {
+        worker.join().unwrap();
+    }
+
+    modules
+}
+
+// Target machines can't be shared between threads either, so workers create their own from this.
+struct TargetDescription {
+    include_ui: bool,
+    optimization_level: OptimizationLevel,
+    triple: String,
+    cpu: String,
+    array_capacity: u8,
+    voice_lanes: u32,
+}
+
+impl TargetDescription {
+    fn new(target: &TargetProperties) -> Self {
+        TargetDescription {
+            include_ui: target.include_ui,
+            optimization_level: target.optimization_level,
+            triple: target.machine.get_triple().to_string_lossy().into_owned(),
+            cpu: target.machine.get_cpu().to_string_lossy().into_owned(),
+            array_capacity: target.array_capacity,
+            voice_lanes: target.voice_lanes,
+        }
+    }
+
+    fn create_target(&self) -> TargetProperties {
+        let machine = Target::from_triple(&self.triple)
+            .unwrap()
+            .create_target_machine(
+                &self.triple,
+                &self.cpu,
+                &get_target_feature_string(*FEATURE_LEVEL),
+                self.optimization_level.into_specification().llvm_level,
+                RelocMode::Default,
+                CodeModel::Default,
+            )
+            .unwrap();
+        let mut target = TargetProperties::new(self.include_ui, self.optimization_level, machine);
+        target.array_capacity = self.array_capacity;
+        target.voice_lanes = self.voice_lanes;
+        target
+    }
+}
+
+struct WorkerCache {
+    context: Context,
+    target: TargetProperties,
+    blocks: Arc<HashMap<BlockRef, Block>>,
+    surfaces: Arc<HashMap<SurfaceRef, Surface>>,
+    specializations: Arc<HashMap<BlockRef, Vec<(usize, ConstantNum)>>>,
+    block_layouts: HashMap<BlockRef, data_analyzer::BlockLayout>,
+    surface_layouts: HashMap<SurfaceRef, data_analyzer::SurfaceLayout>,
+}
+
+impl WorkerCache {
+    // Layouts hold types from the context they were built in, so the worker builds its own copy of
+    // the layouts a job needs, which are kept for later jobs.
+    fn build_layouts(&mut self, job: CodegenJob) {
+        match job {
+            CodegenJob::Block(block_id) => self.build_block_layout(block_id),
+            CodegenJob::Surface(surface_id) => self.build_surface_layout(surface_id),
+        }
+    }
+
+    fn build_block_layout(&mut self, block_id: BlockRef) {
+        if self.block_layouts.contains_key(&block_id) {
+            return;
+        }
+
+        let layout =
+            data_analyzer::build_block_layout(&self.context, &self.blocks[&block_id], &self.target);
+        self.block_layouts.insert(block_id, layout);
+    }
+
+    fn build_surface_layout(&mut self, surface_id: SurfaceRef) {
+        if self.surface_layouts.contains_key(&surface_id) {
+            return;
+        }
+
+        let surfaces = self.surfaces.clone();
+        let surface = &surfaces[&surface_id];
+        for node in &surface.nodes {
+            match node.data {
+                NodeData::Dummy => {}
+                NodeData::Custom { block, .. } => self.build_block_layout(block),
+                NodeData::Group(child_surface)
+                | NodeData::ExtractGroup {
+                    surface: child_surface,
+                    ..
+                } => self.build_surface_layout(child_surface),
+            }
+        }
+
+        let layout = data_analyzer::build_surface_layout(self, surface);
+        self.surface_layouts.insert(surface_id, layout);
+    }
+}
+
+impl ObjectCache for WorkerCache {
+    fn context(&self) -> &Context {
+        &self.context
+    }
+
+    fn target(&self) -> &TargetProperties {
+        &self.target
+    }
+
+    fn surface_mir(&self, id: SurfaceRef) -> Option<&Surface> {
+        self.surfaces.get(&id)
+    }
+
+    fn surface_layout(&self, id: SurfaceRef) -> Option<&data_analyzer::SurfaceLayout> {
+        self.surface_layouts.get(&id)
+    }
+
+    fn block_mir(&self, id: BlockRef) -> Option<&Block> {
+        self.blocks.get(&id)
+    }
+
+    fn block_layout(&self, id: BlockRef) -> Option<&data_analyzer::BlockLayout> {
+        self.block_layouts.get(&id)
+    }
+
+    fn block_specialization(&self, id: BlockRef) -> Option<&[(usize, ConstantNum)]> {
+        self.specializations
+            .get(&id)
+            .map(|values| values.as_slice())
+    }
+}
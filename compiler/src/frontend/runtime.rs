@@ -1,33 +1,56 @@
+use super::buffer_pool::{self, BufferPool};
+use super::control_specializer::{self, ControlSnapshot, ControlSpecializer};
+use super::convolver::{self, ImpulseLibrary};
 use super::dependency_graph::DependencyGraph;
 use super::jit::{Jit, JitKey};
 use super::mir_optimizer;
+use super::module_cache::ModuleCache;
+use super::parallel_codegen::{self, CodegenJob};
+use super::state_migration::StateMap;
+use super::task_pool::{self, TaskPool};
 use super::Transaction;
 use crate::codegen::{
-    block, data_analyzer, editor, globals, root, runtime_lib, surface, ObjectCache, Optimizer,
+    data_analyzer, editor, globals, root, runtime_lib, ObjectCache, OptimizationLevel, Optimizer,
     TargetProperties,
 };
 use crate::mir::{
-    Block, BlockRef, IdAllocator, IncrementalIdAllocator, InternalNodeRef, Root, Surface,
-    SurfaceRef,
+    AtomicIdAllocator, Block, BlockRef, ConstantNum, IdAllocator, InternalNodeRef, NodeData, Root,
+    Surface, SurfaceRef,
 };
 use inkwell::context::Context;
 use inkwell::module::Module;
-use std::collections::hash_map::Entry;
 use std::collections::{HashMap, HashSet, VecDeque};
+use std::hint;
 use std::iter::FromIterator;
 use std::mem;
 use std::os::raw::c_void;
+use std::path::PathBuf;
 use std::ptr;
+use std::sync::atomic::{AtomicPtr, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, OnceLock};
+use std::thread;
 use std::time::{Duration, Instant};
 
+// Code is deployed into one JIT while the audio thread runs the code in the other, so the two can
+// exist side by side even though they use the same symbol names.
+const JIT_SLOT_COUNT: usize = 2;
+
 struct RuntimeModule {
     module: Module,
-    key: Option<JitKey>,
+    keys: [Option<JitKey>; JIT_SLOT_COUNT],
+    // whether the module each key points to is this version of the module
+    is_deployed: [bool; JIT_SLOT_COUNT],
+    cache_key: Option<u64>,
 }
 
 impl RuntimeModule {
-    pub fn new(module: Module, key: Option<JitKey>) -> Self {
-        RuntimeModule { module, key }
+    pub fn new(module: Module) -> Self {
+        RuntimeModule {
+            module,
+            keys: [None; JIT_SLOT_COUNT],
+            is_deployed: [false; JIT_SLOT_COUNT],
+            cache_key: None,
+        }
     }
 }
 
@@ -39,14 +62,29 @@ const POINTERS_GLOBAL_NAME: &str = "maxim.runtime.pointers";
 
 const CONSTRUCT_FUNC_NAME: &str = "maxim.runtime.construct";
 const UPDATE_FUNC_NAME: &str = "maxim.runtime.update";
+const UPDATE_BLOCK_FUNC_NAME: &str = "maxim.runtime.update_block";
 const DESTRUCT_FUNC_NAME: &str = "maxim.runtime.destruct";
 
 const CONVERT_NUM_FUNC_NAME: &str = "maxim.editor.convert_num";
 
+// Globals in the root module that hold the state of the running code.
+const STATE_GLOBAL_NAMES: [&str; 3] = [
+    INITIALIZED_GLOBAL_NAME,
+    SCRATCH_GLOBAL_NAME,
+    SOCKETS_GLOBAL_NAME,
+];
+
+// Used to build modules that are deployed straight away when tiered compilation is enabled.
+const PREVIEW_OPTIMIZATION_LEVEL: OptimizationLevel = OptimizationLevel::None;
+
 struct LibraryPointers {
     samplerate_ptr: *mut c_void,
     bpm_ptr: *mut c_void,
+    array_capacity_ptr: *mut c_void,
     profile_times_ptr: *mut c_void,
+    task_pool_ptr: *mut c_void,
+    buffer_pool_ptr: *mut c_void,
+    impulse_library_ptr: *mut c_void,
     convert_num: unsafe extern "C" fn(*mut c_void, i8, *const c_void),
 }
 
@@ -59,17 +97,35 @@ impl LibraryPointers {
         let bpm_ptr_address = jit.get_symbol_address(globals::BPM_GLOBAL_NAME) as usize;
         assert_ne!(bpm_ptr_address, 0);
 
+        let array_capacity_address =
+            jit.get_symbol_address(globals::ARRAY_CAPACITY_GLOBAL_NAME) as usize;
+        assert_ne!(array_capacity_address, 0);
+
         let profile_times_address =
             jit.get_symbol_address(globals::PROFILE_TIME_GLOBAL_NAME) as usize;
         assert_ne!(profile_times_address, 0);
 
+        let task_pool_address = jit.get_symbol_address(globals::TASK_POOL_GLOBAL_NAME) as usize;
+        assert_ne!(task_pool_address, 0);
+
+        let buffer_pool_address = jit.get_symbol_address(globals::BUFFER_POOL_GLOBAL_NAME) as usize;
+        assert_ne!(buffer_pool_address, 0);
+
+        let impulse_library_address =
+            jit.get_symbol_address(globals::IMPULSE_LIBRARY_GLOBAL_NAME) as usize;
+        assert_ne!(impulse_library_address, 0);
+
         let convert_num_address = jit.get_symbol_address(CONVERT_NUM_FUNC_NAME) as usize;
         assert_ne!(convert_num_address, 0);
 
         LibraryPointers {
             samplerate_ptr: samplerate_ptr_address as *mut c_void,
             bpm_ptr: bpm_ptr_address as *mut c_void,
+            array_capacity_ptr: array_capacity_address as *mut c_void,
             profile_times_ptr: profile_times_address as *mut c_void,
+            task_pool_ptr: task_pool_address as *mut c_void,
+            buffer_pool_ptr: buffer_pool_address as *mut c_void,
+            impulse_library_ptr: impulse_library_address as *mut c_void,
             convert_num: unsafe { mem::transmute(convert_num_address) },
         }
     }
@@ -84,6 +140,7 @@ struct RuntimePointers {
     pointers_ptr: *mut c_void,
     construct: unsafe extern "C" fn(),
     update: unsafe extern "C" fn(),
+    update_block: unsafe extern "C" fn(u64, u64, *const *const f32, *const *mut f32),
     destruct: unsafe extern "C" fn(),
 }
 
@@ -95,6 +152,9 @@ impl RuntimePointers {
         let update_address = jit.get_symbol_address(UPDATE_FUNC_NAME) as usize;
         assert_ne!(update_address, 0);
 
+        let update_block_address = jit.get_symbol_address(UPDATE_BLOCK_FUNC_NAME) as usize;
+        assert_ne!(update_block_address, 0);
+
         let destruct_address = jit.get_symbol_address(DESTRUCT_FUNC_NAME) as usize;
         assert_ne!(destruct_address, 0);
 
@@ -113,29 +173,170 @@ impl RuntimePointers {
             pointers_ptr: pointers_ptr_address as *mut c_void,
             construct: unsafe { mem::transmute(construct_address) },
             update: unsafe { mem::transmute(update_address) },
+            update_block: unsafe { mem::transmute(update_block_address) },
             destruct: unsafe { mem::transmute(destruct_address) },
         }
     }
 }
 
+/// State to move from the code that's running to a new generation when it's switched to.
+struct StateCopy {
+    from: *mut u8,
+    to: *mut u8,
+    size: usize,
+}
+
+/// A version of the deployed code, linked in one of the runtime's JITs along with the state it
+/// runs on.
+struct Generation {
+    id: u64,
+    slot: usize,
+    pointers: RuntimePointers,
+    state: StateMap,
+    state_copies: Vec<StateCopy>,
+    // whether any surface runs voices or branches on the task pool
+    uses_task_pool: bool,
+}
+
+impl Generation {
+    // Copies state across from the generation that was running before.
+    unsafe fn copy_state(&self) {
+        for copy in &self.state_copies {
+            ptr::copy_nonoverlapping(copy.from, copy.to, copy.size);
+        }
+    }
+
+    // Zeroes the state that was copied out of the old generation, which is the state nodes have
+    // before they're constructed, so the old destructor doesn't free anything the new code is
+    // still using.
+    unsafe fn clear_copied_state(&self) {
+        for copy in &self.state_copies {
+            ptr::write_bytes(copy.from, 0, copy.size);
+        }
+    }
+}
+
+// States of the update word.
+const UPDATES_IDLE: usize = 0;
+const UPDATES_RUNNING: usize = 1;
+const UPDATES_PAUSED: usize = 2;
+const UPDATES_SWITCHING: usize = 3;
+
+// How long the deploying thread sleeps between checks while it waits for an update to finish.
+// Updates only take as long as one buffer, so this is never waited on for long.
+const UPDATE_POLL_MICROS: u64 = 50;
+
+// How long the audio thread can go without starting an update before `publish` decides updates
+// have stopped, and switches generations itself. This is longer than any buffer a host would use.
+const UPDATES_STOPPED_MILLIS: u64 = 250;
+
+/// Shares the running generation with the thread running updates. The deploying thread leaves a
+/// new generation in `pending`, and the audio thread switches to it at the start of its next
+/// update, so it's never left without code to run. The audio thread only waits if the deploying
+/// thread is switching generations itself, which it only does when updates have stopped.
+struct Exchange {
+    running: AtomicPtr<Generation>,
+    pending: AtomicPtr<Generation>,
+    update_word: AtomicUsize,
+    created_at: Instant,
+    // when the last update started, in milliseconds after `created_at` plus one, or zero if no
+    // update has run yet
+    last_update_millis: AtomicU64,
+}
+
+impl Exchange {
+    fn new() -> Self {
+        Exchange {
+            running: AtomicPtr::new(ptr::null_mut()),
+            pending: AtomicPtr::new(ptr::null_mut()),
+            update_word: AtomicUsize::new(UPDATES_IDLE),
+            created_at: Instant::now(),
+            last_update_millis: AtomicU64::new(0),
+        }
+    }
+
+    fn elapsed_millis(&self) -> u64 {
+        self.created_at.elapsed().as_millis() as u64 + 1
+    }
+
+    fn are_updates_stopped(&self) -> bool {
+        let last_update_millis = self.last_update_millis.load(Ordering::Relaxed);
+        last_update_millis == 0
+            || self.elapsed_millis().saturating_sub(last_update_millis) >= UPDATES_STOPPED_MILLIS
+    }
+
+    // Switches to the pending generation if there is one, moving state across from the running
+    // one. Must only be called while holding the update word.
+    unsafe fn switch_pending(&self) {
+        let pending = self.pending.swap(ptr::null_mut(), Ordering::Acquire);
+        if !pending.is_null() {
+            (*pending).copy_state();
+            self.running.store(pending, Ordering::Release);
+        }
+    }
+}
+
+/// Optimized versions of modules that were deployed with the preview pipeline or have been
+/// specialized, built by `prepare_optimize`.
+struct OptimizedModules {
+    modules: Vec<(CodegenJob, Module)>,
+    root: Option<Module>,
+}
+
+/// The part of the runtime that the audio thread and the editor use while code is being built on
+/// another thread: running updates, IDs, audio settings and profiling. It's kept apart from the
+/// rest of the runtime, so it can be used without aliasing a `Runtime` that another thread is
+/// building code in.
+pub struct RuntimeShared {
+    id_allocator: AtomicIdAllocator,
+    library_pointers: [LibraryPointers; JIT_SLOT_COUNT],
+    // generated code reaches this through the `maxim.taskpool` global, which stays null until a
+    // surface runs voices or branches in parallel
+    task_pool: OnceLock<TaskPool>,
+    // only referenced by generated code, through the `maxim.bufferpool` global
+    buffer_pool: BufferPool,
+    impulse_library: ImpulseLibrary,
+    exchange: Exchange,
+    // the JIT slot of the latest deployed code, which the editor's profile times come from
+    latest_slot: AtomicUsize,
+    bpm: AtomicU64,
+    sample_rate: AtomicU64,
+    profile_clock_start: (Instant, u64),
+}
+
+// The library pointers and generations are only written by the thread that owns the runtime,
+// before they're handed to other threads through `Exchange` and the atomics above.
+unsafe impl Send for RuntimeShared {}
+unsafe impl Sync for RuntimeShared {}
+
 pub struct Runtime {
-    id_allocator: IncrementalIdAllocator,
+    shared: Arc<RuntimeShared>,
     context: Context,
     target: TargetProperties,
     optimizer: Optimizer,
+    preview_optimizer: Option<Optimizer>,
+    module_cache: Option<ModuleCache>,
     root: (Root, RuntimeModule),
-    surface_mirs: HashMap<SurfaceRef, Surface>,
+    surface_mirs: Arc<HashMap<SurfaceRef, Surface>>,
     surface_layouts: HashMap<SurfaceRef, data_analyzer::SurfaceLayout>,
     surface_modules: HashMap<SurfaceRef, RuntimeModule>,
-    block_mirs: HashMap<BlockRef, Block>,
+    block_mirs: Arc<HashMap<BlockRef, Block>>,
     block_layouts: HashMap<BlockRef, data_analyzer::BlockLayout>,
     block_modules: HashMap<BlockRef, RuntimeModule>,
+    block_specializations: Arc<HashMap<BlockRef, Vec<(usize, ConstantNum)>>>,
+    specializer: Option<ControlSpecializer>,
     graph: DependencyGraph,
-    jit: Jit,
-    library_pointers: LibraryPointers,
-    runtime_pointers: Option<RuntimePointers>,
-    bpm: f64,
-    sample_rate: f64,
+    jits: [Jit; JIT_SLOT_COUNT],
+    generations: [Option<Box<Generation>>; JIT_SLOT_COUNT],
+    running_slot: Option<usize>,
+    staged_slot: Option<usize>,
+    next_generation_id: u64,
+    // keys of modules that have been replaced or removed, taken out of each JIT on its next deploy
+    removed_keys: [Vec<JitKey>; JIT_SLOT_COUNT],
+    is_pending: bool,
+    unoptimized_jobs: HashSet<CodegenJob>,
+    is_root_unoptimized: bool,
+    pending_optimized: Option<OptimizedModules>,
 }
 
 impl Runtime {
@@ -143,35 +344,145 @@ impl Runtime {
         let optimizer = Optimizer::new(&target);
         let context = Context::create();
         let root_module = target.create_module(&context, "root");
-        let jit = Jit::new();
-
-        // deploy the library to the JIT
+        let jits = [Jit::new(), Jit::new()];
         let library_module = Runtime::codegen_lib(&context, &target);
         optimizer.optimize_module(&library_module);
-        jit.deploy(&library_module);
-        let library_pointers = LibraryPointers::new(&jit);
+        for jit in &jits {
+            jit.add_builtin(
+                globals::RUN_TASKS_FUNC_NAME,
+                task_pool::run_tasks as usize as u64,
+            );
+            jit.add_builtin(
+                globals::ALLOC_BUFFER_FUNC_NAME,
+                buffer_pool::alloc_buffer as usize as u64,
+            );
+            jit.add_builtin(
+                globals::FREE_BUFFER_FUNC_NAME,
+                buffer_pool::free_buffer as usize as u64,
+            );
+            jit.add_builtin(
+                globals::CONVOLVE_FUNC_NAME,
+                convolver::convolve as usize as u64,
+            );
+            jit.add_builtin(
+                globals::PROFILE_ADD_FUNC_NAME,
+                add_profile_time as usize as u64,
+            );
+
+            // deploy the library to the JIT
+            jit.deploy(&library_module);
+        }
+        let library_pointers = [
+            LibraryPointers::new(&jits[0]),
+            LibraryPointers::new(&jits[1]),
+        ];
+
+        // point generated code at the buffer pool, so stateful functions can resize their memory
+        // on the audio thread without going to the system allocator
+        let buffer_pool = BufferPool::new();
+
+        // and at the impulses that convolutions use, which are loaded in with `set_impulse`
+        let impulse_library = ImpulseLibrary::new();
+
+        for pointers in &library_pointers {
+            unsafe {
+                *(pointers.buffer_pool_ptr as *mut *const c_void) = buffer_pool.as_ptr();
+                *(pointers.impulse_library_ptr as *mut *const c_void) = impulse_library.as_ptr();
+            }
+        }
+
+        let shared = Arc::new(RuntimeShared {
+            id_allocator: AtomicIdAllocator::new(1),
+            library_pointers,
+            task_pool: OnceLock::new(),
+            buffer_pool,
+            impulse_library,
+            exchange: Exchange::new(),
+            latest_slot: AtomicUsize::new(0),
+            bpm: AtomicU64::new(60f64.to_bits()),
+            sample_rate: AtomicU64::new(44100f64.to_bits()),
+            profile_clock_start: (Instant::now(), read_cycle_counter()),
+        });
 
         Runtime {
-            id_allocator: IncrementalIdAllocator::new(1),
+            shared,
             context,
             target,
             optimizer,
-            root: (Root::new(Vec::new()), RuntimeModule::new(root_module, None)),
-            surface_mirs: HashMap::new(),
+            preview_optimizer: None,
+            module_cache: None,
+            root: (Root::new(Vec::new()), RuntimeModule::new(root_module)),
+            surface_mirs: Arc::new(HashMap::new()),
             surface_layouts: HashMap::new(),
             surface_modules: HashMap::new(),
-            block_mirs: HashMap::new(),
+            block_mirs: Arc::new(HashMap::new()),
             block_layouts: HashMap::new(),
             block_modules: HashMap::new(),
+            block_specializations: Arc::new(HashMap::new()),
+            specializer: None,
             graph: DependencyGraph::new(),
-            jit,
-            library_pointers,
-            runtime_pointers: None,
-            bpm: 60.,
-            sample_rate: 44100.,
+            jits,
+            generations: [None, None],
+            running_slot: None,
+            staged_slot: None,
+            next_generation_id: 1,
+            removed_keys: [Vec::new(), Vec::new()],
+            is_pending: false,
+            unoptimized_jobs: HashSet::new(),
+            is_root_unoptimized: false,
+            pending_optimized: None,
         }
     }
 
+    /// The part of the runtime the audio thread and the editor use while code is being prepared.
+    pub fn shared(&self) -> &Arc<RuntimeShared> {
+        &self.shared
+    }
+
+    /// When enabled, commits are built with a quick pipeline so they can be deployed sooner, and
+    /// `prepare_optimize` and `deploy_optimized` swap in fully optimized code afterwards.
+    pub fn set_tiered(&mut self, tiered: bool) {
+        self.preview_optimizer = if tiered {
+            Some(Optimizer::new_with_level(
+                &self.target,
+                PREVIEW_OPTIMIZATION_LEVEL,
+            ))
+        } else {
+            None
+        };
+    }
+
+    /// When enabled, `prepare_optimize` watches the values of audio controls, and rebuilds blocks
+    /// with the values of controls that haven't changed for a while folded in. Specialized blocks
+    /// check the values every sample and fall back to their regular code if any have changed.
+    pub fn set_specializing(&mut self, specializing: bool) {
+        self.specializer = if specializing {
+            Some(ControlSpecializer::new())
+        } else {
+            None
+        };
+    }
+
+    /// Sets how many voices of an extracted group are updated at once, overriding the count picked
+    /// from the CPU's feature level. Surfaces call the lane functions of the surfaces inside them,
+    /// so this must be set before anything is built.
+    pub fn set_voice_lanes(&mut self, voice_lanes: u32) {
+        self.target.voice_lanes = voice_lanes;
+
+        // the cache is keyed on the lane count
+        if let Some(module_cache) = self.module_cache.take() {
+            self.module_cache = Some(ModuleCache::new(
+                module_cache.directory().to_path_buf(),
+                &self.target,
+            ));
+        }
+    }
+
+    /// Starts loading and storing optimized block and surface modules in the given directory.
+    pub fn set_cache_directory(&mut self, directory: PathBuf) {
+        self.module_cache = Some(ModuleCache::new(directory, &self.target));
+    }
+
     fn codegen_lib(context: &Context, target: &TargetProperties) -> Module {
         let module = target.create_module(context, "lib");
         globals::build_globals(&module);
@@ -223,19 +534,22 @@ impl Runtime {
         Vec::from_iter(required_surfaces.into_iter())
     }
 
-    fn deploy_module(jit: &Jit, module: &mut RuntimeModule) {
+    fn deploy_module(jit: &Jit, slot: usize, module: &mut RuntimeModule) {
         // if the module already has a key, remove it
-        if let Some(key) = module.key {
+        if let Some(key) = module.keys[slot] {
             jit.remove(key);
         }
-        let key = jit.deploy(&module.module);
-        module.key = Some(key);
+        module.keys[slot] = Some(jit.deploy(&module.module));
+        module.is_deployed[slot] = true;
     }
 
-    fn remove_module(jit: &Jit, module: &mut RuntimeModule) {
-        if let Some(key) = module.key {
-            jit.remove(key);
-            module.key = None;
+    fn remove_module(removed_keys: &mut [Vec<JitKey>], module: &mut RuntimeModule) {
+        // the module's code could still be running, so it's only removed from each JIT when code
+        // is next deployed to it
+        for (slot, key) in module.keys.iter_mut().enumerate() {
+            if let Some(key) = key.take() {
+                removed_keys[slot].push(key);
+            }
         }
     }
 
@@ -244,24 +558,32 @@ impl Runtime {
     }
 
     fn optimize_surfaces(&mut self, surfaces: impl IntoIterator<Item = Surface>) -> Vec<Surface> {
-        mir_optimizer::prepare_surfaces(surfaces, &mut self.id_allocator, &self.target).collect()
+        let mut id_allocator = &self.shared.id_allocator;
+        mir_optimizer::prepare_surfaces(surfaces, &mut id_allocator, &self.target).collect()
     }
 
     fn patch_in_blocks(&mut self, blocks: Vec<Block>) {
         for block in blocks {
             let id = block.id.id;
+
+            // the block's controls might have changed, so it starts off generic again
+            Arc::make_mut(&mut self.block_specializations).remove(&id);
+            if let Some(ref mut specializer) = self.specializer {
+                specializer.forget_block(id);
+            }
+
             self.block_layouts.insert(
                 id,
                 data_analyzer::build_block_layout(&self.context, &block, &self.target),
             );
-            self.block_mirs.insert(id, block);
+            Arc::make_mut(&mut self.block_mirs).insert(id, block);
         }
     }
 
     fn patch_in_surfaces(&mut self, surfaces: Vec<Surface>, build_layout_surfaces: &[u64]) {
+        let surface_mirs = Arc::make_mut(&mut self.surface_mirs);
         for surface in surfaces {
-            let id = surface.id.id;
-            self.surface_mirs.insert(id, surface);
+            surface_mirs.insert(surface.id.id, surface);
         }
 
         // rebuild layouts for the flagged surfaces
@@ -273,6 +595,20 @@ impl Runtime {
     }
 
     fn patch_transaction(&mut self, transaction: Transaction) -> (Vec<BlockRef>, Vec<SurfaceRef>) {
+        // The capacity sets the size of every extracted group, so if it changes, every surface
+        // needs a new layout and module. Blocks don't depend on it.
+        let is_capacity_changed = match transaction.root {
+            Some(ref root) if root.array_capacity != self.target.array_capacity => {
+                self.target.array_capacity = root.array_capacity;
+                self.module_cache = self
+                    .module_cache
+                    .as_ref()
+                    .map(|cache| ModuleCache::new(cache.directory().to_path_buf(), &self.target));
+                true
+            }
+            _ => false,
+        };
+
         let surfaces =
             self.optimize_surfaces(transaction.surfaces.into_iter().map(|(_, surface)| surface));
         let mut blocks: Vec<_> = transaction
@@ -294,11 +630,19 @@ impl Runtime {
         // Build a list of affected surfaces (i.e surfaces whose layouts may have changed) to
         // recalculate layouts. This list must be sorted in dependency order, since layout
         // calculation depends on layouts of surfaces inside.
-        let affected_surfaces = HashSet::from_iter(Runtime::get_affected_surfaces(
+        let mut affected_surfaces = HashSet::from_iter(Runtime::get_affected_surfaces(
             &self.graph,
             &new_block_ids,
             &new_surface_ids,
         ));
+        if is_capacity_changed {
+            let graph = &self.graph;
+            affected_surfaces.extend(
+                self.surface_mirs
+                    .keys()
+                    .filter(|&&surface| graph.get_surface_deps(surface).is_some()),
+            );
+        }
         let mut sorted_surfaces = self.graph.get_sorted_surfaces(&affected_surfaces);
 
         // `sorted_surfaces` goes from the root surface down - we need to process them in reverse
@@ -316,55 +660,154 @@ impl Runtime {
         (new_block_ids, sorted_surfaces)
     }
 
-    fn codegen_blocks(&mut self, block_ids: &[BlockRef]) {
-        for &block_id in block_ids {
-            let block = &self.block_mirs[&block_id];
+    fn codegen_modules(&mut self, jobs: Vec<CodegenJob>) {
+        // Jobs are in dependency order, so the keys of a surface's children are found before it.
+        let mut cache_keys = HashMap::new();
+        for &job in &jobs {
+            let cache_key = self.get_cache_key(job, &cache_keys);
+            cache_keys.insert(job, cache_key);
+        }
 
-            let module_id = if let Entry::Occupied(old_module) = self.block_modules.entry(block_id)
-            {
-                old_module.get().key
+        let mut modules = Vec::new();
+        let mut build_jobs = Vec::new();
+        for job in jobs {
+            match self.load_cached_module(job, cache_keys[&job]) {
+                Some(cached_module) => modules.push((job, cached_module)),
+                None => build_jobs.push(job),
+            }
+        }
+
+        // Modules from the cache are always optimized, so they don't need to be rebuilt later.
+        for (job, _) in &modules {
+            self.unoptimized_jobs.remove(job);
+        }
+
+        let is_preview = self.preview_optimizer.is_some();
+        let built_modules = match &self.preview_optimizer {
+            Some(preview_optimizer) => {
+                self.build_modules(build_jobs, preview_optimizer, PREVIEW_OPTIMIZATION_LEVEL)
+            }
+            None => self.build_modules(build_jobs, &self.optimizer, self.target.optimization_level),
+        };
+        for (job, module) in &built_modules {
+            if is_preview {
+                self.unoptimized_jobs.insert(*job);
             } else {
-                None
+                self.store_cached_module(*job, module, cache_keys[job]);
+            }
+        }
+        modules.extend(built_modules);
+
+        for (job, module) in modules {
+            // the old version is replaced in each JIT the next time code is deployed to it
+            let mut module = RuntimeModule::new(module);
+            if let Some(old_module) = self.get_module(job) {
+                module.keys = old_module.keys;
+            }
+            module.cache_key = cache_keys[&job];
+            match job {
+                CodegenJob::Block(block_id) => self.block_modules.insert(block_id, module),
+                CodegenJob::Surface(surface_id) => self.surface_modules.insert(surface_id, module),
             };
+        }
+    }
 
-            let module = RuntimeModule::new(
-                self.target.create_module(
-                    &self.context,
-                    &format!("block.{}.{}", block.id.id, block.id.debug_name),
-                ),
-                module_id,
-            );
-            block::build_funcs(&module.module, self, block);
-            self.optimizer.optimize_module(&module.module);
-            self.block_modules.insert(block_id, module);
+    fn build_modules(
+        &self,
+        jobs: Vec<CodegenJob>,
+        optimizer: &Optimizer,
+        optimization_level: OptimizationLevel,
+    ) -> Vec<(CodegenJob, Module)> {
+        if jobs.len() > 1 {
+            parallel_codegen::build_modules_parallel(
+                &self.context,
+                &self.target,
+                &self.block_mirs,
+                &self.surface_mirs,
+                &self.block_specializations,
+                jobs,
+                optimization_level,
+            )
+        } else {
+            jobs.into_iter()
+                .map(|job| (job, parallel_codegen::build_module(self, optimizer, job)))
+                .collect()
+        }
+    }
+
+    fn is_specialized(&self, job: CodegenJob) -> bool {
+        match job {
+            CodegenJob::Block(block_id) => self.block_specializations.contains_key(&block_id),
+            CodegenJob::Surface(_) => false,
         }
     }
 
-    fn codegen_surfaces(&mut self, surface_ids: &[SurfaceRef]) {
-        for &surface_id in surface_ids {
-            let surface = &self.surface_mirs[&surface_id];
+    fn get_module(&self, job: CodegenJob) -> Option<&RuntimeModule> {
+        match job {
+            CodegenJob::Block(block_id) => self.block_modules.get(&block_id),
+            CodegenJob::Surface(surface_id) => self.surface_modules.get(&surface_id),
+        }
+    }
 
-            let module_id =
-                if let Entry::Occupied(old_module) = self.surface_modules.entry(surface_id) {
-                    old_module.get().key
-                } else {
-                    None
-                };
+    fn load_cached_module(&self, job: CodegenJob, cache_key: Option<u64>) -> Option<Module> {
+        match (&self.module_cache, cache_key) {
+            (Some(cache), Some(key)) => cache.load(&self.context, key, &self.get_cache_ids(job)),
+            _ => None,
+        }
+    }
 
-            let module = RuntimeModule::new(
-                self.target.create_module(
-                    &self.context,
-                    &format!("surface.{}.{}", surface.id.id, surface.id.debug_name),
-                ),
-                module_id,
-            );
-            surface::build_funcs(&module.module, self, surface);
-            self.optimizer.optimize_module(&module.module);
-            self.surface_modules.insert(surface_id, module);
+    fn store_cached_module(&self, job: CodegenJob, module: &Module, cache_key: Option<u64>) {
+        if let (Some(cache), Some(key)) = (&self.module_cache, cache_key) {
+            cache.store(module, key, &self.get_cache_ids(job));
         }
     }
 
-    fn codegen_root(&self, root: &Root) -> Module {
+    fn get_cache_ids(&self, job: CodegenJob) -> Vec<u64> {
+        match job {
+            CodegenJob::Block(block_id) => ModuleCache::block_ids(&self.block_mirs[&block_id]),
+            CodegenJob::Surface(surface_id) => {
+                ModuleCache::surface_ids(self, &self.surface_mirs[&surface_id])
+            }
+        }
+    }
+
+    // Surface keys include the keys of the blocks and surfaces inside them, which are either being
+    // generated in the same transaction or are already deployed. If any of them are missing the
+    // surface isn't cached.
+    fn get_cache_key(
+        &self,
+        job: CodegenJob,
+        new_keys: &HashMap<CodegenJob, Option<u64>>,
+    ) -> Option<u64> {
+        let cache = self.module_cache.as_ref()?;
+        match job {
+            CodegenJob::Block(block_id) => Some(cache.block_key(&self.block_mirs[&block_id])),
+            CodegenJob::Surface(surface_id) => {
+                let surface = &self.surface_mirs[&surface_id];
+                let mut child_keys = Vec::new();
+                for node in &surface.nodes {
+                    let child_job = match node.data {
+                        NodeData::Dummy => continue,
+                        NodeData::Custom { block, .. } => CodegenJob::Block(block),
+                        NodeData::Group(child_surface)
+                        | NodeData::ExtractGroup {
+                            surface: child_surface,
+                            ..
+                        } => CodegenJob::Surface(child_surface),
+                    };
+                    let child_key = match new_keys.get(&child_job) {
+                        Some(&child_key) => child_key,
+                        None => self.get_module(child_job)?.cache_key,
+                    };
+                    child_keys.push(child_key?);
+                }
+
+                Some(cache.surface_key(self, surface, &child_keys))
+            }
+        }
+    }
+
+    fn codegen_root(&self, root: &Root, optimizer: &Optimizer) -> Module {
         let module = self.target.create_module(&self.context, "root");
         let initialized_global =
             root::build_initialized_global(&module, self, 0, INITIALIZED_GLOBAL_NAME);
@@ -389,7 +832,15 @@ impl Runtime {
             DESTRUCT_FUNC_NAME,
             pointers_global.as_pointer_value(),
         );
-        self.optimizer.optimize_module(&module);
+        root::build_update_block_func(
+            &module,
+            self,
+            root,
+            UPDATE_BLOCK_FUNC_NAME,
+            sockets_global.sockets.as_pointer_value(),
+            pointers_global.as_pointer_value(),
+        );
+        optimizer.optimize_module(&module);
         module
     }
 
@@ -398,38 +849,165 @@ impl Runtime {
         new_block_ids: &[BlockRef],
         affected_surfaces: &[SurfaceRef],
     ) {
-        self.codegen_blocks(new_block_ids);
-        self.codegen_surfaces(affected_surfaces);
+        let jobs = new_block_ids
+            .iter()
+            .map(|&block_id| CodegenJob::Block(block_id))
+            .chain(
+                affected_surfaces
+                    .iter()
+                    .map(|&surface_id| CodegenJob::Surface(surface_id)),
+            )
+            .collect();
+        self.codegen_modules(jobs);
+
+        let root_optimizer = self.preview_optimizer.as_ref().unwrap_or(&self.optimizer);
+        let root_module = self.codegen_root(&self.root.0, root_optimizer);
+        self.root.1.module = root_module;
+        self.root.1.is_deployed = [false; JIT_SLOT_COUNT];
+        self.is_root_unoptimized = self.preview_optimizer.is_some();
+    }
+
+    // Brings the code in one of the JITs up to date with the current modules. Surfaces are linked
+    // to the blocks and surfaces inside them when they're deployed, so ones above a module that's
+    // changed since the last deploy to this JIT are deployed again even if they haven't been
+    // rebuilt.
+    fn link_generation(&mut self, slot: usize) -> RuntimePointers {
+        let jit = &self.jits[slot];
+        for key in self.removed_keys[slot].drain(..) {
+            jit.remove(key);
+        }
+
+        let new_blocks: Vec<_> = self
+            .block_modules
+            .iter()
+            .filter(|(_, module)| !module.is_deployed[slot])
+            .map(|(&block_id, _)| block_id)
+            .collect();
+        let new_surfaces: Vec<_> = self
+            .surface_modules
+            .iter()
+            .filter(|(_, module)| !module.is_deployed[slot])
+            .map(|(&surface_id, _)| surface_id)
+            .collect();
+        let deploy_surfaces =
+            Runtime::get_affected_surfaces(&self.graph, &new_blocks, &new_surfaces);
+
+        for block in new_blocks {
+            if let Some(module) = self.block_modules.get_mut(&block) {
+                Runtime::deploy_module(jit, slot, module);
+            }
+        }
+        for surface in deploy_surfaces {
+            if let Some(module) = self.surface_modules.get_mut(&surface) {
+                Runtime::deploy_module(jit, slot, module);
+            }
+        }
+        Runtime::deploy_module(jit, slot, &mut self.root.1);
+
+        // tell the library the capacity the code was built for
+        unsafe {
+            *(self.shared.library_pointers[slot].array_capacity_ptr as *mut u32) =
+                u32::from(self.target.array_capacity);
+        }
 
-        self.root.1.module = self.codegen_root(&self.root.0);
+        RuntimePointers::new(jit)
     }
 
-    fn deploy_transaction(&mut self, block_ids: &[BlockRef], affected_surfaces: &[SurfaceRef]) {
-        for block in block_ids {
-            Runtime::deploy_module(&self.jit, self.block_modules.get_mut(block).unwrap());
+    // Finds the JIT to deploy a new generation to, which is the one the audio thread isn't
+    // running. A generation that was deployed but never published is thrown away.
+    fn free_slot(&mut self) -> usize {
+        if let Some(staged_slot) = self.staged_slot.take() {
+            self.destroy_generation(staged_slot);
+        }
+        match self.running_slot {
+            Some(running_slot) => (running_slot + 1) % JIT_SLOT_COUNT,
+            None => 0,
+        }
+    }
+
+    fn stage_generation(
+        &mut self,
+        slot: usize,
+        pointers: RuntimePointers,
+        state: StateMap,
+        state_copies: Vec<StateCopy>,
+    ) {
+        // The task pool's workers are only started once some code can use them. Neither JIT is
+        // running code that uses the pool before then, so the globals can be set here.
+        let uses_task_pool = self
+            .surface_mirs
+            .values()
+            .any(|surface| surface.parallel_voices || surface.parallel_branches);
+        if uses_task_pool && self.shared.task_pool.get().is_none() {
+            let task_pool = self
+                .shared
+                .task_pool
+                .get_or_init(|| TaskPool::new(task_pool::DEFAULT_WORKER_COUNT));
+            for pointers in &self.shared.library_pointers {
+                unsafe {
+                    *(pointers.task_pool_ptr as *mut *const c_void) = task_pool.as_ptr();
+                }
+            }
         }
-        for surface in affected_surfaces {
-            Runtime::deploy_module(&self.jit, self.surface_modules.get_mut(surface).unwrap());
+
+        let id = self.next_generation_id;
+        self.next_generation_id += 1;
+        self.generations[slot] = Some(Box::new(Generation {
+            id,
+            slot,
+            pointers,
+            state,
+            state_copies,
+            uses_task_pool,
+        }));
+        self.staged_slot = Some(slot);
+        self.shared.latest_slot.store(slot, Ordering::Release);
+    }
+
+    // Runs the destructor of a generation. The audio thread mustn't be running it, and any state
+    // it handed over to a newer generation has already been zeroed.
+    fn destroy_generation(&mut self, slot: usize) {
+        if let Some(generation) = self.generations[slot].take() {
+            unsafe {
+                (generation.pointers.destruct)();
+            }
         }
+    }
 
-        Runtime::deploy_module(&self.jit, &mut self.root.1);
-        self.runtime_pointers = Some(RuntimePointers::new(&self.jit));
+    fn running_generation(&self) -> Option<&Generation> {
+        self.running_slot
+            .and_then(|slot| self.generations[slot].as_ref())
+            .map(|generation| &**generation)
     }
 
-    pub fn commit(&mut self, transaction: Transaction) {
+    // The generation the editor should be looking at, which is the one that will be running once
+    // `publish` is called.
+    fn latest_generation(&self) -> Option<&Generation> {
+        self.staged_slot
+            .or(self.running_slot)
+            .and_then(|slot| self.generations[slot].as_ref())
+            .map(|generation| &**generation)
+    }
+
+    /// Patches, generates and optimizes the modules for a transaction, without touching anything
+    /// the currently deployed code uses. This means it's safe to call while `run_update` or
+    /// `next_id` are being called on other threads. The new modules aren't used until
+    /// `deploy_commit` is called, which must not run concurrently with updates. Returns true if
+    /// there's anything to deploy.
+    pub fn prepare_commit(&mut self, transaction: Transaction) -> bool {
         // if the transaction is empty, early exit
         if transaction.surfaces.is_empty()
             && transaction.blocks.is_empty()
             && transaction.root.is_none()
         {
-            return;
+            return self.is_pending;
         }
 
-        // run destructors on old data before beginning
-        if let Some(ref pointers) = self.runtime_pointers {
-            unsafe {
-                (pointers.destruct)();
-            }
+        // Optimized modules that haven't been deployed yet would be out of date after this, so the
+        // modules they were replacing are rebuilt on the next `prepare_optimize` instead.
+        if let Some(optimized) = self.pending_optimized.take() {
+            self.unoptimized_jobs
+                .extend(optimized.modules.into_iter().map(|(job, _)| job));
         }
 
         let patch_start = Instant::now();
@@ -446,33 +1024,287 @@ impl Runtime {
             precise_duration_seconds(&codegen_start.elapsed())
         );
 
+        self.is_pending = true;
+        true
+    }
+
+    /// Links the modules built by `prepare_commit` into the JIT the audio thread isn't using and
+    /// runs their constructor, without touching the code that's running. Nodes that are still in
+    /// the tree with the same state layout keep their state instead of being constructed again,
+    /// so delays, filters and envelopes carry on through the commit. The new code doesn't run
+    /// until `publish` is called.
+    pub fn deploy_commit(&mut self) {
+        if !self.is_pending {
+            return;
+        }
+        self.is_pending = false;
+
         let deploy_start = Instant::now();
-        self.deploy_transaction(&new_block_ids, &affected_surfaces);
+        let slot = self.free_slot();
+        let pointers = self.link_generation(slot);
         println!(
             "Deploy took {}s",
             precise_duration_seconds(&deploy_start.elapsed())
         );
 
-        // reset the BPM and sample rate
-        Runtime::set_vector(self.library_pointers.bpm_ptr, self.bpm);
-        Runtime::set_vector(self.library_pointers.samplerate_ptr, self.sample_rate);
+        unsafe {
+            (pointers.construct)();
+        }
 
-        if let Some(ref pointers) = self.runtime_pointers {
-            // run the new constructor
-            unsafe {
-                (pointers.construct)();
+        // Layouts are patched by `prepare_commit`, so this describes the code being deployed.
+        // Constructors for migrated nodes have run on zeroed state, and none of them set up
+        // anything that needs to be freed, so it's overwritten with the state from the old code
+        // when it's published.
+        let state = StateMap::build(self, 0);
+        let new_scratch_ptr = pointers.scratch_ptr as *mut u8;
+        let state_copies = match self.running_generation() {
+            Some(running) if !new_scratch_ptr.is_null() => {
+                let old_scratch_ptr = running.pointers.scratch_ptr as *mut u8;
+                running
+                    .state
+                    .plan_migrations(&state)
+                    .into_iter()
+                    .map(|migration| unsafe {
+                        StateCopy {
+                            from: old_scratch_ptr.add(migration.old_offset),
+                            to: new_scratch_ptr.add(migration.new_offset),
+                            size: migration.size,
+                        }
+                    })
+                    .collect()
+            }
+            _ => Vec::new(),
+        };
+        self.stage_generation(slot, pointers, state, state_copies);
+    }
+
+    /// Switches the audio thread over to the code deployed by `deploy_commit` or
+    /// `deploy_optimized`, and tears down the old code. The new code is handed to the audio
+    /// thread, which moves state across and starts running it at the beginning of its next update,
+    /// so no buffer is skipped, and this waits until that's happened. If the audio thread hasn't
+    /// started an update for a while, it's assumed to have stopped and the switch is made here.
+    pub fn publish(&mut self) {
+        let slot = match self.staged_slot.take() {
+            Some(slot) => slot,
+            None => return,
+        };
+        let generation = self.generations[slot]
+            .as_mut()
+            .map(|generation| &mut **generation as *mut Generation)
+            .unwrap();
+
+        let exchange = &self.shared.exchange;
+        exchange.pending.store(generation, Ordering::Release);
+        while exchange.running.load(Ordering::Acquire) != generation {
+            if exchange.are_updates_stopped()
+                && exchange
+                    .update_word
+                    .compare_exchange(
+                        UPDATES_IDLE,
+                        UPDATES_SWITCHING,
+                        Ordering::Acquire,
+                        Ordering::Relaxed,
+                    )
+                    .is_ok()
+            {
+                unsafe {
+                    exchange.switch_pending();
+                }
+                exchange.update_word.store(UPDATES_IDLE, Ordering::Release);
+            } else {
+                thread::sleep(Duration::from_micros(UPDATE_POLL_MICROS));
+            }
+        }
+
+        // The old generation won't run again, so what was moved out of it can be cleared
+        unsafe {
+            (*generation).clear_copied_state();
+        }
+        if let Some(old_slot) = self.running_slot.take() {
+            self.destroy_generation(old_slot);
+        }
+        self.running_slot = Some(slot);
+    }
+
+    /// Whether any deployed code was built with the preview pipeline, or controls are being
+    /// watched for specialization. The root is rebuilt on every commit, so it's unoptimized
+    /// whenever anything else is.
+    pub fn needs_optimize(&self) -> bool {
+        self.is_root_unoptimized || self.specializer.is_some()
+    }
+
+    /// Reads the values of the controls watched for specialization, to be passed to
+    /// `prepare_optimize`. This must be called on the thread that owns the runtime, so the code
+    /// being read isn't replaced, but doesn't stop the audio thread from running updates.
+    pub fn snapshot_controls(&self) -> ControlSnapshot {
+        let root_ptr = self.get_root_ptr();
+        if self.specializer.is_none() || root_ptr.is_null() {
+            return ControlSnapshot::empty();
+        }
+
+        ControlSnapshot::read(self, 0, root_ptr)
+    }
+
+    /// Rebuilds modules that were deployed with the preview pipeline using the full one, along
+    /// with blocks whose controls have settled on new values in `controls` if specializing. Like
+    /// `prepare_commit` this doesn't touch deployed code, and the new modules are swapped in by
+    /// `deploy_optimized`. Returns true if there's anything to deploy.
+    pub fn prepare_optimize(&mut self, controls: ControlSnapshot) -> bool {
+        if self.is_pending || self.pending_optimized.is_some() || !self.needs_optimize() {
+            return self.pending_optimized.is_some();
+        }
+
+        let specialized_blocks = self.update_specializations(&controls);
+        if !self.is_root_unoptimized && specialized_blocks.is_empty() {
+            return false;
+        }
+
+        // objects might have been garbage collected since they were built
+        let mut jobs = mem::replace(&mut self.unoptimized_jobs, HashSet::new());
+        jobs.extend(specialized_blocks.into_iter().map(CodegenJob::Block));
+        let jobs: Vec<_> = jobs
+            .into_iter()
+            .filter(|&job| self.get_module(job).is_some())
+            .collect();
+        let modules = self.build_modules(jobs, &self.optimizer, self.target.optimization_level);
+        for (job, module) in &modules {
+            // specialized modules depend on control values, which aren't part of the cache key
+            if self.is_specialized(*job) {
+                continue;
+            }
+
+            let cache_key = self
+                .get_module(*job)
+                .and_then(|old_module| old_module.cache_key);
+            self.store_cached_module(*job, module, cache_key);
+        }
+        let root = if self.is_root_unoptimized {
+            Some(self.codegen_root(&self.root.0, &self.optimizer))
+        } else {
+            None
+        };
+        self.is_root_unoptimized = false;
+
+        self.pending_optimized = Some(OptimizedModules { modules, root });
+        true
+    }
+
+    /// Links the modules built by `prepare_optimize` into the JIT the audio thread isn't using.
+    /// They have the same layout as the modules they replace, so instead of re-running
+    /// constructors, all of the state is moved across when it's published, and playback carries
+    /// on as it was. Like `deploy_commit`, the new code doesn't run until
+    /// `publish` is called.
+    pub fn deploy_optimized(&mut self) {
+        let optimized = match self.pending_optimized.take() {
+            Some(optimized) => optimized,
+            None => return,
+        };
+
+        for (job, module) in optimized.modules {
+            let runtime_module = match job {
+                CodegenJob::Block(block_id) => self.block_modules.get_mut(&block_id),
+                CodegenJob::Surface(surface_id) => self.surface_modules.get_mut(&surface_id),
+            };
+            if let Some(runtime_module) = runtime_module {
+                runtime_module.module = module;
+                runtime_module.is_deployed = [false; JIT_SLOT_COUNT];
+            }
+        }
+        if let Some(root) = optimized.root {
+            self.root.1.module = root;
+        }
+
+        let slot = self.free_slot();
+        let pointers = self.link_generation(slot);
+        let state = StateMap::build(self, 0);
+        let state_copies = match self.running_generation() {
+            Some(running) => self.plan_state_copies(running.slot, slot),
+            None => {
+                unsafe {
+                    (pointers.construct)();
+                }
+                Vec::new()
+            }
+        };
+        self.stage_generation(slot, pointers, state, state_copies);
+    }
+
+    // Updates blocks whose stable controls have changed to be specialized on the new values.
+    // Blocks whose controls have started moving keep their old specialization, since they already
+    // fall back to the regular code when the values differ. Returns the blocks that need
+    // rebuilding.
+    fn update_specializations(&mut self, controls: &ControlSnapshot) -> Vec<BlockRef> {
+        let stable_values = match self.specializer {
+            Some(ref mut specializer) => specializer.sample(controls),
+            None => return Vec::new(),
+        };
+
+        let mut changed_blocks = Vec::new();
+        for (block, values) in stable_values {
+            let is_changed = match self.block_specializations.get(&block) {
+                Some(old_values) => {
+                    old_values.len() != values.len()
+                        || old_values.iter().zip(values.iter()).any(
+                            |((old_control, old_value), (new_control, new_value))| {
+                                old_control != new_control
+                                    || !control_specializer::is_same_value(old_value, new_value)
+                            },
+                        )
+                }
+                None => true,
+            };
+
+            if is_changed {
+                Arc::make_mut(&mut self.block_specializations).insert(block, values);
+                changed_blocks.push(block);
             }
         }
+        changed_blocks
+    }
+
+    // Copies of the whole of each state global, for switching between generations with the same
+    // layout.
+    fn plan_state_copies(&self, from_slot: usize, to_slot: usize) -> Vec<StateCopy> {
+        let target_data = self.target.machine.get_data();
+        STATE_GLOBAL_NAMES
+            .iter()
+            .map(|&name| {
+                let state_type = self
+                    .root
+                    .1
+                    .module
+                    .get_global(name)
+                    .unwrap()
+                    .as_pointer_value()
+                    .get_type()
+                    .get_element_type();
+                StateCopy {
+                    from: self.jits[from_slot].get_symbol_address(name) as *mut u8,
+                    to: self.jits[to_slot].get_symbol_address(name) as *mut u8,
+                    size: target_data.get_abi_size(&state_type) as usize,
+                }
+            })
+            // globals are null when they're empty
+            .filter(|copy| !copy.from.is_null() && !copy.to.is_null())
+            .collect()
+    }
+
+    pub fn commit(&mut self, transaction: Transaction) {
+        if self.prepare_commit(transaction) {
+            self.deploy_commit();
+            self.publish();
+        }
     }
 
     /// Remove any objects that aren't referenced by others (and aren't the root).
     pub fn garbage_collect(&mut self) {
         let graph = &self.graph;
-        let surface_mirs = &mut self.surface_mirs;
+        let surface_mirs = Arc::make_mut(&mut self.surface_mirs);
         let surface_layouts = &mut self.surface_layouts;
-        let block_mirs = &mut self.block_mirs;
+        let block_mirs = Arc::make_mut(&mut self.block_mirs);
         let block_layouts = &mut self.block_layouts;
-        let jit = &self.jit;
+        let block_specializations = Arc::make_mut(&mut self.block_specializations);
+        let removed_keys = &mut self.removed_keys;
 
         // we can now remove any objects that don't exist in the graph
         self.surface_modules.retain(|&key, module| {
@@ -481,7 +1313,7 @@ impl Runtime {
             } else {
                 surface_mirs.remove(&key);
                 surface_layouts.remove(&key);
-                Runtime::remove_module(jit, module);
+                Runtime::remove_module(removed_keys, module);
                 false
             }
         });
@@ -491,28 +1323,217 @@ impl Runtime {
             } else {
                 block_mirs.remove(&key);
                 block_layouts.remove(&key);
-                Runtime::remove_module(jit, module);
+                block_specializations.remove(&key);
+                Runtime::remove_module(removed_keys, module);
                 false
             }
         });
     }
 
+    /// Finds the root of the latest deployed code, which is what the editor reads and writes
+    /// controls through. This can be code that hasn't been published yet.
+    pub fn get_root_ptr(&self) -> *mut c_void {
+        if let Some(generation) = self.latest_generation() {
+            generation.pointers.pointers_ptr
+        } else {
+            ptr::null_mut()
+        }
+    }
+
+    /// Finds the counter of a node's profiled cycles, which is added to on every profiled tick and
+    /// reset when the surface containing it is rebuilt. Nodes in extracted groups are timed in
+    /// the surface generated for the group, and the time is summed across all voices.
+    pub fn get_node_profile_ptr(&self, surface: SurfaceRef, node: usize) -> *mut u64 {
+        let surface_mir = match self.surface_mir(surface) {
+            Some(surface_mir) => surface_mir,
+            None => return ptr::null_mut(),
+        };
+        let (profile_surface, profile_node) = match surface_mir.source_map.map_to_internal(node) {
+            InternalNodeRef::Direct(node_index) => (surface, node_index),
+            InternalNodeRef::Surface(group_index, node_index) => {
+                match surface_mir.nodes.get(group_index).map(|node| &node.data) {
+                    Some(NodeData::ExtractGroup { surface, .. }) => (*surface, node_index),
+                    _ => return ptr::null_mut(),
+                }
+            }
+        };
+
+        let node_count = match self.surface_mir(profile_surface) {
+            Some(profile_surface_mir) => profile_surface_mir.nodes.len(),
+            None => return ptr::null_mut(),
+        };
+        let slot = match self.latest_generation() {
+            Some(generation) => generation.slot,
+            None => return ptr::null_mut(),
+        };
+        let profile_address =
+            self.jits[slot].get_symbol_address(&globals::get_surface_profile_name(profile_surface));
+        if profile_address == 0 || profile_node >= node_count {
+            return ptr::null_mut();
+        }
+
+        unsafe { (profile_address as *mut u64).add(profile_node) }
+    }
+
+    pub fn is_node_extracted(&self, surface: SurfaceRef, node: usize) -> bool {
+        let surface_mir = match self.surface_mir(surface) {
+            Some(surface_mir) => surface_mir,
+            None => return false,
+        };
+        let node_inner = surface_mir.source_map.map_to_internal(node);
+
+        if let InternalNodeRef::Surface(_, _) = node_inner {
+            true
+        } else {
+            false
+        }
+    }
+
+    pub fn print_mir(&self) {
+        println!(">> Begin MIR");
+        println!("Blocks >>");
+        for block in self.block_mirs.values() {
+            println!("{}", block);
+        }
+        println!("Surfaces >>");
+        for surface in self.surface_mirs.values() {
+            println!("{}", surface);
+        }
+        println!("Root: {:#?}", self.root.0);
+        println!("<< End MIR");
+    }
+
+    pub fn print_modules(&self) {
+        for module in self.block_modules.values() {
+            module.module.print_to_stderr();
+        }
+        for module in self.surface_modules.values() {
+            module.module.print_to_stderr();
+        }
+        self.root.1.module.print_to_stderr();
+    }
+}
+
+impl RuntimeShared {
+    // Waits for the update running on the audio thread to finish, if there is one.
+    fn wait_for_idle_updates(&self) {
+        while self.exchange.update_word.load(Ordering::Acquire) != UPDATES_IDLE {
+            thread::sleep(Duration::from_micros(UPDATE_POLL_MICROS));
+        }
+    }
+
+    /// Called by the audio thread before running updates. Returns the ID of the generation the
+    /// updates will run, which changes whenever newly published code is switched to, or zero if
+    /// there's nothing to run or updates are paused. If an ID is returned, `end_update` must be
+    /// called once the updates are done.
+    pub fn begin_update(&self) -> u64 {
+        loop {
+            match self.exchange.update_word.compare_exchange_weak(
+                UPDATES_IDLE,
+                UPDATES_RUNNING,
+                Ordering::Acquire,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => break,
+                // `publish` only switches generations itself once updates have stopped, so this
+                // is only waited on when they start again during the copy.
+                Err(UPDATES_SWITCHING) | Err(UPDATES_IDLE) => hint::spin_loop(),
+                Err(_) => return 0,
+            }
+        }
+
+        self.exchange
+            .last_update_millis
+            .store(self.exchange.elapsed_millis(), Ordering::Relaxed);
+        unsafe {
+            self.exchange.switch_pending();
+        }
+        let running = self.exchange.running.load(Ordering::Acquire);
+        if running.is_null() {
+            self.end_update();
+            0
+        } else {
+            // Parallel voices and branches start a job on the task pool every sample, so any
+            // workers that have parked since the last buffer are woken ahead of the first one.
+            unsafe {
+                if (*running).uses_task_pool {
+                    if let Some(task_pool) = self.task_pool.get() {
+                        task_pool.wake_workers();
+                    }
+                }
+                (*running).id
+            }
+        }
+    }
+
+    pub fn end_update(&self) {
+        self.exchange
+            .update_word
+            .store(UPDATES_IDLE, Ordering::Release);
+    }
+
+    /// Waits for any update running on the audio thread to finish, and stops new ones from
+    /// starting until `resume_updates` is called, so anything they use can be changed. The audio
+    /// thread doesn't wait while updates are paused, `begin_update` returns zero instead, so every
+    /// buffer it asks for in the meantime is dropped. Publishing code doesn't need this.
+    pub fn pause_updates(&self) {
+        loop {
+            self.wait_for_idle_updates();
+            if self
+                .exchange
+                .update_word
+                .compare_exchange(
+                    UPDATES_IDLE,
+                    UPDATES_PAUSED,
+                    Ordering::Acquire,
+                    Ordering::Relaxed,
+                )
+                .is_ok()
+            {
+                return;
+            }
+        }
+    }
+
+    pub fn resume_updates(&self) {
+        self.exchange
+            .update_word
+            .store(UPDATES_IDLE, Ordering::Release);
+    }
+
+    fn running_pointers(&self) -> Option<&RuntimePointers> {
+        let running = self.exchange.running.load(Ordering::Relaxed);
+        if running.is_null() {
+            None
+        } else {
+            Some(unsafe { &(*running).pointers })
+        }
+    }
+
+    /// Runs one update of the code the audio thread has switched to. Must be called between
+    /// `begin_update` and `end_update`.
     pub unsafe fn run_update(&self) {
-        if let Some(ref pointers) = self.runtime_pointers {
+        if let Some(pointers) = self.running_pointers() {
             (pointers.update)();
         }
     }
 
-    pub fn get_root_ptr(&self) -> *mut c_void {
-        if let Some(ref pointers) = self.runtime_pointers {
-            pointers.pointers_ptr
-        } else {
-            ptr::null_mut()
+    pub unsafe fn run_update_block(
+        &self,
+        frames: u64,
+        stride: u64,
+        inputs: *const *const f32,
+        outputs: *const *mut f32,
+    ) {
+        if let Some(pointers) = self.running_pointers() {
+            (pointers.update_block)(frames, stride, inputs, outputs);
         }
     }
 
+    /// Finds a portal of the code the audio thread is running. Must be called from the audio
+    /// thread between `begin_update` and `end_update`, or while updates are paused.
     pub unsafe fn get_portal_ptr(&self, portal_index: usize) -> *mut c_void {
-        if let Some(ref pointers) = self.runtime_pointers {
+        if let Some(pointers) = self.running_pointers() {
             let portals_array = pointers.portals_ptr as *mut *mut c_void;
             *portals_array.add(portal_index)
         } else {
@@ -528,65 +1549,94 @@ impl Runtime {
         }
     }
 
-    pub fn set_bpm(&mut self, bpm: f64) {
-        self.bpm = bpm;
-        Runtime::set_vector(self.library_pointers.bpm_ptr, bpm);
+    pub fn set_bpm(&self, bpm: f64) {
+        self.bpm.store(bpm.to_bits(), Ordering::Relaxed);
+        for pointers in &self.library_pointers {
+            RuntimeShared::set_vector(pointers.bpm_ptr, bpm);
+        }
     }
 
     pub fn get_bpm(&self) -> f64 {
-        self.bpm
+        f64::from_bits(self.bpm.load(Ordering::Relaxed))
     }
 
-    pub fn set_sample_rate(&mut self, sample_rate: f64) {
-        self.sample_rate = sample_rate;
-        Runtime::set_vector(self.library_pointers.samplerate_ptr, sample_rate);
+    pub fn set_sample_rate(&self, sample_rate: f64) {
+        self.sample_rate
+            .store(sample_rate.to_bits(), Ordering::Relaxed);
+        for pointers in &self.library_pointers {
+            RuntimeShared::set_vector(pointers.samplerate_ptr, sample_rate);
+        }
     }
 
     pub fn get_sample_rate(&self) -> f64 {
-        self.sample_rate
+        f64::from_bits(self.sample_rate.load(Ordering::Relaxed))
     }
 
-    pub fn get_profile_times_ptr(&self) -> *mut u64 {
-        self.library_pointers.profile_times_ptr as *mut u64
+    /// Loads an impulse for `convolve` calls to use, from interleaved samples. Can be called while
+    /// the runtime is generating samples. Returns false if the index is past the last slot.
+    pub fn set_impulse(&self, index: usize, samples: &[f32], channel_count: usize) -> bool {
+        self.impulse_library
+            .set_impulse(index, samples, channel_count)
     }
 
-    pub fn is_node_extracted(&self, surface: SurfaceRef, node: usize) -> bool {
-        let surface_mir = self.surface_mir(surface).unwrap();
-        let node_inner = surface_mir.source_map.map_to_internal(node);
+    pub fn next_id(&self) -> u64 {
+        self.id_allocator.next_id()
+    }
 
-        if let InternalNodeRef::Surface(_, _) = node_inner {
-            true
-        } else {
-            false
+    /// Finds the profile times of the latest deployed code. Each JIT has its own copy of the
+    /// library, so the times are kept separately for the code in each.
+    pub fn get_profile_times_ptr(&self) -> *mut u64 {
+        let slot = self.latest_slot.load(Ordering::Acquire);
+        self.library_pointers[slot].profile_times_ptr as *mut u64
+    }
+
+    /// Asks for the next tick to be profiled. Node times are only measured on requested ticks, so
+    /// the editor can sample them as often as it needs to without slowing down every tick.
+    pub fn request_profile_sample(&self) {
+        for pointers in &self.library_pointers {
+            unsafe {
+                ptr::write_volatile(
+                    (pointers.profile_times_ptr as *mut u64)
+                        .add(globals::PROFILE_REQUEST_INDEX as usize),
+                    1,
+                );
+            }
         }
     }
 
-    pub unsafe fn convert_num(&self, result: *mut c_void, target_form: i8, num: *const c_void) {
-        (self.library_pointers.convert_num)(result, target_form, num)
+    /// The number of ticks that have been profiled.
+    pub fn get_profile_sample_count(&self) -> u64 {
+        self.library_pointers
+            .iter()
+            .map(|pointers| unsafe {
+                ptr::read_volatile(
+                    (pointers.profile_times_ptr as *const u64)
+                        .add(globals::PROFILE_SAMPLE_COUNT_INDEX as usize),
+                )
+            })
+            .sum()
     }
 
-    pub fn print_mir(&self) {
-        println!(">> Begin MIR");
-        println!("Blocks >>");
-        for block in self.block_mirs.values() {
-            println!("{}", block);
+    /// How fast the counter used for profile times runs, measured against the system clock since
+    /// the runtime was created. Returns zero if it can't be measured yet.
+    pub fn get_profile_cycles_per_second(&self) -> f64 {
+        let (start_instant, start_cycles) = self.profile_clock_start;
+        let elapsed = precise_duration_seconds(&start_instant.elapsed());
+        if elapsed <= 0. {
+            return 0.;
         }
-        println!("Surfaces >>");
-        for surface in self.surface_mirs.values() {
-            println!("{}", surface);
-        }
-        println!("Root: {:#?}", self.root.0);
-        println!("<< End MIR");
+        read_cycle_counter().wrapping_sub(start_cycles) as f64 / elapsed
     }
 
-    pub fn print_modules(&self) {
-        for module in self.block_modules.values() {
-            module.module.print_to_stderr();
-        }
-        for module in self.surface_modules.values() {
-            module.module.print_to_stderr();
-        }
-        self.root.1.module.print_to_stderr();
+    pub unsafe fn convert_num(&self, result: *mut c_void, target_form: i8, num: *const c_void) {
+        (self.library_pointers[0].convert_num)(result, target_form, num)
+    }
+
+    /// When disabled, delays and convolutions that need a buffer the pool doesn't have ready get one
+    /// allocated straight away instead of waiting for the pool's helper thread. This makes offline
+    /// renders deterministic, but shouldn't be used where audio runs in real time.
+    pub fn set_realtime(&self, realtime: bool) {
+        self.buffer_pool.set_realtime(realtime);
     }
 }
 
@@ -614,24 +1664,51 @@ impl ObjectCache for Runtime {
     fn block_layout(&self, id: BlockRef) -> Option<&data_analyzer::BlockLayout> {
         self.block_layouts.get(&id)
     }
+
+    fn block_specialization(&self, id: BlockRef) -> Option<&[(usize, ConstantNum)]> {
+        self.block_specializations
+            .get(&id)
+            .map(|values| values.as_slice())
+    }
 }
 
 impl IdAllocator for Runtime {
     fn alloc_id(&mut self) -> u64 {
-        self.id_allocator.alloc_id()
+        self.shared.id_allocator.next_id()
     }
 }
 
 impl Drop for Runtime {
     fn drop(&mut self) {
-        if let Some(ref pointers) = self.runtime_pointers {
-            unsafe {
-                (pointers.destruct)();
-            }
+        // updates have stopped by now, so nothing is running any of the generations
+        for slot in 0..JIT_SLOT_COUNT {
+            self.destroy_generation(slot);
         }
     }
 }
 
+/// Adds a profiled time to a node's total. This is registered with the JIT as the
+/// `maxim.profile.add` builtin.
+unsafe extern "C" fn add_profile_time(total: *mut u64, time: u64) {
+    (*(total as *const AtomicU64)).fetch_add(time, Ordering::Relaxed);
+}
+
+// Matches the timestamps generated code uses for profiling (`llvm.readcyclecounter`).
+#[cfg(target_arch = "x86_64")]
+fn read_cycle_counter() -> u64 {
+    unsafe { std::arch::x86_64::_rdtsc() }
+}
+
+#[cfg(target_arch = "x86")]
+fn read_cycle_counter() -> u64 {
+    unsafe { std::arch::x86::_rdtsc() }
+}
+
+#[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
+fn read_cycle_counter() -> u64 {
+    0
+}
+
 fn precise_duration_seconds(duration: &Duration) -> f64 {
     duration.as_secs() as f64 + f64::from(duration.subsec_nanos()) / 1_000_000_000.
 }
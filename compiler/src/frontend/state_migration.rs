@@ -0,0 +1,213 @@
+use crate::codegen::ObjectCache;
+use crate::mir::block::Function;
+use crate::mir::{BlockRef, NodeData, SurfaceRef};
+use inkwell::targets::TargetData;
+use inkwell::types::{BasicTypeEnum, StructType};
+use std::collections::{HashMap, HashSet};
+
+/// Identifies the state of a node across commits. Each node from the editor has its own block, so
+/// the block's ID identifies the node wherever it ends up, apart from the copies of it in each
+/// voice of an extracted group, which are told apart by their voice indices. Shared data isn't
+/// copied between voices, so it's only identified by the block.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+enum StateKey {
+    Scratch(Vec<usize>, BlockRef),
+    Shared(BlockRef),
+}
+
+#[derive(Debug, Clone)]
+struct StateRegion {
+    offset: usize,
+    size: usize,
+    state_type: BasicTypeEnum,
+    functions: Vec<Function>,
+}
+
+impl StateRegion {
+    // Two blocks with the same functions in the same order use their state in the same way, so
+    // state from one can carry on in the other even if the code around the functions changed.
+    fn is_compatible(&self, other: &StateRegion) -> bool {
+        self.size == other.size
+            && self.state_type == other.state_type
+            && self.functions == other.functions
+    }
+}
+
+/// A copy of a node's state from the old root scratch global to the new one, as byte offsets into
+/// each global.
+#[derive(Debug, Clone, Copy)]
+pub struct StateMigration {
+    pub old_offset: usize,
+    pub new_offset: usize,
+    pub size: usize,
+}
+
+/// Where the state of each node lives in the root scratch global, which holds the scratch and
+/// shared data of every node in the tree.
+pub struct StateMap {
+    regions: HashMap<StateKey, StateRegion>,
+    ambiguous_keys: HashSet<StateKey>,
+}
+
+impl StateMap {
+    pub fn build(cache: &ObjectCache, root_surface: SurfaceRef) -> Self {
+        let mut map = StateMap {
+            regions: HashMap::new(),
+            ambiguous_keys: HashSet::new(),
+        };
+
+        if let Some(layout) = cache.surface_layout(root_surface) {
+            // this must match the global built by `root::build_scratch_global`
+            let root_struct = cache
+                .context()
+                .struct_type(&[&layout.scratch_struct, &layout.shared_struct], false);
+            let target_data = cache.target().machine.get_data();
+            map.add_surface(
+                cache,
+                &target_data,
+                root_surface,
+                get_element_offset(&target_data, &root_struct, 0),
+                get_element_offset(&target_data, &root_struct, 1),
+                &mut Vec::new(),
+            );
+        }
+
+        map
+    }
+
+    /// Finds the nodes that are in both maps with the same state layout, whose state can be
+    /// moved to the new map instead of being constructed from scratch.
+    pub fn plan_migrations(&self, new_map: &StateMap) -> Vec<StateMigration> {
+        new_map
+            .regions
+            .iter()
+            .filter(|(key, _)| {
+                !self.ambiguous_keys.contains(key) && !new_map.ambiguous_keys.contains(key)
+            })
+            .filter_map(|(key, new_region)| {
+                let old_region = self.regions.get(key)?;
+                if new_region.size == 0 || !old_region.is_compatible(new_region) {
+                    return None;
+                }
+
+                Some(StateMigration {
+                    old_offset: old_region.offset,
+                    new_offset: new_region.offset,
+                    size: new_region.size,
+                })
+            })
+            .collect()
+    }
+
+    fn add_region(&mut self, key: StateKey, region: StateRegion) {
+        // Shared data in an extracted group is found once for each voice, which is fine. If a
+        // surface is used in more than one place though, its nodes can't be matched up, and
+        // moving one node's state into two places would leave them both owning the same memory.
+        let is_ambiguous = match self.regions.get(&key) {
+            Some(existing_region) => existing_region.offset != region.offset,
+            None => false,
+        };
+
+        if is_ambiguous {
+            self.ambiguous_keys.insert(key);
+        } else {
+            self.regions.insert(key, region);
+        }
+    }
+
+    fn add_surface(
+        &mut self,
+        cache: &ObjectCache,
+        target_data: &TargetData,
+        surface: SurfaceRef,
+        scratch_offset: usize,
+        shared_offset: usize,
+        voices: &mut Vec<usize>,
+    ) {
+        let surface_mir = cache.surface_mir(surface).unwrap();
+        let layout = cache.surface_layout(surface).unwrap();
+
+        for (node_index, (node, node_layout)) in surface_mir
+            .nodes
+            .iter()
+            .zip(layout.node_layouts.iter())
+            .enumerate()
+        {
+            let node_scratch_offset = scratch_offset
+                + get_element_offset(
+                    target_data,
+                    &layout.scratch_struct,
+                    layout.node_scratch_index(node_index),
+                );
+            let node_shared_offset =
+                shared_offset + get_element_offset(target_data, &layout.shared_struct, node_index);
+
+            match node.data {
+                NodeData::Dummy => {}
+                NodeData::Custom { block, .. } => {
+                    let functions = &cache.block_layout(block).unwrap().functions;
+                    self.add_region(
+                        StateKey::Scratch(voices.clone(), block),
+                        StateRegion {
+                            offset: node_scratch_offset,
+                            size: target_data.get_abi_size(&node_layout.scratch_struct) as usize,
+                            state_type: node_layout.scratch_struct,
+                            functions: functions.clone(),
+                        },
+                    );
+                    self.add_region(
+                        StateKey::Shared(block),
+                        StateRegion {
+                            offset: node_shared_offset,
+                            size: target_data.get_abi_size(&node_layout.shared_struct) as usize,
+                            state_type: node_layout.shared_struct,
+                            functions: functions.clone(),
+                        },
+                    );
+                }
+                NodeData::Group(child_surface) => {
+                    // groups keep the scratch and shared data of the surface in their scratch
+                    let group_struct = node_layout.scratch_struct.into_struct_type();
+                    self.add_surface(
+                        cache,
+                        target_data,
+                        child_surface,
+                        node_scratch_offset + get_element_offset(target_data, &group_struct, 0),
+                        node_scratch_offset + get_element_offset(target_data, &group_struct, 1),
+                        voices,
+                    );
+                }
+                NodeData::ExtractGroup {
+                    surface: child_surface,
+                    ..
+                } => {
+                    // extracted groups have an array of the surface's scratch, one for each voice
+                    let extract_struct = node_layout.scratch_struct.into_struct_type();
+                    let voices_offset =
+                        node_scratch_offset + get_element_offset(target_data, &extract_struct, 0);
+                    let voice_size = target_data
+                        .get_abi_size(&cache.surface_layout(child_surface).unwrap().scratch_struct)
+                        as usize;
+                    for voice_index in 0..cache.target().array_capacity as usize {
+                        voices.push(voice_index);
+                        self.add_surface(
+                            cache,
+                            target_data,
+                            child_surface,
+                            voices_offset + voice_index * voice_size,
+                            node_shared_offset,
+                            voices,
+                        );
+                        voices.pop();
+                    }
+                }
+            }
+        }
+    }
+}
+
+fn get_element_offset(target_data: &TargetData, struct_type: &StructType, index: usize) -> usize {
+    target_data
+        .offset_of_element(struct_type, index as u32)
+        .unwrap() as usize
+}
@@ -0,0 +1,332 @@
+use std::hint::spin_loop;
+use std::mem;
+use std::os::raw::c_void;
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// A task function called from generated code. Receives the data pointer passed to `run` and the
+/// index of the task to run.
+pub type TaskFunc = unsafe extern "C" fn(*mut c_void, u32);
+
+pub const DEFAULT_WORKER_COUNT: usize = 3;
+
+// How long an idle worker polls for a new job before it parks itself. Code that uses the pool
+// starts a job every sample, so this covers the gap between two samples with room to spare, and
+// workers only park once jobs stop coming, e.g at the end of a buffer. Parked workers are woken at
+// the start of the next buffer.
+const SPIN_DURATION: Duration = Duration::from_micros(50);
+
+// How many polls an idle worker makes between checks of the time it's been spinning for.
+const SPINS_PER_CHECK: usize = 64;
+
+// Task indices are claimed from the low half of `claim`, with the job's generation in the high
+// half so workers that are late to a job can't claim tasks from the next one. This index is above
+// any task count, so it closes the job while a new one is being set up.
+const CLOSED_INDEX: u64 = 0xFFFF_FFFF;
+
+fn make_claim(generation: usize, index: u64) -> u64 {
+    ((generation as u64) << 32) | index
+}
+
+struct Shared {
+    worker_count: usize,
+
+    // The current job. These are only written by the thread that holds `is_running`, while the
+    // job is closed.
+    func: AtomicUsize,
+    data: AtomicUsize,
+    count: AtomicUsize,
+    claim: AtomicU64,
+    completed: AtomicUsize,
+
+    generation: AtomicUsize,
+    is_running: AtomicBool,
+    is_shutdown: AtomicBool,
+
+    parked_workers: AtomicUsize,
+    park_lock: Mutex<()>,
+    park_signal: Condvar,
+}
+
+impl Shared {
+    unsafe fn run(&self, func: TaskFunc, data: *mut c_void, count: u32) {
+        // Jobs that can't be split up, or that are started while another job is already running
+        // (e.g from a nested extract group), are just run on the calling thread.
+        if count <= 1
+            || self.worker_count == 0
+            || self
+                .is_running
+                .compare_exchange(false, true, Ordering::Acquire, Ordering::Relaxed)
+                .is_err()
+        {
+            for index in 0..count {
+                func(data, index);
+            }
+            return;
+        }
+
+        // Close the job before changing it, so a worker still looking at the last one can't
+        // claim a task with the new count.
+        let generation = self.generation.load(Ordering::Relaxed).wrapping_add(1);
+        self.claim
+            .store(make_claim(generation, CLOSED_INDEX), Ordering::SeqCst);
+        self.func.store(func as usize, Ordering::Relaxed);
+        self.data.store(data as usize, Ordering::Relaxed);
+        self.count.store(count as usize, Ordering::Release);
+        self.completed.store(0, Ordering::Relaxed);
+        self.claim
+            .store(make_claim(generation, 0), Ordering::Release);
+        self.generation.store(generation, Ordering::SeqCst);
+
+        self.wake_workers();
+
+        // The calling thread takes tasks too, so the job finishes even if no worker turns up.
+        // It only waits for tasks that workers have already started.
+        self.run_job(generation);
+        while self.completed.load(Ordering::Acquire) != count as usize {
+            spin_loop();
+        }
+
+        self.is_running.store(false, Ordering::Release);
+    }
+
+    unsafe fn run_job(&self, generation: usize) {
+        loop {
+            let claim = self.claim.load(Ordering::Acquire);
+            if claim >> 32 != make_claim(generation, 0) >> 32 {
+                break;
+            }
+            let index = claim & CLOSED_INDEX;
+            if index >= self.count.load(Ordering::Acquire) as u64 {
+                break;
+            }
+            if self
+                .claim
+                .compare_exchange_weak(claim, claim + 1, Ordering::AcqRel, Ordering::Relaxed)
+                .is_err()
+            {
+                continue;
+            }
+
+            // The job can't finish until this task does, so it's still the one set up above.
+            let func: TaskFunc = mem::transmute(self.func.load(Ordering::Relaxed));
+            let data = self.data.load(Ordering::Relaxed) as *mut c_void;
+            func(data, index as u32);
+            self.completed.fetch_add(1, Ordering::Release);
+        }
+    }
+
+    // The calling thread is usually the audio thread, so it never waits on the lock. If a worker
+    // is halfway through parking the wakeup is skipped, and it joins the next job.
+    fn wake_workers(&self) {
+        if self.parked_workers.load(Ordering::SeqCst) > 0 {
+            if let Ok(_guard) = self.park_lock.try_lock() {
+                self.park_signal.notify_all();
+            }
+        }
+    }
+
+    fn wait_for_job(&self, seen_generation: usize) -> Option<usize> {
+        let mut spin_start = Instant::now();
+        let mut spins = 0;
+        loop {
+            let generation = self.generation.load(Ordering::Acquire);
+            if generation != seen_generation {
+                return Some(generation);
+            }
+            if self.is_shutdown.load(Ordering::Acquire) {
+                return None;
+            }
+
+            spins += 1;
+            if spins % SPINS_PER_CHECK != 0 || spin_start.elapsed() < SPIN_DURATION {
+                spin_loop();
+                continue;
+            }
+
+            let mut guard = self.park_lock.lock().unwrap();
+            self.parked_workers.fetch_add(1, Ordering::SeqCst);
+            while self.generation.load(Ordering::SeqCst) == seen_generation
+                && !self.is_shutdown.load(Ordering::SeqCst)
+            {
+                guard = self.park_signal.wait(guard).unwrap();
+            }
+            self.parked_workers.fetch_sub(1, Ordering::SeqCst);
+            spin_start = Instant::now();
+            spins = 0;
+        }
+    }
+}
+
+fn worker_main(shared: Arc<Shared>) {
+    set_flush_denormals();
+    set_realtime_priority();
+
+    let mut seen_generation = shared.generation.load(Ordering::Acquire);
+    while let Some(generation) = shared.wait_for_job(seen_generation) {
+        seen_generation = generation;
+        unsafe {
+            shared.run_job(generation);
+        }
+    }
+}
+
+// Generated code expects denormals to be flushed to zero, which the audio thread sets up before
+// running. Workers need the same mode so voices sound the same regardless of where they run.
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+fn set_flush_denormals() {
+    use std::arch::asm;
+
+    // sets the flush-to-zero and denormals-are-zero bits of MXCSR
+    let mut csr: u32 = 0;
+    unsafe {
+        asm!("stmxcsr [{}]", in(reg) &mut csr, options(nostack));
+        csr |= 0x8040;
+        asm!("ldmxcsr [{}]", in(reg) &csr, options(nostack));
+    }
+}
+
+#[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
+fn set_flush_denormals() {}
+
+// The audio thread spins until every task a worker has started is finished, so a worker that's
+// preempted halfway through a voice holds up the whole buffer. Workers ask for a realtime
+// priority a quarter of the way up the range, which puts them ahead of normal threads without
+// competing with audio threads, which hosts usually run near the top. If the process isn't
+// allowed to (e.g. without rtkit or the right limits on Linux), they stay at normal priority.
+#[cfg(unix)]
+fn set_realtime_priority() {
+    use std::os::raw::c_int;
+
+    #[cfg(target_os = "linux")]
+    const SCHED_FIFO: c_int = 1;
+    #[cfg(not(target_os = "linux"))]
+    const SCHED_FIFO: c_int = 4;
+
+    #[repr(C)]
+    struct SchedParam {
+        sched_priority: c_int,
+        #[cfg(target_os = "macos")]
+        opaque: [u8; 4],
+    }
+
+    extern "C" {
+        fn pthread_self() -> usize;
+        fn pthread_setschedparam(thread: usize, policy: c_int, param: *const SchedParam) -> c_int;
+        fn sched_get_priority_min(policy: c_int) -> c_int;
+        fn sched_get_priority_max(policy: c_int) -> c_int;
+    }
+
+    unsafe {
+        let min_priority = sched_get_priority_min(SCHED_FIFO);
+        let max_priority = sched_get_priority_max(SCHED_FIFO);
+        let param = SchedParam {
+            sched_priority: min_priority + (max_priority - min_priority) / 4,
+            #[cfg(target_os = "macos")]
+            opaque: [0; 4],
+        };
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+}
+
+#[cfg(windows)]
+fn set_realtime_priority() {
+    use std::os::raw::c_int;
+
+    const THREAD_PRIORITY_HIGHEST: c_int = 2;
+
+    extern "system" {
+        fn GetCurrentThread() -> *mut c_void;
+        fn SetThreadPriority(thread: *mut c_void, priority: c_int) -> c_int;
+    }
+
+    unsafe {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    }
+}
+
+#[cfg(not(any(unix, windows)))]
+fn set_realtime_priority() {}
+
+/// A fixed set of worker threads that generated code can hand independent tasks to. Running a
+/// job doesn't allocate, block on a lock, or wait for workers that haven't picked it up yet, so
+/// it's safe to use from the audio thread.
+pub struct TaskPool {
+    shared: Arc<Shared>,
+    workers: Vec<thread::JoinHandle<()>>,
+}
+
+impl TaskPool {
+    pub fn new(worker_count: usize) -> Self {
+        let shared = Arc::new(Shared {
+            worker_count,
+            func: AtomicUsize::new(0),
+            data: AtomicUsize::new(0),
+            count: AtomicUsize::new(0),
+            claim: AtomicU64::new(make_claim(0, CLOSED_INDEX)),
+            completed: AtomicUsize::new(0),
+            generation: AtomicUsize::new(0),
+            is_running: AtomicBool::new(false),
+            is_shutdown: AtomicBool::new(false),
+            parked_workers: AtomicUsize::new(0),
+            park_lock: Mutex::new(()),
+            park_signal: Condvar::new(),
+        });
+
+        let workers = (0..worker_count)
+            .map(|worker_index| {
+                let worker_shared = shared.clone();
+                thread::Builder::new()
+                    .name(format!("maxim.worker{}", worker_index))
+                    .spawn(move || worker_main(worker_shared))
+                    .unwrap()
+            })
+            .collect();
+
+        TaskPool { shared, workers }
+    }
+
+    /// The pointer that generated code passes back to `run_tasks`.
+    pub fn as_ptr(&self) -> *const c_void {
+        &*self.shared as *const Shared as *const c_void
+    }
+
+    /// Wakes any parked workers ahead of a buffer's updates, so they're already polling when the
+    /// first sample starts a job. Like `run_tasks`, this never waits.
+    pub fn wake_workers(&self) {
+        self.shared.wake_workers();
+    }
+}
+
+impl Drop for TaskPool {
+    fn drop(&mut self) {
+        {
+            let _guard = self.shared.park_lock.lock().unwrap();
+            self.shared.is_shutdown.store(true, Ordering::SeqCst);
+            self.shared.park_signal.notify_all();
+        }
+        for worker in self.workers.drain(..) {
+            worker.join().unwrap();
+        }
+    }
+}
+
+/// Runs tasks `0..count` of `func`, possibly in parallel, and returns once they have all
+/// finished. The tasks are run on the calling thread if there's no pool. This is registered with
+/// the JIT as the `maxim.runtasks` builtin.
+pub unsafe extern "C" fn run_tasks(
+    pool: *const c_void,
+    func: TaskFunc,
+    data: *mut c_void,
+    count: u32,
+) {
+    if pool.is_null() {
+        for index in 0..count {
+            func(data, index);
+        }
+    } else {
+        (*(pool as *const Shared)).run(func, data, count);
+    }
+}
@@ -24,7 +24,7 @@ pub struct ControlPointers {
     pub ui: ControlUiPtr,
 }
 
-fn get_internal_node_ptr(
+pub fn get_internal_node_ptr(
     target: &TargetProperties,
     layout: &SurfaceLayout,
     ptr: SurfacePtr,
@@ -45,12 +45,18 @@ pub fn get_node_ptr(
     ptr: SurfacePtr,
     node: usize,
 ) -> NodePtr {
-    let surface_mir = cache.surface_mir(surface).unwrap();
-    let surface_layout = cache.surface_layout(surface).unwrap();
+    // The editor can ask about surfaces and nodes that were created after the deployed code was
+    // built, so anything unknown gives back a null pointer instead of panicking.
+    let (surface_mir, surface_layout) =
+        match (cache.surface_mir(surface), cache.surface_layout(surface)) {
+            (Some(surface_mir), Some(surface_layout)) => (surface_mir, surface_layout),
+            _ => return null_mut(),
+        };
     match surface_mir.source_map.map_to_internal(node) {
-        InternalNodeRef::Direct(node) => {
+        InternalNodeRef::Direct(node) if node < surface_mir.nodes.len() => {
             get_internal_node_ptr(cache.target(), surface_layout, ptr, node)
         }
+        InternalNodeRef::Direct(_) => null_mut(),
         InternalNodeRef::Surface(surface_node, node) => {
             let subsurface_ptr = get_surface_ptr(get_internal_node_ptr(
                 cache.target(),
@@ -74,8 +80,11 @@ pub fn get_node_active_bitmap_ptr(
     ptr: SurfacePtr,
     node: usize,
 ) -> *const u32 {
-    let surface_mir = cache.surface_mir(surface).unwrap();
-    let surface_layout = cache.surface_layout(surface).unwrap();
+    let (surface_mir, surface_layout) =
+        match (cache.surface_mir(surface), cache.surface_layout(surface)) {
+            (Some(surface_mir), Some(surface_layout)) => (surface_mir, surface_layout),
+            _ => return null(),
+        };
     match surface_mir.source_map.map_to_internal(node) {
         InternalNodeRef::Direct(_) => null(),
         InternalNodeRef::Surface(surface_node, _) => {
@@ -105,7 +114,18 @@ pub fn get_control_ptrs(
     ptr: NodePtr,
     control: usize,
 ) -> ControlPointers {
-    let block_layout = cache.block_layout(block).unwrap();
+    let block_layout = match cache.block_layout(block) {
+        Some(block_layout) if control < block_layout.control_count() => block_layout,
+        _ => {
+            return ControlPointers {
+                value: null_mut(),
+                initialized: null_mut(),
+                data: null_mut(),
+                shared: null_mut(),
+                ui: null_mut(),
+            }
+        }
+    };
     let control_offset = block_layout.control_index(control);
 
     // format of the data in the node pointer:
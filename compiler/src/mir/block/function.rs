@@ -51,7 +51,7 @@ macro_rules! define_functions {
             }
         }
 
-        pub const FUNCTION_TABLE: [&str; 60] = [$($str_name, )*];
+        pub const FUNCTION_TABLE: [&str; 62] = [$($str_name, )*];
     );
 }
 
@@ -94,9 +94,11 @@ define_functions! {
     Sequence = "sequence" func![(Num => Num) -> Num],
     Last = "last" func![(Num) -> Num],
     Delay = "delay" func![(Num, Num, ?Num) -> Num],
+    Convolve = "convolve" func![(Num, Num) -> Num],
     Amplitude = "amplitude" func![(Num) -> Num],
     Hold = "hold" func![(Num, Num, ?Num) -> Num],
     Accum = "accum" func![(Num, Num, ?Num) -> Num],
+    ControlRate = "controlRate" func![(Num) -> Num],
     Mixdown = "mixdown" func![(VarType::new_array(Num)) -> Num],
     SvFilter = "svFilter" func![(Num, Num, Num) -> Tuple(vec![Num, Num, Num, Num])],
     LowBqFilter = "lowBqFilter" func![(Num, Num, Num) -> Num],
@@ -111,6 +113,9 @@ define_functions! {
     SawOsc = "sawOsc" func![(Num, ?Num) -> Num],
     TriOsc = "triOsc" func![(Num, ?Num) -> Num],
     RmpOsc = "rmpOsc" func![(Num, ?Num) -> Num],
+    BlSqrOsc = "blSqrOsc" func![(Num, ?Num, ?Num) -> Num],
+    BlSawOsc = "blSawOsc" func![(Num, ?Num) -> Num],
+    BlTriOsc = "blTriOsc" func![(Num, ?Num) -> Num],
     Note = "note" func![(Midi) -> Tuple(vec![Num, Num, Num, Num])],
     Voices = "voices" func![(Midi, VarType::new_array(Num)) -> VarType::new_array(Midi)],
     Channel = "channel" func![(Midi, Num) -> Midi],
@@ -14,7 +14,7 @@ pub use self::block::{Block, BlockId, BlockRef, FUNCTION_TABLE};
 pub use self::constant_value::{ConstantNum, ConstantTuple, ConstantValue};
 pub use self::control_initializer::{ControlInitializer, GraphControlInitializer};
 pub use self::node::{Node, NodeData};
-pub use self::pool_id::{IdAllocator, IncrementalIdAllocator};
+pub use self::pool_id::{AtomicIdAllocator, IdAllocator, IncrementalIdAllocator};
 pub use self::root::Root;
 pub use self::source_map::{InternalNodeRef, SourceMap};
 pub use self::surface::{Surface, SurfaceId, SurfaceRef};
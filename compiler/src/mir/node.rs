@@ -13,6 +13,7 @@ pub enum NodeData {
         surface: SurfaceRef,
         source_sockets: Vec<usize>,
         dest_sockets: Vec<usize>,
+        parallel: bool,
     },
 }
 
@@ -56,8 +57,12 @@ impl fmt::Display for Node {
                 surface,
                 source_sockets,
                 dest_sockets,
+                parallel,
             } => {
                 write!(f, "extract @{}", surface)?;
+                if *parallel {
+                    write!(f, " parallel")?;
+                }
                 Some((source_sockets, dest_sockets))
             }
         };
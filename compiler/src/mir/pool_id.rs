@@ -1,5 +1,6 @@
 use std::fmt;
 use std::marker::PhantomData;
+use std::sync::atomic::{AtomicUsize, Ordering};
 
 pub type PoolRef = u64;
 
@@ -70,3 +71,34 @@ impl IdAllocator for IncrementalIdAllocator {
         take_id
     }
 }
+
+/// An ID allocator that can be shared between threads, for allocating IDs while the owner might be
+/// using it on another thread.
+#[derive(Debug)]
+pub struct AtomicIdAllocator {
+    next_id: AtomicUsize,
+}
+
+impl AtomicIdAllocator {
+    pub fn new(start_index: u64) -> Self {
+        AtomicIdAllocator {
+            next_id: AtomicUsize::new(start_index as usize),
+        }
+    }
+
+    pub fn next_id(&self) -> u64 {
+        self.next_id.fetch_add(1, Ordering::Relaxed) as u64
+    }
+}
+
+impl IdAllocator for AtomicIdAllocator {
+    fn alloc_id(&mut self) -> u64 {
+        self.next_id()
+    }
+}
+
+impl<'a> IdAllocator for &'a AtomicIdAllocator {
+    fn alloc_id(&mut self) -> u64 {
+        self.next_id()
+    }
+}
@@ -1,12 +1,20 @@
+use crate::codegen::values;
 use crate::mir::VarType;
 
 #[derive(Debug, PartialEq, Eq, Clone)]
 pub struct Root {
     pub sockets: Vec<VarType>,
+
+    /// How many voices extracted groups in the project have, from 1 to
+    /// `values::MAX_ARRAY_CAPACITY`.
+    pub array_capacity: u8,
 }
 
 impl Root {
     pub fn new(sockets: Vec<VarType>) -> Self {
-        Root { sockets }
+        Root {
+            sockets,
+            array_capacity: values::DEFAULT_ARRAY_CAPACITY,
+        }
     }
 }
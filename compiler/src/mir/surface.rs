@@ -12,6 +12,16 @@ pub struct Surface {
     pub groups: Vec<ValueGroup>,
     pub nodes: Vec<Node>,
     pub source_map: SourceMap,
+
+    /// Whether voices of extract groups in this surface should be run on the task pool.
+    pub parallel_voices: bool,
+
+    /// Whether independent branches of nodes in this surface should be run on the task pool.
+    pub parallel_branches: bool,
+
+    /// How many times the nodes of this surface run per sample, as a power of two. Inputs are
+    /// upsampled and outputs downsampled to match.
+    pub oversampling: u8,
 }
 
 impl Surface {
@@ -21,13 +31,26 @@ impl Surface {
             groups,
             nodes,
             source_map: SourceMap::new(),
+            parallel_voices: false,
+            parallel_branches: false,
+            oversampling: 1,
         }
     }
 }
 
 impl fmt::Display for Surface {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        writeln!(f, "surface @{:?} {{", self.id)?;
+        write!(f, "surface @{:?}", self.id)?;
+        if self.parallel_voices {
+            write!(f, " (parallel voices)")?;
+        }
+        if self.parallel_branches {
+            write!(f, " (parallel branches)")?;
+        }
+        if self.oversampling > 1 {
+            write!(f, " (oversampled {}x)", self.oversampling)?;
+        }
+        writeln!(f, " {{")?;
         writeln!(f, "  groups:")?;
         for (i, group) in self.groups.iter().enumerate() {
             writeln!(f, "    %{} {} = {}", i, group.value_type, group)?;
@@ -190,6 +190,7 @@ impl<'a> GroupExtractor<'a> {
                     .into_iter()
                     .map(|group| group_socket_indexes[&group])
                     .collect(),
+                parallel: self.surface.parallel_voices,
             },
         );
 
@@ -10,6 +10,7 @@ mod remove_dead_groups;
 mod remove_dead_sockets;
 mod sort_group_sockets;
 mod sort_value_groups;
+mod specialize_controls;
 
 pub use self::dedup_blocks::deduplicate_blocks;
 pub use self::dedup_surfaces::deduplicate_surfaces;
@@ -23,3 +24,4 @@ pub use self::remove_dead_groups::remove_dead_groups;
 pub use self::remove_dead_sockets::remove_dead_sockets;
 pub use self::sort_group_sockets::sort_group_sockets;
 pub use self::sort_value_groups::sort_value_groups;
+pub use self::specialize_controls::specialize_controls;
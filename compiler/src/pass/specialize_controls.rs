@@ -0,0 +1,94 @@
+use crate::ast::{AudioField, ControlField, UNDEF_SOURCE_RANGE};
+use crate::mir::block::Statement;
+use crate::mir::{Block, ConstantNum, ConstantValue};
+use crate::util::constant_propagate;
+
+/// Builds a copy of the block's statements with the value of each given audio control replaced
+/// by a constant, folding any statements that then only depend on constants. Statements are
+/// replaced in place and never removed, so indices (and the function data they refer to) still
+/// match the original block.
+pub fn specialize_controls(block: &Block, values: &[(usize, ConstantNum)]) -> Vec<Statement> {
+    let mut statements = Vec::with_capacity(block.statements.len());
+    for statement in &block.statements {
+        let new_statement =
+            fold_statement(&statements, statement, values).unwrap_or_else(|| statement.clone());
+        statements.push(new_statement);
+    }
+    statements
+}
+
+fn get_constant(statements: &[Statement], index: usize) -> Option<&ConstantValue> {
+    match &statements[index] {
+        Statement::Constant(value) => Some(value),
+        _ => None,
+    }
+}
+
+fn get_num_constant(statements: &[Statement], index: usize) -> Option<&ConstantNum> {
+    get_constant(statements, index)?.as_num()
+}
+
+fn get_constants(statements: &[Statement], indexes: &[usize]) -> Option<Vec<ConstantValue>> {
+    indexes
+        .iter()
+        .map(|index| get_constant(statements, *index).cloned())
+        .collect()
+}
+
+fn fold_statement(
+    statements: &[Statement],
+    statement: &Statement,
+    values: &[(usize, ConstantNum)],
+) -> Option<Statement> {
+    match statement {
+        Statement::LoadControl {
+            control,
+            field: ControlField::Audio(AudioField::Value),
+        } => values
+            .iter()
+            .find(|(value_control, _)| value_control == control)
+            .map(|(_, value)| Statement::new_const_num(value.clone())),
+        Statement::NumCast { target_form, input } => Some(Statement::new_const_num(
+            constant_propagate::const_cast(get_num_constant(statements, *input)?, *target_form),
+        )),
+        Statement::NumUnaryOp { op, input } => Some(Statement::new_const_num(
+            constant_propagate::const_unary_op(get_num_constant(statements, *input)?, *op),
+        )),
+        Statement::NumMathOp { op, lhs, rhs } => {
+            Some(Statement::new_const_num(constant_propagate::const_math_op(
+                get_num_constant(statements, *lhs)?,
+                get_num_constant(statements, *rhs)?,
+                *op,
+            )))
+        }
+        Statement::Extract { tuple, index } => match get_constant(statements, *tuple)? {
+            ConstantValue::Tuple(tuple) => {
+                constant_propagate::const_extract(tuple, *index, &UNDEF_SOURCE_RANGE)
+                    .ok()
+                    .map(|value| Statement::Constant(value.clone()))
+            }
+            ConstantValue::Num(_) => None,
+        },
+        Statement::Combine { indexes } => Some(Statement::new_const_tuple(
+            constant_propagate::const_combine(get_constants(statements, indexes)?),
+        )),
+        Statement::CallFunc {
+            function,
+            args,
+            varargs,
+        } => {
+            // only pure functions are folded, calls to anything with state are left alone
+            let const_args = get_constants(statements, args)?;
+            let const_varargs = get_constants(statements, varargs)?;
+            constant_propagate::const_call(
+                *function,
+                &const_args,
+                &const_varargs,
+                &UNDEF_SOURCE_RANGE,
+            )?
+            .ok()
+            .map(Statement::Constant)
+        }
+        _ => None,
+    }
+}
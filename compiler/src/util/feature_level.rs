@@ -7,10 +7,13 @@ pub enum FeatureLevel {
     SSE42,
     AVX,
     AVX2,
+    AVX512,
 }
 
 fn get_feature_level() -> FeatureLevel {
-    if is_x86_feature_detected!("avx2") {
+    if is_x86_feature_detected!("avx512f") {
+        FeatureLevel::AVX512
+    } else if is_x86_feature_detected!("avx2") {
         FeatureLevel::AVX2
     } else if is_x86_feature_detected!("avx") {
         FeatureLevel::AVX
@@ -28,7 +31,7 @@ lazy_static! {
 }
 
 pub fn get_target_feature_string(feature_level: FeatureLevel) -> String {
-    // we need SSE4.1 at a minimum, so dynamically enable SSE4.2, AVX, and AVX2 if we can
+    // we need SSE4.1 at a minimum, so dynamically enable SSE4.2, AVX, AVX2, and AVX-512 if we can
     let mut base_features = "+x87,+mmx,+sse,+sse2,+sse3,+ssse3,+sse4.1".to_string();
 
     if feature_level >= FeatureLevel::SSE42 {
@@ -40,6 +43,19 @@ pub fn get_target_feature_string(feature_level: FeatureLevel) -> String {
     if feature_level >= FeatureLevel::AVX2 {
         base_features.push_str(",+avx2");
     }
+    if feature_level >= FeatureLevel::AVX512 {
+        base_features.push_str(",+avx512f");
+    }
 
     base_features
 }
+
+/// How many voices fit side by side in one vector register. Each voice's numbers take up a 128-bit
+/// `v2f64`, so AVX registers hold two voices and AVX-512 registers hold four.
+pub fn get_voice_lanes(feature_level: FeatureLevel) -> u32 {
+    match feature_level {
+        FeatureLevel::SSE41 | FeatureLevel::SSE42 => 1,
+        FeatureLevel::AVX | FeatureLevel::AVX2 => 2,
+        FeatureLevel::AVX512 => 4,
+    }
+}
@@ -3,12 +3,14 @@
 #include <QtCore/QFileInfo>
 #include <QtCore/QStandardPaths>
 #include <QtWidgets/QMessageBox>
+#include <algorithm>
 #include <ctime>
 #include <iostream>
 #include <pmmintrin.h>
 #include <xmmintrin.h>
 
 #include "../AxiomEditor.h"
+#include "../compiler/interface/Runtime.h"
 #include "../model/ModelRoot.h"
 #include "../model/Project.h"
 #include "../model/objects/RootSurface.h"
@@ -16,24 +18,93 @@
 #include "../util.h"
 #include "../widgets/InteractiveImport.h"
 #include "../widgets/windows/MainWindow.h"
+#include "WavReader.h"
 
 using namespace AxiomBackend;
 
-GenerateContext::GenerateContext(uint64_t count, AudioBackend *backend)
-    : backend(backend), _maxGenerateCount(count),
-      runtimeLock(backend->_editor->window()->project()->mainRoot().lockRuntime()) {
+GenerateContext::GenerateContext(AudioBackend *backend, uint64_t generation)
+    : backend(backend), generation(generation) {
     beforeFpuState = _mm_getcsr();
     _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
     _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 }
 
 GenerateContext::~GenerateContext() {
+    if (isLive()) {
+        std::fill(backend->boundInputs.begin(), backend->boundInputs.end(), nullptr);
+        std::fill(backend->boundOutputs.begin(), backend->boundOutputs.end(), nullptr);
+        backend->currentRuntime()->endUpdate();
+    }
     _mm_setcsr(beforeFpuState);
 }
 
 void GenerateContext::generate() {
-    backend->generatedSamples++;
-    backend->_editor->window()->runtime()->runUpdate();
+    if (isLive()) {
+        auto hadEvents = backend->deliverDueEvents();
+        backend->currentRuntime()->runUpdate();
+        if (hadEvents) backend->clearMidiInputs();
+    }
+    backend->currentFrame++;
+}
+
+void GenerateContext::bindAudioInput(size_t portalId, const float *left, const float *right) {
+    if (!isLive()) return;
+
+    auto bufferIndex = backend->portalSockets[portalId] * 2;
+    backend->boundInputs[bufferIndex] = left;
+    backend->boundInputs[bufferIndex + 1] = right;
+}
+
+void GenerateContext::bindAudioOutput(size_t portalId, float *left, float *right) {
+    if (!isLive()) return;
+
+    auto bufferIndex = backend->portalSockets[portalId] * 2;
+    backend->boundOutputs[bufferIndex] = left;
+    backend->boundOutputs[bufferIndex + 1] = right;
+}
+
+void GenerateContext::generateBlock(uint64_t offset, uint64_t count, size_t stride) {
+    // if the runtime isn't available, time still passes and any events that become due are delivered late
+    if (!isLive()) {
+        backend->currentFrame += count;
+        return;
+    }
+
+    auto endOffset = offset + count;
+    while (offset < endOffset) {
+        // MIDI events only last for a single frame, so render that one separately and clear them before the rest
+        if (backend->deliverDueEvents()) {
+            renderFrames(offset, 1, stride);
+            backend->clearMidiInputs();
+            offset++;
+            continue;
+        }
+
+        // render up until the next event is due
+        auto runEndOffset = endOffset;
+        if (!backend->queuedEvents.empty()) {
+            auto nextEventTime = backend->queuedEvents.front().time;
+            auto framesUntilEvent = nextEventTime > backend->currentFrame ? nextEventTime - backend->currentFrame : 1;
+            runEndOffset = std::min(runEndOffset, offset + framesUntilEvent);
+        }
+        renderFrames(offset, runEndOffset - offset, stride);
+        offset = runEndOffset;
+    }
+}
+
+void GenerateContext::renderFrames(uint64_t offset, uint64_t count, size_t stride) {
+    auto sampleOffset = offset * stride;
+    for (size_t i = 0; i < backend->boundInputs.size(); i++) {
+        auto input = backend->boundInputs[i];
+        backend->offsetInputs[i] = input ? input + sampleOffset : nullptr;
+    }
+    for (size_t i = 0; i < backend->boundOutputs.size(); i++) {
+        auto output = backend->boundOutputs[i];
+        backend->offsetOutputs[i] = output ? output + sampleOffset : nullptr;
+    }
+    backend->currentRuntime()->runUpdateBlock(count, stride, backend->offsetInputs.data(),
+                                              backend->offsetOutputs.data());
+    backend->currentFrame += count;
 }
 
 NumValue *AudioBackend::getAudioPortal(size_t portalId) const {
@@ -62,11 +133,25 @@ std::string AudioBackend::getDataPath() {
     return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation).toStdString();
 }
 
+void AudioBackend::loadImpulses(MaximCompiler::Runtime *runtime) {
+    for (size_t i = 0; i < MaximCompiler::Runtime::impulseSlotCount(); i++) {
+        auto path = findDataFile("impulses/" + std::to_string(i) + ".wav");
+        if (path.empty()) continue;
+
+        WavData wav;
+        if (!readWavFile(path, &wav)) {
+            std::cerr << "Failed to read impulse response " << path << std::endl;
+            continue;
+        }
+        runtime->setImpulse(i, wav.samples.data(), wav.samples.size(), wav.channelCount);
+    }
+}
+
 QByteArray AudioBackend::serialize(std::optional<std::function<void(QDataStream &)>> serializeCustomCallback) {
     QByteArray buffer;
     QDataStream stream(&buffer, QIODevice::WriteOnly);
 
-    auto project = _editor->window()->project();
+    auto project = currentProject();
     AxiomModel::ProjectSerializer::serialize(project, stream,
                                              [project](QDataStream &stream) { stream << project->linkedFile(); });
     if (serializeCustomCallback) {
@@ -127,15 +212,21 @@ void AudioBackend::deserialize(QByteArray *data,
 }
 
 void AudioBackend::setBpm(float bpm) {
-    _editor->window()->runtime()->setBpm(bpm);
+    currentRuntime()->setBpm(bpm);
 }
 
 void AudioBackend::setSampleRate(float sampleRate) {
-    _editor->window()->runtime()->setSampleRate(sampleRate);
+    currentRuntime()->setSampleRate(sampleRate);
+}
+
+void AudioBackend::setHeadless(AxiomModel::Project *project, MaximCompiler::Runtime *runtime) {
+    _headlessProject = project;
+    _headlessRuntime = runtime;
+    loadImpulses(runtime);
 }
 
-void AudioBackend::queueMidiEvent(uint64_t deltaFrames, size_t portalId, AxiomBackend::MidiEvent event) {
-    queuedEvents.push_back({deltaFrames, portalId, event});
+bool AudioBackend::queueMidiEvent(uint64_t deltaFrames, size_t portalId, AxiomBackend::MidiEvent event) {
+    return queuedEvents.push(currentFrame + deltaFrames, portalId, event);
 }
 
 void AudioBackend::clearMidi(size_t portalId) {
@@ -147,27 +238,38 @@ void AudioBackend::clearNotes(size_t portalId) {
 }
 
 GenerateContext AudioBackend::beginGenerate() {
-    // decrement all deltaFrames from last time
-    for (auto &event : queuedEvents) {
-        if (event.deltaFrames > generatedSamples) {
-            event.deltaFrames -= generatedSamples;
-        } else {
-            event.deltaFrames = 0;
+    auto runtime = currentRuntime();
+    auto generation = runtime->beginUpdate();
+    if (generation && generation != portalGeneration) {
+        for (size_t portalIndex = 0; portalIndex < portalValues.size(); portalIndex++) {
+            portalValues[portalIndex] = runtime->getPortalPtr(portalSockets[portalIndex]);
         }
+        portalGeneration = generation;
+    }
 
-        if (event.deltaFrames == 0) {
-            getMidiPortal(event.portalId)->pushEvent(event.event);
+    return GenerateContext(this, generation);
+}
 
-            // note: deque doesn't invalidate iterators when removing items from start or end, so this is safe to do.
-            queuedEvents.pop_front();
+bool AudioBackend::deliverDueEvents() {
+    auto hadEvents = false;
+    while (!queuedEvents.empty() && queuedEvents.front().time <= currentFrame) {
+        const auto &queuedEvent = queuedEvents.front();
+
+        // the portal might have disappeared since the event was queued
+        if (auto portal = getMidiPortal(queuedEvent.portalId)) {
+            // if the portal is full, leave the rest of the events for the next frame
+            if (portal->count >= MidiValue::MAX_EVENTS) break;
+            portal->pushEvent(queuedEvent.event);
+            hadEvents = true;
         }
+        queuedEvents.pop();
     }
-    generatedSamples = 0;
+    return hadEvents;
+}
 
-    if (queuedEvents.empty()) {
-        return GenerateContext(UINT64_MAX, this);
-    } else {
-        return GenerateContext(queuedEvents[0].deltaFrames, this);
+void AudioBackend::clearMidiInputs() {
+    for (auto portalId : midiInputPortals) {
+        clearMidi(portalId);
     }
 }
 
@@ -180,26 +282,68 @@ bool AudioBackend::canFiddleAutomation() const {
 }
 
 void AudioBackend::internalUpdateConfiguration() {
-    auto newPortals = std::move(_editor->window()->project()->getAudioConfiguration().portals);
+    auto newPortals = std::move(currentProject()->getAudioConfiguration().portals);
     std::sort(newPortals.begin(), newPortals.end());
 
+    // If the portals are in the same sockets as before, the audio thread finds their new pointers itself when it
+    // switches to the new code, so it doesn't need to stop.
+    std::vector<size_t> newSockets;
+    newSockets.reserve(newPortals.size());
+    for (const auto &newPortal : newPortals) {
+        newSockets.push_back(newPortal._key);
+    }
+    if (hasCurrent && newPortals == currentPortals && newSockets == portalSockets) {
+        return;
+    }
+
+    // Otherwise updates are paused while everything the audio thread uses is replaced. The new code has already been
+    // published by this point, so the portal pointers are found in it directly.
+    auto runtime = currentRuntime();
+    runtime->pauseUpdates();
+
     // update the value pointers
     portalValues.clear();
     portalValues.reserve(newPortals.size());
-    for (const auto &newPortal : newPortals) {
-        portalValues.push_back(_editor->window()->runtime()->getPortalPtr(newPortal._key));
+    portalSockets.clear();
+    portalSockets.reserve(newPortals.size());
+    midiInputPortals.clear();
+    size_t socketCount = 0;
+    for (size_t portalIndex = 0; portalIndex < newPortals.size(); portalIndex++) {
+        const auto &newPortal = newPortals[portalIndex];
+        portalValues.push_back(runtime->getPortalPtr(newPortal._key));
+        portalSockets.push_back(newPortal._key);
+        socketCount = std::max(socketCount, newPortal._key + 1);
+
+        if (newPortal.type == PortalType::INPUT && newPortal.value == PortalValue::MIDI) {
+            midiInputPortals.push_back(portalIndex);
+        }
     }
 
-    // no point continuing if the portals are the same
-    if (hasCurrent && newPortals == currentPortals) {
-        return;
+    // socket indices can change between builds, so the backend needs to rebind its buffers
+    boundInputs.assign(socketCount * 2, nullptr);
+    boundOutputs.assign(socketCount * 2, nullptr);
+    offsetInputs.assign(socketCount * 2, nullptr);
+    offsetOutputs.assign(socketCount * 2, nullptr);
+    portalGeneration = 0;
+
+    // the backend only needs to know if the portals themselves have changed
+    if (!hasCurrent || !(newPortals == currentPortals)) {
+        AudioConfiguration currentConfiguration(std::move(newPortals));
+        handleConfigurationChange(currentConfiguration);
+
+        currentPortals = std::move(currentConfiguration.portals);
+        hasCurrent = true;
     }
 
-    AudioConfiguration currentConfiguration(std::move(newPortals));
-    handleConfigurationChange(currentConfiguration);
+    runtime->resumeUpdates();
+}
+
+AxiomModel::Project *AudioBackend::currentProject() const {
+    return _headlessProject ? _headlessProject : _editor->window()->project();
+}
 
-    currentPortals = std::move(currentConfiguration.portals);
-    hasCurrent = true;
+MaximCompiler::Runtime *AudioBackend::currentRuntime() const {
+    return _headlessRuntime ? _headlessRuntime : _editor->window()->runtime();
 }
 
 size_t AudioBackend::internalRemapPortal(uint64_t id) {
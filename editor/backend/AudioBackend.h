@@ -1,48 +1,74 @@
 #pragma once
 
 #include <QtCore/QByteArray>
-#include <deque>
 #include <functional>
-#include <mutex>
 #include <optional>
 
 #include "AudioConfiguration.h"
 #include "BackendDefines.h"
+#include "MidiEventQueue.h"
 
 class AxiomEditor;
 
+namespace AxiomModel {
+    class Project;
+}
+
+namespace MaximCompiler {
+    class Runtime;
+}
+
 namespace AxiomBackend {
     class AudioBackend;
 
     // An RAII handler for generating samples into a buffer.
-    // While this object is alive, the runtime is guaranteed to be locked, and the FPU state will be correct.
-    // You shouldn't call `generate` more times than `maxGenerateCount`. Once the count has expired, delete this object
-    // and request a new one with `beginGenerate` on the audio backend.
+    // While this object is alive, the FPU state will be correct, and if `isLive` returns true the runtime's code won't
+    // be torn down. Newly published code is picked up when the context is created, without waiting for the editor. If
+    // the portal configuration is in the middle of changing, or nothing has been built yet, the context won't wait for
+    // it. Instead it won't be live, `generate` and `generateBlock` do nothing, and the backend should output silence.
+    // Portals must not be accessed while the context isn't live.
+    // Queued MIDI events are delivered on the frame they're due as part of `generate` and `generateBlock`, so a single
+    // context can be used for a whole buffer.
     // ONLY call `generate` from the thread you requested the context from!
     class GenerateContext {
         friend class AudioBackend;
 
     private:
-        GenerateContext(uint64_t count, AudioBackend *backend);
+        GenerateContext(AudioBackend *backend, uint64_t generation);
 
     public:
+        GenerateContext(const GenerateContext &) = delete;
+
+        GenerateContext &operator=(const GenerateContext &) = delete;
+
         ~GenerateContext();
 
-        // The max number of samples (i.e `generate` calls) until you should request a new context. This is used, for
-        // example, for the internal queueing of MIDI events.
-        // Note: the return value of this function will _always_ be greater than 0. This value will not change after
-        // the class has been created.
-        uint64_t maxGenerateCount() const { return _maxGenerateCount; }
+        // Whether the runtime is able to generate samples.
+        bool isLive() const { return generation != 0; }
 
         // Simulates the internal graph once. Inputs will be read as per their state before this call, and outputs will
-        // be written to.
+        // be written to. MIDI input portals that had events delivered are cleared afterwards.
         void generate();
 
+        // Binds left and right sample buffers to an audio portal, to be used by `generateBlock`. Unbound input portals
+        // keep their current value, and unbound output portals aren't written anywhere. Bindings only last until this
+        // context is destroyed, and are ignored if it isn't live.
+        void bindAudioInput(size_t portalId, const float *left, const float *right);
+        void bindAudioOutput(size_t portalId, float *left, float *right);
+
+        // Simulates the internal graph `count` times in one call into the runtime. Audio portals bound with
+        // `bindAudioInput` and `bindAudioOutput` are read from and written to starting `offset` frames into their
+        // buffers, with `stride` floats between consecutive frames (e.g 2 for interleaved stereo). The block is split
+        // internally at frames where MIDI events are due, and MIDI input portals are cleared after the frame their
+        // events were delivered on, so there's no need to call `clearMidi` yourself.
+        void generateBlock(uint64_t offset, uint64_t count, size_t stride = 1);
+
     private:
         AudioBackend *backend;
-        uint64_t _maxGenerateCount;
-        std::lock_guard<std::mutex> runtimeLock;
+        uint64_t generation;
         unsigned int beforeFpuState;
+
+        void renderFrames(uint64_t offset, uint64_t count, size_t stride);
     };
 
     class AudioBackend {
@@ -67,6 +93,10 @@ namespace AxiomBackend {
         // Returns the main writable data path, guaranteed to exist.
         static std::string getDataPath();
 
+        // Loads the impulse responses used by `convolve` into the runtime, from WAV files named `impulses/0.wav`,
+        // `impulses/1.wav` and so on in the data paths.
+        static void loadImpulses(MaximCompiler::Runtime *runtime);
+
         // Serializes or deserializes the current open project. Use this for saving/loading the project from a DAW
         // project file.
         QByteArray serialize(std::optional<std::function<void(QDataStream &)>> serializeCustomCallback = std::nullopt);
@@ -74,22 +104,27 @@ namespace AxiomBackend {
             QByteArray *data,
             std::optional<std::function<void(QDataStream &, uint32_t)>> deserializeCustomCallback = std::nullopt);
 
-        // Queues a MIDI event to be input in a certain number of samples time. Should be called from the audio thread.
-        // You should call clearMidi after the first generated sample (at least) to clear the MIDI portals that had
-        // data queued.
-        void queueMidiEvent(uint64_t deltaFrames, size_t portalId, MidiEvent event);
+        // Makes the backend use the given project and runtime directly instead of the ones in the editor window, so it
+        // can run without a UI, and loads impulse responses into the runtime. Must be called before the runtime is
+        // attached to the project.
+        void setHeadless(AxiomModel::Project *project, MaximCompiler::Runtime *runtime);
+
+        // Queues a MIDI event to be input in a certain number of samples time, relative to the next sample to be
+        // generated. Events don't need to be queued in order. Should be called from the audio thread. If too many
+        // events are queued at once, new ones are dropped and false is returned.
+        bool queueMidiEvent(uint64_t deltaFrames, size_t portalId, MidiEvent event);
         void clearMidi(size_t portalId);
 
         // Clears all pressed MIDI keys. Should be called from the audio thread.
         void clearNotes(size_t portalId);
 
-        // Signals that you're about to start a batch of `generate` calls. May block if the runtime is being rebuilt,
-        // but as long as the returned value exists, generation calls are safe.
+        // Signals that you're about to start generating a buffer. Never blocks, and as long as the returned value
+        // exists, generation calls are safe.
         GenerateContext beginGenerate();
 
         // To be implemented by the audio backend, called from the UI thread when the IO configuration changes.
         // Note that this is not always called when the runtime is rebuilt, only if the rebuild results in a change in
-        // configuration. The runtime will be locked while in this method.
+        // configuration. Generate contexts won't be live while in this method.
         virtual void handleConfigurationChange(const AudioConfiguration &configuration) = 0;
 
         // To be implemented by the audio backend, called from the UI thread when a new project is created to setup
@@ -124,20 +159,35 @@ namespace AxiomBackend {
         size_t internalRemapPortal(uint64_t id);
 
     private:
-        struct QueuedEvent {
-            uint64_t deltaFrames;
-            size_t portalId;
-            MidiEvent event;
-        };
-
         bool hasCurrent = false;
         std::vector<ConfigurationPortal> currentPortals;
 
-        AxiomEditor *_editor;
+        AxiomEditor *_editor = nullptr;
+        AxiomModel::Project *_headlessProject = nullptr;
+        MaximCompiler::Runtime *_headlessRuntime = nullptr;
         std::vector<void *> portalValues;
+        std::vector<size_t> portalSockets;
+        std::vector<size_t> midiInputPortals;
+
+        // The runtime code `portalValues` points into. Each build of the code has its own portals, so the pointers are
+        // found again on the audio thread whenever it switches to new code.
+        uint64_t portalGeneration = 0;
+
+        // Buffers bound to each runtime socket, with two entries (left and right) per socket. The offset arrays are
+        // scratch space for `generateBlock`, allocated ahead of time so the audio thread doesn't need to.
+        std::vector<const float *> boundInputs;
+        std::vector<float *> boundOutputs;
+        std::vector<const float *> offsetInputs;
+        std::vector<float *> offsetOutputs;
+
+        MidiEventQueue queuedEvents;
+        uint64_t currentFrame = 0;
+
+        AxiomModel::Project *currentProject() const;
+        MaximCompiler::Runtime *currentRuntime() const;
 
-        // todo: use a circular buffer instead of a deque here
-        std::deque<QueuedEvent> queuedEvents;
-        size_t generatedSamples = 0;
+        // Pushes events due on the current frame into their portals, returning true if any were.
+        bool deliverDueEvents();
+        void clearMidiInputs();
     };
 }
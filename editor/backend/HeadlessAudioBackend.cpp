@@ -0,0 +1,25 @@
+#include "HeadlessAudioBackend.h"
+
+using namespace AxiomBackend;
+
+void HeadlessAudioBackend::handleConfigurationChange(const AudioConfiguration &configuration) {
+    midiInputPortal = -1;
+    audioOutputPortal = -1;
+    for (size_t i = 0; i < configuration.portals.size(); i++) {
+        const auto &portal = configuration.portals[i];
+        if (audioOutputPortal == -1 && portal.type == PortalType::OUTPUT && portal.value == PortalValue::AUDIO) {
+            audioOutputPortal = (ssize_t) i;
+        } else if (midiInputPortal == -1 && portal.type == PortalType::INPUT && portal.value == PortalValue::MIDI) {
+            midiInputPortal = (ssize_t) i;
+        }
+
+        if (midiInputPortal != -1 && audioOutputPortal != -1) {
+            break;
+        }
+    }
+}
+
+DefaultConfiguration HeadlessAudioBackend::createDefaultConfiguration() {
+    return DefaultConfiguration({DefaultPortal(PortalType::INPUT, PortalValue::MIDI, "Keyboard"),
+                                 DefaultPortal(PortalType::OUTPUT, PortalValue::AUDIO, "Speakers")});
+}
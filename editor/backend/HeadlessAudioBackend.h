@@ -0,0 +1,22 @@
+#pragma once
+
+#include "AudioBackend.h"
+
+namespace AxiomBackend {
+
+    // A backend for tools that drive the runtime without a UI or audio device, such as the offline renderer and the
+    // benchmarks. Like the standalone backend, it only uses the first MIDI input and first audio output portal.
+    class HeadlessAudioBackend : public AudioBackend {
+    public:
+        ssize_t midiInputPortal = -1;
+        ssize_t audioOutputPortal = -1;
+
+        void handleConfigurationChange(const AudioConfiguration &configuration) override;
+
+        DefaultConfiguration createDefaultConfiguration() override;
+
+        bool doesSaveInternally() const override { return true; }
+
+        std::string getPortalLabel(size_t portalIndex) const override { return "1"; }
+    };
+}
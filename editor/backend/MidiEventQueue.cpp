@@ -0,0 +1,26 @@
+#include "MidiEventQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace AxiomBackend;
+
+bool MidiEventQueue::push(uint64_t time, size_t portalId, AxiomBackend::MidiEvent event) {
+    if (full()) return false;
+
+    events[size] = {time, nextSequence++, portalId, event};
+    size++;
+    std::push_heap(events.begin(), events.begin() + size, isLater);
+    return true;
+}
+
+void MidiEventQueue::pop() {
+    assert(!empty());
+    std::pop_heap(events.begin(), events.begin() + size, isLater);
+    size--;
+}
+
+void MidiEventQueue::clear() {
+    size = 0;
+    nextSequence = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "BackendDefines.h"
+
+namespace AxiomBackend {
+
+    // A fixed-capacity queue of MIDI events ordered by the absolute frame they should be delivered at, safe to use from
+    // the audio thread since it never allocates. Events are kept in a binary heap, so pushing and popping are
+    // O(log n) however out of order they arrive. Each event is tagged with the order it was pushed in, so events with
+    // the same time come out in that order.
+    class MidiEventQueue {
+    public:
+        static constexpr size_t CAPACITY = 1024;
+
+        struct QueuedEvent {
+            uint64_t time;
+            uint64_t sequence;
+            size_t portalId;
+            MidiEvent event;
+        };
+
+        bool empty() const { return size == 0; }
+
+        bool full() const { return size == CAPACITY; }
+
+        // Returns false and drops the event if the queue is full.
+        bool push(uint64_t time, size_t portalId, MidiEvent event);
+
+        const QueuedEvent &front() const { return events[0]; }
+
+        void pop();
+
+        void clear();
+
+    private:
+        std::array<QueuedEvent, CAPACITY> events;
+        size_t size = 0;
+        uint64_t nextSequence = 0;
+
+        // Orders the heap so the earliest event is at the top.
+        static bool isLater(const QueuedEvent &a, const QueuedEvent &b) {
+            return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+        }
+    };
+}
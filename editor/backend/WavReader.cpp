@@ -0,0 +1,106 @@
+#include "WavReader.h"
+
+#include <QtCore/QFile>
+#include <algorithm>
+#include <cstring>
+
+using namespace AxiomBackend;
+
+static constexpr uint16_t FORMAT_PCM = 1;
+static constexpr uint16_t FORMAT_FLOAT = 3;
+static constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+
+static uint32_t readU16(const char *data) {
+    return (uint32_t)(uint8_t) data[0] | ((uint32_t)(uint8_t) data[1] << 8);
+}
+
+static uint32_t readU32(const char *data) {
+    return readU16(data) | (readU16(data + 2) << 16);
+}
+
+static float decodeSample(const char *data, uint16_t format, uint16_t bitsPerSample) {
+    if (format == FORMAT_FLOAT) {
+        if (bitsPerSample == 32) {
+            float value;
+            uint32_t bits = readU32(data);
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        } else {
+            double value;
+            uint64_t bits = readU32(data) | ((uint64_t) readU32(data + 4) << 32);
+            memcpy(&value, &bits, sizeof(value));
+            return (float) value;
+        }
+    }
+
+    // 8-bit samples are unsigned, wider ones are signed
+    if (bitsPerSample == 8) {
+        return ((float) (uint8_t) data[0] - 128.f) / 128.f;
+    }
+
+    auto byteCount = bitsPerSample / 8;
+    uint32_t bits = 0;
+    for (auto i = 0; i < byteCount; i++) {
+        bits |= (uint32_t)(uint8_t) data[i] << (32 - bitsPerSample + i * 8);
+    }
+    return (float) (int32_t) bits / 2147483648.f;
+}
+
+bool AxiomBackend::readWavFile(const std::string &path, WavData *data) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    auto contents = file.readAll();
+
+    if (contents.size() < 12 || memcmp(contents.constData(), "RIFF", 4) != 0 ||
+        memcmp(contents.constData() + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    uint16_t format = 0;
+    uint16_t channelCount = 0;
+    uint32_t sampleRate = 0;
+    uint16_t bitsPerSample = 0;
+    const char *sampleData = nullptr;
+    uint32_t sampleDataSize = 0;
+
+    // chunks are padded to an even number of bytes
+    int64_t chunkPos = 12;
+    while (chunkPos + 8 <= contents.size()) {
+        auto chunk = contents.constData() + chunkPos;
+        auto chunkSize = readU32(chunk + 4);
+        auto chunkData = chunk + 8;
+        auto availableSize = std::min((int64_t) chunkSize, contents.size() - chunkPos - 8);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && availableSize >= 16) {
+            format = readU16(chunkData);
+            channelCount = readU16(chunkData + 2);
+            sampleRate = readU32(chunkData + 4);
+            bitsPerSample = readU16(chunkData + 14);
+
+            // extensible files keep the real format at the start of their subformat GUID
+            if (format == FORMAT_EXTENSIBLE && availableSize >= 26) {
+                format = readU16(chunkData + 24);
+            }
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            sampleData = chunkData;
+            sampleDataSize = (uint32_t) availableSize;
+        }
+
+        chunkPos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    auto isSupportedInt = format == FORMAT_PCM && (bitsPerSample == 8 || bitsPerSample == 16 ||
+                                                   bitsPerSample == 24 || bitsPerSample == 32);
+    auto isSupportedFloat = format == FORMAT_FLOAT && (bitsPerSample == 32 || bitsPerSample == 64);
+    if (!sampleData || channelCount == 0 || (!isSupportedInt && !isSupportedFloat)) return false;
+
+    auto bytesPerSample = bitsPerSample / 8;
+    auto frameCount = sampleDataSize / (bytesPerSample * channelCount);
+    data->samples.resize(frameCount * channelCount);
+    for (size_t i = 0; i < data->samples.size(); i++) {
+        data->samples[i] = decodeSample(sampleData + i * bytesPerSample, format, bitsPerSample);
+    }
+    data->channelCount = channelCount;
+    data->sampleRate = sampleRate;
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AxiomBackend {
+
+    // The contents of a WAV file, with samples interleaved and converted to floats between -1 and 1.
+    struct WavData {
+        std::vector<float> samples;
+        uint16_t channelCount = 0;
+        uint32_t sampleRate = 0;
+    };
+
+    // Reads an 8, 16, 24 or 32-bit integer or a 32 or 64-bit float WAV file. Returns false if the file can't be opened
+    // or isn't in one of those formats.
+    bool readWavFile(const std::string &path, WavData *data);
+}
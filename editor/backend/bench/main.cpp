@@ -0,0 +1,451 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../compiler/interface/Runtime.h"
+#include "../../model/ModelRoot.h"
+#include "../../model/Project.h"
+#include "../../model/actions/CreateConnectionAction.h"
+#include "../../model/objects/Control.h"
+#include "../../model/objects/ControlSurface.h"
+#include "../../model/objects/CustomNode.h"
+#include "../../model/objects/GroupNode.h"
+#include "../../model/objects/GroupSurface.h"
+#include "../../model/objects/PortalControl.h"
+#include "../../model/objects/PortalNode.h"
+#include "../../model/objects/RootSurface.h"
+#include "../../model/serialize/ProjectSerializer.h"
+#include "../HeadlessAudioBackend.h"
+
+using namespace AxiomBackend;
+
+static constexpr uint64_t SAMPLE_RATE = 48000;
+static constexpr uint64_t BLOCK_SIZE = 512;
+static constexpr double DEFAULT_RENDER_SECONDS = 2;
+static constexpr double WARMUP_SECONDS = 0.25;
+static constexpr int WARM_COMMIT_RUNS = 8;
+
+// The compiler logs to standard output, so results go to a file to keep them machine-readable.
+static constexpr const char *DEFAULT_OUTPUT_PATH = "axiom_bench.json";
+
+// How many filters each voice of the grouped voice patches runs through.
+static constexpr int HEAVY_VOICE_FILTERS = 32;
+
+// Notes held down while benchmarking example projects, so their voices are actually doing something.
+static constexpr uint8_t HELD_NOTES[] = {48, 55, 60, 64};
+
+struct BenchOptions {
+    double renderSeconds = DEFAULT_RENDER_SECONDS;
+    std::vector<int> voiceCounts = {1, 8, 32};
+    std::vector<int> nodeCounts = {1, 16, 64, 256};
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point startTime) {
+    return std::chrono::duration<double>(Clock::now() - startTime).count();
+}
+
+// Everything needed to run one patch. The backend and runtimes are declared first so they outlive the project, which
+// uses them while being destroyed.
+class BenchPatch {
+public:
+    HeadlessAudioBackend backend;
+
+    // Synthetic patches are built against a scratch runtime first, since a node's controls only exist once its code has
+    // been compiled and the patch can't be wired up until then.
+    MaximCompiler::Runtime setupRuntime{false};
+    MaximCompiler::Runtime runtime{false};
+
+    std::unique_ptr<AxiomModel::Project> project;
+
+    double loadSeconds = 0;
+    double coldCommitSeconds = 0;
+
+    // Whether the measured runtime updates voices in lanes, like the editor does. The setup runtime is left as is, since
+    // it's never rendered.
+    bool voiceLanes = true;
+
+    void attach() {
+        // delays get their buffers on the first sample, so every run does the same work
+        runtime.setRealtime(false);
+        runtime.setVoiceLanes(voiceLanes);
+        backend.setHeadless(project.get(), &runtime);
+        project->attachBackend(&backend);
+
+        auto startTime = Clock::now();
+        project->mainRoot().attachRuntime(&runtime);
+        coldCommitSeconds = secondsSince(startTime);
+
+        backend.setSampleRate(SAMPLE_RATE);
+    }
+
+    // Recompiles the root surface against a runtime that already has everything else built, which is what happens
+    // after most edits in the editor.
+    double measureWarmCommit() {
+        std::vector<double> times;
+        for (int i = 0; i < WARM_COMMIT_RUNS; i++) {
+            auto startTime = Clock::now();
+            project->rootSurface()->forceCompile();
+            MaximCompiler::Transaction transaction;
+            project->mainRoot().applyDirtyItemsTo(&transaction);
+            project->mainRoot().applyTransaction(std::move(transaction));
+            times.push_back(secondsSince(startTime));
+        }
+
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    // Renders the patch for the given time and returns the average time taken per sample, in nanoseconds.
+    double measureNsPerSample(double seconds) {
+        std::vector<float> buffer(BLOCK_SIZE * 2);
+
+        auto warmupFrames = (uint64_t)(WARMUP_SECONDS * SAMPLE_RATE);
+        renderFrames(warmupFrames, buffer.data());
+
+        auto frames = std::max((uint64_t)(seconds * SAMPLE_RATE), (uint64_t) 1);
+        auto startTime = Clock::now();
+        renderFrames(frames, buffer.data());
+        return secondsSince(startTime) * 1e9 / frames;
+    }
+
+    void holdNotes() {
+        if (backend.midiInputPortal == -1) return;
+
+        for (auto note : HELD_NOTES) {
+            MidiEvent event;
+            event.event = MidiEventType::NOTE_ON;
+            event.channel = 0;
+            event.note = note;
+            event.param = 200;
+            backend.queueMidiEvent(0, (size_t) backend.midiInputPortal, event);
+        }
+    }
+
+private:
+    void renderFrames(uint64_t frames, float *buffer) {
+        for (uint64_t frame = 0; frame < frames; frame += BLOCK_SIZE) {
+            auto blockFrames = std::min(BLOCK_SIZE, frames - frame);
+            auto context = backend.beginGenerate();
+            if (backend.audioOutputPortal != -1) {
+                context.bindAudioOutput((size_t) backend.audioOutputPortal, buffer, buffer + 1);
+            }
+            context.generateBlock(0, blockFrames, 2);
+        }
+    }
+};
+
+static AxiomModel::CustomNode *addCustomNode(AxiomModel::Project *project, QPoint pos, const QString &name,
+                                             const QString &code) {
+    auto &root = project->mainRoot();
+    auto nodeUuid = QUuid::createUuid();
+    auto controlsUuid = QUuid::createUuid();
+    auto node = root.pool().registerObj(AxiomModel::CustomNode::create(
+        nodeUuid, project->rootSurface()->uuid(), pos, QSize(3, 2), false, name, controlsUuid, code, false,
+        QSizeF(3, AxiomModel::CustomNode::minPanelHeight), &root));
+    root.pool().registerObj(AxiomModel::ControlSurface::create(controlsUuid, nodeUuid, &root));
+    return static_cast<AxiomModel::CustomNode *>(node);
+}
+
+static AxiomModel::Control *findControl(AxiomModel::Node *node, const QString &name) {
+    auto controls = *node->controls().value();
+    for (const auto &control : controls->controls().sequence()) {
+        if (control->name() == name) return control;
+    }
+    std::cerr << "Synthetic patch is missing control " << name.toStdString() << std::endl;
+    abort();
+}
+
+static AxiomModel::Control *findOutputPortal(AxiomModel::Project *project) {
+    for (const auto &node : project->mainRoot().nodes().sequence()) {
+        if (!dynamic_cast<AxiomModel::PortalNode *>(node)) continue;
+
+        for (const auto &control : (*node->controls().value())->controls().sequence()) {
+            auto portal = dynamic_cast<AxiomModel::PortalControl *>(control);
+            if (portal && portal->portalType() == AxiomModel::PortalControl::PortalType::OUTPUT &&
+                portal->wireType() == AxiomModel::ConnectionWire::WireType::NUM) {
+                return portal;
+            }
+        }
+    }
+    std::cerr << "Synthetic patch is missing its output portal" << std::endl;
+    abort();
+}
+
+static void connectControls(AxiomModel::Project *project, AxiomModel::Control *a, AxiomModel::Control *b) {
+    AxiomModel::CreateConnectionAction::create(project->rootSurface()->uuid(), a->uuid(), b->uuid(),
+                                               &project->mainRoot())
+        ->forward(true);
+}
+
+static std::unique_ptr<BenchPatch> loadExample(const QString &path) {
+    auto patch = std::make_unique<BenchPatch>();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Failed to open project " << path.toStdString() << std::endl;
+        return nullptr;
+    }
+
+    auto startTime = Clock::now();
+    QDataStream stream(&file);
+    uint32_t readVersion = 0;
+    patch->project = AxiomModel::ProjectSerializer::deserialize(
+        stream, &readVersion, [](AxiomModel::Library *) {}, [path](QDataStream &, uint32_t) { return path; });
+    patch->loadSeconds = secondsSince(startTime);
+
+    if (!patch->project) {
+        std::cerr << "Failed to load project " << path.toStdString() << " (version " << readVersion << ")"
+                  << std::endl;
+        return nullptr;
+    }
+
+    patch->attach();
+    patch->holdNotes();
+    return patch;
+}
+
+// Builds a patch with `nodeCount` filter nodes chained together after an oscillator.
+static std::unique_ptr<BenchPatch> buildNodesPatch(int nodeCount) {
+    auto patch = std::make_unique<BenchPatch>();
+    patch->project = std::make_unique<AxiomModel::Project>(patch->backend.createDefaultConfiguration());
+    auto project = patch->project.get();
+
+    std::vector<AxiomModel::CustomNode *> nodes;
+    nodes.push_back(addCustomNode(project, QPoint(0, 0), "osc", "out:num = sawOsc(110) * 0.1"));
+    for (int i = 0; i < nodeCount; i++) {
+        auto code = QString("out:num = tanh(lowBqFilter(in:num, %1, 0.7))").arg(1000 + i);
+        nodes.push_back(addCustomNode(project, QPoint(4 * (i + 1), 0), QString("filter %1").arg(i), code));
+    }
+
+    patch->backend.setHeadless(project, &patch->setupRuntime);
+    project->attachBackend(&patch->backend);
+    project->mainRoot().attachRuntime(&patch->setupRuntime);
+
+    for (size_t i = 1; i < nodes.size(); i++) {
+        connectControls(project, findControl(nodes[i - 1], "out"), findControl(nodes[i], "in"));
+    }
+    connectControls(project, findControl(nodes.back(), "out"), findOutputPortal(project));
+
+    patch->attach();
+    return patch;
+}
+
+// Builds a patch with one node extracted `voiceCount` times, all of which are always active, with the voices updated
+// in lanes or one at a time.
+static std::unique_ptr<BenchPatch> buildVoicesPatch(int voiceCount, bool voiceLanes) {
+    auto patch = std::make_unique<BenchPatch>();
+    patch->project = std::make_unique<AxiomModel::Project>(patch->backend.createDefaultConfiguration());
+    auto project = patch->project.get();
+
+    auto source = addCustomNode(project, QPoint(0, 0), "source", QString("out:num[] = indexed(%1)").arg(voiceCount));
+    auto voice = addCustomNode(project, QPoint(4, 0), "voice",
+                               "out:num = lowBqFilter(sawOsc(110 + index:num * 10), 2000, 0.7) * 0.1");
+    auto mix = addCustomNode(project, QPoint(8, 0), "mix", "out:num = mixdown(in:num[])");
+
+    patch->backend.setHeadless(project, &patch->setupRuntime);
+    project->attachBackend(&patch->backend);
+    project->mainRoot().attachRuntime(&patch->setupRuntime);
+
+    connectControls(project, findControl(source, "out"), findControl(voice, "index"));
+    connectControls(project, findControl(voice, "out"), findControl(mix, "in"));
+    connectControls(project, findControl(mix, "out"), findOutputPortal(project));
+
+    patch->voiceLanes = voiceLanes;
+    patch->attach();
+    return patch;
+}
+
+// Builds the voice code for the grouped voice patches, with a chain of filters so each voice has enough work to pass
+// the compiler's threshold for running voices on the task pool.
+static QString buildHeavyVoiceCode() {
+    QString code = "s0 = sawOsc(110 + index:num * 10)\n";
+    for (int i = 1; i <= HEAVY_VOICE_FILTERS; i++) {
+        code += QString("s%1 = lowBqFilter(s%2, %3, 0.7)\n").arg(i).arg(i - 1).arg(4000 - i * 50);
+    }
+    code += QString("out:num = s%1 * 0.1").arg(HEAVY_VOICE_FILTERS);
+    return code;
+}
+
+// Like buildVoicesPatch, but inside a group with heavier voices and the group's parallel voices setting as given, so
+// serial and parallel voices can be compared.
+static std::unique_ptr<BenchPatch> buildGroupedVoicesPatch(int voiceCount, bool parallelVoices) {
+    auto patch = std::make_unique<BenchPatch>();
+    patch->project = std::make_unique<AxiomModel::Project>(patch->backend.createDefaultConfiguration());
+    auto project = patch->project.get();
+
+    auto source = addCustomNode(project, QPoint(0, 0), "source", QString("out:num[] = indexed(%1)").arg(voiceCount));
+    auto voice = addCustomNode(project, QPoint(4, 0), "voice", buildHeavyVoiceCode());
+    auto mix = addCustomNode(project, QPoint(8, 0), "mix", "out:num = mixdown(in:num[])");
+
+    patch->backend.setHeadless(project, &patch->setupRuntime);
+    project->attachBackend(&patch->backend);
+    project->mainRoot().attachRuntime(&patch->setupRuntime);
+
+    connectControls(project, findControl(source, "out"), findControl(voice, "index"));
+    connectControls(project, findControl(voice, "out"), findControl(mix, "in"));
+    connectControls(project, findControl(mix, "out"), findOutputPortal(project));
+
+    source->select(true);
+    voice->select(false);
+    mix->select(false);
+    project->rootSurface()->groupSelectedNodes();
+    for (const auto &node : project->rootSurface()->nodes().sequence()) {
+        if (auto group = dynamic_cast<AxiomModel::GroupNode *>(node)) {
+            (*group->nodes().value())->setParallelVoices(parallelVoices);
+        }
+    }
+
+    patch->attach();
+    return patch;
+}
+
+static QJsonObject runBench(BenchPatch *patch, const QString &kind, const QString &name, int size,
+                            const BenchOptions &options) {
+    std::cerr << "Benchmarking " << kind.toStdString() << " " << name.toStdString() << std::endl;
+
+    auto nsPerSample = patch->measureNsPerSample(options.renderSeconds);
+    auto warmCommitSeconds = patch->measureWarmCommit();
+
+    QJsonObject result;
+    result["kind"] = kind;
+    result["name"] = name;
+    if (size) result["size"] = size;
+    result["loadSeconds"] = patch->loadSeconds;
+    result["coldCommitSeconds"] = patch->coldCommitSeconds;
+    result["warmCommitSeconds"] = warmCommitSeconds;
+    result["nsPerSample"] = nsPerSample;
+
+    // the fraction of one core needed to keep up with realtime
+    result["cpuLoadAt48k"] = nsPerSample * SAMPLE_RATE / 1e9;
+    return result;
+}
+
+static std::vector<int> parseCounts(const char *arg) {
+    std::vector<int> counts;
+    for (const auto &part : QString(arg).split(',', QString::SkipEmptyParts)) {
+        bool ok = false;
+        auto count = part.toInt(&ok);
+        if (ok && count > 0) counts.push_back(count);
+    }
+    return counts;
+}
+
+static void printUsage() {
+    std::cerr << "Usage: axiom_bench [options] [project.axp...]" << std::endl
+              << "Benchmarks the example projects, synthetic patches, and any projects given." << std::endl
+              << "Options:" << std::endl
+              << "  --output <file>     Where to write JSON results (default: " << DEFAULT_OUTPUT_PATH << ")"
+              << std::endl
+              << "  --examples <dir>    Directory of example projects (default: " << AXIOM_EXAMPLES_DIR << ")"
+              << std::endl
+              << "  --seconds <s>       Audio time to render per patch (default: " << DEFAULT_RENDER_SECONDS << ")"
+              << std::endl
+              << "  --voices <n,...>    Voice counts for the synthetic voice patches, which are run with voices in"
+              << std::endl
+              << "                      the root surface one at a time and in lanes, and grouped with parallel"
+              << std::endl
+              << "                      voices off and on" << std::endl
+              << "  --nodes <n,...>     Node counts for the synthetic node patches" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName("Axiom");
+
+    BenchOptions options;
+    QString outputPath = DEFAULT_OUTPUT_PATH;
+    QString examplesPath = AXIOM_EXAMPLES_DIR;
+    QStringList projectPaths;
+
+    for (auto i = 1; i < argc; i++) {
+        auto hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--examples") == 0 && hasValue) {
+            examplesPath = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+            options.renderSeconds = QString(argv[++i]).toDouble();
+        } else if (strcmp(argv[i], "--voices") == 0 && hasValue) {
+            options.voiceCounts = parseCounts(argv[++i]);
+        } else if (strcmp(argv[i], "--nodes") == 0 && hasValue) {
+            options.nodeCounts = parseCounts(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            printUsage();
+            return 1;
+        } else {
+            projectPaths.push_back(argv[i]);
+        }
+    }
+
+    if (options.renderSeconds <= 0) {
+        printUsage();
+        return 1;
+    }
+
+    if (!examplesPath.isEmpty()) {
+        QDir examplesDir(examplesPath);
+        for (const auto &entry : examplesDir.entryInfoList({"*.axp"}, QDir::Files, QDir::Name)) {
+            projectPaths.push_back(entry.filePath());
+        }
+    }
+
+    QJsonArray results;
+    for (const auto &path : projectPaths) {
+        if (auto patch = loadExample(path)) {
+            results.push_back(runBench(patch.get(), "project", QFileInfo(path).completeBaseName(), 0, options));
+        }
+    }
+    for (auto voiceCount : options.voiceCounts) {
+        auto patch = buildVoicesPatch(voiceCount, false);
+        results.push_back(runBench(patch.get(), "voices", QString("%1 voices").arg(voiceCount), voiceCount, options));
+        patch.reset();
+
+        auto lanesPatch = buildVoicesPatch(voiceCount, true);
+        results.push_back(runBench(lanesPatch.get(), "lane voices", QString("%1 lane voices").arg(voiceCount),
+                                   voiceCount, options));
+    }
+    for (auto voiceCount : options.voiceCounts) {
+        auto serialPatch = buildGroupedVoicesPatch(voiceCount, false);
+        results.push_back(runBench(serialPatch.get(), "serial voices", QString("%1 serial voices").arg(voiceCount),
+                                   voiceCount, options));
+        serialPatch.reset();
+
+        auto parallelPatch = buildGroupedVoicesPatch(voiceCount, true);
+        results.push_back(runBench(parallelPatch.get(), "parallel voices",
+                                   QString("%1 parallel voices").arg(voiceCount), voiceCount, options));
+    }
+    for (auto nodeCount : options.nodeCounts) {
+        auto patch = buildNodesPatch(nodeCount);
+        results.push_back(runBench(patch.get(), "nodes", QString("%1 nodes").arg(nodeCount), nodeCount, options));
+    }
+
+    QJsonObject report;
+    report["schemaVersion"] = (int) AxiomModel::ProjectSerializer::schemaVersion;
+    report["sampleRate"] = (int) SAMPLE_RATE;
+    report["blockSize"] = (int) BLOCK_SIZE;
+    report["renderSeconds"] = options.renderSeconds;
+    report["results"] = results;
+
+    QFile outputFile(outputPath);
+    if (!outputFile.open(QIODevice::WriteOnly)) {
+        std::cerr << "Failed to open output file " << outputPath.toStdString() << std::endl;
+        return 1;
+    }
+    outputFile.write(QJsonDocument(report).toJson());
+    std::cerr << "Wrote results to " << outputPath.toStdString() << std::endl;
+
+    return 0;
+}
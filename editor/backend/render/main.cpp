@@ -0,0 +1,450 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../compiler/interface/Runtime.h"
+#include "../../model/ModelRoot.h"
+#include "../../model/Project.h"
+#include "../../model/serialize/ProjectSerializer.h"
+#include "../HeadlessAudioBackend.h"
+#include "editor/backend/EventConverter.h"
+
+using namespace AxiomBackend;
+
+static constexpr uint64_t DEFAULT_SAMPLE_RATE = 44100;
+static constexpr uint64_t DEFAULT_BLOCK_SIZE = 512;
+static constexpr double DEFAULT_TAIL_SECONDS = 2;
+static constexpr uint32_t DEFAULT_MICROSECONDS_PER_BEAT = 500000;
+
+// A MIDI event from the input file, with its time converted to seconds.
+struct TimedMidiEvent {
+    double time;
+    MidiEvent event;
+};
+
+// A tempo change from the input file, with its time converted to seconds.
+struct TimedTempoChange {
+    double time;
+    double bpm;
+};
+
+struct MidiFile {
+    std::vector<TimedMidiEvent> events;
+    std::vector<TimedTempoChange> tempoChanges;
+};
+
+class MidiFileReader {
+public:
+    explicit MidiFileReader(std::vector<uint8_t> data) : data(std::move(data)) {}
+
+    bool read(MidiFile *file, std::string *error) {
+        if (!expectChunk("MThd")) {
+            *error = "not a Standard MIDI File (bad header chunk)";
+            return false;
+        }
+        auto headerLength = readU32();
+        auto headerEnd = position + headerLength;
+        auto format = readU16();
+        auto trackCount = readU16();
+        auto division = readU16();
+        position = headerEnd;
+
+        if (format > 1) {
+            *error = "only format 0 and 1 MIDI files are supported";
+            return false;
+        }
+        if (division & 0x8000) {
+            // SMPTE timing: the upper byte is the negative frame rate, the lower byte is ticks per frame
+            auto framesPerSecond = (double) -(int8_t)(division >> 8);
+            secondsPerTick = 1 / (framesPerSecond * (division & 0xFF));
+            isSmpte = true;
+        } else {
+            ticksPerBeat = division;
+        }
+
+        std::vector<TrackEvent> trackEvents;
+        std::vector<TempoChange> tempoChanges;
+        for (uint16_t trackIndex = 0; trackIndex < trackCount; trackIndex++) {
+            if (!expectChunk("MTrk")) {
+                *error = "track " + std::to_string(trackIndex) + " is missing its chunk header";
+                return false;
+            }
+            auto trackLength = readU32();
+            auto trackEnd = std::min(position + trackLength, data.size());
+            readTrack(trackEnd, &trackEvents, &tempoChanges);
+            position = trackEnd;
+        }
+
+        // events on the same tick keep the order they were in across tracks
+        std::stable_sort(trackEvents.begin(), trackEvents.end(),
+                         [](const TrackEvent &a, const TrackEvent &b) { return a.tick < b.tick; });
+        std::stable_sort(tempoChanges.begin(), tempoChanges.end(),
+                         [](const TempoChange &a, const TempoChange &b) { return a.tick < b.tick; });
+
+        // walk the tempo map alongside the events to convert ticks into seconds
+        uint64_t lastTick = 0;
+        double lastTime = 0;
+        uint32_t microsecondsPerBeat = DEFAULT_MICROSECONDS_PER_BEAT;
+        size_t nextTempoChange = 0;
+        auto advanceTo = [&](uint64_t tick) {
+            lastTime += (tick - lastTick) * getSecondsPerTick(microsecondsPerBeat);
+            lastTick = tick;
+        };
+        auto applyTempoChangesUntil = [&](uint64_t tick) {
+            while (nextTempoChange < tempoChanges.size() && tempoChanges[nextTempoChange].tick <= tick) {
+                advanceTo(tempoChanges[nextTempoChange].tick);
+                microsecondsPerBeat = tempoChanges[nextTempoChange].microsecondsPerBeat;
+                file->tempoChanges.push_back({lastTime, 60000000. / microsecondsPerBeat});
+                nextTempoChange++;
+            }
+        };
+        for (const auto &trackEvent : trackEvents) {
+            applyTempoChangesUntil(trackEvent.tick);
+            advanceTo(trackEvent.tick);
+            file->events.push_back({lastTime, trackEvent.event});
+        }
+
+        // changes after the last event still affect the tail
+        applyTempoChangesUntil(UINT64_MAX);
+
+        return true;
+    }
+
+private:
+    struct TrackEvent {
+        uint64_t tick;
+        MidiEvent event;
+    };
+
+    struct TempoChange {
+        uint64_t tick;
+        uint32_t microsecondsPerBeat;
+    };
+
+    std::vector<uint8_t> data;
+    size_t position = 0;
+    uint16_t ticksPerBeat = 0;
+    double secondsPerTick = 0;
+    bool isSmpte = false;
+
+    double getSecondsPerTick(uint32_t microsecondsPerBeat) const {
+        return isSmpte ? secondsPerTick : microsecondsPerBeat / (1000000. * ticksPerBeat);
+    }
+
+    uint8_t readU8() { return position < data.size() ? data[position++] : 0; }
+
+    uint16_t readU16() {
+        auto high = readU8();
+        return (uint16_t)((high << 8) | readU8());
+    }
+
+    uint32_t readU32() {
+        auto high = readU16();
+        return ((uint32_t) high << 16) | readU16();
+    }
+
+    uint32_t readVarLength() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            auto byte = readU8();
+            value = (value << 7) | (byte & 0x7F);
+            if (!(byte & 0x80)) break;
+        }
+        return value;
+    }
+
+    bool expectChunk(const char *id) {
+        if (position + 4 > data.size() || memcmp(&data[position], id, 4) != 0) return false;
+        position += 4;
+        return true;
+    }
+
+    void readTrack(size_t trackEnd, std::vector<TrackEvent> *events, std::vector<TempoChange> *tempoChanges) {
+        uint64_t tick = 0;
+        uint8_t runningStatus = 0;
+
+        while (position < trackEnd) {
+            tick += readVarLength();
+
+            auto status = readU8();
+            if (status < 0x80) {
+                // running status: the byte we just read is the first data byte
+                position--;
+                status = runningStatus;
+            }
+
+            if (status == 0xFF) {
+                auto metaType = readU8();
+                auto length = readVarLength();
+                auto metaEnd = position + length;
+                if (metaType == 0x51 && length == 3) {
+                    uint32_t microsecondsPerBeat = readU8();
+                    microsecondsPerBeat = (microsecondsPerBeat << 16) | readU16();
+                    tempoChanges->push_back({tick, microsecondsPerBeat});
+                } else if (metaType == 0x2F) {
+                    break;
+                }
+                position = metaEnd;
+            } else if (status == 0xF0 || status == 0xF7) {
+                // sysex events aren't supported by the runtime, so they're skipped
+                auto length = readVarLength();
+                position += length;
+            } else if (status >= 0x80) {
+                runningStatus = status;
+                auto eventType = status & 0xF0;
+                auto hasTwoDataBytes = eventType != 0xC0 && eventType != 0xD0;
+                uint8_t data1 = readU8();
+                uint8_t data2 = hasTwoDataBytes ? readU8() : (uint8_t) 0;
+
+                // a note on with zero velocity is a note off
+                if (eventType == 0x90 && data2 == 0) {
+                    status = (uint8_t)(0x80 | (status & 0x0F));
+                }
+
+                int32_t message = status | (data1 << 8) | (data2 << 16);
+                if (auto convertedEvent = convertFromMidi(message)) {
+                    events->push_back({tick, *convertedEvent});
+                }
+            } else {
+                // a data byte with no running status to apply it to, the track is corrupt
+                break;
+            }
+        }
+    }
+};
+
+static bool readFile(const QString &path, std::vector<uint8_t> *data) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    auto bytes = file.readAll();
+    data->assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+static std::unique_ptr<AxiomModel::Project> loadProject(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        std::cerr << "Failed to open project " << path.toStdString() << std::endl;
+        return nullptr;
+    }
+
+    QDataStream stream(&file);
+    uint32_t readVersion = 0;
+    auto project = AxiomModel::ProjectSerializer::deserialize(
+        stream, &readVersion,
+        // the render doesn't have a library to import modules into
+        [](AxiomModel::Library *) {}, [path](QDataStream &, uint32_t) { return path; });
+
+    if (!project) {
+        if (readVersion) {
+            std::cerr << "Project " << path.toStdString() << " was created with an incompatible version of Axiom "
+                      << "(expected between " << AxiomModel::ProjectSerializer::minSchemaVersion << " and "
+                      << AxiomModel::ProjectSerializer::schemaVersion << ", actual " << readVersion << ")"
+                      << std::endl;
+        } else {
+            std::cerr << "Project " << path.toStdString() << " is an invalid project file (bad magic header)"
+                      << std::endl;
+        }
+    }
+    return project;
+}
+
+static void writeU16(std::ofstream &stream, uint16_t value) {
+    char bytes[] = {(char) (value & 0xFF), (char) (value >> 8)};
+    stream.write(bytes, sizeof(bytes));
+}
+
+static void writeU32(std::ofstream &stream, uint32_t value) {
+    writeU16(stream, (uint16_t)(value & 0xFFFF));
+    writeU16(stream, (uint16_t)(value >> 16));
+}
+
+// Writes interleaved stereo samples as a 32-bit float WAV file.
+static bool writeWav(const std::string &path, const std::vector<float> &samples, uint32_t sampleRate) {
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream) return false;
+
+    const uint16_t channelCount = 2;
+    const uint16_t bytesPerSample = sizeof(float);
+    auto dataSize = (uint32_t)(samples.size() * bytesPerSample);
+
+    stream.write("RIFF", 4);
+    writeU32(stream, 36 + dataSize);
+    stream.write("WAVE", 4);
+
+    stream.write("fmt ", 4);
+    writeU32(stream, 16);
+    writeU16(stream, 3); // IEEE float
+    writeU16(stream, channelCount);
+    writeU32(stream, sampleRate);
+    writeU32(stream, sampleRate * channelCount * bytesPerSample);
+    writeU16(stream, channelCount * bytesPerSample);
+    writeU16(stream, bytesPerSample * 8);
+
+    stream.write("data", 4);
+    writeU32(stream, dataSize);
+    for (auto sample : samples) {
+        uint32_t bits;
+        memcpy(&bits, &sample, sizeof(bits));
+        writeU32(stream, bits);
+    }
+
+    return (bool) stream;
+}
+
+static void printUsage() {
+    std::cerr << "Usage: axiom_render [options] <project.axp> <input.mid> <output.wav>" << std::endl
+              << "Options:" << std::endl
+              << "  --rate <hz>       Sample rate to render at (default " << DEFAULT_SAMPLE_RATE << ")" << std::endl
+              << "  --block <frames>  Frames to render per runtime call (default " << DEFAULT_BLOCK_SIZE << ")"
+              << std::endl
+              << "  --tail <seconds>  Time to keep rendering after the last MIDI event (default "
+              << DEFAULT_TAIL_SECONDS << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    // only a core application, since nothing here needs widgets or an event loop
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName("Axiom");
+
+    uint64_t sampleRate = DEFAULT_SAMPLE_RATE;
+    uint64_t blockSize = DEFAULT_BLOCK_SIZE;
+    double tailSeconds = DEFAULT_TAIL_SECONDS;
+    std::vector<std::string> paths;
+
+    for (auto i = 1; i < argc; i++) {
+        auto hasValue = i + 1 < argc;
+        try {
+            if (strcmp(argv[i], "--rate") == 0 && hasValue) {
+                sampleRate = std::stoul(argv[++i]);
+            } else if (strcmp(argv[i], "--block") == 0 && hasValue) {
+                blockSize = std::stoul(argv[++i]);
+            } else if (strcmp(argv[i], "--tail") == 0 && hasValue) {
+                tailSeconds = std::stod(argv[++i]);
+            } else {
+                paths.emplace_back(argv[i]);
+            }
+        } catch (const std::invalid_argument &) {
+            printUsage();
+            return 1;
+        } catch (const std::out_of_range &) {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (paths.size() != 3 || sampleRate == 0 || blockSize == 0 || tailSeconds < 0) {
+        printUsage();
+        return 1;
+    }
+    auto projectPath = QString::fromStdString(paths[0]);
+    auto midiPath = QString::fromStdString(paths[1]);
+    const auto &outputPath = paths[2];
+
+    std::vector<uint8_t> midiData;
+    if (!readFile(midiPath, &midiData)) {
+        std::cerr << "Failed to open MIDI file " << paths[1] << std::endl;
+        return 1;
+    }
+    MidiFile midiFile;
+    std::string midiError;
+    if (!MidiFileReader(std::move(midiData)).read(&midiFile, &midiError)) {
+        std::cerr << "Failed to read MIDI file " << paths[1] << ": " << midiError << std::endl;
+        return 1;
+    }
+
+    // the backend and runtime need to outlive the project, since it uses them while being destroyed
+    HeadlessAudioBackend backend;
+    MaximCompiler::Runtime runtime(false);
+    runtime.setRealtime(false);
+
+    auto loadStartTime = std::chrono::steady_clock::now();
+    auto project = loadProject(projectPath);
+    if (!project) return 1;
+
+    backend.setHeadless(project.get(), &runtime);
+    project->attachBackend(&backend);
+    project->mainRoot().attachRuntime(&runtime);
+    auto loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStartTime).count();
+
+    if (backend.audioOutputPortal == -1) {
+        std::cerr << "Project has no audio output portal to render" << std::endl;
+        return 1;
+    }
+    if (backend.midiInputPortal == -1 && !midiFile.events.empty()) {
+        std::cerr << "Warning: project has no MIDI input portal, MIDI events will be ignored" << std::endl;
+    }
+
+    backend.setSampleRate(sampleRate);
+    backend.setBpm((float) (60000000. / DEFAULT_MICROSECONDS_PER_BEAT));
+
+    auto lastEventTime = midiFile.events.empty() ? 0 : midiFile.events.back().time;
+    auto totalFrames = (uint64_t)((lastEventTime + tailSeconds) * sampleRate) + 1;
+    std::vector<float> samples(totalFrames * 2, 0.f);
+
+    auto renderStartTime = std::chrono::steady_clock::now();
+    size_t nextEvent = 0;
+    size_t nextTempoChange = 0;
+    uint64_t blockFrames = 0;
+    for (uint64_t blockStart = 0; blockStart < totalFrames; blockStart += blockFrames) {
+        blockFrames = std::min(blockSize, totalFrames - blockStart);
+
+        // follow the tempo map, ending the block early at the next change so it lands on the right frame
+        while (nextTempoChange < midiFile.tempoChanges.size()) {
+            const auto &tempoChange = midiFile.tempoChanges[nextTempoChange];
+            auto changeFrame = (uint64_t)(tempoChange.time * sampleRate);
+            if (changeFrame > blockStart) {
+                blockFrames = std::min(blockFrames, changeFrame - blockStart);
+                break;
+            }
+
+            backend.setBpm((float) tempoChange.bpm);
+            nextTempoChange++;
+        }
+
+        // Only queue events due in this block, so the fixed-size event queue doesn't overflow on long files. If a block
+        // has more events than fit in the queue, it ends at the first one that doesn't fit, which is queued again in
+        // the next block once the earlier ones have been delivered.
+        while (nextEvent < midiFile.events.size()) {
+            const auto &timedEvent = midiFile.events[nextEvent];
+            auto eventFrame = (uint64_t)(timedEvent.time * sampleRate);
+            if (eventFrame >= blockStart + blockFrames) break;
+
+            if (backend.midiInputPortal != -1) {
+                auto deltaFrames = eventFrame > blockStart ? eventFrame - blockStart : 0;
+                if (!backend.queueMidiEvent(deltaFrames, (size_t) backend.midiInputPortal, timedEvent.event)) {
+                    // at least one frame is rendered, so events due on the first frame still make progress
+                    blockFrames = std::max(deltaFrames, (uint64_t) 1);
+                    break;
+                }
+            }
+            nextEvent++;
+        }
+
+        // nothing else touches the runtime, so the context is always live
+        auto context = backend.beginGenerate();
+        auto blockBuffer = samples.data() + blockStart * 2;
+        context.bindAudioOutput((size_t) backend.audioOutputPortal, blockBuffer, blockBuffer + 1);
+        context.generateBlock(0, blockFrames, 2);
+    }
+    auto renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStartTime).count();
+
+    if (!writeWav(outputPath, samples, (uint32_t) sampleRate)) {
+        std::cerr << "Failed to write output file " << outputPath << std::endl;
+        return 1;
+    }
+
+    auto audioSeconds = (double) totalFrames / sampleRate;
+    std::cout << "Loaded project in " << loadTime << "s" << std::endl
+              << "Rendered " << audioSeconds << "s of audio in " << renderTime << "s ("
+              << (renderTime > 0 ? audioSeconds / renderTime : 0) << "x realtime)" << std::endl;
+    return 0;
+}
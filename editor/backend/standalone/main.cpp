@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -186,36 +187,29 @@ public:
         backend->processIncomingMidiEvents();
 #endif
 
-        uint64_t processPos = 0;
-
         auto outputNums = (float *) outputBuffer;
-
         auto sampleFrames64 = (uint64_t) framesPerBuffer;
-        while (processPos < sampleFrames64) {
-            auto context = backend->beginGenerate();
-            auto endProcessPos = processPos + context.maxGenerateCount();
-            if (endProcessPos > sampleFrames64) endProcessPos = sampleFrames64;
-
-            for (auto i = processPos; i < endProcessPos; i++) {
-                context.generate();
-
-                if (backend->audioOutputPortal != -1) {
-                    auto outputNum = *backend->getAudioPortal(backend->audioOutputPortal);
-                    *outputNums++ = (float) outputNum.left;
-                    *outputNums++ = (float) outputNum.right;
-                }
+        auto context = backend->beginGenerate();
+
+        // the output buffer is interleaved, so the two channels are offset by one with a stride of two
+        if (backend->audioOutputPortal != -1 && context.isLive()) {
+            context.bindAudioOutput((size_t) backend->audioOutputPortal, outputNums, outputNums + 1);
+        } else {
+            std::fill(outputNums, outputNums + sampleFrames64 * 2, 0.f);
+        }
 
 #ifdef PORTMIDI
+        // outgoing MIDI events only last for a single frame, so they need to be read after each one
+        if (context.isLive() && backend->midiOutputStream != nullptr && backend->midiOutputPortal != -1) {
+            for (uint64_t i = 0; i < sampleFrames64; i++) {
+                context.generateBlock(i, 1, 2);
                 backend->processOutgoingMidiEvents();
-#endif
-
-                if (backend->midiInputPortal != -1 && i == processPos) {
-                    backend->clearMidi((size_t) backend->midiInputPortal);
-                }
             }
-
-            processPos = endProcessPos;
+            return 0;
         }
+#endif
+
+        context.generateBlock(0, sampleFrames64, 2);
 
         return 0;
     }
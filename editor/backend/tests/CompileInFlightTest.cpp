@@ -0,0 +1,129 @@
+#include <QtCore/QCoreApplication>
+#include <chrono>
+#include <memory>
+
+#include "../../compiler/interface/Runtime.h"
+#include "../../model/ModelRoot.h"
+#include "../../model/Project.h"
+#include "../../model/actions/CreateConnectionAction.h"
+#include "../../model/objects/Control.h"
+#include "../../model/objects/ControlSurface.h"
+#include "../../model/objects/CustomNode.h"
+#include "../../model/objects/GroupNode.h"
+#include "../../model/objects/GroupSurface.h"
+#include "../../model/objects/RootSurface.h"
+#include "../HeadlessAudioBackend.h"
+#include "TestCheck.h"
+
+using namespace AxiomBackend;
+using AxiomTest::check;
+
+// How long compiles are given to finish before the test gives up on them.
+static constexpr auto COMPILE_TIMEOUT = std::chrono::seconds(60);
+
+// The backend and runtime are declared first so they outlive the project, which uses them while being destroyed.
+class TestPatch {
+public:
+    HeadlessAudioBackend backend;
+    MaximCompiler::Runtime runtime{false};
+    std::unique_ptr<AxiomModel::Project> project;
+
+    TestPatch() : project(std::make_unique<AxiomModel::Project>(backend.createDefaultConfiguration())) {}
+
+    void attach() {
+        backend.setHeadless(project.get(), &runtime);
+        project->attachBackend(&backend);
+        project->mainRoot().attachRuntime(&runtime);
+    }
+};
+
+static AxiomModel::CustomNode *addCustomNode(AxiomModel::Project *project, QPoint pos, const QString &name,
+                                             const QString &code) {
+    auto &root = project->mainRoot();
+    auto nodeUuid = QUuid::createUuid();
+    auto controlsUuid = QUuid::createUuid();
+    auto node = root.pool().registerObj(AxiomModel::CustomNode::create(
+        nodeUuid, project->rootSurface()->uuid(), pos, QSize(3, 2), false, name, controlsUuid, code, false,
+        QSizeF(3, AxiomModel::CustomNode::minPanelHeight), &root));
+    root.pool().registerObj(AxiomModel::ControlSurface::create(controlsUuid, nodeUuid, &root));
+    return static_cast<AxiomModel::CustomNode *>(node);
+}
+
+static AxiomModel::Control *findControl(AxiomModel::Node *node, const QString &name) {
+    auto controls = *node->controls().value();
+    for (const auto &control : controls->controls().sequence()) {
+        if (control->name() == name) return control;
+    }
+    return nullptr;
+}
+
+static bool hasRuntimePointers(AxiomModel::Node *node, const QString &controlName) {
+    auto control = findControl(node, controlName);
+    return control && control->runtimePointers();
+}
+
+// Runs the event loop until the compile worker has deployed everything, including compiles that were queued up by
+// edits made while another compile was running.
+static bool waitForCompiles(AxiomModel::ModelRoot &root) {
+    auto deadline = std::chrono::steady_clock::now() + COMPILE_TIMEOUT;
+    while (root.isCompiling()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return true;
+}
+
+// Groups nodes and adds a new one while their surface is being compiled, so the model is ahead of the compiled code
+// when it's deployed. Nothing that wasn't in the compiled transaction should be given runtime pointers until the
+// follow-up compile has deployed it.
+static void testEditWhileCompiling() {
+    TestPatch patch;
+    auto project = patch.project.get();
+    auto &root = project->mainRoot();
+
+    auto source = addCustomNode(project, QPoint(0, 0), "source", "out:num = 1");
+    auto sink = addCustomNode(project, QPoint(4, 0), "sink", "out:num = in:num");
+    patch.attach();
+    check(hasRuntimePointers(sink, "in"), "nodes have runtime pointers after attaching");
+
+    AxiomModel::CreateConnectionAction::create(project->rootSurface()->uuid(), findControl(source, "out")->uuid(),
+                                               findControl(sink, "in")->uuid(), &root)
+        ->forward(true);
+    root.compileDirtyItems();
+    check(root.isCompiling(), "connecting nodes starts a background compile");
+
+    // The worker only becomes idle once its callback has run on this thread, so these edits always land mid-compile.
+    source->select(true);
+    sink->select(false);
+    project->rootSurface()->groupSelectedNodes();
+    auto added = addCustomNode(project, QPoint(0, 4), "added", "out:num = 2");
+    root.compileDirtyItems();
+
+    check(waitForCompiles(root), "compiles queued while compiling finish");
+
+    AxiomModel::GroupNode *group = nullptr;
+    for (const auto &node : project->rootSurface()->nodes().sequence()) {
+        if (auto groupNode = dynamic_cast<AxiomModel::GroupNode *>(node)) group = groupNode;
+    }
+    check(group != nullptr, "grouping creates a group node");
+    if (!group) return;
+
+    auto groupSurface = *group->nodes().value();
+    size_t groupedCount = 0;
+    for (const auto &node : groupSurface->nodes().sequence()) {
+        if (!dynamic_cast<AxiomModel::CustomNode *>(node)) continue;
+        groupedCount++;
+        check(hasRuntimePointers(node, "out"), "grouped nodes have runtime pointers once deployed");
+    }
+    check(groupedCount == 2, "both nodes are moved into the group");
+    check(hasRuntimePointers(added, "out"), "a node added while compiling has runtime pointers once deployed");
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication application(argc, argv);
+    QCoreApplication::setApplicationName("Axiom");
+
+    testEditWhileCompiling();
+
+    return AxiomTest::checkResult();
+}
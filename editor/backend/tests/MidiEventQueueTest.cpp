@@ -0,0 +1,82 @@
+#include <vector>
+
+#include "../MidiEventQueue.h"
+#include "TestCheck.h"
+
+using namespace AxiomBackend;
+using AxiomTest::check;
+
+static MidiEvent noteOn(uint8_t note) {
+    MidiEvent event;
+    event.event = MidiEventType::NOTE_ON;
+    event.note = note;
+    return event;
+}
+
+static std::vector<uint8_t> drainNotes(MidiEventQueue &queue) {
+    std::vector<uint8_t> notes;
+    while (!queue.empty()) {
+        notes.push_back(queue.front().event.note);
+        queue.pop();
+    }
+    return notes;
+}
+
+static void testOrdersByTime() {
+    MidiEventQueue queue;
+    queue.push(30, 0, noteOn(3));
+    queue.push(10, 0, noteOn(1));
+    queue.push(40, 0, noteOn(4));
+    queue.push(20, 0, noteOn(2));
+    check(drainNotes(queue) == std::vector<uint8_t>{1, 2, 3, 4}, "events come out in time order");
+}
+
+static void testEqualTimesKeepPushOrder() {
+    MidiEventQueue queue;
+    queue.push(10, 0, noteOn(1));
+    queue.push(5, 0, noteOn(0));
+    queue.push(10, 0, noteOn(2));
+    queue.push(20, 0, noteOn(5));
+    queue.push(10, 0, noteOn(3));
+    queue.push(10, 0, noteOn(4));
+    check(drainNotes(queue) == std::vector<uint8_t>{0, 1, 2, 3, 4, 5},
+          "events with the same time come out in the order they were pushed");
+
+    // heap operations shuffle events around, so check a longer run with lots of repeated times
+    MidiEventQueue retrigger;
+    for (uint8_t i = 0; i < 100; i++) {
+        retrigger.push(100 - i % 7, 0, noteOn(i));
+    }
+    auto lastTime = retrigger.front().time;
+    uint8_t lastNote = 0;
+    auto isOrdered = true;
+    while (!retrigger.empty()) {
+        const auto &event = retrigger.front();
+        if (event.time == lastTime && event.event.note < lastNote) isOrdered = false;
+        lastTime = event.time;
+        lastNote = event.event.note;
+        retrigger.pop();
+    }
+    check(isOrdered, "many events with repeated times stay in push order");
+}
+
+static void testFullQueueDropsEvents() {
+    MidiEventQueue queue;
+    for (size_t i = 0; i < MidiEventQueue::CAPACITY; i++) {
+        check(queue.push(MidiEventQueue::CAPACITY - i, 0, noteOn(0)), "push succeeds until the queue is full");
+    }
+    check(queue.full(), "queue is full at capacity");
+    check(!queue.push(0, 0, noteOn(1)), "push fails when the queue is full");
+    check(queue.front().time == 1, "dropped event isn't queued");
+
+    queue.clear();
+    check(queue.empty(), "clear empties the queue");
+}
+
+int main() {
+    testOrdersByTime();
+    testEqualTimesKeepPushOrder();
+    testFullQueueDropsEvents();
+
+    return AxiomTest::checkResult();
+}
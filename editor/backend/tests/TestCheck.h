@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+
+// A minimal check harness shared by the backend test executables. Failed checks are printed as they happen, and
+// `checkResult` gives the exit code for main.
+namespace AxiomTest {
+
+    inline int &failureCount() {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check(bool condition, const char *description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failureCount()++;
+        }
+    }
+
+    inline int checkResult() {
+        if (failureCount() != 0) {
+            std::cerr << failureCount() << " checks failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+}
@@ -1,5 +1,6 @@
 #include <QtCore/QSharedMemory>
 #include <QtCore/QTimer>
+#include <algorithm>
 #include <iostream>
 #include <thread>
 
@@ -290,46 +291,31 @@ private:
 
     void handleGenerate(VstAudioGenerateMessage message) {
         auto sampleFrames64 = (uint64_t) message.sampleCount;
-        uint64_t processPos = 0;
-        while (processPos < sampleFrames64) {
-            auto context = backend->beginGenerate();
-            auto endProcessPos = processPos + context.maxGenerateCount();
-            if (endProcessPos > sampleFrames64) endProcessPos = sampleFrames64;
-
-            for (auto i = processPos; i < endProcessPos; i++) {
-                for (size_t inputIndex = 0; inputIndex < backend->audioInputs.size(); inputIndex++) {
-                    const auto &input = backend->audioInputs[inputIndex];
-                    if (input) {
-                        auto inputSource = getInputBufferPtr(inputIndex);
-                        auto &inputNum = *backend->getAudioPortal(input->portalIndex);
-                        inputNum.left = inputSource[i * 2];
-                        inputNum.right = inputSource[i * 2 + 1];
-                        inputNum.form = AxiomBackend::NumForm::OSCILLATOR;
-                    }
-                }
-
-                context.generate();
 
-                for (size_t outputIndex = 0; outputIndex < backend->audioOutputs.size(); outputIndex++) {
-                    const auto &output = backend->audioOutputs[outputIndex];
-                    auto outputDest = getOutputBufferPtr(outputIndex);
+        {
+            auto context = backend->beginGenerate();
 
-                    if (output) {
-                        auto outputNum = *backend->getAudioPortal(output->portalIndex);
-                        outputDest[i * 2] = (float) outputNum.left;
-                        outputDest[i * 2 + 1] = (float) outputNum.right;
-                    } else {
-                        outputDest[i * 2] = 0;
-                        outputDest[i * 2 + 1] = 0;
-                    }
+            // the IO buffers are interleaved, so the two channels are offset by one with a stride of two
+            for (size_t inputIndex = 0; inputIndex < backend->audioInputs.size(); inputIndex++) {
+                const auto &input = backend->audioInputs[inputIndex];
+                if (input) {
+                    auto inputSource = getInputBufferPtr(inputIndex);
+                    context.bindAudioInput(input->portalIndex, inputSource, inputSource + 1);
                 }
+            }
+
+            for (size_t outputIndex = 0; outputIndex < backend->audioOutputs.size(); outputIndex++) {
+                const auto &output = backend->audioOutputs[outputIndex];
+                auto outputDest = getOutputBufferPtr(outputIndex);
 
-                if (backend->midiInputPortal != -1 && i == processPos) {
-                    backend->clearMidi((size_t) backend->midiInputPortal);
+                if (output && context.isLive()) {
+                    context.bindAudioOutput(output->portalIndex, outputDest, outputDest + 1);
+                } else {
+                    std::fill(outputDest, outputDest + sampleFrames64 * 2, 0.f);
                 }
             }
 
-            processPos = endProcessPos;
+            context.generateBlock(0, sampleFrames64, 2);
         }
 
         AppAudioMessage msg(AppAudioMessageType::GENERATE_DONE);
@@ -1,5 +1,6 @@
 #include "AxiomVstPlugin.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "editor/backend/EventConverter.h"
@@ -60,48 +61,30 @@ void AxiomVstPlugin::processReplacing(float **inputs, float **outputs, VstInt32
     }
 
     auto sampleFrames64 = (uint64_t) sampleFrames;
-    uint64_t processPos = 0;
-    while (processPos < sampleFrames64) {
-        auto context = _backend.beginGenerate();
-        auto endProcessPos = processPos + context.maxGenerateCount();
-        if (endProcessPos > sampleFrames64) endProcessPos = sampleFrames64;
-
-        for (auto i = processPos; i < endProcessPos; i++) {
-            for (size_t inputIndex = 0; inputIndex < expectedInputCount; inputIndex++) {
-                const auto &input = _backend.audioInputs[inputIndex];
-                if (input) {
-                    auto &inputNum = *_backend.getAudioPortal(input->portalIndex);
-                    inputNum.left = inputs[inputIndex * 2][i];
-                    inputNum.right = inputs[inputIndex * 2 + 1][i];
-                    inputNum.form = AxiomBackend::NumForm::OSCILLATOR;
-                }
-            }
-
-            context.generate();
-
-            for (size_t outputIndex = 0; outputIndex < expectedOutputCount; outputIndex++) {
-                const auto &output = _backend.audioOutputs[outputIndex];
-                auto leftIndex = outputIndex * 2;
-                auto rightIndex = leftIndex + 1;
-
-                if (output) {
-                    auto outputNum = *_backend.getAudioPortal(output->portalIndex);
-                    outputs[leftIndex][i] = (float) outputNum.left;
-                    outputs[rightIndex][i] = (float) outputNum.right;
-                } else {
-                    outputs[leftIndex][i] = 0;
-                    outputs[rightIndex][i] = 0;
-                }
-            }
-
-            if (_backend.midiInputPortal != -1 && i == processPos) {
-                _backend.clearMidi((size_t) _backend.midiInputPortal);
-            }
+    auto context = _backend.beginGenerate();
+
+    for (size_t inputIndex = 0; inputIndex < expectedInputCount; inputIndex++) {
+        const auto &input = _backend.audioInputs[inputIndex];
+        if (input) {
+            context.bindAudioInput(input->portalIndex, inputs[inputIndex * 2], inputs[inputIndex * 2 + 1]);
         }
+    }
+
+    for (size_t outputIndex = 0; outputIndex < expectedOutputCount; outputIndex++) {
+        const auto &output = _backend.audioOutputs[outputIndex];
+        auto leftOutput = outputs[outputIndex * 2];
+        auto rightOutput = outputs[outputIndex * 2 + 1];
 
-        processPos = endProcessPos;
+        if (output && context.isLive()) {
+            context.bindAudioOutput(output->portalIndex, leftOutput, rightOutput);
+        } else {
+            std::fill(leftOutput, leftOutput + sampleFrames64, 0.f);
+            std::fill(rightOutput, rightOutput + sampleFrames64, 0.f);
+        }
     }
 
+    context.generateBlock(0, sampleFrames64);
+
     expectedInputCount = _backend.audioInputs.size();
     expectedOutputCount = _backend.audioOutputs.size();
 }
@@ -65,6 +65,11 @@ void SurfaceMirBuilder::build(MaximCompiler::Transaction *transaction, AxiomMode
     if (!surface->root()->runtime()) return;
 
     auto mir = transaction->buildSurface(surface->getRuntimeId(), surface->name());
+    mir.setParallelBranches(surface->parallelBranches());
+    if (auto groupSurface = dynamic_cast<AxiomModel::GroupSurface *>(surface)) {
+        mir.setParallelVoices(groupSurface->parallelVoices());
+        mir.setOversampling(groupSurface->oversampling());
+    }
 
     // build control groups
     std::unordered_map<ValueGroup *, std::unique_ptr<ValueGroup>> groups;
@@ -255,7 +260,7 @@ void SurfaceMirBuilder::build(MaximCompiler::Transaction *transaction, AxiomMode
                 controlInitializers.push_back(control->getInitializer());
             }
 
-            customNode->setCompileMeta(AxiomModel::NodeCompileMeta(nodeIndex));
+            customNode->setCompileMeta(AxiomModel::NodeCompileMeta(nodeIndex, surface->getRuntimeId()));
             auto mirNode =
                 mir.addCustomNode(customNode->getRuntimeId(), controlInitializers.size(), &controlInitializers[0]);
 
@@ -273,7 +278,7 @@ void SurfaceMirBuilder::build(MaximCompiler::Transaction *transaction, AxiomMode
 
             nodeIndex++;
         } else if (auto groupNode = dynamic_cast<AxiomModel::GroupNode *>(node)) {
-            groupNode->setCompileMeta(AxiomModel::NodeCompileMeta(nodeIndex));
+            groupNode->setCompileMeta(AxiomModel::NodeCompileMeta(nodeIndex, surface->getRuntimeId()));
             auto groupSurface = *groupNode->nodes().value();
             auto mirNode = mir.addGroupNode(groupSurface->getRuntimeId());
             auto &portalControlGroups = groupSurface->compileMeta()->portals;
@@ -294,6 +299,7 @@ void SurfaceMirBuilder::build(MaximCompiler::Transaction *transaction, AxiomMode
     // build root metadata and the updated transaction root
     if (rootSurface) {
         auto mirRoot = transaction->buildRoot();
+        mirRoot.setArrayCapacity(rootSurface->arrayCapacity());
         std::vector<AxiomModel::RootSurfacePortal> portals;
 
         for (size_t i = 0; i < rootPortals.size(); i++) {
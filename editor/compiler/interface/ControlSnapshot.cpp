@@ -0,0 +1,7 @@
+#include "ControlSnapshot.h"
+
+#include "Frontend.h"
+
+using namespace MaximCompiler;
+
+ControlSnapshot::ControlSnapshot(void *handle) : OwnedObject(handle, &MaximFrontend::maxim_destroy_control_snapshot) {}
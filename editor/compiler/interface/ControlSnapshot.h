@@ -0,0 +1,12 @@
+#pragma once
+
+#include "OwnedObject.h"
+
+namespace MaximCompiler {
+
+    // The values of the controls a runtime is watching for specialization, read by `Runtime::snapshotControls`.
+    class ControlSnapshot : public OwnedObject {
+    public:
+        explicit ControlSnapshot(void *handle);
+    };
+}
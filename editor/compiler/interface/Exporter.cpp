@@ -14,9 +14,9 @@ TargetConfig::TargetConfig(MaximFrontend::TargetPlatform platform, MaximFrontend
                   &MaximFrontend::maxim_destroy_target_config) {}
 
 CodeConfig::CodeConfig(MaximFrontend::OptimizationLevel optimizationLevel, const QString &instrumentPrefix,
-                       bool includeInstrument, bool includeLibrary)
+                       bool includeInstrument, bool includeLibrary, MaximFrontend::Precision precision)
     : OwnedObject(MaximFrontend::maxim_create_code_config(optimizationLevel, instrumentPrefix.toUtf8().constData(),
-                                                          includeInstrument, includeLibrary),
+                                                          includeInstrument, includeLibrary, precision),
                   &MaximFrontend::maxim_destroy_code_config) {}
 
 ObjectOutputConfig::ObjectOutputConfig(MaximFrontend::ObjectFormat format, const QString &location)
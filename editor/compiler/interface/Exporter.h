@@ -23,7 +23,7 @@ namespace MaximCompiler {
     class CodeConfig : public OwnedObject {
     public:
         CodeConfig(MaximFrontend::OptimizationLevel optimizationLevel, const QString &instrumentPrefix,
-                   bool includeInstrument, bool includeLibrary);
+                   bool includeInstrument, bool includeLibrary, MaximFrontend::Precision precision);
     };
 
     class ObjectOutputConfig : public OwnedObject {
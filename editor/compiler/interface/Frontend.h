@@ -8,10 +8,13 @@ namespace MaximFrontend {
 
     using MaximRuntime = void;
     using MaximRuntimeRef = MaximRuntime;
+    using MaximRuntimeSharedRef = void;
 
     using MaximTransaction = void;
     using MaximTransactionRef = MaximTransaction;
 
+    using MaximControlSnapshot = void;
+
     using MaximVarType = void;
     using MaximVarTypeRef = MaximVarType;
     using MaximConstantValue = void;
@@ -55,7 +58,7 @@ namespace MaximFrontend {
         void *ui;
     };
 
-    enum class FeatureLevel : uint8_t { SSE41, SSE42, AVX, AVX2 };
+    enum class FeatureLevel : uint8_t { SSE41, SSE42, AVX, AVX2, AVX512 };
 
     enum class TargetPlatform : uint8_t { WINDOWS_MSVC, WINDOWS_GNU, MAC, LINUX };
 
@@ -72,6 +75,8 @@ namespace MaximFrontend {
         AGGRESSIVE_SIZE,
     };
 
+    enum class Precision : uint8_t { DOUBLE, SINGLE };
+
     enum class ObjectFormat : uint8_t { OBJECT, BITCODE, IR, ASSEMBLY_LISTING };
 
     enum class MetaFormat : uint8_t { C_HEADER, RUST_MODULE, JSON };
@@ -81,19 +86,34 @@ namespace MaximFrontend {
 
     MaximRuntime *maxim_create_runtime(bool includeUi);
     void maxim_destroy_runtime(MaximRuntime *);
-    uint64_t maxim_allocate_id(MaximRuntimeRef *runtime);
+    void maxim_set_cache_directory(MaximRuntimeRef *runtime, const char *directory);
+    MaximRuntimeSharedRef *maxim_get_runtime_shared(MaximRuntimeRef *runtime);
+    uint64_t maxim_allocate_id(MaximRuntimeSharedRef *shared);
     bool maxim_export_transaction(MaximExportConfigRef *config, MaximTransaction *transaction);
 
-    void maxim_run_update(MaximRuntimeRef *runtime);
-    void maxim_set_bpm(MaximRuntimeRef *runtime, double bpm);
-    double maxim_get_bpm(MaximRuntimeRef *runtime);
-    void maxim_set_sample_rate(MaximRuntimeRef *runtime, double sample_rate);
-    double maxim_get_sample_rate(MaximRuntimeRef *runtime);
-    uint64_t *maxim_get_profile_times_ptr(MaximRuntimeRef *runtime);
+    uint64_t maxim_begin_update(MaximRuntimeSharedRef *shared);
+    void maxim_end_update(MaximRuntimeSharedRef *shared);
+    void maxim_pause_updates(MaximRuntimeSharedRef *shared);
+    void maxim_resume_updates(MaximRuntimeSharedRef *shared);
+    void maxim_run_update(MaximRuntimeSharedRef *shared);
+    void maxim_run_update_block(MaximRuntimeSharedRef *shared, uint64_t frames, uint64_t stride,
+                                const float *const *inputs, float *const *outputs);
+    void maxim_set_bpm(MaximRuntimeSharedRef *shared, double bpm);
+    double maxim_get_bpm(MaximRuntimeSharedRef *shared);
+    void maxim_set_sample_rate(MaximRuntimeSharedRef *shared, double sample_rate);
+    double maxim_get_sample_rate(MaximRuntimeSharedRef *shared);
+    size_t maxim_get_impulse_slot_count();
+    bool maxim_set_impulse(MaximRuntimeSharedRef *shared, size_t index, const float *samples, size_t sample_count,
+                           size_t channel_count);
+    uint64_t *maxim_get_profile_times_ptr(MaximRuntimeSharedRef *shared);
+    void maxim_request_profile_sample(MaximRuntimeSharedRef *shared);
+    uint64_t maxim_get_profile_sample_count(MaximRuntimeSharedRef *shared);
+    double maxim_get_profile_cycles_per_second(MaximRuntimeSharedRef *shared);
+    const uint64_t *maxim_get_node_profile_ptr(MaximRuntimeRef *runtime, uint64_t surface, size_t node);
     bool maxim_is_node_extracted(MaximRuntimeRef *runtime, uint64_t surface, size_t node);
-    void maxim_convert_num(MaximRuntimeRef *runtime, void *result, uint8_t targetForm, const void *input);
+    void maxim_convert_num(MaximRuntimeSharedRef *shared, void *result, uint8_t targetForm, const void *input);
 
-    void *maxim_get_portal_ptr(MaximRuntimeRef *runtime, size_t portal);
+    void *maxim_get_portal_ptr(MaximRuntimeSharedRef *shared, size_t portal);
     void *maxim_get_root_ptr(MaximRuntimeRef *runtime);
     void *maxim_get_node_ptr(MaximRuntimeRef *runtime, uint64_t surface, void *surface_ptr, size_t node);
     uint32_t *maxim_get_extracted_bitmask_ptr(MaximRuntimeRef *runtime, uint64_t surface, void *surface_ptr,
@@ -107,6 +127,7 @@ namespace MaximFrontend {
     MaximTransaction *maxim_clone_transaction(MaximTransactionRef *);
     void maxim_destroy_transaction(MaximTransaction *);
     void maxim_print_transaction_to_stdout(MaximTransactionRef *);
+    bool maxim_transaction_uses_impulses(MaximTransactionRef *);
 
     MaximVarType *maxim_vartype_num();
     MaximVarType *maxim_vartype_midi();
@@ -123,8 +144,12 @@ namespace MaximFrontend {
 
     MaximRootRef *maxim_build_root(MaximTransactionRef *transaction);
     void maxim_build_root_socket(MaximRootRef *root, MaximVarType *vartype);
+    void maxim_set_root_array_capacity(MaximRootRef *root, uint8_t capacity);
 
     MaximSurfaceRef *maxim_build_surface(MaximTransactionRef *transaction, uint64_t id, const char *name);
+    void maxim_set_surface_parallel_voices(MaximSurfaceRef *surface, bool parallel_voices);
+    void maxim_set_surface_parallel_branches(MaximSurfaceRef *surface, bool parallel_branches);
+    void maxim_set_surface_oversampling(MaximSurfaceRef *surface, uint8_t oversampling);
 
     MaximValueGroupSource *maxim_valuegroupsource_none();
     MaximValueGroupSource *maxim_valuegroupsource_socket(size_t index);
@@ -165,6 +190,18 @@ namespace MaximFrontend {
     bool maxim_control_get_read(MaximBlockControlRef *control);
 
     void maxim_commit(MaximRuntimeRef *runtime, MaximTransaction *transaction);
+    bool maxim_prepare_commit(MaximRuntimeRef *runtime, MaximTransaction *transaction);
+    void maxim_deploy_commit(MaximRuntimeRef *runtime);
+    void maxim_publish(MaximRuntimeRef *runtime);
+    void maxim_set_tiered(MaximRuntimeRef *runtime, bool tiered);
+    void maxim_set_specializing(MaximRuntimeRef *runtime, bool specializing);
+    void maxim_set_realtime(MaximRuntimeSharedRef *shared, bool realtime);
+    void maxim_set_voice_lanes(MaximRuntimeRef *runtime, bool voice_lanes);
+    bool maxim_needs_optimize(MaximRuntimeRef *runtime);
+    MaximControlSnapshot *maxim_snapshot_controls(MaximRuntimeRef *runtime);
+    void maxim_destroy_control_snapshot(MaximControlSnapshot *snapshot);
+    bool maxim_prepare_optimize(MaximRuntimeRef *runtime, MaximControlSnapshot *snapshot);
+    void maxim_deploy_optimized(MaximRuntimeRef *runtime);
 
     MaximAudioConfig *maxim_create_audio_config(double sampleRate, double bpm);
     void maxim_destroy_audio_config(MaximAudioConfig *);
@@ -172,7 +209,7 @@ namespace MaximFrontend {
                                                   FeatureLevel featureLevel);
     void maxim_destroy_target_config(MaximTargetConfig *);
     MaximCodeConfig *maxim_create_code_config(OptimizationLevel optimizationLevel, const char *instrumentPrefix,
-                                              bool includeInstrument, bool includeLibrary);
+                                              bool includeInstrument, bool includeLibrary, Precision precision);
     void maxim_destroy_code_config(MaximCodeConfig *);
     MaximObjectOutputConfig *maxim_create_object_output_config(ObjectFormat format, const char *location);
     void maxim_destroy_object_output_config(MaximObjectOutputConfig *);
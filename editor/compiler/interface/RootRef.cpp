@@ -9,3 +9,7 @@ RootRef::RootRef(void *handle) : handle(handle) {}
 void RootRef::addSocket(MaximCompiler::VarType vartype) {
     MaximFrontend::maxim_build_root_socket(get(), vartype.release());
 }
+
+void RootRef::setArrayCapacity(uint8_t capacity) {
+    MaximFrontend::maxim_set_root_array_capacity(get(), capacity);
+}
@@ -12,6 +12,8 @@ namespace MaximCompiler {
 
         void addSocket(VarType vartype);
 
+        void setArrayCapacity(uint8_t capacity);
+
     private:
         void *handle;
     };
@@ -5,52 +5,145 @@
 using namespace MaximCompiler;
 
 Runtime::Runtime(bool includeUi)
-    : OwnedObject(MaximFrontend::maxim_create_runtime(includeUi), &MaximFrontend::maxim_destroy_runtime) {}
+    : OwnedObject(MaximFrontend::maxim_create_runtime(includeUi), &MaximFrontend::maxim_destroy_runtime),
+      _shared(MaximFrontend::maxim_get_runtime_shared(get())) {}
+
+void Runtime::setCacheDirectory(const QString &directory) {
+    MaximFrontend::maxim_set_cache_directory(get(), directory.toUtf8().constData());
+}
 
 uint64_t Runtime::nextId() {
-    return MaximFrontend::maxim_allocate_id(get());
+    return MaximFrontend::maxim_allocate_id(_shared);
+}
+
+uint64_t Runtime::beginUpdate() {
+    return MaximFrontend::maxim_begin_update(_shared);
+}
+
+void Runtime::endUpdate() {
+    MaximFrontend::maxim_end_update(_shared);
+}
+
+void Runtime::pauseUpdates() {
+    MaximFrontend::maxim_pause_updates(_shared);
+}
+
+void Runtime::resumeUpdates() {
+    MaximFrontend::maxim_resume_updates(_shared);
 }
 
 void Runtime::runUpdate() {
-    MaximFrontend::maxim_run_update(get());
+    MaximFrontend::maxim_run_update(_shared);
+}
+
+void Runtime::runUpdateBlock(uint64_t frames, uint64_t stride, const float *const *inputs, float *const *outputs) {
+    MaximFrontend::maxim_run_update_block(_shared, frames, stride, inputs, outputs);
 }
 
 void Runtime::setBpm(double bpm) {
-    MaximFrontend::maxim_set_bpm(get(), bpm);
+    MaximFrontend::maxim_set_bpm(_shared, bpm);
 }
 
 double Runtime::getBpm() {
-    return MaximFrontend::maxim_get_bpm(get());
+    return MaximFrontend::maxim_get_bpm(_shared);
 }
 
 void Runtime::setSampleRate(double sampleRate) {
-    MaximFrontend::maxim_set_sample_rate(get(), sampleRate);
+    MaximFrontend::maxim_set_sample_rate(_shared, sampleRate);
 }
 
 double Runtime::getSampleRate() {
-    return MaximFrontend::maxim_get_sample_rate(get());
+    return MaximFrontend::maxim_get_sample_rate(_shared);
+}
+
+size_t Runtime::impulseSlotCount() {
+    return MaximFrontend::maxim_get_impulse_slot_count();
+}
+
+bool Runtime::setImpulse(size_t index, const float *samples, size_t sampleCount, size_t channelCount) {
+    return MaximFrontend::maxim_set_impulse(_shared, index, samples, sampleCount, channelCount);
 }
 
 uint64_t *Runtime::getProfileTimesPtr() {
-    return MaximFrontend::maxim_get_profile_times_ptr(get());
+    return MaximFrontend::maxim_get_profile_times_ptr(_shared);
+}
+
+void Runtime::requestProfileSample() {
+    MaximFrontend::maxim_request_profile_sample(_shared);
+}
+
+uint64_t Runtime::getProfileSampleCount() {
+    return MaximFrontend::maxim_get_profile_sample_count(_shared);
+}
+
+double Runtime::getProfileCyclesPerSecond() {
+    return MaximFrontend::maxim_get_profile_cycles_per_second(_shared);
+}
+
+const uint64_t *Runtime::getNodeProfilePtr(uint64_t surface, size_t node) {
+    return MaximFrontend::maxim_get_node_profile_ptr(get(), surface, node);
 }
 
 void Runtime::commit(MaximCompiler::Transaction transaction) {
     MaximFrontend::maxim_commit(get(), transaction.release());
 }
 
+bool Runtime::prepareCommit(MaximCompiler::Transaction transaction) {
+    return MaximFrontend::maxim_prepare_commit(get(), transaction.release());
+}
+
+void Runtime::deployCommit() {
+    MaximFrontend::maxim_deploy_commit(get());
+}
+
+void Runtime::publish() {
+    MaximFrontend::maxim_publish(get());
+}
+
+void Runtime::setTiered(bool tiered) {
+    MaximFrontend::maxim_set_tiered(get(), tiered);
+}
+
+void Runtime::setSpecializing(bool specializing) {
+    MaximFrontend::maxim_set_specializing(get(), specializing);
+}
+
+void Runtime::setRealtime(bool realtime) {
+    MaximFrontend::maxim_set_realtime(_shared, realtime);
+}
+
+void Runtime::setVoiceLanes(bool voiceLanes) {
+    MaximFrontend::maxim_set_voice_lanes(get(), voiceLanes);
+}
+
+bool Runtime::needsOptimize() {
+    return MaximFrontend::maxim_needs_optimize(get());
+}
+
+ControlSnapshot Runtime::snapshotControls() {
+    return ControlSnapshot(MaximFrontend::maxim_snapshot_controls(get()));
+}
+
+bool Runtime::prepareOptimize(MaximCompiler::ControlSnapshot controls) {
+    return MaximFrontend::maxim_prepare_optimize(get(), controls.release());
+}
+
+void Runtime::deployOptimized() {
+    MaximFrontend::maxim_deploy_optimized(get());
+}
+
 bool Runtime::isNodeExtracted(uint64_t surface, size_t node) {
     return MaximFrontend::maxim_is_node_extracted(get(), surface, node);
 }
 
 AxiomModel::NumValue Runtime::convertNum(AxiomModel::FormType targetForm, AxiomModel::NumValue value) {
     AxiomModel::NumValue result;
-    MaximFrontend::maxim_convert_num(get(), &result, (uint8_t) targetForm, &value);
+    MaximFrontend::maxim_convert_num(_shared, &result, (uint8_t) targetForm, &value);
     return result;
 }
 
 void *Runtime::getPortalPtr(size_t portal) {
-    return MaximFrontend::maxim_get_portal_ptr(get(), portal);
+    return MaximFrontend::maxim_get_portal_ptr(_shared, portal);
 }
 
 void *Runtime::getRootPtr() {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <QtCore/QString>
+
+#include "ControlSnapshot.h"
 #include "OwnedObject.h"
 #include "Transaction.h"
 #include "editor/model/Value.h"
@@ -12,8 +15,25 @@ namespace MaximCompiler {
 
         uint64_t nextId();
 
+        void setCacheDirectory(const QString &directory);
+
+        // Must be called on the audio thread before running updates. Returns the ID of the code they'll run, which
+        // changes when newly published code is switched to, or zero if updates can't run right now. If an ID is
+        // returned, `endUpdate` must be called after the updates.
+        uint64_t beginUpdate();
+
+        void endUpdate();
+
+        // Waits for the current update to finish, and stops new ones from starting until `resumeUpdates` is called.
+        // `beginUpdate` returns zero while updates are paused.
+        void pauseUpdates();
+
+        void resumeUpdates();
+
         void runUpdate();
 
+        void runUpdateBlock(uint64_t frames, uint64_t stride, const float *const *inputs, float *const *outputs);
+
         void setBpm(double bpm);
 
         double getBpm();
@@ -22,10 +42,51 @@ namespace MaximCompiler {
 
         double getSampleRate();
 
+        static size_t impulseSlotCount();
+
+        bool setImpulse(size_t index, const float *samples, size_t sampleCount, size_t channelCount);
+
         uint64_t *getProfileTimesPtr();
 
+        void requestProfileSample();
+
+        uint64_t getProfileSampleCount();
+
+        double getProfileCyclesPerSecond();
+
+        const uint64_t *getNodeProfilePtr(uint64_t surface, size_t node);
+
         void commit(Transaction transaction);
 
+        bool prepareCommit(Transaction transaction);
+
+        void deployCommit();
+
+        // Hands the code built by `deployCommit` or `deployOptimized` to the audio thread, which moves state across and
+        // switches to it at the start of its next update, and waits for that to happen. No buffer is skipped.
+        void publish();
+
+        void setTiered(bool tiered);
+
+        void setSpecializing(bool specializing);
+
+        // Offline renders turn this off, so delays get their buffers straight away instead of from a background thread.
+        void setRealtime(bool realtime);
+
+        // Voices of extracted groups are updated several at a time on targets with wide vector registers. Turning this
+        // off updates them one at a time everywhere, e.g. to compare the two. It must be set before anything is built.
+        void setVoiceLanes(bool voiceLanes);
+
+        bool needsOptimize();
+
+        // Reads the controls that are watched for specialization without stopping updates, so `prepareOptimize` can run
+        // on another thread. Must be called on the thread that owns the runtime.
+        ControlSnapshot snapshotControls();
+
+        bool prepareOptimize(ControlSnapshot controls);
+
+        void deployOptimized();
+
         bool isNodeExtracted(uint64_t surface, size_t node);
 
         AxiomModel::NumValue convertNum(AxiomModel::FormType targetForm, AxiomModel::NumValue value);
@@ -41,5 +102,11 @@ namespace MaximCompiler {
         void *getSurfacePtr(void *nodePtr);
 
         MaximFrontend::ControlPointers getControlPtrs(uint64_t block, void *nodePtr, size_t control);
+
+    private:
+        // The part of the runtime that updates, IDs, audio settings, profiling and number conversion go through. These
+        // are called from the audio thread and the UI while the compile worker is preparing code, so they never touch
+        // the runtime handle itself.
+        void *_shared;
     };
 }
@@ -6,6 +6,18 @@ using namespace MaximCompiler;
 
 SurfaceRef::SurfaceRef(void *handle) : handle(handle) {}
 
+void SurfaceRef::setParallelVoices(bool parallelVoices) {
+    MaximFrontend::maxim_set_surface_parallel_voices(get(), parallelVoices);
+}
+
+void SurfaceRef::setParallelBranches(bool parallelBranches) {
+    MaximFrontend::maxim_set_surface_parallel_branches(get(), parallelBranches);
+}
+
+void SurfaceRef::setOversampling(uint8_t oversampling) {
+    MaximFrontend::maxim_set_surface_oversampling(get(), oversampling);
+}
+
 void SurfaceRef::addValueGroup(MaximCompiler::VarType vartype, MaximCompiler::ValueGroupSource source) {
     MaximFrontend::maxim_build_value_group(get(), vartype.release(), source.release());
 }
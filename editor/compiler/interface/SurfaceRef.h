@@ -13,6 +13,12 @@ namespace MaximCompiler {
 
         void *get() const { return handle; }
 
+        void setParallelVoices(bool parallelVoices);
+
+        void setParallelBranches(bool parallelBranches);
+
+        void setOversampling(uint8_t oversampling);
+
         void addValueGroup(VarType vartype, ValueGroupSource source);
 
         NodeRef addCustomNode(uint64_t blockId, size_t controlInitializerCount, ControlInitializer *initializers);
@@ -25,6 +25,10 @@ void Transaction::printToStdout() const {
     MaximFrontend::maxim_print_transaction_to_stdout(get());
 }
 
+bool Transaction::usesImpulses() const {
+    return MaximFrontend::maxim_transaction_uses_impulses(get());
+}
+
 Transaction Transaction::clone() const {
     return Transaction(MaximFrontend::maxim_clone_transaction(get()));
 }
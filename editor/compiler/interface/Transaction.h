@@ -21,6 +21,9 @@ namespace MaximCompiler {
 
         void printToStdout() const;
 
+        // Whether any block uses `convolve`, which can't be exported since impulses are only loaded into runtimes.
+        bool usesImpulses() const;
+
         Transaction clone() const;
 
     private:
@@ -0,0 +1,82 @@
+#include "CompileWorker.h"
+
+#include <cassert>
+
+#include "editor/compiler/interface/Runtime.h"
+
+using namespace AxiomModel;
+
+CompileWorker::CompileWorker(MaximCompiler::Runtime *runtime, FinishedCallback finishedCallback,
+                             FinishedCallback optimizedCallback)
+    : _runtime(runtime), _finishedCallback(std::move(finishedCallback)),
+      _optimizedCallback(std::move(optimizedCallback)), _thread([this]() { run(); }) {}
+
+CompileWorker::~CompileWorker() {
+    {
+        std::lock_guard lock(_mutex);
+        _isStopping = true;
+    }
+    _condition.notify_one();
+
+    // if a transaction is in progress this waits for it to finish, its callback is dropped along with the context
+    _thread.join();
+}
+
+void CompileWorker::compile(MaximCompiler::Transaction transaction) {
+    assert(!_isBusy);
+    _isBusy = true;
+    _isOptimizing = false;
+
+    {
+        std::lock_guard lock(_mutex);
+        _queuedTransaction = std::move(transaction);
+    }
+    _condition.notify_one();
+}
+
+void CompileWorker::optimize(MaximCompiler::ControlSnapshot controls) {
+    assert(!_isBusy);
+    _isBusy = true;
+    _isOptimizing = true;
+
+    {
+        std::lock_guard lock(_mutex);
+        _queuedOptimize = std::move(controls);
+    }
+    _condition.notify_one();
+}
+
+void CompileWorker::run() {
+    while (true) {
+        std::unique_lock lock(_mutex);
+        _condition.wait(lock, [this]() { return _isStopping || _queuedTransaction || _queuedOptimize; });
+        if (_isStopping) return;
+
+        if (_queuedOptimize) {
+            auto controls = std::move(*_queuedOptimize);
+            _queuedOptimize.reset();
+            lock.unlock();
+
+            auto needsDeploy = _runtime->prepareOptimize(std::move(controls));
+            QMetaObject::invokeMethod(&_callbackContext,
+                                      [this, needsDeploy]() {
+                                          _isBusy = false;
+                                          _optimizedCallback(needsDeploy);
+                                      },
+                                      Qt::QueuedConnection);
+            continue;
+        }
+
+        auto transaction = std::move(*_queuedTransaction);
+        _queuedTransaction.reset();
+        lock.unlock();
+
+        auto needsDeploy = _runtime->prepareCommit(std::move(transaction));
+        QMetaObject::invokeMethod(&_callbackContext,
+                                  [this, needsDeploy]() {
+                                      _isBusy = false;
+                                      _finishedCallback(needsDeploy);
+                                  },
+                                  Qt::QueuedConnection);
+    }
+}
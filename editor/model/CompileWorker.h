@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QtCore/QObject>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "editor/compiler/interface/ControlSnapshot.h"
+#include "editor/compiler/interface/Transaction.h"
+
+namespace MaximCompiler {
+    class Runtime;
+}
+
+namespace AxiomModel {
+
+    // Runs the expensive part of a runtime commit (patching, codegen and optimization) on a background thread, so the
+    // editor stays responsive while compiling. Only one transaction is compiled at a time. Once it's done, the callback
+    // is invoked on the thread the worker was created on, which is then responsible for deploying the commit.
+    // The worker also re-optimizes code that was deployed with the runtime's quick preview pipeline, which is reported
+    // through a separate callback.
+    class CompileWorker {
+    public:
+        using FinishedCallback = std::function<void(bool needsDeploy)>;
+
+        CompileWorker(MaximCompiler::Runtime *runtime, FinishedCallback finishedCallback,
+                      FinishedCallback optimizedCallback);
+
+        ~CompileWorker();
+
+        bool isBusy() const { return _isBusy; }
+
+        bool isOptimizing() const { return _isBusy && _isOptimizing; }
+
+        // Starts compiling a transaction. Must not be called while the worker is busy.
+        void compile(MaximCompiler::Transaction transaction);
+
+        // Starts optimizing the code that's deployed, specializing on the given control values. The snapshot has to be
+        // taken on the thread that owns the runtime, since control values can't be read safely from the worker.
+        // Must not be called while the worker is busy.
+        void optimize(MaximCompiler::ControlSnapshot controls);
+
+    private:
+        MaximCompiler::Runtime *_runtime;
+        FinishedCallback _finishedCallback;
+        FinishedCallback _optimizedCallback;
+        QObject _callbackContext;
+        bool _isBusy = false;
+        bool _isOptimizing = false;
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::optional<MaximCompiler::Transaction> _queuedTransaction;
+        std::optional<MaximCompiler::ControlSnapshot> _queuedOptimize;
+        bool _isStopping = false;
+        std::thread _thread;
+
+        void run();
+    };
+}
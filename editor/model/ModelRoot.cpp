@@ -17,6 +17,9 @@
 
 using namespace AxiomModel;
 
+// How often the runtime is given a chance to specialize code on controls that have stopped moving.
+static constexpr int OPTIMIZE_INTERVAL_MS = 1000;
+
 ModelRoot::ModelRoot()
     : _nodeSurfaces(AxiomCommon::dynamicCastWatch<NodeSurface *>(_pool.sequence())),
       _nodes(AxiomCommon::dynamicCastWatch<Node *>(_pool.sequence())),
@@ -24,6 +27,11 @@ ModelRoot::ModelRoot()
       _controls(AxiomCommon::dynamicCastWatch<Control *>(_pool.sequence())),
       _connections(AxiomCommon::dynamicCastWatch<Connection *>(_pool.sequence())) {
     _history.stackChanged.connectTo(this, &ModelRoot::compileDirtyItems);
+
+    _optimizeTimer.setInterval(OPTIMIZE_INTERVAL_MS);
+    QObject::connect(&_optimizeTimer, &QTimer::timeout, [this]() {
+        if (_compileWorker && !_compileWorker->isBusy()) startOptimize();
+    });
 }
 
 RootSurface *ModelRoot::rootSurface() {
@@ -35,6 +43,7 @@ RootSurface *ModelRoot::rootSurface() {
 }
 
 void ModelRoot::attachRuntime(MaximCompiler::Runtime *runtime) {
+    _compileWorker.reset();
     _runtime = runtime;
 
     MaximCompiler::Transaction buildTransaction;
@@ -50,10 +59,12 @@ void ModelRoot::attachRuntime(MaximCompiler::Runtime *runtime) {
             modelObj->clearDirty();
         }
     }
-}
 
-std::lock_guard<std::mutex> ModelRoot::lockRuntime() {
-    return std::lock_guard(_runtimeLock);
+    // from now on compiles happen in the background, so edits don't block the UI
+    _compileWorker = std::make_unique<CompileWorker>(_runtime, [this](bool needsDeploy) { finishCompile(needsDeploy); },
+                                                     [this](bool needsDeploy) { finishOptimize(needsDeploy); });
+    startOptimize();
+    _optimizeTimer.start();
 }
 
 void ModelRoot::setHistory(AxiomModel::HistoryList history) {
@@ -83,33 +94,116 @@ void ModelRoot::applyDirtyItemsTo(MaximCompiler::Transaction *transaction) {
 }
 
 void ModelRoot::compileDirtyItems() {
-    MaximCompiler::Transaction transaction;
-    applyDirtyItemsTo(&transaction);
-    applyTransaction(std::move(transaction));
+    if (!_compileWorker) {
+        MaximCompiler::Transaction transaction;
+        applyDirtyItemsTo(&transaction);
+        applyTransaction(std::move(transaction));
+    } else if (_compileWorker->isBusy()) {
+        // Items stay dirty until the running compile is done, and are then compiled together. This means edits made
+        // while compiling are coalesced into one transaction with the latest state.
+        _needsCompile = true;
+        if (_compileWorker->isOptimizing()) compilingChanged(true);
+    } else {
+        startCompile();
+        compilingChanged(true);
+    }
 
     modified();
 }
 
 void ModelRoot::applyTransaction(MaximCompiler::Transaction transaction) {
-    auto lock = lockRuntime();
+    // The old code keeps running on the audio thread while the new code is built and deployed, until it's published.
+    auto needsDeploy = _runtime && _runtime->prepareCommit(std::move(transaction));
+    deployPreparedTransaction(needsDeploy);
+}
+
+void ModelRoot::startCompile() {
+    _needsCompile = false;
+
+    MaximCompiler::Transaction transaction;
+    applyDirtyItemsTo(&transaction);
+    _compileWorker->compile(std::move(transaction));
+}
 
-    if (_runtime) {
+void ModelRoot::finishCompile(bool needsDeploy) {
+    deployPreparedTransaction(needsDeploy);
+    runIdleRuntimeCallbacks();
+
+    if (_needsCompile) {
+        startCompile();
+    } else {
+        compilingChanged(false);
+        startOptimize();
+    }
+}
+
+void ModelRoot::startOptimize() {
+    // The runtime only needs optimizing if it has tiered compilation enabled
+    if (_runtime->needsOptimize()) {
+        _compileWorker->optimize(_runtime->snapshotControls());
+    }
+}
+
+void ModelRoot::finishOptimize(bool needsDeploy) {
+    if (needsDeploy) {
+        // The optimized code carries on from the state of the code it replaces, so nothing needs to be saved. The state
+        // is only moved across when it's published, so pointers are updated after publishing.
+        _runtime->deployOptimized();
+        _runtime->publish();
+        rootSurface()->updateRuntimePointers(_runtime, _runtime->getRootPtr());
+    }
+    runIdleRuntimeCallbacks();
+
+    if (_needsCompile) {
+        startCompile();
+    }
+}
+
+void ModelRoot::deployPreparedTransaction(bool needsDeploy) {
+    if (needsDeploy) {
         auto allObjects = AxiomCommon::dynamicCast<ModelObject *>(_pool.sequence().sequence());
         for (const auto &obj : allObjects) {
             obj->saveState();
         }
 
-        _runtime->commit(std::move(transaction));
+        // The new code is constructed alongside the running code, so the saved state is restored into it before the
+        // audio thread switches over.
+        _runtime->deployCommit();
         rootSurface()->updateRuntimePointers(_runtime, _runtime->getRootPtr());
 
         for (const auto &obj : allObjects) {
             obj->restoreState();
         }
+
+        _runtime->publish();
     }
 
     configurationChanged();
 }
 
+void ModelRoot::withIdleRuntime(std::function<void(MaximCompiler::Runtime *)> callback) {
+    if (_compileWorker && _compileWorker->isBusy()) {
+        _idleRuntimeCallbacks.push_back(std::move(callback));
+    } else if (_runtime) {
+        callback(_runtime);
+    }
+}
+
+void ModelRoot::runIdleRuntimeCallbacks() {
+    auto callbacks = std::move(_idleRuntimeCallbacks);
+    _idleRuntimeCallbacks.clear();
+    for (const auto &callback : callbacks) {
+        callback(_runtime);
+    }
+}
+
+void ModelRoot::setProfiling(bool profiling) {
+    if (profiling != _isProfiling) {
+        _isProfiling = profiling;
+        profilingChanged(profiling);
+    }
+}
+
 void ModelRoot::destroy() {
     _pool.destroy();
 }
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <QtCore/QTimer>
+#include <functional>
 #include <memory>
-#include <mutex>
+#include <vector>
 
+#include "CompileWorker.h"
 #include "HistoryList.h"
 #include "Pool.h"
 #include "common/WatchSequence.h"
@@ -45,6 +48,8 @@ namespace AxiomModel {
 
         AxiomCommon::Event<> modified;
         AxiomCommon::Event<> configurationChanged;
+        AxiomCommon::Event<bool> compilingChanged;
+        AxiomCommon::Event<bool> profilingChanged;
 
         ModelRoot();
 
@@ -74,8 +79,6 @@ namespace AxiomModel {
 
         MaximCompiler::Runtime *runtime() const { return _runtime; }
 
-        std::lock_guard<std::mutex> lockRuntime();
-
         void setHistory(HistoryList history);
 
         void applyDirtyItemsTo(MaximCompiler::Transaction *transaction);
@@ -84,6 +87,18 @@ namespace AxiomModel {
 
         void applyTransaction(MaximCompiler::Transaction transaction);
 
+        bool isCompiling() const {
+            return _compileWorker && _compileWorker->isBusy() && !_compileWorker->isOptimizing();
+        }
+
+        // Calls the callback with the runtime once the compile worker isn't using it, for changing runtime options.
+        // It's called straight away if the worker is idle, and dropped if no runtime is attached.
+        void withIdleRuntime(std::function<void(MaximCompiler::Runtime *)> callback);
+
+        bool isProfiling() const { return _isProfiling; }
+
+        void setProfiling(bool profiling);
+
         void destroy();
 
     private:
@@ -95,7 +110,23 @@ namespace AxiomModel {
         ModelRootCollection<Control *> _controls;
         ModelRootCollection<Connection *> _connections;
 
-        std::mutex _runtimeLock;
         MaximCompiler::Runtime *_runtime = nullptr;
+        std::unique_ptr<CompileWorker> _compileWorker;
+        QTimer _optimizeTimer;
+        bool _needsCompile = false;
+        bool _isProfiling = false;
+        std::vector<std::function<void(MaximCompiler::Runtime *)>> _idleRuntimeCallbacks;
+
+        void startCompile();
+
+        void finishCompile(bool needsDeploy);
+
+        void startOptimize();
+
+        void finishOptimize(bool needsDeploy);
+
+        void deployPreparedTransaction(bool needsDeploy);
+
+        void runIdleRuntimeCallbacks();
     };
 }
@@ -4,6 +4,7 @@
 #include "../backend/AudioConfiguration.h"
 #include "ModelRoot.h"
 #include "PoolOperators.h"
+#include "Value.h"
 #include "actions/CreatePortalNodeAction.h"
 #include "objects/PortalNode.h"
 #include "objects/RootSurface.h"
@@ -17,7 +18,8 @@ Project::Project(const AxiomBackend::DefaultConfiguration &defaultConfiguration)
     // setup default project
     //  1. create default surface
     auto rootId = QUuid::createUuid();
-    auto rootSurface = std::make_unique<RootSurface>(rootId, QPointF(0, 0), 0, 0, &mainRoot());
+    auto rootSurface = std::make_unique<RootSurface>(rootId, QPointF(0, 0), 0, false, 0, ArrayValue::MAX_CAPACITY,
+                                                     &mainRoot());
     _rootSurface = rootSurface.get();
     mainRoot().pool().registerObj(std::move(rootSurface));
 
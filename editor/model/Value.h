@@ -8,6 +8,10 @@ namespace AxiomModel {
     // NOTE: all structs here must match those defined in the compiler.
 
     struct ArrayValue {
+        // Arrays have room for as many items as there are bits in the flags. Projects can use fewer, by setting an
+        // array capacity on their root surface.
+        static constexpr uint8_t MAX_CAPACITY = 32;
+
         uint32_t flags;
     };
 
@@ -75,6 +75,12 @@ QString Action::typeToString(AxiomModel::Action::ActionType type) {
         return "Set Graph Tension";
     case ActionType::SET_NUM_RANGE:
         return "Set Num Range";
+    case ActionType::SET_PARALLEL_VOICES:
+        return "Set Parallel Voices";
+    case ActionType::SET_ARRAY_CAPACITY:
+        return "Set Voice Count";
+    case ActionType::SET_OVERSAMPLING:
+        return "Set Oversampling";
     }
 
     unreachable;
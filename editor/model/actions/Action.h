@@ -40,7 +40,10 @@ namespace AxiomModel {
             MOVE_GRAPH_POINT,
             SET_GRAPH_TAG,
             SET_GRAPH_TENSION,
-            SET_NUM_RANGE
+            SET_NUM_RANGE,
+            SET_PARALLEL_VOICES,
+            SET_ARRAY_CAPACITY,
+            SET_OVERSAMPLING
         };
 
         Action(ActionType actionType, ModelRoot *root);
@@ -31,7 +31,7 @@ void CreateGroupNodeAction::forward(bool) {
     root()->pool().registerObj(
         GroupNode::create(_uuid, _parentUuid, _pos, QSize(3, 2), false, _name, _controlsUuid, _innerUuid, root()));
     root()->pool().registerObj(ControlSurface::create(_controlsUuid, _uuid, root()));
-    root()->pool().registerObj(GroupSurface::create(_innerUuid, _uuid, QPoint(0, 0), 0, root()));
+    root()->pool().registerObj(GroupSurface::create(_innerUuid, _uuid, QPoint(0, 0), 0, false, false, 1, root()));
 }
 
 void CreateGroupNodeAction::backward() {
@@ -0,0 +1,22 @@
+#include "SetArrayCapacityAction.h"
+
+#include "../ModelRoot.h"
+#include "../objects/RootSurface.h"
+
+using namespace AxiomModel;
+
+SetArrayCapacityAction::SetArrayCapacityAction(uint8_t beforeVal, uint8_t afterVal, AxiomModel::ModelRoot *root)
+    : Action(ActionType::SET_ARRAY_CAPACITY, root), _beforeVal(beforeVal), _afterVal(afterVal) {}
+
+std::unique_ptr<SetArrayCapacityAction> SetArrayCapacityAction::create(uint8_t beforeVal, uint8_t afterVal,
+                                                                       AxiomModel::ModelRoot *root) {
+    return std::make_unique<SetArrayCapacityAction>(beforeVal, afterVal, root);
+}
+
+void SetArrayCapacityAction::forward(bool first) {
+    root()->rootSurface()->setArrayCapacity(_afterVal);
+}
+
+void SetArrayCapacityAction::backward() {
+    root()->rootSurface()->setArrayCapacity(_beforeVal);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Action.h"
+
+namespace AxiomModel {
+
+    class SetArrayCapacityAction : public Action {
+    public:
+        SetArrayCapacityAction(uint8_t beforeVal, uint8_t afterVal, ModelRoot *root);
+
+        static std::unique_ptr<SetArrayCapacityAction> create(uint8_t beforeVal, uint8_t afterVal, ModelRoot *root);
+
+        void forward(bool first) override;
+
+        void backward() override;
+
+        uint8_t beforeVal() const { return _beforeVal; }
+
+        uint8_t afterVal() const { return _afterVal; }
+
+    private:
+        uint8_t _beforeVal;
+        uint8_t _afterVal;
+    };
+}
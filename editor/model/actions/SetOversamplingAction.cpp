@@ -0,0 +1,26 @@
+#include "SetOversamplingAction.h"
+
+#include "../ModelRoot.h"
+#include "../PoolOperators.h"
+#include "../objects/GroupSurface.h"
+
+using namespace AxiomModel;
+
+SetOversamplingAction::SetOversamplingAction(const QUuid &uuid, uint8_t beforeVal, uint8_t afterVal,
+                                             AxiomModel::ModelRoot *root)
+    : Action(ActionType::SET_OVERSAMPLING, root), _uuid(uuid), _beforeVal(beforeVal), _afterVal(afterVal) {}
+
+std::unique_ptr<SetOversamplingAction> SetOversamplingAction::create(const QUuid &uuid, uint8_t beforeVal,
+                                                                     uint8_t afterVal, AxiomModel::ModelRoot *root) {
+    return std::make_unique<SetOversamplingAction>(uuid, beforeVal, afterVal, root);
+}
+
+void SetOversamplingAction::forward(bool first) {
+    find(AxiomCommon::dynamicCast<GroupSurface *>(root()->nodeSurfaces().sequence()), _uuid)
+        ->setOversampling(_afterVal);
+}
+
+void SetOversamplingAction::backward() {
+    find(AxiomCommon::dynamicCast<GroupSurface *>(root()->nodeSurfaces().sequence()), _uuid)
+        ->setOversampling(_beforeVal);
+}
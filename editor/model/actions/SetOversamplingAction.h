@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtCore/QUuid>
+
+#include "Action.h"
+
+namespace AxiomModel {
+
+    class SetOversamplingAction : public Action {
+    public:
+        SetOversamplingAction(const QUuid &uuid, uint8_t beforeVal, uint8_t afterVal, ModelRoot *root);
+
+        static std::unique_ptr<SetOversamplingAction> create(const QUuid &uuid, uint8_t beforeVal, uint8_t afterVal,
+                                                             ModelRoot *root);
+
+        void forward(bool first) override;
+
+        void backward() override;
+
+        const QUuid &uuid() const { return _uuid; }
+
+        const uint8_t &beforeVal() const { return _beforeVal; }
+
+        const uint8_t &afterVal() const { return _afterVal; }
+
+    private:
+        QUuid _uuid;
+        uint8_t _beforeVal;
+        uint8_t _afterVal;
+    };
+}
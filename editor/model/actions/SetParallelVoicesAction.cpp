@@ -0,0 +1,26 @@
+#include "SetParallelVoicesAction.h"
+
+#include "../ModelRoot.h"
+#include "../PoolOperators.h"
+#include "../objects/GroupSurface.h"
+
+using namespace AxiomModel;
+
+SetParallelVoicesAction::SetParallelVoicesAction(const QUuid &uuid, bool beforeVal, bool afterVal,
+                                                 AxiomModel::ModelRoot *root)
+    : Action(ActionType::SET_PARALLEL_VOICES, root), _uuid(uuid), _beforeVal(beforeVal), _afterVal(afterVal) {}
+
+std::unique_ptr<SetParallelVoicesAction> SetParallelVoicesAction::create(const QUuid &uuid, bool beforeVal,
+                                                                         bool afterVal, AxiomModel::ModelRoot *root) {
+    return std::make_unique<SetParallelVoicesAction>(uuid, beforeVal, afterVal, root);
+}
+
+void SetParallelVoicesAction::forward(bool first) {
+    find(AxiomCommon::dynamicCast<GroupSurface *>(root()->nodeSurfaces().sequence()), _uuid)
+        ->setParallelVoices(_afterVal);
+}
+
+void SetParallelVoicesAction::backward() {
+    find(AxiomCommon::dynamicCast<GroupSurface *>(root()->nodeSurfaces().sequence()), _uuid)
+        ->setParallelVoices(_beforeVal);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtCore/QUuid>
+
+#include "Action.h"
+
+namespace AxiomModel {
+
+    class SetParallelVoicesAction : public Action {
+    public:
+        SetParallelVoicesAction(const QUuid &uuid, bool beforeVal, bool afterVal, ModelRoot *root);
+
+        static std::unique_ptr<SetParallelVoicesAction> create(const QUuid &uuid, bool beforeVal, bool afterVal,
+                                                               ModelRoot *root);
+
+        void forward(bool first) override;
+
+        void backward() override;
+
+        const QUuid &uuid() const { return _uuid; }
+
+        const bool &beforeVal() const { return _beforeVal; }
+
+        const bool &afterVal() const { return _afterVal; }
+
+    private:
+        QUuid _uuid;
+        bool _beforeVal;
+        bool _afterVal;
+    };
+}
@@ -51,6 +51,7 @@ void CustomNode::promoteStaging() {
     if (_stagingBlock) {
         _compiledBlock = std::move(_stagingBlock);
         _stagingBlock = std::nullopt;
+        _blockVersion++;
         setDirty();
         surface()->forceCompile();
     } else {
@@ -97,8 +98,13 @@ void CustomNode::updateRuntimePointers(MaximCompiler::Runtime *runtime, void *su
     if (!_compiledBlock) return;
 
     Node::updateRuntimePointers(runtime, surfacePtr);
+    if (!isDeployedInSurface()) return;
 
     auto nodePtr = runtime->getNodePtr(surface()->getRuntimeId(), surfacePtr, compileMeta()->mirIndex);
+    if (!nodePtr || _builtBlockVersion != _blockVersion) {
+        clearRuntimePointers();
+        return;
+    }
     auto runtimeId = getRuntimeId();
 
     controls().then([nodePtr, runtime, runtimeId](ControlSurface *controlSurface) {
@@ -115,6 +121,7 @@ const std::optional<CustomNodeError> &CustomNode::compileError() const {
 void CustomNode::build(MaximCompiler::Transaction *transaction) {
     if (!_compiledBlock) return;
     transaction->buildBlock(_compiledBlock->clone());
+    _builtBlockVersion = _blockVersion;
 }
 
 void CustomNode::buildAll(MaximCompiler::Transaction *transaction) {
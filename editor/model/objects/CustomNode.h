@@ -82,6 +82,11 @@ namespace AxiomModel {
         std::optional<MaximCompiler::Block> _stagingBlock;
         std::optional<CustomNodeError> _compileError;
 
+        // Counts changes to the compiled block. The controls are renumbered for a new block straight away, so the
+        // runtime only has them where their compile meta says if the block was built into the deployed code.
+        uint64_t _blockVersion = 0;
+        uint64_t _builtBlockVersion = 0;
+
         void updateControls(SetCodeAction *action);
 
         void surfaceControlAdded(Control *control);
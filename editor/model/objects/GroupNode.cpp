@@ -35,8 +35,13 @@ void GroupNode::buildAll(MaximCompiler::Transaction *transaction) {
 
 void GroupNode::updateRuntimePointers(MaximCompiler::Runtime *runtime, void *surfacePtr) {
     Node::updateRuntimePointers(runtime, surfacePtr);
+    if (!isDeployedInSurface()) return;
 
     auto nodePtr = runtime->getNodePtr(surface()->getRuntimeId(), surfacePtr, compileMeta()->mirIndex);
+    if (!nodePtr) {
+        clearRuntimePointers();
+        return;
+    }
     auto subsurfacePtr = runtime->getSurfacePtr(nodePtr);
     nodes().then([subsurfacePtr, runtime](GroupSurface *subsurface) {
         subsurface->updateRuntimePointers(runtime, subsurfacePtr);
@@ -49,6 +54,11 @@ void GroupNode::updateRuntimePointers(MaximCompiler::Runtime *runtime, void *sur
     });
 }
 
+void GroupNode::clearRuntimePointers() {
+    Node::clearRuntimePointers();
+    nodes().then([](GroupSurface *subsurface) { subsurface->clearRuntimePointers(); });
+}
+
 void GroupNode::remove() {
     if (nodes().value()) (*nodes().value())->remove();
     Node::remove();
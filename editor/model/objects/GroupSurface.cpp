@@ -2,21 +2,26 @@
 
 #include "../ModelRoot.h"
 #include "../PoolOperators.h"
+#include "Control.h"
+#include "ControlSurface.h"
 #include "GroupNode.h"
 #include "editor/compiler/interface/Runtime.h"
 
 using namespace AxiomModel;
 
-GroupSurface::GroupSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom,
-                           AxiomModel::ModelRoot *root)
-    : NodeSurface(uuid, parentUuid, pan, zoom, root),
-      _node(find(AxiomCommon::dynamicCast<GroupNode *>(root->nodes().sequence()), parentUuid)) {
+GroupSurface::GroupSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, bool parallelBranches,
+                           bool parallelVoices, uint8_t oversampling, AxiomModel::ModelRoot *root)
+    : NodeSurface(uuid, parentUuid, pan, zoom, parallelBranches, root),
+      _node(find(AxiomCommon::dynamicCast<GroupNode *>(root->nodes().sequence()), parentUuid)),
+      _parallelVoices(parallelVoices), _oversampling(oversampling) {
     _node->nameChanged.connectTo(&nameChanged);
 }
 
 std::unique_ptr<GroupSurface> GroupSurface::create(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom,
+                                                   bool parallelBranches, bool parallelVoices, uint8_t oversampling,
                                                    AxiomModel::ModelRoot *root) {
-    return std::make_unique<GroupSurface>(uuid, parentUuid, pan, zoom, root);
+    return std::make_unique<GroupSurface>(uuid, parentUuid, pan, zoom, parallelBranches, parallelVoices, oversampling,
+                                          root);
 }
 
 QString GroupSurface::name() {
@@ -27,6 +32,37 @@ QString GroupSurface::debugName() {
     return "GroupSurface";
 }
 
+void GroupSurface::setParallelVoices(bool parallelVoices) {
+    if (_parallelVoices != parallelVoices) {
+        _parallelVoices = parallelVoices;
+        parallelVoicesChanged(parallelVoices);
+        forceCompile();
+        root()->compileDirtyItems();
+    }
+}
+
+void GroupSurface::setOversampling(uint8_t oversampling) {
+    if (_oversampling != oversampling) {
+        _oversampling = oversampling;
+        oversamplingChanged(oversampling);
+        forceCompile();
+        root()->compileDirtyItems();
+    }
+}
+
+bool GroupSurface::canOversample() const {
+    auto controlSurface = _node->controls().value();
+    if (!controlSurface) return true;
+
+    for (const auto &control : (*controlSurface)->controls().sequence()) {
+        if (control->wireType() == ConnectionWire::WireType::MIDI ||
+            control->controlType() == Control::ControlType::NUM_EXTRACT) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void GroupSurface::attachRuntime(MaximCompiler::Runtime *runtime) {
     if (runtime) {
         runtimeId = runtime->nextId();
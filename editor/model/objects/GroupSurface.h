@@ -26,9 +26,14 @@ namespace AxiomModel {
 
     class GroupSurface : public NodeSurface {
     public:
-        GroupSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, AxiomModel::ModelRoot *root);
+        AxiomCommon::Event<bool> parallelVoicesChanged;
+        AxiomCommon::Event<uint8_t> oversamplingChanged;
+
+        GroupSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, bool parallelBranches,
+                     bool parallelVoices, uint8_t oversampling, AxiomModel::ModelRoot *root);
 
         static std::unique_ptr<GroupSurface> create(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom,
+                                                    bool parallelBranches, bool parallelVoices, uint8_t oversampling,
                                                     AxiomModel::ModelRoot *root);
 
         QString name() override;
@@ -41,6 +46,22 @@ namespace AxiomModel {
 
         GroupNode *node() const { return _node; }
 
+        // When enabled, the voices of any polyphonic (extracted) nodes in this group are run on the runtime's worker
+        // threads instead of one after the other on the audio thread.
+        bool parallelVoices() const { return _parallelVoices; }
+
+        void setParallelVoices(bool parallelVoices);
+
+        // How many times the nodes in this group run per sample: 1, 2, 4 or 8. Values going in and out of the group
+        // are resampled to match, so only the nodes inside pay for the higher rate. Groups with MIDI or array
+        // sockets aren't oversampled.
+        uint8_t oversampling() const { return _oversampling; }
+
+        void setOversampling(uint8_t oversampling);
+
+        // Whether the oversampling setting is applied, which it is unless the group has MIDI or array sockets.
+        bool canOversample() const;
+
         uint64_t getRuntimeId() override { return runtimeId; }
 
         void attachRuntime(MaximCompiler::Runtime *runtime) override;
@@ -53,6 +74,8 @@ namespace AxiomModel {
 
     private:
         GroupNode *_node;
+        bool _parallelVoices;
+        uint8_t _oversampling;
         uint64_t runtimeId = 0;
         std::optional<GroupSurfaceCompileMeta> _compileMeta;
     };
@@ -5,7 +5,7 @@
 using namespace AxiomModel;
 
 ModuleSurface::ModuleSurface(const QUuid &uuid, QPointF pan, float zoom, AxiomModel::ModelRoot *root)
-    : NodeSurface(uuid, QUuid(), pan, zoom, root) {}
+    : NodeSurface(uuid, QUuid(), pan, zoom, false, root) {}
 
 QString ModuleSurface::name() {
     return _entry->name();
@@ -13,6 +13,8 @@
 #include "PortalNode.h"
 #include "editor/compiler/interface/Runtime.h"
 
+#include <cmath>
+
 using namespace AxiomModel;
 
 Node::Node(NodeType nodeType, const QUuid &uuid, const QUuid &parentUuid, QPoint pos, QSize size, bool selected,
@@ -139,10 +141,45 @@ void Node::doSizeAction() {
     }
 }
 
+bool Node::isDeployedInSurface() const {
+    return compileMeta() && compileMeta()->surfaceId == surface()->getRuntimeId();
+}
+
 void Node::updateRuntimePointers(MaximCompiler::Runtime *runtime, void *surfacePtr) {
-    if (compileMeta()) {
-        setExtracted(runtime->isNodeExtracted(surface()->getRuntimeId(), compileMeta()->mirIndex));
-        _activeBitmap = runtime->getExtractedBitmaskPtr(surface()->getRuntimeId(), surfacePtr, compileMeta()->mirIndex);
+    if (!isDeployedInSurface()) {
+        clearRuntimePointers();
+        return;
+    }
+
+    setExtracted(runtime->isNodeExtracted(surface()->getRuntimeId(), compileMeta()->mirIndex));
+    _activeBitmap = runtime->getExtractedBitmaskPtr(surface()->getRuntimeId(), surfacePtr, compileMeta()->mirIndex);
+    _profileCycles = runtime->getNodeProfilePtr(surface()->getRuntimeId(), compileMeta()->mirIndex);
+}
+
+void Node::clearRuntimePointers() {
+    _activeBitmap = nullptr;
+    _profileCycles = nullptr;
+    controls().then([](ControlSurface *controlSurface) {
+        for (const auto &control : controlSurface->controls().sequence()) {
+            control->setRuntimePointers(std::nullopt);
+        }
+    });
+}
+
+void Node::updateCpuLoad(uint64_t sampleCount, double cyclesPerSample) {
+    if (!_profileCycles || sampleCount == 0 || cyclesPerSample <= 0) return;
+
+    // The counter is written from the audio thread, and starts again from zero when the surface is rebuilt.
+    auto profileCycles = *static_cast<const volatile uint64_t *>(_profileCycles);
+    if (profileCycles < _lastProfileCycles) _lastProfileCycles = 0;
+    auto sampleLoad = (float) ((profileCycles - _lastProfileCycles) / (sampleCount * cyclesPerSample));
+    _lastProfileCycles = profileCycles;
+
+    // Smooth out the jumps between samples so the number is readable
+    auto newLoad = _cpuLoad + (sampleLoad - _cpuLoad) * 0.1f;
+    if (std::abs(newLoad - _cpuLoad) > 0.0001f) {
+        _cpuLoad = newLoad;
+        cpuLoadChanged(newLoad);
     }
 }
 
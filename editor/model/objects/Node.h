@@ -20,7 +20,11 @@ namespace AxiomModel {
     struct NodeCompileMeta {
         size_t mirIndex;
 
-        explicit NodeCompileMeta(size_t mirIndex) : mirIndex(mirIndex) {}
+        // The runtime ID of the surface the node was built into. Nodes can be moved to another surface while a compile
+        // is running, and aren't in the new surface until the next one.
+        uint64_t surfaceId;
+
+        NodeCompileMeta(size_t mirIndex, uint64_t surfaceId) : mirIndex(mirIndex), surfaceId(surfaceId) {}
     };
 
     class Node : public GridItem, public ModelObject {
@@ -31,6 +35,7 @@ namespace AxiomModel {
         AxiomCommon::Event<bool> extractedChanged;
         AxiomCommon::Event<bool> activeChanged;
         AxiomCommon::Event<bool> inErrorStateChanged;
+        AxiomCommon::Event<float> cpuLoadChanged;
 
         Node(NodeType nodeType, const QUuid &uuid, const QUuid &parentUuid, QPoint pos, QSize size, bool selected,
              QString name, const QUuid &controlsUuid, ModelRoot *root);
@@ -59,6 +64,11 @@ namespace AxiomModel {
 
         bool isInErrorState() const { return _isInErrorState; }
 
+        // The fraction of one core's time the node is using, averaged over recent profile samples.
+        float cpuLoad() const { return _cpuLoad; }
+
+        void updateCpuLoad(uint64_t sampleCount, double cyclesPerSample);
+
         bool isMovable() const override { return true; }
 
         bool isResizable() const override { return true; }
@@ -81,8 +91,16 @@ namespace AxiomModel {
 
         void setCompileMeta(std::optional<NodeCompileMeta> compileMeta) { _compileMeta = std::move(compileMeta); }
 
+        // Whether the deployed code has this node where its compile meta says. Nodes that were added or moved while a
+        // compile was running aren't in the code it deploys.
+        bool isDeployedInSurface() const;
+
         virtual void updateRuntimePointers(MaximCompiler::Runtime *runtime, void *surfacePtr);
 
+        // Drops the pointers into the runtime for nodes that aren't in the deployed code, since the code they pointed
+        // into is about to be freed.
+        virtual void clearRuntimePointers();
+
         void doRuntimeUpdate() override;
 
         void remove() override;
@@ -98,5 +116,8 @@ namespace AxiomModel {
         uint32_t *_activeBitmap = nullptr;
         bool _isActive = true;
         bool _isInErrorState = false;
+        const uint64_t *_profileCycles = nullptr;
+        uint64_t _lastProfileCycles = 0;
+        float _cpuLoad = 0;
     };
 }
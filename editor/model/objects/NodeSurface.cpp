@@ -18,13 +18,13 @@
 
 using namespace AxiomModel;
 
-NodeSurface::NodeSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom,
+NodeSurface::NodeSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, bool parallelBranches,
                          AxiomModel::ModelRoot *root)
     : ModelObject(ModelType::NODE_SURFACE, uuid, parentUuid, root),
       _nodes(cacheSequence(findChildrenWatch(root->nodes(), uuid))),
       _connections(cacheSequence(findChildrenWatch(root->connections(), uuid))),
       _grid(AxiomCommon::boxWatchSequence(AxiomCommon::staticCastWatch<GridItem *>(_nodes.asRef())), true), _pan(pan),
-      _zoom(zoom) {
+      _zoom(zoom), _parallelBranches(parallelBranches) {
     _nodes.events().itemAdded().connectTo(this, &NodeSurface::nodeAdded);
 
     _nodes.events().itemAdded().connectTo(this, &NodeSurface::setDirty);
@@ -48,6 +48,15 @@ void NodeSurface::setZoom(float zoom) {
     }
 }
 
+void NodeSurface::setParallelBranches(bool parallelBranches) {
+    if (parallelBranches != _parallelBranches) {
+        _parallelBranches = parallelBranches;
+        parallelBranchesChanged(parallelBranches);
+        forceCompile();
+        root()->compileDirtyItems();
+    }
+}
+
 std::vector<ModelObject *> NodeSurface::getCopyItems() {
     // we want to copy:
     // all nodes and their children (but NOT nodes that aren't copyable!)
@@ -156,7 +165,8 @@ void NodeSurface::groupSelectedNodes() {
     root()->pool().registerObj(GroupNode::create(groupNodeUuid, uuid(), QPoint(0, 0), QSize(3, 2), false, "",
                                                  controlsUuid, innerUuid, root()));
     root()->pool().registerObj(ControlSurface::create(controlsUuid, groupNodeUuid, root()));
-    root()->pool().registerObj(GroupSurface::create(innerUuid, groupNodeUuid, QPoint(0, 0), 0, root()));
+    root()->pool().registerObj(
+        GroupSurface::create(innerUuid, groupNodeUuid, QPoint(0, 0), 0, false, false, 1, root()));
 
     // Copy the `copyChildren` and `copyConnections` into the new group.
     // Note: we don't need to worry about remapping UUIDs since they will still be unique
@@ -200,6 +210,12 @@ void NodeSurface::updateRuntimePointers(MaximCompiler::Runtime *runtime, void *s
     }
 }
 
+void NodeSurface::clearRuntimePointers() {
+    for (const auto &node : nodes().sequence()) {
+        node->clearRuntimePointers();
+    }
+}
+
 void NodeSurface::build(MaximCompiler::Transaction *transaction) {
     MaximCompiler::SurfaceMirBuilder::build(transaction, this);
 }
@@ -217,6 +233,10 @@ void NodeSurface::doRuntimeUpdate() {
     _grid.tryFlush();
     _wireGrid.tryFlush();
 
+    if (_runtime && root()->isProfiling()) {
+        updateProfile();
+    }
+
     for (const auto &node : nodes().sequence()) {
         if (auto controls = node->controls().value()) {
             for (const auto &control : (*controls)->controls().sequence()) {
@@ -227,6 +247,20 @@ void NodeSurface::doRuntimeUpdate() {
     }
 }
 
+void NodeSurface::updateProfile() {
+    // Only one tick is profiled for each request, so the cost of measuring stays low.
+    auto sampleCount = _runtime->getProfileSampleCount();
+    if (sampleCount != _lastProfileSampleCount) {
+        auto cyclesPerSample = _runtime->getProfileCyclesPerSecond() / _runtime->getSampleRate();
+        auto newSamples = sampleCount - _lastProfileSampleCount;
+        for (const auto &node : nodes().sequence()) {
+            node->updateCpuLoad(newSamples, cyclesPerSample);
+        }
+        _lastProfileSampleCount = sampleCount;
+    }
+    _runtime->requestProfileSample();
+}
+
 void NodeSurface::remove() {
     auto nodes = findChildren(root()->nodes().sequence(), uuid());
     while (!nodes.empty()) {
@@ -30,8 +30,10 @@ namespace AxiomModel {
         AxiomCommon::Event<const QString &> nameChanged;
         AxiomCommon::Event<const QPointF &> panChanged;
         AxiomCommon::Event<float> zoomChanged;
+        AxiomCommon::Event<bool> parallelBranchesChanged;
 
-        NodeSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, AxiomModel::ModelRoot *root);
+        NodeSurface(const QUuid &uuid, const QUuid &parentUuid, QPointF pan, float zoom, bool parallelBranches,
+                    AxiomModel::ModelRoot *root);
 
         ChildCollection &nodes() { return _nodes; }
 
@@ -59,6 +61,12 @@ namespace AxiomModel {
 
         void setZoom(float zoom);
 
+        // When enabled, independent chains of nodes in this surface can be run on the runtime's worker threads at the
+        // same time.
+        bool parallelBranches() const { return _parallelBranches; }
+
+        void setParallelBranches(bool parallelBranches);
+
         std::vector<ModelObject *> getCopyItems();
 
         void groupSelectedNodes();
@@ -71,6 +79,8 @@ namespace AxiomModel {
 
         void updateRuntimePointers(MaximCompiler::Runtime *runtime, void *surfacePtr);
 
+        void clearRuntimePointers();
+
         void build(MaximCompiler::Transaction *transaction) override;
 
         void buildAll(MaximCompiler::Transaction *transaction);
@@ -86,9 +96,13 @@ namespace AxiomModel {
         WireGrid _wireGrid;
         QPointF _pan;
         float _zoom;
+        bool _parallelBranches;
 
         MaximCompiler::Runtime *_runtime = nullptr;
+        uint64_t _lastProfileSampleCount = 0;
 
         void nodeAdded(Node *node);
+
+        void updateProfile();
     };
 }
@@ -1,10 +1,27 @@
 #include "RootSurface.h"
 
+#include "../ModelRoot.h"
+#include "../Value.h"
+
 using namespace AxiomModel;
 
-RootSurface::RootSurface(const QUuid &uuid, QPointF pan, float zoom, size_t nextPortalId, AxiomModel::ModelRoot *root)
-    : NodeSurface(uuid, QUuid(), pan, zoom, root), _nextPortalId(nextPortalId) {}
+RootSurface::RootSurface(const QUuid &uuid, QPointF pan, float zoom, bool parallelBranches, size_t nextPortalId,
+                         uint8_t arrayCapacity, AxiomModel::ModelRoot *root)
+    : NodeSurface(uuid, QUuid(), pan, zoom, parallelBranches, root), _nextPortalId(nextPortalId),
+      _arrayCapacity(arrayCapacity) {}
 
 QString RootSurface::debugName() {
     return "RootSurface";
 }
+
+void RootSurface::setArrayCapacity(uint8_t arrayCapacity) {
+    if (arrayCapacity < 1) arrayCapacity = 1;
+    if (arrayCapacity > ArrayValue::MAX_CAPACITY) arrayCapacity = ArrayValue::MAX_CAPACITY;
+
+    if (_arrayCapacity != arrayCapacity) {
+        _arrayCapacity = arrayCapacity;
+        arrayCapacityChanged(arrayCapacity);
+        forceCompile();
+        root()->compileDirtyItems();
+    }
+}
@@ -28,7 +28,10 @@ namespace AxiomModel {
 
     class RootSurface : public NodeSurface {
     public:
-        RootSurface(const QUuid &uuid, QPointF pan, float zoom, size_t nextPortalId, AxiomModel::ModelRoot *root);
+        AxiomCommon::Event<uint8_t> arrayCapacityChanged;
+
+        RootSurface(const QUuid &uuid, QPointF pan, float zoom, bool parallelBranches, size_t nextPortalId,
+                    uint8_t arrayCapacity, AxiomModel::ModelRoot *root);
 
         QString name() override { return "Root"; }
 
@@ -50,8 +53,15 @@ namespace AxiomModel {
 
         uint64_t takePortalId() { return _nextPortalId++; }
 
+        // The number of voices polyphonic (extracted) nodes in the project have. Projects that need fewer voices use
+        // less memory, and can't go above AxiomModel::ArrayValue::MAX_CAPACITY.
+        uint8_t arrayCapacity() const { return _arrayCapacity; }
+
+        void setArrayCapacity(uint8_t arrayCapacity);
+
     private:
         std::optional<RootSurfaceCompileMeta> _compileMeta;
         uint64_t _nextPortalId;
+        uint8_t _arrayCapacity;
     };
 }
@@ -23,12 +23,15 @@
 #include "../actions/PasteBufferAction.h"
 #include "../actions/RenameControlAction.h"
 #include "../actions/RenameNodeAction.h"
+#include "../actions/SetArrayCapacityAction.h"
 #include "../actions/SetCodeAction.h"
 #include "../actions/SetGraphTagAction.h"
 #include "../actions/SetGraphTensionAction.h"
 #include "../actions/SetNumModeAction.h"
 #include "../actions/SetNumRangeAction.h"
 #include "../actions/SetNumValueAction.h"
+#include "../actions/SetOversamplingAction.h"
+#include "../actions/SetParallelVoicesAction.h"
 #include "../actions/SetShowNameAction.h"
 #include "../actions/UnexposeControlAction.h"
 #include "../objects/RootSurface.h"
@@ -116,6 +119,12 @@ void HistorySerializer::serializeAction(AxiomModel::Action *action, QDataStream
         serializeSetGraphTensionAction(setGraphTension, stream);
     else if (auto setNumRange = dynamic_cast<SetNumRangeAction *>(action))
         serializeSetNumRangeAction(setNumRange, stream);
+    else if (auto setParallelVoices = dynamic_cast<SetParallelVoicesAction *>(action))
+        serializeSetParallelVoicesAction(setParallelVoices, stream);
+    else if (auto setArrayCapacity = dynamic_cast<SetArrayCapacityAction *>(action))
+        serializeSetArrayCapacityAction(setArrayCapacity, stream);
+    else if (auto setOversampling = dynamic_cast<SetOversamplingAction *>(action))
+        serializeSetOversamplingAction(setOversampling, stream);
     else
         unreachable;
 }
@@ -176,6 +185,12 @@ std::unique_ptr<Action> HistorySerializer::deserializeAction(QDataStream &stream
         return deserializeSetGraphTensionAction(stream, version, root);
     case Action::ActionType::SET_NUM_RANGE:
         return deserializeSetNumRangeAction(stream, version, root);
+    case Action::ActionType::SET_PARALLEL_VOICES:
+        return deserializeSetParallelVoicesAction(stream, version, root);
+    case Action::ActionType::SET_ARRAY_CAPACITY:
+        return deserializeSetArrayCapacityAction(stream, version, root);
+    case Action::ActionType::SET_OVERSAMPLING:
+        return deserializeSetOversamplingAction(stream, version, root);
     }
 
     unreachable;
@@ -788,3 +803,60 @@ std::unique_ptr<SetNumRangeAction> HistorySerializer::deserializeSetNumRangeActi
 
     return SetNumRangeAction::create(uuid, beforeMin, beforeMax, beforeStep, afterMin, afterMax, afterStep, root);
 }
+
+void HistorySerializer::serializeSetParallelVoicesAction(AxiomModel::SetParallelVoicesAction *action,
+                                                         QDataStream &stream) {
+    stream << action->uuid();
+    stream << action->beforeVal();
+    stream << action->afterVal();
+}
+
+std::unique_ptr<SetParallelVoicesAction>
+    HistorySerializer::deserializeSetParallelVoicesAction(QDataStream &stream, uint32_t version,
+                                                          AxiomModel::ModelRoot *root) {
+    QUuid uuid;
+    stream >> uuid;
+    bool beforeVal;
+    stream >> beforeVal;
+    bool afterVal;
+    stream >> afterVal;
+
+    return SetParallelVoicesAction::create(uuid, beforeVal, afterVal, root);
+}
+
+void HistorySerializer::serializeSetArrayCapacityAction(AxiomModel::SetArrayCapacityAction *action,
+                                                        QDataStream &stream) {
+    stream << (quint8) action->beforeVal();
+    stream << (quint8) action->afterVal();
+}
+
+std::unique_ptr<SetArrayCapacityAction>
+    HistorySerializer::deserializeSetArrayCapacityAction(QDataStream &stream, uint32_t version,
+                                                         AxiomModel::ModelRoot *root) {
+    quint8 beforeVal;
+    stream >> beforeVal;
+    quint8 afterVal;
+    stream >> afterVal;
+
+    return SetArrayCapacityAction::create(beforeVal, afterVal, root);
+}
+
+void HistorySerializer::serializeSetOversamplingAction(AxiomModel::SetOversamplingAction *action,
+                                                       QDataStream &stream) {
+    stream << action->uuid();
+    stream << (quint8) action->beforeVal();
+    stream << (quint8) action->afterVal();
+}
+
+std::unique_ptr<SetOversamplingAction>
+    HistorySerializer::deserializeSetOversamplingAction(QDataStream &stream, uint32_t version,
+                                                        AxiomModel::ModelRoot *root) {
+    QUuid uuid;
+    stream >> uuid;
+    quint8 beforeVal;
+    stream >> beforeVal;
+    quint8 afterVal;
+    stream >> afterVal;
+
+    return SetOversamplingAction::create(uuid, beforeVal, afterVal, root);
+}
@@ -32,6 +32,9 @@ namespace AxiomModel {
     class SetGraphTagAction;
     class SetGraphTensionAction;
     class SetNumRangeAction;
+    class SetParallelVoicesAction;
+    class SetArrayCapacityAction;
+    class SetOversamplingAction;
 
     namespace HistorySerializer {
         void serialize(const HistoryList &history, QDataStream &stream);
@@ -159,5 +162,20 @@ namespace AxiomModel {
 
         std::unique_ptr<SetNumRangeAction> deserializeSetNumRangeAction(QDataStream &stream, uint32_t version,
                                                                         ModelRoot *root);
+
+        void serializeSetParallelVoicesAction(SetParallelVoicesAction *action, QDataStream &stream);
+
+        std::unique_ptr<SetParallelVoicesAction> deserializeSetParallelVoicesAction(QDataStream &stream,
+                                                                                    uint32_t version, ModelRoot *root);
+
+        void serializeSetArrayCapacityAction(SetArrayCapacityAction *action, QDataStream &stream);
+
+        std::unique_ptr<SetArrayCapacityAction> deserializeSetArrayCapacityAction(QDataStream &stream,
+                                                                                  uint32_t version, ModelRoot *root);
+
+        void serializeSetOversamplingAction(SetOversamplingAction *action, QDataStream &stream);
+
+        std::unique_ptr<SetOversamplingAction> deserializeSetOversamplingAction(QDataStream &stream, uint32_t version,
+                                                                                ModelRoot *root);
     }
 }
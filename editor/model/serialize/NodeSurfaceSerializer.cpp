@@ -1,5 +1,6 @@
 #include "NodeSurfaceSerializer.h"
 
+#include "../Value.h"
 #include "../objects/GroupSurface.h"
 #include "../objects/ModuleSurface.h"
 #include "../objects/NodeSurface.h"
@@ -10,9 +11,14 @@ using namespace AxiomModel;
 void NodeSurfaceSerializer::serialize(AxiomModel::NodeSurface *surface, QDataStream &stream) {
     stream << surface->pan();
     stream << surface->zoom();
+    stream << surface->parallelBranches();
 
     if (auto rootSurface = dynamic_cast<RootSurface *>(surface)) {
         stream << (quint64) rootSurface->nextPortalId();
+        stream << (quint8) rootSurface->arrayCapacity();
+    } else if (auto groupSurface = dynamic_cast<GroupSurface *>(surface)) {
+        stream << groupSurface->parallelVoices();
+        stream << (quint8) groupSurface->oversampling();
     }
 }
 
@@ -25,6 +31,14 @@ std::unique_ptr<NodeSurface> NodeSurfaceSerializer::deserialize(QDataStream &str
     float zoom;
     stream >> zoom;
 
+    // parallel branches, parallel voices, array capacities and oversampling were all added in schema version 8
+    auto hasSurfaceOptions = version >= 8;
+
+    bool parallelBranches = false;
+    if (hasSurfaceOptions) {
+        stream >> parallelBranches;
+    }
+
     if (parentUuid.isNull()) {
         if (isLibrary) {
             return std::make_unique<ModuleSurface>(uuid, pan, zoom, root);
@@ -36,8 +50,22 @@ std::unique_ptr<NodeSurface> NodeSurfaceSerializer::deserialize(QDataStream &str
             stream >> nextPortalId;
         }
 
-        return std::make_unique<RootSurface>(uuid, pan, zoom, nextPortalId, root);
+        // older projects always had the maximum array capacity
+        quint8 arrayCapacity = ArrayValue::MAX_CAPACITY;
+        if (hasSurfaceOptions) {
+            stream >> arrayCapacity;
+        }
+
+        return std::make_unique<RootSurface>(uuid, pan, zoom, parallelBranches, nextPortalId, arrayCapacity, root);
     } else {
-        return std::make_unique<GroupSurface>(uuid, parentUuid, pan, zoom, root);
+        bool parallelVoices = false;
+        quint8 oversampling = 1;
+        if (hasSurfaceOptions) {
+            stream >> parallelVoices;
+            stream >> oversampling;
+        }
+
+        return std::make_unique<GroupSurface>(uuid, parentUuid, pan, zoom, parallelBranches, parallelVoices,
+                                              oversampling, root);
     }
 }
@@ -19,7 +19,8 @@ namespace AxiomModel {
         //                = 5 in 0.4.0
         //                = 6 in 0.4.3
         //                = 7 in 0.5.0
-        static constexpr uint32_t schemaVersion = 7;
+        //                = 8 in 0.5.1
+        static constexpr uint32_t schemaVersion = 8;
         static constexpr uint32_t minSchemaVersion = 2;
         static constexpr uint64_t projectSchemaMagic = 0x4D4F4E4144415850; // "MONADAXP"
         static constexpr uint64_t librarySchemaMagic = 0x4D4F4E414441584C; // "MONADAXL"
@@ -25,6 +25,11 @@ CodeConfigWidget::CodeConfigWidget() {
     optimizationSelect->setCurrentIndex(4);
     layout->addRow("Optimization level:", optimizationSelect);
 
+    precisionSelect = new QComboBox();
+    precisionSelect->addItem("Double");
+    precisionSelect->addItem("Single (faster math, smaller delays)");
+    layout->addRow("Math precision:", precisionSelect);
+
     instrumentPrefixEdit = new QLineEdit(oldSafePrefix);
     layout->addRow("Instrument prefix:", instrumentPrefixEdit);
     connect(instrumentPrefixEdit, &QLineEdit::editingFinished, this, &CodeConfigWidget::ensureInstrumentPrefixSafe);
@@ -69,10 +74,17 @@ MaximCompiler::CodeConfig CodeConfigWidget::buildConfig() {
         unreachable
     }
 
-    auto includeInstrument = instrumentAndLibraryContent->isChecked() || instrumentContent->isChecked();
+    auto precision = precisionSelect->currentIndex() == 1 ? MaximFrontend::Precision::SINGLE
+                                                          : MaximFrontend::Precision::DOUBLE;
+
+    auto includeInstrument = includesInstrument();
     auto includeLibrary = instrumentAndLibraryContent->isChecked() || libraryContent->isChecked();
 
-    return MaximCompiler::CodeConfig(optLevel, oldSafePrefix, includeInstrument, includeLibrary);
+    return MaximCompiler::CodeConfig(optLevel, oldSafePrefix, includeInstrument, includeLibrary, precision);
+}
+
+bool CodeConfigWidget::includesInstrument() const {
+    return instrumentAndLibraryContent->isChecked() || instrumentContent->isChecked();
 }
 
 void CodeConfigWidget::processPrefixChange(const QString &newPrefix) {
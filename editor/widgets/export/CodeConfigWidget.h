@@ -18,6 +18,8 @@ namespace AxiomGui {
 
         MaximCompiler::CodeConfig buildConfig();
 
+        bool includesInstrument() const;
+
     signals:
 
         void instrumentPrefixChanged(const QString &oldSafePrefix, const QString &safePrefix);
@@ -30,6 +32,7 @@ namespace AxiomGui {
         QString oldSafePrefix = "axiom_";
 
         QComboBox *optimizationSelect;
+        QComboBox *precisionSelect;
 
         QRadioButton *instrumentAndLibraryContent;
         QRadioButton *instrumentContent;
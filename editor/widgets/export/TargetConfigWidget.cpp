@@ -34,7 +34,7 @@ TargetConfigWidget::TargetConfigWidget() {
     layout->addRow("Machine:", machineLayout);
 
     featureSlider = new QSlider(Qt::Horizontal);
-    featureSlider->setRange(0, 3);
+    featureSlider->setRange(0, 4);
     featureSlider->setSingleStep(1);
     auto sliderLayout = new QVBoxLayout();
     sliderLayout->addWidget(featureSlider);
@@ -48,8 +48,11 @@ TargetConfigWidget::TargetConfigWidget() {
     avxLabel->setAlignment(Qt::AlignHCenter);
     labelsLayout->addWidget(avxLabel, 2);
     auto avx2Label = new QLabel("AVX2");
-    avx2Label->setAlignment(Qt::AlignRight);
-    labelsLayout->addWidget(avx2Label, 1);
+    avx2Label->setAlignment(Qt::AlignHCenter);
+    labelsLayout->addWidget(avx2Label, 2);
+    auto avx512Label = new QLabel("AVX-512");
+    avx512Label->setAlignment(Qt::AlignRight);
+    labelsLayout->addWidget(avx512Label, 1);
     sliderLayout->addLayout(labelsLayout);
     layout->addRow("Features:", sliderLayout);
 
@@ -108,6 +111,9 @@ MaximCompiler::TargetConfig TargetConfigWidget::buildConfig() {
     case 3:
         featureLevel = MaximFrontend::FeatureLevel::AVX2;
         break;
+    case 4:
+        featureLevel = MaximFrontend::FeatureLevel::AVX512;
+        break;
     default:
         unreachable;
     }
@@ -14,17 +14,21 @@
 #include "editor/model/CloneReferenceMapper.h"
 #include "editor/model/Library.h"
 #include "editor/model/LibraryEntry.h"
+#include "editor/model/ModelRoot.h"
 #include "editor/model/PoolOperators.h"
 #include "editor/model/actions/CompositeAction.h"
 #include "editor/model/actions/DeleteObjectAction.h"
 #include "editor/model/actions/GridItemMoveAction.h"
 #include "editor/model/actions/GridItemSizeAction.h"
 #include "editor/model/actions/RenameNodeAction.h"
+#include "editor/model/actions/SetOversamplingAction.h"
+#include "editor/model/actions/SetParallelVoicesAction.h"
 #include "editor/model/objects/ControlSurface.h"
 #include "editor/model/objects/CustomNode.h"
 #include "editor/model/objects/ExtractControl.h"
 #include "editor/model/objects/GraphControl.h"
 #include "editor/model/objects/GroupNode.h"
+#include "editor/model/objects/GroupSurface.h"
 #include "editor/model/objects/MidiControl.h"
 #include "editor/model/objects/ModuleSurface.h"
 #include "editor/model/objects/Node.h"
@@ -47,6 +51,9 @@ const qreal CONTROL_ZVALUE = 1;
 const qreal EDGE_RESIZE_ZVALUE = 2;
 const qreal CORNER_RESIZE_ZVALUE = 3;
 
+// The CPU load at which a node is drawn fully highlighted while profiling.
+const float HOT_CPU_LOAD = 0.1f;
+
 NodeItem::NodeItem(Node *node, NodeSurfaceCanvas *canvas, MaximCompiler::Runtime *runtime)
     : canvas(canvas), runtime(runtime), node(node) {
     node->nameChanged.connectTo(this, &NodeItem::triggerUpdate);
@@ -57,6 +64,8 @@ NodeItem::NodeItem(Node *node, NodeSurfaceCanvas *canvas, MaximCompiler::Runtime
     node->selectedChanged.connectTo(this, &NodeItem::setIsSelected);
     node->deselected.connectTo(this, &NodeItem::triggerUpdate);
     node->inErrorStateChanged.connectTo(this, &NodeItem::triggerUpdate);
+    node->cpuLoadChanged.connectTo(this, &NodeItem::triggerUpdate);
+    node->root()->profilingChanged.connectTo(this, &NodeItem::triggerUpdate);
     node->removed.connectTo(this, &NodeItem::remove);
 
     node->controls().then([this](ControlSurface *surface) {
@@ -184,6 +193,19 @@ void NodeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
         headerBr.setLeft(headerBr.left() + 8);
         painter->drawText(headerBr, Qt::AlignLeft | Qt::AlignVCenter, node->name());
     }
+
+    if (node->root()->isProfiling()) {
+        auto heat = std::min(node->cpuLoad() / HOT_CPU_LOAD, 1.f);
+        auto heatBr = drawBoundingRect();
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(QColor(255, 60, 0, (int) (heat * 120)));
+        painter->drawRect(heatBr);
+
+        heatBr.adjust(0, 0, -4, -2);
+        painter->setPen(QColor(255, 255, 255, 200));
+        painter->drawText(heatBr, Qt::AlignRight | Qt::AlignBottom,
+                          QString::number(node->cpuLoad() * 100, 'f', 1) + "%");
+    }
 }
 
 QPainterPath NodeItem::shape() const {
@@ -269,6 +291,33 @@ void NodeItem::contextMenuEvent(QGraphicsSceneContextMenuEvent *event) {
     saveModuleAction->setEnabled(!copyableItems.empty());
     menu.addSeparator();
 
+    QAction *parallelVoicesAction = nullptr;
+    std::vector<std::pair<QAction *, uint8_t>> oversamplingActions;
+    GroupSurface *groupSurface = nullptr;
+    if (auto groupNode = dynamic_cast<GroupNode *>(node); groupNode && groupNode->nodes().value()) {
+        groupSurface = *groupNode->nodes().value();
+        parallelVoicesAction = menu.addAction(tr("&Parallel Voices"));
+        parallelVoicesAction->setCheckable(true);
+        parallelVoicesAction->setChecked(groupSurface->parallelVoices());
+
+        // the compiler leaves groups with MIDI or array sockets at the normal rate, so say so instead of offering a
+        // setting that won't do anything
+        auto canOversample = groupSurface->canOversample();
+        auto oversamplingMenu = menu.addMenu(tr("&Oversampling"));
+        if (!canOversample) {
+            oversamplingMenu->addAction(tr("Not available with MIDI or array sockets"))->setEnabled(false);
+            oversamplingMenu->addSeparator();
+        }
+        for (uint8_t factor : {1, 2, 4, 8}) {
+            auto factorAction = oversamplingMenu->addAction(factor == 1 ? tr("None") : tr("%1x").arg(factor));
+            factorAction->setCheckable(true);
+            factorAction->setChecked(groupSurface->oversampling() == factor);
+            factorAction->setEnabled(canOversample);
+            oversamplingActions.emplace_back(factorAction, factor);
+        }
+        menu.addSeparator();
+    }
+
     QAction *fiddleAction = nullptr;
     auto rootSurface = dynamic_cast<RootSurface *>(node->surface());
     auto mainWindow = canvas->panel->window;
@@ -332,6 +381,9 @@ void NodeItem::contextMenuEvent(QGraphicsSceneContextMenuEvent *event) {
 
             mainWindow->library()->addEntry(std::move(newEntry));
         }
+    } else if (selectedAction == parallelVoicesAction && groupSurface) {
+        node->root()->history().append(SetParallelVoicesAction::create(
+            groupSurface->uuid(), groupSurface->parallelVoices(), parallelVoicesAction->isChecked(), node->root()));
     } else if (selectedAction == deleteAction) {
         node->root()->history().append(DeleteObjectAction::create(node->uuid(), node->root()));
     } else if (selectedAction == fiddleAction && portalControl) {
@@ -340,6 +392,13 @@ void NodeItem::contextMenuEvent(QGraphicsSceneContextMenuEvent *event) {
         auto currentPortalValue = *backend->getAudioPortal(remappedIndex);
         backend->automationValueChanged(remappedIndex, currentPortalValue);
     }
+
+    for (const auto &oversamplingAction : oversamplingActions) {
+        if (selectedAction == oversamplingAction.first && oversamplingAction.second != groupSurface->oversampling()) {
+            node->root()->history().append(SetOversamplingAction::create(
+                groupSurface->uuid(), groupSurface->oversampling(), oversamplingAction.second, node->root()));
+        }
+    }
 }
 
 void NodeItem::setPos(QPoint newPos) {
@@ -1,10 +1,15 @@
 #include "AddNodeMenu.h"
 
+#include <QtWidgets/QActionGroup>
 #include <QtWidgets/QLineEdit>
 
 #include "editor/model/LibraryEntry.h"
+#include "editor/model/ModelRoot.h"
 #include "editor/model/Project.h"
+#include "editor/model/Value.h"
+#include "editor/model/actions/SetArrayCapacityAction.h"
 #include "editor/model/objects/NodeSurface.h"
+#include "editor/model/objects/RootSurface.h"
 
 using namespace AxiomGui;
 
@@ -63,6 +68,31 @@ AddNodeMenu::AddNodeMenu(AxiomModel::NodeSurface *surface, const QString &search
         });
     }
 
+    addSeparator();
+
+    auto parallelBranchesAction = addAction(tr("Parallel Branches"));
+    parallelBranchesAction->setCheckable(true);
+    parallelBranchesAction->setChecked(surface->parallelBranches());
+    connect(parallelBranchesAction, &QAction::triggered, this,
+            [surface](bool checked) { surface->setParallelBranches(checked); });
+
+    if (auto rootSurface = dynamic_cast<AxiomModel::RootSurface *>(surface)) {
+        auto voicesMenu = addMenu(tr("Voices"));
+        auto voicesGroup = new QActionGroup(voicesMenu);
+        for (uint8_t capacity = 1; capacity <= AxiomModel::ArrayValue::MAX_CAPACITY; capacity *= 2) {
+            auto capacityAction = voicesMenu->addAction(QString::number(capacity));
+            capacityAction->setCheckable(true);
+            capacityAction->setChecked(rootSurface->arrayCapacity() == capacity);
+            voicesGroup->addAction(capacityAction);
+            connect(capacityAction, &QAction::triggered, this, [rootSurface, capacity]() {
+                if (rootSurface->arrayCapacity() == capacity) return;
+                auto root = rootSurface->root();
+                root->history().append(
+                    AxiomModel::SetArrayCapacityAction::create(rootSurface->arrayCapacity(), capacity, root));
+            });
+        }
+    }
+
     /*addSeparator();
 
     // add default entries
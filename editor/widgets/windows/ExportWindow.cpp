@@ -110,6 +110,15 @@ void ExportWindow::doExport() {
     MaximCompiler::Transaction transaction;
     project.rootSurface()->buildAll(&transaction);
 
+    // the exporter rejects these too, this just gives a better message
+    if (outputObjectSection->isChecked() && codeConfigWidget->includesInstrument() && transaction.usesImpulses()) {
+        QMessageBox::critical(this, "Export Failed",
+                              "The project uses convolve, which can't be exported since impulse responses are only "
+                              "loaded by Axiom itself.");
+        setEnabled(true);
+        return;
+    }
+
     // run the exporter
     auto success = MaximCompiler::Exporter::exportTransaction(config, std::move(transaction));
     if (success) {
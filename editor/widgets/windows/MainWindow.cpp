@@ -4,6 +4,7 @@
 #include <QStandardPaths>
 #include <QtCore/QDateTime>
 #include <QtCore/QMimeData>
+#include <QtCore/QSettings>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QStringBuilder>
 #include <QtCore/QTimer>
@@ -41,9 +42,11 @@ MainWindow::MainWindow(AxiomBackend::AudioBackend *backend)
       fileExportLibraryAction("E&xport Library..."), fileOpenAction("&Open..."), fileSaveAction("&Save"),
       fileSaveAsAction("S&ave As..."), fileExportAction("&Export..."), fileQuitAction("&Quit"), editUndoAction("&Undo"),
       editRedoAction("&Redo"), editCutAction("C&ut"), editCopyAction("&Copy"), editPasteAction("&Paste"),
-      editDeleteAction("&Delete"), editSelectAllAction("&Select All"), editPreferencesAction("Pr&eferences..."),
-      helpAboutAction("&About"), _backend(backend), _runtime(true), libraryLock(globalLibraryLockPath()),
-      rightResizer(this), bottomResizer(this), bottomRightResizer(this) {
+      editDeleteAction("&Delete"), editSelectAllAction("&Select All"),
+      editOptimizeInBackgroundAction("Optimize in &Background"),
+      editSpecializeControlsAction("Optimize for &Unchanged Controls"), editPreferencesAction("Pr&eferences..."),
+      viewCpuUsageAction("Show CPU &Usage"), helpAboutAction("&About"), _backend(backend), _runtime(true),
+      libraryLock(globalLibraryLockPath()), rightResizer(this), bottomResizer(this), bottomRightResizer(this) {
     setStyleSheet(AxiomUtil::loadStylesheet(":/styles/MainStyles.qss"));
     setCentralWidget(nullptr);
     setWindowTitle(tr(VER_PRODUCTNAME_STR));
@@ -75,6 +78,24 @@ MainWindow::MainWindow(AxiomBackend::AudioBackend *backend)
 
     _library->changed.connectTo(this, &MainWindow::triggerLibraryChanged);
 
+    // modules that haven't changed since the last time the project was loaded are read back from disk
+    _runtime.setCacheDirectory(QString::fromStdString(AxiomBackend::AudioBackend::getDataPath()) + "/modulecache");
+
+    // impulse responses for convolutions are read from the data paths too
+    AxiomBackend::AudioBackend::loadImpulses(&_runtime);
+
+    // edits can be deployed without optimizations so they can be heard straight away, and optimized in the background
+    QSettings preferences(preferencesFilePath(), QSettings::IniFormat);
+    editOptimizeInBackgroundAction.setCheckable(true);
+    editOptimizeInBackgroundAction.setChecked(preferences.value("optimizeInBackground", true).toBool());
+    _runtime.setTiered(editOptimizeInBackgroundAction.isChecked());
+
+    // blocks can be recompiled in the background with the values of knobs that haven't moved for a while folded in,
+    // which is off by default since each recompile costs a deploy
+    editSpecializeControlsAction.setCheckable(true);
+    editSpecializeControlsAction.setChecked(preferences.value("specializeControls", false).toBool());
+    _runtime.setSpecializing(editSpecializeControlsAction.isChecked());
+
     saveDebounceTimer.setSingleShot(true);
     saveDebounceTimer.setInterval(500);
     connect(&saveDebounceTimer, &QTimer::timeout, this, &MainWindow::triggerLibraryChangeDebounce);
@@ -109,6 +130,8 @@ MainWindow::MainWindow(AxiomBackend::AudioBackend *backend)
     editPreferencesAction.setShortcut(QKeySequence::Preferences);
     editPreferencesAction.setEnabled(false);
 
+    viewCpuUsageAction.setCheckable(true);
+
     helpAboutAction.setShortcut(QKeySequence::HelpContents);
 
     // build menus
@@ -144,11 +167,16 @@ MainWindow::MainWindow(AxiomBackend::AudioBackend *backend)
     editMenu->addAction(&editSelectAllAction);
     editMenu->addSeparator();
 
+    editMenu->addAction(&editOptimizeInBackgroundAction);
+    editMenu->addAction(&editSpecializeControlsAction);
+    editMenu->addSeparator();
+
     editMenu->addAction(&editPreferencesAction);
 
     _viewMenu = menuBar()->addMenu(tr("&View"));
     _viewMenu->addAction(_modulePanel->toggleViewAction());
     _viewMenu->addAction(_historyPanel->toggleViewAction());
+    _viewMenu->addAction(&viewCpuUsageAction);
 
     auto helpMenu = menuBar()->addMenu(tr("&Help"));
     helpMenu->addAction(&helpAboutAction);
@@ -163,6 +191,11 @@ MainWindow::MainWindow(AxiomBackend::AudioBackend *backend)
     connect(&fileImportLibraryAction, &QAction::triggered, this, &MainWindow::importLibrary);
     connect(&fileExportLibraryAction, &QAction::triggered, this, &MainWindow::exportLibrary);
 
+    connect(&editOptimizeInBackgroundAction, &QAction::toggled, this, &MainWindow::setOptimizeInBackground);
+    connect(&editSpecializeControlsAction, &QAction::toggled, this, &MainWindow::setSpecializeControls);
+
+    connect(&viewCpuUsageAction, &QAction::toggled, this, &MainWindow::setShowCpuUsage);
+
     connect(&helpAboutAction, &QAction::triggered, this, &MainWindow::showAbout);
 
     // Setup resizer widgets for some backends to use
@@ -330,6 +363,7 @@ void MainWindow::setProject(std::unique_ptr<AxiomModel::Project> project) {
     // attach the backend and our runtime
     _project->attachBackend(_backend);
     _project->mainRoot().attachRuntime(runtime());
+    _project->mainRoot().setProfiling(viewCpuUsageAction.isChecked());
 
     // find root surface and show it
     auto defaultSurface =
@@ -345,6 +379,39 @@ void MainWindow::setProject(std::unique_ptr<AxiomModel::Project> project) {
     _project->linkedFileChanged.connectTo(
         [this](const QString &newName) { updateWindowTitle(newName, _project->isDirty()); });
     _project->isDirtyChanged.connectTo([this](bool isDirty) { updateWindowTitle(_project->linkedFile(), isDirty); });
+    _project->mainRoot().compilingChanged.connectTo(
+        [this](bool) { updateWindowTitle(_project->linkedFile(), _project->isDirty()); });
+}
+
+void MainWindow::setShowCpuUsage(bool show) {
+    if (_project) {
+        _project->mainRoot().setProfiling(show);
+    }
+}
+
+void MainWindow::setOptimizeInBackground(bool optimize) {
+    QSettings preferences(preferencesFilePath(), QSettings::IniFormat);
+    preferences.setValue("optimizeInBackground", optimize);
+
+    // the runtime might be compiling on another thread, so the change waits until it's done
+    if (_project) {
+        _project->mainRoot().withIdleRuntime(
+            [optimize](MaximCompiler::Runtime *runtime) { runtime->setTiered(optimize); });
+    } else {
+        _runtime.setTiered(optimize);
+    }
+}
+
+void MainWindow::setSpecializeControls(bool specialize) {
+    QSettings preferences(preferencesFilePath(), QSettings::IniFormat);
+    preferences.setValue("specializeControls", specialize);
+
+    if (_project) {
+        _project->mainRoot().withIdleRuntime(
+            [specialize](MaximCompiler::Runtime *runtime) { runtime->setSpecializing(specialize); });
+    } else {
+        _runtime.setSpecializing(specialize);
+    }
 }
 
 QString MainWindow::globalLibraryLockPath() {
@@ -355,6 +422,10 @@ QString MainWindow::globalLibraryFilePath() {
     return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("library.axl");
 }
 
+QString MainWindow::preferencesFilePath() {
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("preferences.ini");
+}
+
 void MainWindow::lockGlobalLibrary() {
     if (isLibraryLocked) return;
     isLibraryLocked = true;
@@ -666,19 +737,25 @@ bool MainWindow::checkCloseProject() {
 }
 
 void MainWindow::updateWindowTitle(const QString &linkedFile, bool isDirty) {
+    QString title;
     if (linkedFile.isEmpty()) {
         if (isDirty) {
-            setWindowTitle("Axiom - <unsaved> *");
+            title = "Axiom - <unsaved> *";
         } else {
-            setWindowTitle("Axiom");
+            title = "Axiom";
         }
     } else {
         if (isDirty) {
-            setWindowTitle("Axiom - " % linkedFile % " *");
+            title = "Axiom - " % linkedFile % " *";
         } else {
-            setWindowTitle("Axiom - " % linkedFile);
+            title = "Axiom - " % linkedFile;
         }
     }
+
+    if (_project && _project->mainRoot().isCompiling()) {
+        title += " (compiling...)";
+    }
+    setWindowTitle(title);
 }
 
 void MainWindow::startedResize() {
@@ -53,8 +53,12 @@ namespace AxiomGui {
         QAction editPasteAction;
         QAction editDeleteAction;
         QAction editSelectAllAction;
+        QAction editOptimizeInBackgroundAction;
+        QAction editSpecializeControlsAction;
         QAction editPreferencesAction;
 
+        QAction viewCpuUsageAction;
+
         QAction helpAboutAction;
 
         explicit MainWindow(AxiomBackend::AudioBackend *backend);
@@ -73,6 +77,8 @@ namespace AxiomGui {
 
         static QString globalLibraryFilePath();
 
+        static QString preferencesFilePath();
+
         void lockGlobalLibrary();
 
         void unlockGlobalLibrary();
@@ -122,6 +128,12 @@ namespace AxiomGui {
 
         void exportLibrary();
 
+        void setShowCpuUsage(bool show);
+
+        void setOptimizeInBackground(bool optimize);
+
+        void setSpecializeControls(bool specialize);
+
         void importLibraryFrom(const QString &path);
 
     private: